@@ -91,21 +91,20 @@ uint16_t ArithmeticLogicUnit::Swap16(uint16_t number)
 void ArithmeticLogicUnit::ADD(uint16_t instruction)
 {
     // Extract Destination Register (DR), Source Register 1 (SR1), and Immediate Flag (Imm)
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Source Register 1
-    uint16_t Imm = (instruction >> 5) & 0x0001; // Immediate Flag
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t SR1 = IsaSR1(instruction); // Source Register 1
+    uint16_t Imm = IsaImmediateFlag(instruction); // Immediate Flag
 
     if (Imm)
     {
         // If Immediate Flag is set, extract immediate value and perform addition
-        uint16_t imm5 = (instruction) & 0x001F;
-        imm5 = SignExtend(imm5, 5); // Sign-extend the immediate value
+        uint16_t imm5 = IsaOffset(instruction, ISA_BITS_ADD); // Sign-extended immediate value
         registersPtr[DR] = registersPtr[SR1] + imm5;
     }
     else
     {
         // If Immediate Flag is not set, extract Source Register 2 (SR2) and perform addition
-        uint16_t SR2 = (instruction) & 0x0007; // Source Register 2
+        uint16_t SR2 = IsaSR2(instruction); // Source Register 2
         registersPtr[DR] = registersPtr[SR1] + registersPtr[SR2];
     }
 
@@ -121,21 +120,20 @@ void ArithmeticLogicUnit::ADD(uint16_t instruction)
 void ArithmeticLogicUnit::AND(uint16_t instruction)
 {
     // Extract Destination Register (DR), Source Register 1 (SR1), and Immediate Flag (Imm)
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Source Register 1
-    uint16_t Imm = (instruction >> 5) & 0x0001; // Immediate Flag
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t SR1 = IsaSR1(instruction); // Source Register 1
+    uint16_t Imm = IsaImmediateFlag(instruction); // Immediate Flag
 
     if (Imm)
     {
         // If Immediate Flag is set, extract immediate value and perform bitwise AND
-        uint16_t imm5 = (instruction) & 0x001F;
-        imm5 = SignExtend(imm5, 5); // Sign-extend the immediate value
+        uint16_t imm5 = IsaOffset(instruction, ISA_BITS_AND); // Sign-extended immediate value
         registersPtr[DR] = registersPtr[SR1] & imm5;
     }
     else
     {
         // If Immediate Flag is not set, extract Source Register 2 (SR2) and perform bitwise AND
-        uint16_t SR2 = (instruction) & 0x0007; // Source Register 2
+        uint16_t SR2 = IsaSR2(instruction); // Source Register 2
         registersPtr[DR] = registersPtr[SR1] & registersPtr[SR2];
     }
 
@@ -151,8 +149,8 @@ void ArithmeticLogicUnit::AND(uint16_t instruction)
 void ArithmeticLogicUnit::NOT(uint16_t instruction)
 {
     // Extract Destination Register (DR) and Source Register 1 (SR1)
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Source Register 1
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t SR1 = IsaSR1(instruction); // Source Register 1
 
     // Perform bitwise NOT operation on the value in source register and store it in destination register
     registersPtr[DR] = ~registersPtr[SR1];
@@ -169,8 +167,8 @@ void ArithmeticLogicUnit::NOT(uint16_t instruction)
 void ArithmeticLogicUnit::BR(uint16_t instruction)
 {
     // Extract pcOffset and Condition Flag
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9);
-    uint16_t conditionFlag = (instruction >> 9) & 0x0007;
+    uint16_t pcOffset = IsaOffset(instruction, ISA_BITS_BR);
+    uint16_t conditionFlag = IsaDR(instruction);
 
     // Check if condition flag is set in the Condition Register, then update PC
     if (conditionFlag & registersPtr[Registers::R_COND])
@@ -187,7 +185,7 @@ void ArithmeticLogicUnit::BR(uint16_t instruction)
 void ArithmeticLogicUnit::JMP(uint16_t instruction)
 {
     // Extract Source Register (SR1)
-    uint16_t SR1 = (instruction >> 6) & 0x0007;
+    uint16_t SR1 = IsaSR1(instruction);
 
     // Set PC to the value in the source register
     registersPtr[Registers::R_PC] = registersPtr[SR1];
@@ -201,7 +199,7 @@ void ArithmeticLogicUnit::JMP(uint16_t instruction)
 void ArithmeticLogicUnit::JSR(uint16_t instruction)
 {
     // Extract Long Flag to determine the type of jump
-    uint16_t longFlag = (instruction >> 11) & 0x0001;
+    uint16_t longFlag = IsaLongFlag(instruction);
 
     // Save the current PC value to R7 (Return Address Register)
     registersPtr[Registers::R_7] = registersPtr[Registers::R_PC];
@@ -209,13 +207,13 @@ void ArithmeticLogicUnit::JSR(uint16_t instruction)
     if (longFlag)
     {
         // If Long Flag is set, calculate the long PC offset and perform jump
-        uint16_t longPCOffset = SignExtend(instruction & 0x07FF, 11);
+        uint16_t longPCOffset = IsaOffset(instruction, ISA_BITS_JSR);
         registersPtr[Registers::R_PC] += longPCOffset;  // JSR
     }
     else
     {
         // If Long Flag is not set, extract the source register and perform jump
-        uint16_t SR1 = (instruction >> 6) & 0x0007;
+        uint16_t SR1 = IsaSR1(instruction);
         registersPtr[Registers::R_PC] = registersPtr[SR1]; // JSRR
     }
 }
@@ -228,8 +226,8 @@ void ArithmeticLogicUnit::JSR(uint16_t instruction)
 void ArithmeticLogicUnit::LD(uint16_t instruction)
 {
     // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9);
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t pcOffset = IsaOffset(instruction, ISA_BITS_LD);
 
     // Load the value from memory at the calculated address into the destination register
     registersPtr[DR] = memoryIOPtr->Read(registersPtr[Registers::R_PC] + pcOffset);
@@ -246,9 +244,9 @@ void ArithmeticLogicUnit::LD(uint16_t instruction)
 void ArithmeticLogicUnit::LDR(uint16_t instruction)
 {
     // Extract Destination Register (DR), Base Register (SR1), and Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Base Register
-    uint16_t offset = SignExtend(instruction & 0x003F, 6); // Offset
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t SR1 = IsaSR1(instruction); // Base Register
+    uint16_t offset = IsaOffset(instruction, ISA_BITS_LDR); // Offset
 
     // Load the value from memory at the address calculated by adding base register value and offset
     registersPtr[DR] = memoryIOPtr->Read(registersPtr[SR1] + offset);
@@ -265,8 +263,8 @@ void ArithmeticLogicUnit::LDR(uint16_t instruction)
 void ArithmeticLogicUnit::LEA(uint16_t instruction)
 {
     // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9); // PC Offset
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t pcOffset = IsaOffset(instruction, ISA_BITS_LEA); // PC Offset
 
     // Calculate the effective address by adding PC value and PC offset
     registersPtr[DR] = registersPtr[Registers::R_PC] + pcOffset;
@@ -283,8 +281,8 @@ void ArithmeticLogicUnit::LEA(uint16_t instruction)
 void ArithmeticLogicUnit::ST(uint16_t instruction)
 {
     // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9); // PC Offset
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t pcOffset = IsaOffset(instruction, ISA_BITS_ST); // PC Offset
 
     // Write the value from DR register to memory at the address calculated by adding PC value and PC offset
     memoryIOPtr->Write(registersPtr[Registers::R_PC] + pcOffset, registersPtr[DR]);
@@ -298,8 +296,8 @@ void ArithmeticLogicUnit::ST(uint16_t instruction)
 void ArithmeticLogicUnit::STI(uint16_t instruction)
 {
     // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9); // PC Offset
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t pcOffset = IsaOffset(instruction, ISA_BITS_STI); // PC Offset
 
     // Perform an indirect store by first reading the memory at the address calculated by adding PC value and PC offset,
     // then storing the value from DR register to the memory location read.
@@ -314,9 +312,9 @@ void ArithmeticLogicUnit::STI(uint16_t instruction)
 void ArithmeticLogicUnit::STR(uint16_t instruction)
 {
     // Extract Destination Register (DR), Base Register (SR1), and Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Base Register
-    uint16_t offset = SignExtend(instruction & 0x003F, 6); // Offset
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t SR1 = IsaSR1(instruction); // Base Register
+    uint16_t offset = IsaOffset(instruction, ISA_BITS_STR); // Offset
 
     // Write the value from DR register to memory at the address calculated by adding SR1 register value and offset
     memoryIOPtr->Write(registersPtr[SR1] + offset, registersPtr[DR]);
@@ -330,8 +328,8 @@ void ArithmeticLogicUnit::STR(uint16_t instruction)
 void ArithmeticLogicUnit::LDI(uint16_t instruction)
 {
     // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pc_offset = SignExtend(instruction & 0x01FF, 9); // PC Offset
+    uint16_t DR = IsaDR(instruction); // Destination Register
+    uint16_t pc_offset = IsaOffset(instruction, ISA_BITS_LDI); // PC Offset
 
     // Calculate the effective address by adding PC value and PC offset,
     // then load the value from the memory location pointed by the calculated address into the destination register
@@ -339,4 +337,193 @@ void ArithmeticLogicUnit::LDI(uint16_t instruction)
 
     // Update the condition flags based on the value loaded into the destination register
     cpuPtr->UpdateFlags(DR);
+}
+
+
+/**
+ * @brief Extracts the operand fields of an instruction.
+ *
+ * The fields are extracted with the same helpers as the instruction implementations above;
+ * the width of the offset and the meaning of the flag come from the opcode's row of LC3_ISA.
+ *
+ * @param instruction The 16-bit instruction.
+ * @return The decoded operation and operand fields.
+ */
+DecodedInstruction ArithmeticLogicUnit::Decode(uint16_t instruction) const
+{
+    DecodedInstruction decoded;
+    const IsaEntry& entry = isaTable[instruction >> 12];
+
+    decoded.instruction = instruction;
+    decoded.operation = (uint8_t)(instruction >> 12); // Opcode
+    decoded.DR = (uint8_t)IsaDR(instruction); // Destination Register (BR: condition flags)
+    decoded.SR1 = (uint8_t)IsaSR1(instruction); // Source / Base Register
+    decoded.SR2 = (uint8_t)IsaSR2(instruction); // Source Register 2
+
+    // Immediate Flag, or Long Flag for JSR
+    decoded.flag = (uint8_t)(entry.format == IsaFormats::ISA_FORMAT_SUBROUTINE ? IsaLongFlag(instruction) : IsaImmediateFlag(instruction));
+    decoded.offset = entry.offsetBits ? IsaOffset(instruction, entry.offsetBits) : 0;
+
+    return decoded;
+}
+
+
+/**
+ * @brief Performs an addition operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::ADD(const DecodedInstruction& decoded)
+{
+    // Use the sign-extended immediate value or the second source register
+    uint16_t operand = decoded.flag ? decoded.offset : registersPtr[decoded.SR2];
+    registersPtr[decoded.DR] = registersPtr[decoded.SR1] + operand;
+
+    cpuPtr->UpdateFlags(decoded.DR);
+}
+
+
+/**
+ * @brief Performs a bitwise AND operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::AND(const DecodedInstruction& decoded)
+{
+    // Use the sign-extended immediate value or the second source register
+    uint16_t operand = decoded.flag ? decoded.offset : registersPtr[decoded.SR2];
+    registersPtr[decoded.DR] = registersPtr[decoded.SR1] & operand;
+
+    cpuPtr->UpdateFlags(decoded.DR);
+}
+
+
+/**
+ * @brief Performs a bitwise NOT operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::NOT(const DecodedInstruction& decoded)
+{
+    registersPtr[decoded.DR] = ~registersPtr[decoded.SR1];
+
+    cpuPtr->UpdateFlags(decoded.DR);
+}
+
+
+/**
+ * @brief Performs a branch operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::BR(const DecodedInstruction& decoded)
+{
+    // DR holds the n/z/p condition bits for branches
+    if (decoded.DR & registersPtr[Registers::R_COND])
+    {
+        registersPtr[Registers::R_PC] += decoded.offset;
+    }
+}
+
+
+/**
+ * @brief Performs a jump operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::JMP(const DecodedInstruction& decoded)
+{
+    registersPtr[Registers::R_PC] = registersPtr[decoded.SR1];
+}
+
+
+/**
+ * @brief Performs a jump to subroutine operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::JSR(const DecodedInstruction& decoded)
+{
+    registersPtr[Registers::R_7] = registersPtr[Registers::R_PC];
+
+    if (decoded.flag)
+    {
+        registersPtr[Registers::R_PC] += decoded.offset; // JSR
+    }
+    else
+    {
+        registersPtr[Registers::R_PC] = registersPtr[decoded.SR1]; // JSRR
+    }
+}
+
+
+/**
+ * @brief Performs a load operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::LD(const DecodedInstruction& decoded)
+{
+    registersPtr[decoded.DR] = memoryIOPtr->Read(registersPtr[Registers::R_PC] + decoded.offset);
+
+    cpuPtr->UpdateFlags(decoded.DR);
+}
+
+
+/**
+ * @brief Performs a load from base register with offset operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::LDR(const DecodedInstruction& decoded)
+{
+    registersPtr[decoded.DR] = memoryIOPtr->Read(registersPtr[decoded.SR1] + decoded.offset);
+
+    cpuPtr->UpdateFlags(decoded.DR);
+}
+
+
+/**
+ * @brief Performs a load effective address operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::LEA(const DecodedInstruction& decoded)
+{
+    registersPtr[decoded.DR] = registersPtr[Registers::R_PC] + decoded.offset;
+
+    cpuPtr->UpdateFlags(decoded.DR);
+}
+
+
+/**
+ * @brief Performs a store operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::ST(const DecodedInstruction& decoded)
+{
+    memoryIOPtr->Write(registersPtr[Registers::R_PC] + decoded.offset, registersPtr[decoded.DR]);
+}
+
+
+/**
+ * @brief Performs an indirect store operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::STI(const DecodedInstruction& decoded)
+{
+    memoryIOPtr->Write(memoryIOPtr->Read(registersPtr[Registers::R_PC] + decoded.offset), registersPtr[decoded.DR]);
+}
+
+
+/**
+ * @brief Performs a store register operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::STR(const DecodedInstruction& decoded)
+{
+    memoryIOPtr->Write(registersPtr[decoded.SR1] + decoded.offset, registersPtr[decoded.DR]);
+}
+
+
+/**
+ * @brief Performs a load indirect operation using predecoded operands.
+ * @param decoded The decoded instruction.
+ */
+void ArithmeticLogicUnit::LDI(const DecodedInstruction& decoded)
+{
+    registersPtr[decoded.DR] = memoryIOPtr->Read(memoryIOPtr->Read(registersPtr[Registers::R_PC] + decoded.offset));
+
+    cpuPtr->UpdateFlags(decoded.DR);
 }
\ No newline at end of file
@@ -14,29 +14,24 @@ Copyright 
 
 #include <cstdint>
 
+#include "Isa.h"
+
 
 class MemoryIO;
 class CPU;
 
 
-enum Opcodes : uint16_t
+// Operand fields of an instruction extracted once, so that engines which cache
+// decoded code do not repeat the shifting, masking and sign extension per execution.
+struct DecodedInstruction
 {
-    OP_BR = 0, // branch
-    OP_ADD,    // add 
-    OP_LD,     // load
-    OP_ST,     // store
-    OP_JSR,    // jump register
-    OP_AND,    // bitwise and
-    OP_LDR,    // load register
-    OP_STR,    // store register
-    OP_RTI,    // unused
-    OP_NOT,    // bitwise not
-    OP_LDI,    // load indirect
-    OP_STI,    // store indirect
-    OP_JMP,    // jump
-    OP_RES,    // reserved (unused)
-    OP_LEA,    // load effective address
-    OP_TRAP    // execute trap
+    uint16_t instruction; // raw 16-bit instruction
+    uint16_t offset;      // sign-extended imm5, offset6, PCoffset9 or PCoffset11
+    uint8_t operation;    // opcode, bits [15:12]
+    uint8_t DR;           // destination (or source for stores) register, or BR condition flags, bits [11:9]
+    uint8_t SR1;          // source or base register, bits [8:6]
+    uint8_t SR2;          // second source register, bits [2:0]
+    uint8_t flag;         // immediate flag (bit 5) for ADD/AND, long flag (bit 11) for JSR
 };
 
 
@@ -54,22 +49,17 @@ public:
     uint16_t SignExtend(uint16_t immNumber, int immNumberLength) const;
     uint16_t Swap16(uint16_t number);
 
-    void ADD(uint16_t instruction);
-    void AND(uint16_t instruction);
-    void NOT(uint16_t instruction);
-
-    void BR(uint16_t instruction);
-    void JMP(uint16_t instruction);
-    void JSR(uint16_t instruction);
-
-    void LD(uint16_t instruction);
-    void LDR(uint16_t instruction);
-    void LEA(uint16_t instruction);
-
-    void ST(uint16_t instruction);
-    void STI(uint16_t instruction);
-    void STR(uint16_t instruction);
-
-    void LDI(uint16_t instruction);
+    DecodedInstruction Decode(uint16_t instruction) const;
+
+    // One method per ALU instruction of LC3_ISA, taking the raw instruction or its decoded fields
+#define ISA_DECLARE(NAME, KIND, FORMAT, BITS) ISA_DECLARE_##KIND(NAME)
+#define ISA_DECLARE_ALU(NAME) void NAME(uint16_t instruction); void NAME(const DecodedInstruction& decoded);
+#define ISA_DECLARE_TRAP(NAME)
+#define ISA_DECLARE_RESERVED(NAME)
+    LC3_ISA(ISA_DECLARE)
+#undef ISA_DECLARE
+#undef ISA_DECLARE_ALU
+#undef ISA_DECLARE_TRAP
+#undef ISA_DECLARE_RESERVED
 };
 #endif
\ No newline at end of file
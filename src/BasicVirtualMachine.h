@@ -0,0 +1,199 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef BASIC_VIRTUAL_MACHINE_H
+#define BASIC_VIRTUAL_MACHINE_H
+
+// Calls a hook on every policy, in order. Expands to nothing when there are no policies.
+#define POLICY_HOOK(CALL) (void)HookExpansion{ 0, (Policies::CALL, 0)... }
+
+
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+
+#include "CPU.h"
+#include "ArithmeticLogicUnit.h"
+#include "MemoryIO.h"
+#include "Trap.h"
+#include "ExecutionPolicies.h"
+
+
+// Interface through which the virtual machine runs a policy instantiation chosen at startup.
+// Only Run and Report are virtual, so the per-instruction hooks are still resolved at compile time.
+class ExecutionLoop
+{
+public:
+    virtual ~ExecutionLoop() {}
+
+    virtual uint64_t Run(uint64_t budget) = 0;
+    virtual void Report() = 0;
+};
+
+
+// Switch dispatch loop parameterized by execution policies (see ExecutionPolicy).
+template <typename... Policies>
+class BasicVirtualMachine final : public ExecutionLoop, public Policies...
+{
+private:
+    typedef int HookExpansion[];
+
+    CPU* cpuPtr;
+    MemoryIO* memoryIOPtr;
+    ArithmeticLogicUnit* aluPtr;
+    Trap* trapPtr;
+
+public:
+    BasicVirtualMachine(CPU* cpu, MemoryIO* memoryIO, ArithmeticLogicUnit* alu, Trap* trap)
+        : cpuPtr(cpu), memoryIOPtr(memoryIO), aluPtr(alu), trapPtr(trap)
+    {
+    }
+
+    uint64_t Run(uint64_t budget) override;
+
+    void Report() override
+    {
+        POLICY_HOOK(Report());
+    }
+
+private:
+    int StopsSlice(uint16_t instruction, std::true_type);
+    int StopsSlice(uint16_t, std::false_type) { return 0; }
+    void OnMemoryAccess(uint16_t instruction, std::true_type);
+    void OnMemoryAccess(uint16_t, std::false_type) {}
+};
+
+
+/**
+ * @brief Executes instructions by switching on the opcode of every fetched instruction.
+ *
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed.
+ */
+template <typename... Policies>
+uint64_t BasicVirtualMachine<Policies...>::Run(uint64_t budget)
+{
+    uint64_t retired = 0;
+
+    while (cpuPtr->running && retired < budget)
+    {
+        uint16_t pc = cpuPtr->registers[Registers::R_PC]++;
+
+        // Fetch Instruction. Read the memory location pointed by program counter.
+        uint16_t instruction = memoryIOPtr->Fetch(pc);
+
+        // Effective addresses are only worked out when there are policies to tell. A load that
+        // stops the slice to latch MR_ICOUNT0 runs again in the next one and is only reported there.
+        std::integral_constant<bool, (sizeof...(Policies) > 0)> hooked;
+        int stops = StopsSlice(instruction, hooked);
+        if (!stops)
+        {
+            POLICY_HOOK(OnFetch(pc, instruction));
+            OnMemoryAccess(instruction, hooked);
+        }
+
+        // Extract the opcode from the instruction by considering bits [15:12]
+        switch (instruction >> 12)
+        {
+#define ISA_EXECUTE(NAME) aluPtr->NAME(instruction)
+        LC3_ISA(ISA_ALU_CASE)
+#undef ISA_EXECUTE
+        case OP_TRAP:
+            POLICY_HOOK(OnTrap(instruction & 0x00FF));
+            trapPtr->Proxy(instruction);
+            break;
+        default:
+            abort();
+            break;
+        }
+
+        if (!stops)
+        {
+            POLICY_HOOK(OnRetire(pc, instruction));
+        }
+        ++retired;
+    }
+
+    return retired;
+}
+
+
+/**
+ * @brief Tells whether an instruction is a load that will stop the slice to latch MR_ICOUNT0.
+ *
+ * @param instruction The instruction about to execute, with the PC already incremented.
+ * @return Returns 1 if the load stops the slice, 0 otherwise.
+ */
+template <typename... Policies>
+int BasicVirtualMachine<Policies...>::StopsSlice(uint16_t instruction, std::true_type)
+{
+    const uint16_t* registers = cpuPtr->registers;
+    uint16_t pointer = (uint16_t)(registers[Registers::R_PC] + IsaOffset(instruction, ISA_BITS_LD));
+
+    switch (instruction >> 12)
+    {
+    case OP_LD:
+        return memoryIOPtr->StopsSlice(pointer);
+    case OP_LDR:
+        return memoryIOPtr->StopsSlice((uint16_t)(registers[IsaSR1(instruction)] + IsaOffset(instruction, ISA_BITS_LDR)));
+    case OP_LDI:
+        return memoryIOPtr->StopsSlice(pointer) || memoryIOPtr->StopsSlice(cpuPtr->Word(pointer));
+    default:
+        return 0;
+    }
+}
+
+
+/**
+ * @brief Reports the memory accesses a load or store is about to make.
+ *
+ * Addresses are computed from the registers, and pointers of indirect accesses are read from
+ * memory directly, so that memory-mapped registers see no extra accesses.
+ *
+ * @param instruction The instruction about to execute, with the PC already incremented.
+ */
+template <typename... Policies>
+void BasicVirtualMachine<Policies...>::OnMemoryAccess(uint16_t instruction, std::true_type)
+{
+    const uint16_t* registers = cpuPtr->registers;
+    uint16_t pcOffset = IsaOffset(instruction, ISA_BITS_LD);
+    uint16_t baseOffset = IsaOffset(instruction, ISA_BITS_LDR);
+    uint16_t source = registers[IsaDR(instruction)];
+    uint16_t base = registers[IsaSR1(instruction)];
+    uint16_t pointer = (uint16_t)(registers[Registers::R_PC] + pcOffset);
+
+    switch (instruction >> 12)
+    {
+    case OP_LD:
+        POLICY_HOOK(OnMemRead(pointer));
+        break;
+    case OP_LDR:
+        POLICY_HOOK(OnMemRead((uint16_t)(base + baseOffset)));
+        break;
+    case OP_LDI:
+        POLICY_HOOK(OnMemRead(pointer));
+        POLICY_HOOK(OnMemRead(cpuPtr->Word(pointer)));
+        break;
+    case OP_ST:
+        POLICY_HOOK(OnMemWrite(pointer, source));
+        break;
+    case OP_STR:
+        POLICY_HOOK(OnMemWrite((uint16_t)(base + baseOffset), source));
+        break;
+    case OP_STI:
+        POLICY_HOOK(OnMemRead(pointer));
+        POLICY_HOOK(OnMemWrite(cpuPtr->Word(pointer), source));
+        break;
+    }
+}
+
+
+#undef POLICY_HOOK
+#endif
\ No newline at end of file
@@ -12,6 +12,8 @@ Copyright 
 
 
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
 
 
 #include "Trap.h"
@@ -19,16 +21,29 @@ Copyright 
 #include "ArithmeticLogicUnit.h"
 #include "OS.h"
 #include "CPU.h"
+#include "ShadowMemory.h"
+#include "ImagePager.h"
 
 
 /**
  * @brief Initializes the CPU object.
  *
- * This constructor initializes the CPU object by setting the default condition flag to zero
- * and setting the Program Counter (PC) to the starting position.
+ * This constructor initializes the CPU object by clearing memory and registers, setting the
+ * default condition flag to zero and setting the Program Counter (PC) to the starting position.
+ *
+ * @param words The memory size in words, a power of two from MEMORY_MIN to MEMORY_MAX.
+ * @param mode What addresses past the end of a smaller memory refer to, as a value of MemoryModes.
+ * @param node The NUMA node to allocate the memory on, or NUMA_NO_PREFERRED_NODE.
  */
-CPU::CPU()
+CPU::CPU(uint32_t words, uint16_t mode, DWORD node)
 {
+    // Start from a zeroed machine, so that the memory contents only depend on the loaded images
+    memory = nullptr;
+    ownsMemory = 0;
+    memoryNode = node;
+    ConfigureMemory(words, mode);
+    memset(registers, 0, sizeof(registers));
+
     // Set the default condition flag to zero
     registers[Registers::R_COND] = ConditionFlags::FL_ZERO;
 
@@ -38,12 +53,83 @@ CPU::CPU()
 
 
 /**
- * @brief Destroys the CPU object.
- *
- * This destructor does not perform any specific actions as the CPU object is being destroyed.
+ * @brief Destroys the CPU object and releases its memory.
  */
 CPU::~CPU()
 {
+    if (ownsMemory)
+    {
+        VirtualFree(memory, 0, MEM_RELEASE);
+    }
+}
+
+
+/**
+ * @brief Replaces the memory with a zeroed one of the given size, allocated on the CPU's NUMA node.
+ *
+ * MemoryIO and DecodeCache keep their own copy of the layout, so they must be attached to the CPU
+ * again afterwards.
+ *
+ * @param words The memory size in words, a power of two from MEMORY_MIN to MEMORY_MAX.
+ * @param mode What addresses past the end of a smaller memory refer to, as a value of MemoryModes.
+ */
+void CPU::ConfigureMemory(uint32_t words, uint16_t mode)
+{
+    if (ownsMemory)
+    {
+        VirtualFree(memory, 0, MEM_RELEASE);
+    }
+
+    // Pages of their own rather than the shared CRT heap, whose blocks may already have been
+    // touched on another node; fresh pages are zero
+    memory = (uint16_t*)VirtualAllocExNuma(GetCurrentProcess(), NULL, words * sizeof(uint16_t),
+        MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, memoryNode);
+    if (!memory)
+    {
+        fprintf(stderr, "could not allocate %u words of guest memory\n", words);
+        exit(1);
+    }
+    ownsMemory = 1;
+
+    memoryWords = words;
+    addressMask = (uint16_t)(words - 1);
+    faultMask = mode == MemoryModes::MEMORY_FAULT ? (uint16_t)~addressMask : 0;
+}
+
+
+/**
+ * @brief Replaces the memory with one provided by the caller, such as a mapped file.
+ *
+ * The caller keeps owning the words and must give the CPU a memory of its own again before
+ * releasing them. MemoryIO and DecodeCache must be attached to the CPU again afterwards.
+ *
+ * @param words The words, which the CPU uses as they are.
+ * @param count The memory size in words, a power of two from MEMORY_MIN to MEMORY_MAX.
+ * @param mode What addresses past the end of a smaller memory refer to, as a value of MemoryModes.
+ */
+void CPU::MapMemory(uint16_t* words, uint32_t count, uint16_t mode)
+{
+    if (ownsMemory)
+    {
+        VirtualFree(memory, 0, MEM_RELEASE);
+    }
+    memory = words;
+    ownsMemory = 0;
+
+    memoryWords = count;
+    addressMask = (uint16_t)(count - 1);
+    faultMask = mode == MemoryModes::MEMORY_FAULT ? (uint16_t)~addressMask : 0;
+}
+
+
+/**
+ * @brief Brings in the page of an image loaded on demand that holds an address.
+ *
+ * @param address An address in a page that is still absent.
+ */
+void CPU::LoadPage(uint16_t address)
+{
+    pagerPtr->Load(address);
 }
 
 
@@ -80,10 +166,14 @@ void CPU::UpdateFlags(uint16_t DR)
  * This function reads the contents of the specified image file and stores them in the memory array
  * starting from the specified origin address. It also performs byte order conversion as necessary.
  *
+ * In a memory smaller than MEMORY_MAX the image is placed at its origin modulo the memory size,
+ * and must end before the end of the memory.
+ *
  * @param file Pointer to the image file to be read.
  * @param alu Pointer to the ArithmeticLogicUnit object used for byte swapping.
+ * @return 1 if the image fits in memory, 0 otherwise.
  */
-void CPU::ReadImageFile(FILE* file, ArithmeticLogicUnit* alu)
+int CPU::ReadImageFile(FILE* file, ArithmeticLogicUnit* alu)
 {
     // Declare a variable to store the origin, which indicates the starting address in memory to store the image
     uint16_t origin;
@@ -94,23 +184,42 @@ void CPU::ReadImageFile(FILE* file, ArithmeticLogicUnit* alu)
     // Convert origin to little endian format
     origin = alu->Swap16(origin);
 
+    // In fault mode an image cannot start outside the memory
+    if (!Contains(origin))
+    {
+        return 0;
+    }
+
     // The maximum file size is known, allowing for a single fread operation.
     // With the predetermined limit, the file size will not exceed this value.
     // Thus, a single file read operation is sufficient.
-    uint16_t maxRead = MEMORY_MAX - origin;
+    uint32_t maxRead = memoryWords - (origin & addressMask);
 
     // Pointer to the memory location to start reading from
-    uint16_t* p = memory + origin;
+    uint16_t* p = memory + (origin & addressMask);
 
     // Read the contents of the file into memory
     size_t read = fread(p, sizeof(uint16_t), maxRead, file);
 
+    // Anything left over would run past the end of the memory
+    if (read == maxRead && fgetc(file) != EOF)
+    {
+        return 0;
+    }
+
+    // The loaded words are initialized as far as the shadow memory is concerned
+    if (shadowPtr)
+    {
+        shadowPtr->MarkInitialized(origin, (uint32_t)read);
+    }
+
     // Convert each read value to little endian format
     while (read-- > 0)
     {
         *p = alu->Swap16(*p);
         ++p; // Move to the next memory location
     }
+    return 1;
 }
 
 
@@ -134,11 +243,11 @@ int CPU::ReadImage(const char* imagePath, ArithmeticLogicUnit* alu)
     }
 
     // Call the ReadImageFile function to read the contents of the image file into memory
-    ReadImageFile(file, alu);
+    int fits = ReadImageFile(file, alu);
 
     // Close the file stream to release resources
     fclose(file);
 
     // Return 1 to indicate that the image file was successfully read into memory
-    return 1;
+    return fits;
 }
\ No newline at end of file
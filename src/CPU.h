@@ -16,6 +16,16 @@ Copyright 
 // The maximum memory size is specified as 128 kilobytes (KB).
 #define MEMORY_MAX (1 << 16)
 
+// Smallest guest memory, in words; it still holds the 512-word device page at its top.
+#define MEMORY_MIN (1 << 12)
+
+// First address of the device page, which every memory size maps onto its last 512 words.
+#define MEMORY_DEVICE_PAGE 0xFE00
+
+// Words per page of an image loaded on demand; 512, so the device page is a page of its own.
+#define IMAGE_PAGE_SHIFT 9
+#define IMAGE_PAGE_WORDS (1 << IMAGE_PAGE_SHIFT)
+
 // Virtual Machine includes total number of 10 registers.
 #define REGISTER_COUNT 10
 
@@ -33,6 +43,8 @@ Copyright 
 class Trap;
 class ArithmeticLogicUnit;
 class MemoryIO;
+class ShadowMemory;
+class ImagePager;
 class OS;
 
 
@@ -74,6 +86,14 @@ enum PC : uint16_t
 };
 
 
+// What an address past the end of a memory smaller than MEMORY_MAX refers to.
+enum MemoryModes : uint16_t
+{
+    MEMORY_WRAP = 0, // the word at the address modulo the memory size, ignoring the upper address bits
+    MEMORY_FAULT     // nothing: loads, stores and fetches halt the guest with a memory fault
+};
+
+
 class CPU
 {
 public:
@@ -84,18 +104,52 @@ public:
     // If "uint16_t" is not explicitly specified (and "int" is used instead), 
     // the size of each element might vary depending on the compiler and system,
     // potentially being interpreted as either 16 or 32 bits.
-    uint16_t memory[MEMORY_MAX];
+    // The array holds memoryWords words, a power of two; an address selects the word at
+    // (address & addressMask), so the device page xFE00-xFFFF is always its last 512 words.
+    uint16_t* memory;
+    uint32_t memoryWords;
+    uint16_t addressMask;
+
+    // Whether memory was allocated by the CPU, rather than mapped by its owner.
+    int ownsMemory;
+
+    // NUMA node the CPU allocates its memory on, or NUMA_NO_PREFERRED_NODE to leave it to the system.
+    DWORD memoryNode;
+
+    // Address bits that fault: those above addressMask in MEMORY_FAULT mode, none otherwise.
+    uint16_t faultMask;
 
     // Boolean flag to control the execution state of the Virtual Machine.
     int running = 1;
 
+    // Optional shadow memory told which words each loaded image initializes.
+    ShadowMemory* shadowPtr = nullptr;
+
+    // Optional pager loading images on demand, and its flag per page of memory not loaded yet.
+    ImagePager* pagerPtr = nullptr;
+    const uint8_t* absentPages = nullptr;
+
 public:
-	CPU();
+	CPU(uint32_t words = MEMORY_MAX, uint16_t mode = MemoryModes::MEMORY_WRAP, DWORD node = NUMA_NO_PREFERRED_NODE);
     ~CPU();
+
+    void ConfigureMemory(uint32_t words, uint16_t mode);
+    void MapMemory(uint16_t* words, uint32_t count, uint16_t mode);
+    int Contains(uint16_t address) const { return (address & faultMask) == 0 || address >= MEMORY_DEVICE_PAGE; }
+    void LoadPage(uint16_t address);
+
+    uint16_t& Word(uint16_t address)
+    {
+        if (absentPages && absentPages[(address & addressMask) >> IMAGE_PAGE_SHIFT])
+        {
+            LoadPage(address);
+        }
+        return memory[address & addressMask];
+    }
 		
     void UpdateFlags(uint16_t DR);
 
-    void ReadImageFile(FILE* file, ArithmeticLogicUnit* alu);
+    int ReadImageFile(FILE* file, ArithmeticLogicUnit* alu);
     int ReadImage(const char* imagePath, ArithmeticLogicUnit* alu);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,630 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+
+
+#include "CheckpointLog.h"
+#include "ImagePager.h"
+#include "MemoryIO.h"
+
+
+/**
+ * @brief Constructs a CheckpointLog for a CPU; nothing is logged until Open and Start.
+ *
+ * @param cpu Pointer to the CPU whose memory and registers are checkpointed.
+ * @param memoryIO Pointer to the MemoryIO object, whose counters are checkpointed with the registers.
+ */
+CheckpointLog::CheckpointLog(CPU* cpu, MemoryIO* memoryIO)
+    : pendingReady(0), running(0)
+{
+    cpuPtr = cpu;
+    memoryIOPtr = memoryIO;
+    file = INVALID_HANDLE_VALUE;
+    logBytes = 0;
+    memoryWords = cpu->memoryWords;
+    memoryMode = MemoryModes::MEMORY_WRAP;
+
+    recovering = 0;
+    sequence = 0;
+    instructions = 0;
+    lastCheckpoint = 0;
+
+    pending = new PendingCheckpoint();
+    wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    image = new uint16_t[MEMORY_MAX]();
+    memset(imageRegisters, 0, sizeof(imageRegisters));
+    imageInstructions = 0;
+    imageMicroseconds = 0;
+    for (uint32_t page = 0; page < CHECKPOINT_PAGES; ++page)
+    {
+        allPages[page] = (uint16_t)page;
+    }
+    compactNext = 0;
+
+    record = new uint8_t[RecordBytes(CHECKPOINT_PAGES)];
+
+    memset(dirty, 0, sizeof(dirty));
+
+    checkpoints = 0;
+    pauses = 0;
+    deferred = 0;
+    pauseTotal = 0;
+    pauseLongest = 0;
+    frequency = 1;
+
+    pagesLogged = 0;
+    compactions = 0;
+    writeFailures = 0;
+}
+
+
+/**
+ * @brief Stops the writer thread if Stop was not called and closes the log.
+ */
+CheckpointLog::~CheckpointLog()
+{
+    if (writer.joinable())
+    {
+        running.store(0);
+        SetEvent(wakeEvent);
+        writer.join();
+    }
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+    }
+    CloseHandle(wakeEvent);
+
+    delete pending;
+    delete[] image;
+    delete[] record;
+}
+
+
+/**
+ * @brief Opens a checkpoint log, creating it if needed, and recovers the guest it holds.
+ *
+ * A log whose last checkpoint was taken while the guest ran gives the CPU the memory and registers
+ * of that checkpoint, and no image is loaded. A new log, or one whose guest halted, starts over
+ * empty and the images are loaded.
+ *
+ * @param path The path of the checkpoint log.
+ * @param mode What addresses past the end of a smaller memory refer to, which an existing log must match.
+ * @return Returns 1 on success, 0 on failure, after printing the reason.
+ */
+int CheckpointLog::Open(const char* path, uint16_t mode)
+{
+    logPath = path;
+    memoryWords = cpuPtr->memoryWords;
+    memoryMode = mode;
+
+    file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "checkpoint: could not open %s\n", path);
+        return 0;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        fprintf(stderr, "checkpoint: could not open %s\n", path);
+        return 0;
+    }
+
+    if (size.QuadPart == 0)
+    {
+        return Reset();
+    }
+
+    // Never truncate a file that is not a checkpoint log of the same layout
+    CheckpointLogHeader header;
+    DWORD read = 0;
+    if (!ReadFile(file, &header, sizeof(header), &read, NULL) || read != sizeof(header) ||
+        header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION)
+    {
+        fprintf(stderr, "checkpoint: %s is not a checkpoint log\n", path);
+        return 0;
+    }
+    if (header.memoryWords != memoryWords || header.memoryMode != mode)
+    {
+        fprintf(stderr, "checkpoint: %s holds %u words of %s memory; start with the same --memory options\n",
+            path, header.memoryWords, header.memoryMode == MemoryModes::MEMORY_FAULT ? "faulting" : "wrapping");
+        return 0;
+    }
+
+    return Recover((uint64_t)size.QuadPart);
+}
+
+
+/**
+ * @brief Tells whether the guest was recovered from the log, so that no image is loaded.
+ *
+ * @return Returns 1 if the last checkpoint of the log was taken while the guest ran, 0 otherwise.
+ */
+int CheckpointLog::IsRecovering() const
+{
+    return recovering;
+}
+
+
+/**
+ * @brief Starts the writer thread and takes a first checkpoint of the whole memory.
+ *
+ * Called once the images are loaded or the guest recovered or received, right before it runs, so
+ * the first checkpoint does not pause it.
+ */
+void CheckpointLog::Start()
+{
+    // Every later change of memory has to go through MemoryIO::Write or MemoryIO::Patch, which mark its page
+    if (cpuPtr->pagerPtr)
+    {
+        cpuPtr->pagerPtr->LoadAll();
+    }
+
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = counterFrequency.QuadPart;
+
+    running.store(1);
+    writer = std::thread(&CheckpointLog::WriterLoop, this);
+    lastCheckpoint = GetTickCount64();
+
+    // Memory may have changed since the log was opened, by loading the images or receiving a migrated guest
+    memset(dirty, 1, memoryWords >> CHECKPOINT_PAGE_SHIFT);
+    Capture(CheckpointKinds::CHECKPOINT_RUNNING);
+}
+
+
+/**
+ * @brief Counts a slice of execution and checkpoints once CHECKPOINT_INTERVAL_MS have passed since the last one.
+ *
+ * Called between slices, where the registers match the memory. While the writer thread is still
+ * busy with the previous checkpoint, the dirty pages are kept for a later slice.
+ *
+ * @param retired The number of instructions executed by the slice.
+ */
+void CheckpointLog::Tick(uint64_t retired)
+{
+    instructions += retired;
+
+    if (GetTickCount64() - lastCheckpoint < CHECKPOINT_INTERVAL_MS)
+    {
+        return;
+    }
+
+    if (pendingReady.load())
+    {
+        ++deferred;
+        return;
+    }
+
+    LONGLONG pause = Capture(CheckpointKinds::CHECKPOINT_RUNNING);
+    pauseTotal += pause;
+    if (pause > pauseLongest)
+    {
+        pauseLongest = pause;
+    }
+    ++pauses;
+}
+
+
+/**
+ * @brief Writes a last checkpoint marking the guest halted, stops the writer thread and reports.
+ */
+void CheckpointLog::Stop()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+
+    while (pendingReady.load())
+    {
+        Sleep(1);
+    }
+    Capture(CheckpointKinds::CHECKPOINT_HALTED);
+
+    running.store(0);
+    SetEvent(wakeEvent);
+    writer.join();
+
+    double ticksPerMicrosecond = frequency / 1e6;
+    fprintf(stderr, "checkpoint: %llu checkpoints of %llu pages to %s, guest paused %.1f us on average and %.1f us at most, %llu deferred, %llu compactions\n",
+        (unsigned long long)checkpoints, (unsigned long long)pagesLogged, logPath.c_str(),
+        pauses ? pauseTotal / ticksPerMicrosecond / pauses : 0.0, pauseLongest / ticksPerMicrosecond,
+        (unsigned long long)deferred, (unsigned long long)compactions);
+
+    if (writeFailures)
+    {
+        fprintf(stderr, "checkpoint: %llu writes to %s failed\n", (unsigned long long)writeFailures, logPath.c_str());
+    }
+}
+
+
+/**
+ * @brief Replays the checkpoints of the log up to the first incomplete or damaged one.
+ *
+ * A checkpoint is only applied once its checksum matched, so the memory always ends up as of a
+ * complete checkpoint. Whatever follows it, typically a checkpoint torn by a crash, is cut off.
+ *
+ * @param size The size of the log in bytes.
+ * @return Returns 1 on success, 0 on failure, after printing the reason.
+ */
+int CheckpointLog::Recover(uint64_t size)
+{
+    CheckpointHeader* header = (CheckpointHeader*)record;
+    uint32_t pageTotal = memoryWords >> CHECKPOINT_PAGE_SHIFT;
+    uint64_t offset = sizeof(CheckpointLogHeader);
+    uint64_t replayed = 0;
+    uint16_t lastKind = CheckpointKinds::CHECKPOINT_HALTED;
+
+    while (offset + sizeof(CheckpointHeader) <= size)
+    {
+        DWORD read = 0;
+        if (!ReadFile(file, record, sizeof(CheckpointHeader), &read, NULL) || read != sizeof(CheckpointHeader) ||
+            header->magic != CHECKPOINT_RECORD_MAGIC || header->kind > CheckpointKinds::CHECKPOINT_HALTED ||
+            header->pageCount > pageTotal || (replayed && header->sequence <= sequence))
+        {
+            break;
+        }
+
+        size_t bytes = RecordBytes(header->pageCount);
+        DWORD payload = (DWORD)(bytes - sizeof(CheckpointHeader));
+        if (offset + bytes > size ||
+            !ReadFile(file, record + sizeof(CheckpointHeader), payload, &read, NULL) || read != payload)
+        {
+            break;
+        }
+
+        uint64_t checksum = header->checksum;
+        header->checksum = 0;
+        if (Checksum(record, bytes) != checksum)
+        {
+            break;
+        }
+
+        const uint16_t* pages = (const uint16_t*)(record + sizeof(CheckpointHeader));
+        const uint16_t* words = (const uint16_t*)(record + bytes) - header->pageCount * CHECKPOINT_PAGE_WORDS;
+
+        uint32_t i = 0;
+        while (i < header->pageCount && pages[i] < pageTotal)
+        {
+            ++i;
+        }
+        if (i < header->pageCount)
+        {
+            break;
+        }
+
+        for (i = 0; i < header->pageCount; ++i)
+        {
+            memcpy(&image[pages[i] << CHECKPOINT_PAGE_SHIFT], &words[i * CHECKPOINT_PAGE_WORDS], CHECKPOINT_PAGE_WORDS * sizeof(uint16_t));
+        }
+        memcpy(imageRegisters, header->registers, sizeof(imageRegisters));
+        imageInstructions = header->instructions;
+        imageMicroseconds = header->microseconds;
+        sequence = header->sequence;
+        lastKind = header->kind;
+
+        offset += bytes;
+        ++replayed;
+    }
+
+    // A halted guest starts over from its images
+    if (!replayed || lastKind == CheckpointKinds::CHECKPOINT_HALTED)
+    {
+        return Reset();
+    }
+
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)offset;
+    if (!SetFilePointerEx(file, end, NULL, FILE_BEGIN) || (offset < size && !SetEndOfFile(file)))
+    {
+        fprintf(stderr, "checkpoint: could not write %s\n", logPath.c_str());
+        return 0;
+    }
+    if (offset < size)
+    {
+        fprintf(stderr, "checkpoint: dropped %llu bytes of an incomplete checkpoint at the end of %s\n",
+            (unsigned long long)(size - offset), logPath.c_str());
+    }
+
+    logBytes = offset;
+    instructions = imageInstructions;
+    recovering = 1;
+
+    memcpy(cpuPtr->memory, image, memoryWords * sizeof(uint16_t));
+    memcpy(cpuPtr->registers, imageRegisters, sizeof(cpuPtr->registers));
+    memoryIOPtr->SeedCounters(imageInstructions, imageMicroseconds);
+
+    fprintf(stderr, "checkpoint: recovered the guest of %s at x%04X after %llu instructions from %llu checkpoints\n",
+        logPath.c_str(), cpuPtr->registers[Registers::R_PC], (unsigned long long)instructions, (unsigned long long)replayed);
+
+    return 1;
+}
+
+
+/**
+ * @brief Empties the log, leaving only its header.
+ *
+ * @return Returns 1 on success, 0 on failure, after printing the reason.
+ */
+int CheckpointLog::Reset()
+{
+    CheckpointLogHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.memoryWords = memoryWords;
+    header.memoryMode = memoryMode;
+
+    LARGE_INTEGER start;
+    start.QuadPart = 0;
+    DWORD written = 0;
+    if (!SetFilePointerEx(file, start, NULL, FILE_BEGIN) || !SetEndOfFile(file) ||
+        !WriteFile(file, &header, sizeof(header), &written, NULL) || written != sizeof(header) || !FlushFileBuffers(file))
+    {
+        fprintf(stderr, "checkpoint: could not write %s\n", logPath.c_str());
+        return 0;
+    }
+
+    logBytes = sizeof(header);
+    sequence = 0;
+    instructions = 0;
+    memset(image, 0, MEMORY_MAX * sizeof(uint16_t));
+    memset(imageRegisters, 0, sizeof(imageRegisters));
+    imageInstructions = 0;
+    imageMicroseconds = 0;
+
+    return 1;
+}
+
+
+/**
+ * @brief Copies the dirty pages and the registers for the writer thread, which must be idle.
+ *
+ * This is the only part of a checkpoint that pauses the guest; the writer thread does the rest.
+ *
+ * @param kind The state of the guest, as a value of CheckpointKinds.
+ * @return The time spent copying, in performance counter ticks.
+ */
+LONGLONG CheckpointLog::Capture(uint16_t kind)
+{
+    LARGE_INTEGER begin;
+    QueryPerformanceCounter(&begin);
+
+    uint32_t pageTotal = memoryWords >> CHECKPOINT_PAGE_SHIFT;
+    uint32_t count = 0;
+    for (uint32_t page = 0; page < pageTotal; ++page)
+    {
+        if (dirty[page])
+        {
+            dirty[page] = 0;
+            pending->pages[count] = (uint16_t)page;
+            memcpy(&pending->words[count * CHECKPOINT_PAGE_WORDS], &cpuPtr->memory[page << CHECKPOINT_PAGE_SHIFT], CHECKPOINT_PAGE_WORDS * sizeof(uint16_t));
+            ++count;
+        }
+    }
+    pending->kind = kind;
+    pending->pageCount = count;
+    pending->instructions = memoryIOPtr->GetInstructions();
+    pending->microseconds = memoryIOPtr->GetMicroseconds();
+    memcpy(pending->registers, cpuPtr->registers, sizeof(pending->registers));
+
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+
+    pendingReady.store(1);
+    SetEvent(wakeEvent);
+
+    ++checkpoints;
+    lastCheckpoint = GetTickCount64();
+    return end.QuadPart - begin.QuadPart;
+}
+
+
+/**
+ * @brief Body of the writer thread: writes each checkpoint handed over until Stop.
+ */
+void CheckpointLog::WriterLoop()
+{
+    while (true)
+    {
+        WaitForSingleObject(wakeEvent, CHECKPOINT_IDLE_MS);
+
+        // Read before the checkpoint, so that the last one handed over is written before leaving
+        int stopping = !running.load();
+
+        if (pendingReady.load())
+        {
+            Write();
+            pendingReady.store(0);
+        }
+
+        if (stopping)
+        {
+            break;
+        }
+    }
+}
+
+
+/**
+ * @brief Applies the pending checkpoint to the image and appends it to the log, or compacts the log.
+ *
+ * Runs on the writer thread, which owns the pending checkpoint while pendingReady is set.
+ */
+void CheckpointLog::Write()
+{
+    for (uint32_t i = 0; i < pending->pageCount; ++i)
+    {
+        memcpy(&image[pending->pages[i] << CHECKPOINT_PAGE_SHIFT], &pending->words[i * CHECKPOINT_PAGE_WORDS], CHECKPOINT_PAGE_WORDS * sizeof(uint16_t));
+    }
+    memcpy(imageRegisters, pending->registers, sizeof(imageRegisters));
+    imageInstructions = pending->instructions;
+    imageMicroseconds = pending->microseconds;
+    pagesLogged += pending->pageCount;
+    ++sequence;
+
+    // Once the log has grown, or after a failed write, the image replaces it as one checkpoint
+    if (compactNext || logBytes >= CHECKPOINT_COMPACT_BYTES || file == INVALID_HANDLE_VALUE)
+    {
+        compactNext = !Compact(pending->kind);
+        return;
+    }
+
+    if (!Append(file, pending->kind, pending->pageCount, pending->pages, pending->words, pending->registers, pending->instructions, pending->microseconds))
+    {
+        // Cut off whatever part of the checkpoint was written; its pages only survive in the image now
+        LARGE_INTEGER end;
+        end.QuadPart = (LONGLONG)logBytes;
+        SetFilePointerEx(file, end, NULL, FILE_BEGIN);
+        SetEndOfFile(file);
+        ++writeFailures;
+        compactNext = 1;
+        return;
+    }
+
+    logBytes += RecordBytes(pending->pageCount);
+}
+
+
+/**
+ * @brief Appends one checkpoint to a file and waits until it is written.
+ *
+ * @param target The file to append to, positioned at its end.
+ * @param kind The state of the guest, as a value of CheckpointKinds.
+ * @param pageCount The number of pages in the checkpoint.
+ * @param pages The index of each page.
+ * @param words The words of each page, one page after the other.
+ * @param registers The registers of the guest.
+ * @param recordInstructions The number of instructions the guest has run.
+ * @param recordMicroseconds The time the guest's clock has reached.
+ * @return Returns 1 once the checkpoint is written, 0 on failure.
+ */
+int CheckpointLog::Append(HANDLE target, uint16_t kind, uint32_t pageCount, const uint16_t* pages, const uint16_t* words,
+    const uint16_t* registers, uint64_t recordInstructions, uint64_t recordMicroseconds)
+{
+    size_t bytes = RecordBytes(pageCount);
+    memset(record, 0, bytes - pageCount * CHECKPOINT_PAGE_WORDS * sizeof(uint16_t));
+
+    CheckpointHeader* header = (CheckpointHeader*)record;
+    header->magic = CHECKPOINT_RECORD_MAGIC;
+    header->kind = kind;
+    header->pageCount = (uint16_t)pageCount;
+    header->sequence = sequence;
+    header->instructions = recordInstructions;
+    header->microseconds = recordMicroseconds;
+    memcpy(header->registers, registers, sizeof(header->registers));
+
+    memcpy(record + sizeof(CheckpointHeader), pages, pageCount * sizeof(uint16_t));
+    memcpy(record + bytes - pageCount * CHECKPOINT_PAGE_WORDS * sizeof(uint16_t), words, pageCount * CHECKPOINT_PAGE_WORDS * sizeof(uint16_t));
+    header->checksum = Checksum(record, bytes);
+
+    DWORD written = 0;
+    return WriteFile(target, record, (DWORD)bytes, &written, NULL) && written == bytes && FlushFileBuffers(target);
+}
+
+
+/**
+ * @brief Replaces the log with one holding a single checkpoint of the whole image.
+ *
+ * The new log is written next to the old one and renamed over it, so a crash at any point leaves
+ * one of the two complete.
+ *
+ * @param kind The state of the guest, as a value of CheckpointKinds.
+ * @return Returns 1 on success, 0 on failure.
+ */
+int CheckpointLog::Compact(uint16_t kind)
+{
+    std::string compactPath = logPath + ".compact";
+    uint32_t pageTotal = memoryWords >> CHECKPOINT_PAGE_SHIFT;
+
+    HANDLE compactFile = CreateFileA(compactPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (compactFile == INVALID_HANDLE_VALUE)
+    {
+        ++writeFailures;
+        return 0;
+    }
+
+    CheckpointLogHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.memoryWords = memoryWords;
+    header.memoryMode = memoryMode;
+
+    DWORD written = 0;
+    int complete = WriteFile(compactFile, &header, sizeof(header), &written, NULL) && written == sizeof(header) &&
+        Append(compactFile, kind, pageTotal, allPages, image, imageRegisters, imageInstructions, imageMicroseconds);
+    CloseHandle(compactFile);
+
+    if (!complete)
+    {
+        DeleteFileA(compactPath.c_str());
+        ++writeFailures;
+        return 0;
+    }
+
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+    }
+    int renamed = MoveFileExA(compactPath.c_str(), logPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+
+    // Appends go on at the end of whichever log is in place now
+    file = CreateFileA(logPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER end;
+    end.QuadPart = 0;
+    if (!renamed || file == INVALID_HANDLE_VALUE || !SetFilePointerEx(file, end, &end, FILE_END))
+    {
+        ++writeFailures;
+        return 0;
+    }
+
+    logBytes = (uint64_t)end.QuadPart;
+    ++compactions;
+    return 1;
+}
+
+
+/**
+ * @brief Computes the size of a checkpoint in the log.
+ *
+ * @param pageCount The number of pages in the checkpoint.
+ * @return The size in bytes: the header, the page indices padded to 8 bytes, and the words.
+ */
+size_t CheckpointLog::RecordBytes(uint32_t pageCount)
+{
+    return sizeof(CheckpointHeader) + ((pageCount * sizeof(uint16_t) + 7) & ~(size_t)7) + pageCount * CHECKPOINT_PAGE_WORDS * sizeof(uint16_t);
+}
+
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of a checkpoint.
+ *
+ * @param data The bytes of the checkpoint, with its checksum field zero.
+ * @param length The number of bytes.
+ * @return The hash.
+ */
+uint64_t CheckpointLog::Checksum(const uint8_t* data, size_t length)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL; // FNV offset basis
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL; // FNV prime
+    }
+    return hash;
+}
\ No newline at end of file
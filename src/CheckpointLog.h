@@ -0,0 +1,174 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef CHECKPOINT_LOG_H
+#define CHECKPOINT_LOG_H
+
+// Identifies a checkpoint log ("L3CKPLOG") and each of its records ("CKPT"); bump the version whenever they change.
+#define CHECKPOINT_MAGIC 0x474F4C504B43334CULL
+#define CHECKPOINT_RECORD_MAGIC 0x54504B43
+#define CHECKPOINT_VERSION 2
+
+// Words per page of a checkpoint; only the pages written since the previous checkpoint are logged.
+#define CHECKPOINT_PAGE_SHIFT 8
+#define CHECKPOINT_PAGE_WORDS (1 << CHECKPOINT_PAGE_SHIFT)
+#define CHECKPOINT_PAGES (MEMORY_MAX >> CHECKPOINT_PAGE_SHIFT)
+
+// Interval between two checkpoints, in milliseconds.
+#define CHECKPOINT_INTERVAL_MS 1000
+
+// Instructions run between two looks at the clock while checkpointing.
+#define CHECKPOINT_SLICE (1 << 20)
+
+// Size past which the writer thread rewrites the log as a single full checkpoint, in bytes.
+#define CHECKPOINT_COMPACT_BYTES (8 * MEMORY_MAX * 2)
+
+// Longest the writer thread sleeps before looking for a checkpoint again, in milliseconds.
+#define CHECKPOINT_IDLE_MS 100
+
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <Windows.h>
+
+#include "CPU.h"
+
+
+class MemoryIO;
+
+
+// State of the guest a checkpoint records.
+enum CheckpointKinds : uint16_t
+{
+    CHECKPOINT_RUNNING = 0, // taken while it runs; the last one is recovered after a crash
+    CHECKPOINT_HALTED       // taken at its halt; the next run starts over from the images
+};
+
+
+// Start of a checkpoint log.
+struct CheckpointLogHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t memoryWords;
+    uint16_t memoryMode;
+    uint16_t reserved[3];
+};
+
+
+// One checkpoint, followed by the indices of its pages, padded to 8 bytes, and then their words.
+struct CheckpointHeader
+{
+    uint32_t magic;
+    uint16_t kind;                      // a value of CheckpointKinds
+    uint16_t pageCount;
+    uint64_t sequence;
+    uint64_t instructions;              // run by the guest since it was loaded, which MR_ICOUNT0 continues from
+    uint64_t microseconds;              // reached by the guest's clock, which MR_USEC0 continues from
+    uint16_t registers[REGISTER_COUNT];
+    uint16_t reserved[2];
+    uint64_t checksum;                  // FNV-1a hash of the record, taken with this field zero
+};
+
+
+// A checkpoint handed from the guest thread to the writer thread.
+struct PendingCheckpoint
+{
+    uint16_t kind;
+    uint32_t pageCount;
+    uint64_t instructions;
+    uint64_t microseconds;
+    uint16_t registers[REGISTER_COUNT];
+    uint16_t pages[CHECKPOINT_PAGES];
+    uint16_t words[MEMORY_MAX];
+};
+
+
+// Write-ahead log of incremental checkpoints. Between slices, the guest thread only copies the pages
+// written since the previous checkpoint; a writer thread appends them with a checksum, makes them
+// durable and rewrites the log as one full checkpoint once it has grown. After a crash, the log is
+// replayed up to its last complete checkpoint.
+class CheckpointLog
+{
+public:
+    // One flag per page, set by MemoryIO::Write and cleared when the page is checkpointed.
+    uint8_t dirty[CHECKPOINT_PAGES];
+
+private:
+    CPU* cpuPtr;
+    MemoryIO* memoryIOPtr;
+    std::string logPath;
+    HANDLE file;
+    uint64_t logBytes;
+    uint32_t memoryWords;
+    uint16_t memoryMode;
+
+    int recovering;
+    uint64_t sequence;
+    uint64_t instructions;
+    ULONGLONG lastCheckpoint;
+
+    // Handed over while pendingReady is set, then owned by the writer thread until it clears it
+    PendingCheckpoint* pending;
+    std::atomic<int> pendingReady;
+    std::atomic<int> running;
+    HANDLE wakeEvent;
+    std::thread writer;
+
+    // Memory and registers as of the last checkpoint written, which compaction writes out in full
+    uint16_t* image;
+    uint16_t imageRegisters[REGISTER_COUNT];
+    uint64_t imageInstructions;
+    uint64_t imageMicroseconds;
+    uint16_t allPages[CHECKPOINT_PAGES];
+    int compactNext;
+
+    // A record as written to or read from the log
+    uint8_t* record;
+
+    // Guest thread statistics
+    uint64_t checkpoints;
+    uint64_t pauses;
+    uint64_t deferred;
+    LONGLONG pauseTotal;
+    LONGLONG pauseLongest;
+    LONGLONG frequency;
+
+    // Writer thread statistics, read once it has stopped
+    uint64_t pagesLogged;
+    uint64_t compactions;
+    uint64_t writeFailures;
+
+public:
+    CheckpointLog(CPU* cpu, MemoryIO* memoryIO);
+    ~CheckpointLog();
+
+    int Open(const char* path, uint16_t mode);
+    int IsRecovering() const;
+    void Start();
+    void Tick(uint64_t retired);
+    void Stop();
+
+private:
+    int Recover(uint64_t size);
+    int Reset();
+    LONGLONG Capture(uint16_t kind);
+    void WriterLoop();
+    void Write();
+    int Append(HANDLE target, uint16_t kind, uint32_t pageCount, const uint16_t* pages, const uint16_t* words,
+        const uint16_t* registers, uint64_t recordInstructions, uint64_t recordMicroseconds);
+    int Compact(uint16_t kind);
+
+    static size_t RecordBytes(uint32_t pageCount);
+    static uint64_t Checksum(const uint8_t* data, size_t length);
+};
+#endif
\ No newline at end of file
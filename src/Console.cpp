@@ -0,0 +1,419 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <mutex>
+#include <conio.h>  // _kbhit
+
+
+#include "Console.h"
+#include "ScreenModel.h"
+#include "OutputWriter.h"
+
+
+// Held while console input records are read, so a drain on another thread never removes a
+// record getchar is about to take.
+static std::mutex inputLock;
+
+
+/**
+ * @brief Constructs a Console writing guest output directly to stdout.
+ */
+Console::Console()
+{
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = counterFrequency.QuadPart;
+    lastRender = 0;
+
+    guestBytes = 0;
+    terminalBytes = 0;
+    frames = 0;
+
+    queuedRead = 0;
+}
+
+
+/**
+ * @brief Destroys the Console object.
+ */
+Console::~Console()
+{
+    delete writerPtr;
+    delete screenPtr;
+}
+
+
+/**
+ * @brief Routes guest output through an in-memory screen model.
+ *
+ * Output is then interpreted into the model and only the differences are written to the
+ * terminal at frame boundaries. ANSI processing is enabled on the console for the renderer.
+ *
+ * @param columns Width of the screen, or 0 to use the console window width.
+ * @param rows Height of the screen, or 0 to use the console window height.
+ */
+void Console::EnableScreen(int columns, int rows)
+{
+    HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if ((columns <= 0 || rows <= 0) && GetConsoleScreenBufferInfo(hStdout, &info))
+    {
+        columns = info.srWindow.Right - info.srWindow.Left + 1;
+        rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+    }
+    if (columns <= 0 || rows <= 0)
+    {
+        columns = 80;
+        rows = 24;
+    }
+
+    DWORD mode;
+    if (GetConsoleMode(hStdout, &mode))
+    {
+        SetConsoleMode(hStdout, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
+
+    delete screenPtr;
+    screenPtr = new ScreenModel(columns, rows);
+}
+
+
+/**
+ * @brief Hands terminal output to a dedicated writer thread.
+ *
+ * The guest then only copies bytes into a ring and never blocks on a slow terminal or pipe,
+ * unless the ring fills up. Everything, including the echo of INC, still goes through the one
+ * ring, so the output order is unchanged.
+ *
+ * @param ringSize Size of the ring in bytes.
+ */
+void Console::EnableWriterThread(size_t ringSize)
+{
+    delete writerPtr;
+    writerPtr = new OutputWriter(ringSize);
+    writerPtr->Start();
+}
+
+
+/**
+ * @brief Outputs one guest character.
+ *
+ * @param character The character to output.
+ */
+void Console::Put(char character)
+{
+    ++guestBytes;
+
+    if (screenPtr)
+    {
+        screenPtr->Write(character);
+        return;
+    }
+
+    if (writerPtr)
+    {
+        writerPtr->Put(character);
+        return;
+    }
+
+    putc(character, stdout);
+}
+
+
+/**
+ * @brief Outputs a null-terminated string.
+ *
+ * @param text The string to output.
+ */
+void Console::Write(const char* text)
+{
+    while (*text)
+    {
+        Put(*text++);
+    }
+}
+
+
+/**
+ * @brief Ends a burst of guest output.
+ *
+ * Without the screen model this flushes stdout, as the traps always did, or only publishes
+ * the bytes to the writer thread. With it, a frame is rendered only if the last one is older
+ * than SCREEN_FRAME_MS, so whole-screen redraws spread over many traps reach the terminal as
+ * one update.
+ */
+void Console::Flush()
+{
+    if (!screenPtr)
+    {
+        if (writerPtr)
+        {
+            writerPtr->Publish();
+        }
+        else
+        {
+            fflush(stdout);
+        }
+        return;
+    }
+
+    Tick();
+}
+
+
+/**
+ * @brief Renders the pending changes of the screen model if the last frame is older than
+ * SCREEN_FRAME_MS.
+ *
+ * Called between slices of execution as well, so what a guest drew before a long computation
+ * without output still reaches the terminal.
+ */
+void Console::Tick()
+{
+    if (!screenPtr || !screenPtr->IsDirty())
+    {
+        return;
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    if ((now.QuadPart - lastRender) * 1000 >= frequency * SCREEN_FRAME_MS)
+    {
+        Render();
+    }
+}
+
+
+/**
+ * @brief Marks a frame boundary because the guest is about to wait for input.
+ *
+ * Everything the guest drew before asking for input must be visible.
+ */
+void Console::InputWait()
+{
+    if (screenPtr && screenPtr->IsDirty())
+    {
+        Render();
+    }
+
+    if (writerPtr)
+    {
+        writerPtr->Publish();
+    }
+}
+
+
+/**
+ * @brief Renders any pending changes, drains the writer thread and prints the output statistics.
+ */
+void Console::Close()
+{
+    if (screenPtr)
+    {
+        Render();
+    }
+
+    if (writerPtr)
+    {
+        writerPtr->Stop();
+    }
+    fflush(stdout);
+
+    if (screenPtr)
+    {
+        fprintf(stderr, "screen: %llu guest bytes rendered as %llu terminal bytes in %llu frames\n",
+            (unsigned long long)guestBytes, (unsigned long long)terminalBytes, (unsigned long long)frames);
+    }
+    if (writerPtr)
+    {
+        writerPtr->Report();
+    }
+}
+
+
+/**
+ * @brief Queues keys for the guest to read before anything typed on this keyboard.
+ *
+ * @param data The keys, in the order they were typed.
+ * @param length The number of keys.
+ */
+void Console::QueueInput(const char* data, size_t length)
+{
+    queuedInput.append(data, length);
+}
+
+
+/**
+ * @brief Tells whether queued keys are left.
+ *
+ * @return Returns 1 if GetChar returns a queued key, 0 if it reads the keyboard.
+ */
+int Console::HasQueuedInput() const
+{
+    return queuedRead < queuedInput.size();
+}
+
+
+/**
+ * @brief Tells whether a key is queued or typed, without waiting for one.
+ *
+ * @return Returns 1 if GetChar returns at once, 0 if it would wait.
+ */
+int Console::KeyPending() const
+{
+    return HasQueuedInput() || (WaitForSingleObject(GetStdHandle(STD_INPUT_HANDLE), 0) == WAIT_OBJECT_0 && _kbhit());
+}
+
+
+/**
+ * @brief Removes the console input records in front of the first key press.
+ *
+ * Key releases, modifier keys, focus, mouse and buffer size records are skipped by getchar,
+ * but keep the input handle signaled, so a wait on it would return at once.
+ *
+ * @return Returns 1 if a key press is left at the front, 0 if the input buffer is empty.
+ */
+int Console::DrainInput()
+{
+    HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+    std::lock_guard<std::mutex> guard(inputLock);
+
+    INPUT_RECORD record;
+    DWORD count;
+    while (PeekConsoleInput(hStdin, &record, 1, &count) && count == 1)
+    {
+        if (record.EventType == KEY_EVENT && record.Event.KeyEvent.bKeyDown && record.Event.KeyEvent.uChar.AsciiChar)
+        {
+            return 1;
+        }
+        ReadConsoleInput(hStdin, &record, 1, &count);
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Waits until a key is typed or the timeout elapses.
+ *
+ * @param milliseconds The longest time to wait.
+ * @return Returns 1 if GetChar returns at once, 0 if it would still wait.
+ */
+int Console::WaitForKey(DWORD milliseconds)
+{
+    if (HasQueuedInput() || DrainInput())
+    {
+        return 1;
+    }
+
+    // Only records that are not key presses were removed; the next one to arrive ends the wait
+    if (WaitForSingleObject(GetStdHandle(STD_INPUT_HANDLE), milliseconds) != WAIT_OBJECT_0)
+    {
+        return 0;
+    }
+    return DrainInput();
+}
+
+
+/**
+ * @brief Reads the next key, taking queued keys first.
+ *
+ * @return The key read.
+ */
+int Console::GetChar()
+{
+    if (queuedRead < queuedInput.size())
+    {
+        return (unsigned char)queuedInput[queuedRead++];
+    }
+
+    std::lock_guard<std::mutex> guard(inputLock);
+    return getchar();
+}
+
+
+/**
+ * @brief Takes every key the guest has not read yet, queued or already typed, without waiting.
+ *
+ * @param keys Receives the keys, in the order they would have been read.
+ */
+void Console::TakeInput(std::string& keys)
+{
+    keys.assign(queuedInput, queuedRead, std::string::npos);
+    queuedInput.clear();
+    queuedRead = 0;
+
+    HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+    std::lock_guard<std::mutex> guard(inputLock);
+    while (WaitForSingleObject(hStdin, 0) == WAIT_OBJECT_0 && _kbhit())
+    {
+        int key = getchar();
+        if (key == EOF)
+        {
+            break;
+        }
+        keys.push_back((char)key);
+    }
+}
+
+
+/**
+ * @brief Returns the number of bytes the guest has output so far.
+ *
+ * @return The number of guest output bytes.
+ */
+uint64_t Console::GetGuestBytes() const
+{
+    return guestBytes;
+}
+
+
+/**
+ * @brief Writes the differences between the screen model and the terminal in one write.
+ */
+void Console::Render()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    lastRender = now.QuadPart;
+
+    if (!screenPtr->IsDirty())
+    {
+        return;
+    }
+
+    frame.clear();
+    screenPtr->Render(frame);
+    Emit(frame.data(), frame.size());
+
+    terminalBytes += frame.size();
+    ++frames;
+}
+
+
+/**
+ * @brief Writes a rendered frame to the terminal, through the writer thread when it is enabled.
+ *
+ * @param data The bytes to write.
+ * @param length The number of bytes.
+ */
+void Console::Emit(const char* data, size_t length)
+{
+    if (writerPtr)
+    {
+        writerPtr->Write(data, length);
+        writerPtr->Publish();
+        return;
+    }
+
+    fwrite(data, 1, length, stdout);
+    fflush(stdout);
+}
\ No newline at end of file
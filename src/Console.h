@@ -0,0 +1,82 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// With the screen model enabled, pending changes are rendered at least this often
+// while the guest keeps running without waiting for input.
+#define SCREEN_FRAME_MS 16
+
+// Largest number of instructions run between two looks at the screen model, so a frame is
+// due again well within SCREEN_FRAME_MS even while the guest computes without output.
+#define SCREEN_SLICE (1 << 18)
+
+
+#include <cstdint>
+#include <string>
+#include <Windows.h>
+
+
+class ScreenModel;
+class OutputWriter;
+
+
+class Console
+{
+private:
+    // Optional screen model; guest output goes straight to stdout while it is null.
+    ScreenModel* screenPtr = nullptr;
+    std::string frame;
+
+    // Optional writer thread; terminal bytes are written synchronously while it is null.
+    OutputWriter* writerPtr = nullptr;
+
+    LONGLONG frequency;
+    LONGLONG lastRender;
+
+    // Bytes produced by the guest and bytes actually written to the terminal.
+    uint64_t guestBytes;
+    uint64_t terminalBytes;
+    uint64_t frames;
+
+    // Keys carried over from another process, read before the keyboard.
+    std::string queuedInput;
+    size_t queuedRead;
+
+public:
+    Console();
+    ~Console();
+
+    void EnableScreen(int columns, int rows);
+    void EnableWriterThread(size_t ringSize);
+
+    void Put(char character);
+    void Write(const char* text);
+    void Flush();
+    void Tick();
+    void InputWait();
+    void Close();
+
+    void QueueInput(const char* data, size_t length);
+    int HasQueuedInput() const;
+    int KeyPending() const;
+    static int DrainInput();
+    int WaitForKey(DWORD milliseconds);
+    int GetChar();
+    void TakeInput(std::string& keys);
+
+    uint64_t GetGuestBytes() const;
+
+private:
+    void Render();
+    void Emit(const char* data, size_t length);
+};
+#endif
\ No newline at end of file
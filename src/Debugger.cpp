@@ -0,0 +1,447 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+#include "Debugger.h"
+
+
+// Operator spellings accepted in breakpoint conditions, longest first so "<=" is not read as "<".
+static const struct
+{
+    const char* text;
+    uint8_t op;
+} conditionOperators[] =
+{
+    { "==", ConditionOperators::COND_EQ },
+    { "!=", ConditionOperators::COND_NE },
+    { "<=", ConditionOperators::COND_LE },
+    { ">=", ConditionOperators::COND_GE },
+    { "<", ConditionOperators::COND_LT },
+    { ">", ConditionOperators::COND_GT }
+};
+
+
+/**
+ * @brief Constructs a Debugger with no breakpoints or watchpoints.
+ *
+ * @param cpu Pointer to the CPU object whose registers conditions are evaluated against.
+ */
+Debugger::Debugger(CPU* cpu)
+{
+    cpuPtr = cpu;
+
+    memset(breakpointMap, 0, sizeof(breakpointMap));
+    memset(watchPages, 0, sizeof(watchPages));
+
+    stopReason = StopReasons::STOP_NONE;
+    stopAddress = 0;
+    stopKind = 0;
+    stopValue = 0;
+    stepOver = 0;
+}
+
+
+/**
+ * @brief Parses a number written as xNNNN (LC-3 hexadecimal), 0xNNNN or decimal.
+ *
+ * @param text The text to parse.
+ * @param end Receives the first character after the number.
+ * @param value Receives the parsed value.
+ * @return Returns 1 if a number was parsed, 0 otherwise.
+ */
+int Debugger::ParseNumber(const char* text, const char** end, uint16_t* value)
+{
+    char* stop;
+    unsigned long parsed;
+
+    if (text[0] == 'x' || text[0] == 'X')
+    {
+        parsed = strtoul(text + 1, &stop, 16);
+        if (stop == text + 1)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        parsed = strtoul(text, &stop, 0);
+        if (stop == text)
+        {
+            return 0;
+        }
+    }
+
+    *end = stop;
+    *value = (uint16_t)parsed;
+    return parsed <= 0xFFFF;
+}
+
+
+/**
+ * @brief Adds a breakpoint from a command-line specification.
+ *
+ * The specification is ADDRESS[,REG OP VALUE][,hits=N], for example "x3005,R0==5,hits=3".
+ * REG is R0-R7 or PC, OP is one of == != < <= > >=, and hits=N stops from the N-th match on.
+ *
+ * @param spec The breakpoint specification.
+ * @return Returns 1 if the specification was valid, 0 otherwise.
+ */
+int Debugger::AddBreakpoint(const char* spec)
+{
+    Breakpoint breakpoint = {};
+    const char* p;
+
+    if (!ParseNumber(spec, &p, &breakpoint.address))
+    {
+        return 0;
+    }
+
+    while (*p == ',')
+    {
+        ++p;
+
+        if (strncmp(p, "hits=", 5) == 0)
+        {
+            uint16_t hits;
+            if (!ParseNumber(p + 5, &p, &hits) || hits == 0)
+            {
+                return 0;
+            }
+            breakpoint.ignore = hits - 1;
+            continue;
+        }
+
+        // Register operand
+        if ((p[0] == 'R' || p[0] == 'r') && p[1] >= '0' && p[1] <= '7')
+        {
+            breakpoint.reg = (uint8_t)(p[1] - '0');
+        }
+        else if ((p[0] == 'P' || p[0] == 'p') && (p[1] == 'C' || p[1] == 'c'))
+        {
+            breakpoint.reg = Registers::R_PC;
+        }
+        else
+        {
+            return 0;
+        }
+        p += 2;
+
+        // Comparison operator
+        breakpoint.op = ConditionOperators::COND_ALWAYS;
+        for (size_t i = 0; i < sizeof(conditionOperators) / sizeof(conditionOperators[0]); ++i)
+        {
+            size_t length = strlen(conditionOperators[i].text);
+            if (strncmp(p, conditionOperators[i].text, length) == 0)
+            {
+                breakpoint.op = conditionOperators[i].op;
+                p += length;
+                break;
+            }
+        }
+
+        if (breakpoint.op == ConditionOperators::COND_ALWAYS || !ParseNumber(p, &p, &breakpoint.value))
+        {
+            return 0;
+        }
+    }
+
+    if (*p != '\0')
+    {
+        return 0;
+    }
+
+    AddBreakpoint(breakpoint);
+    return 1;
+}
+
+
+/**
+ * @brief Adds a breakpoint and marks its address in the breakpoint map.
+ *
+ * @param breakpoint The breakpoint to add.
+ */
+void Debugger::AddBreakpoint(const Breakpoint& breakpoint)
+{
+    breakpoints.push_back(breakpoint);
+    breakpointMap[breakpoint.address >> 6] |= 1ULL << (breakpoint.address & 63);
+}
+
+
+/**
+ * @brief Removes every breakpoint at an address.
+ *
+ * @param address The address to clear.
+ */
+void Debugger::RemoveBreakpoints(uint16_t address)
+{
+    for (size_t i = breakpoints.size(); i-- > 0;)
+    {
+        if (breakpoints[i].address == address)
+        {
+            breakpoints.erase(breakpoints.begin() + i);
+        }
+    }
+
+    breakpointMap[address >> 6] &= ~(1ULL << (address & 63));
+}
+
+
+/**
+ * @brief Adds a watchpoint from a command-line specification.
+ *
+ * The specification is ADDRESS[+LENGTH][:r|w|rw]; without a kind only writes are watched.
+ *
+ * @param spec The watchpoint specification.
+ * @return Returns 1 if the specification was valid, 0 otherwise.
+ */
+int Debugger::AddWatchpoint(const char* spec)
+{
+    Watchpoint watchpoint = {};
+    const char* p;
+
+    if (!ParseNumber(spec, &p, &watchpoint.address))
+    {
+        return 0;
+    }
+
+    watchpoint.length = 1;
+    if (*p == '+' && (!ParseNumber(p + 1, &p, &watchpoint.length) || watchpoint.length == 0))
+    {
+        return 0;
+    }
+
+    watchpoint.kinds = WatchKinds::WATCH_WRITE;
+    if (*p == ':')
+    {
+        ++p;
+        watchpoint.kinds = 0;
+        while (*p == 'r' || *p == 'w')
+        {
+            watchpoint.kinds |= (*p++ == 'r') ? WatchKinds::WATCH_READ : WatchKinds::WATCH_WRITE;
+        }
+    }
+
+    if (*p != '\0' || watchpoint.kinds == 0)
+    {
+        return 0;
+    }
+
+    AddWatchpoint(watchpoint);
+    return 1;
+}
+
+
+/**
+ * @brief Adds a watchpoint and flags the pages it covers.
+ *
+ * @param watchpoint The watchpoint to add.
+ */
+void Debugger::AddWatchpoint(const Watchpoint& watchpoint)
+{
+    watchpoints.push_back(watchpoint);
+    RebuildWatchPages();
+}
+
+
+/**
+ * @brief Removes every watchpoint starting at an address.
+ *
+ * @param address The first watched address of the watchpoints to remove.
+ */
+void Debugger::RemoveWatchpoints(uint16_t address)
+{
+    for (size_t i = watchpoints.size(); i-- > 0;)
+    {
+        if (watchpoints[i].address == address)
+        {
+            watchpoints.erase(watchpoints.begin() + i);
+        }
+    }
+
+    RebuildWatchPages();
+}
+
+
+/**
+ * @brief Removes every breakpoint and watchpoint and forgets the last stop, so the engines run again.
+ */
+void Debugger::Clear()
+{
+    breakpoints.clear();
+    watchpoints.clear();
+    memset(breakpointMap, 0, sizeof(breakpointMap));
+    RebuildWatchPages();
+
+    stopReason = StopReasons::STOP_NONE;
+    stepOver = 0;
+}
+
+
+/**
+ * @brief Recomputes the page flags from the remaining watchpoints.
+ *
+ * A watchpoint covers the words its addresses select, so in a smaller memory its range wraps
+ * around the end like the addresses do.
+ */
+void Debugger::RebuildWatchPages()
+{
+    memset(watchPages, 0, sizeof(watchPages));
+
+    uint32_t words = (uint32_t)cpuPtr->addressMask + 1;
+    uint32_t pageMask = cpuPtr->addressMask >> WATCH_PAGE_SHIFT;
+
+    for (size_t i = 0; i < watchpoints.size(); ++i)
+    {
+        uint32_t first = watchpoints[i].address & cpuPtr->addressMask;
+        uint32_t last = first + (watchpoints[i].length < words ? watchpoints[i].length : words) - 1;
+
+        for (uint32_t page = first >> WATCH_PAGE_SHIFT; page <= (last >> WATCH_PAGE_SHIFT); ++page)
+        {
+            watchPages[page & pageMask] = 1;
+        }
+    }
+}
+
+
+/**
+ * @brief Tells whether any breakpoint or watchpoint is set, so the debug dispatch loop is needed.
+ *
+ * @return Returns 1 if the debugger has anything to check, 0 otherwise.
+ */
+int Debugger::IsActive() const
+{
+    return !breakpoints.empty() || !watchpoints.empty();
+}
+
+
+/**
+ * @brief Evaluates the breakpoints at an address whose bit is set in the breakpoint map.
+ *
+ * @param pc The address of the instruction about to execute.
+ * @return Returns 1 if execution must stop before the instruction, 0 otherwise.
+ */
+int Debugger::CheckBreakpoints(uint16_t pc)
+{
+    uint16_t* registers = cpuPtr->registers;
+    int stop = 0;
+
+    for (size_t i = 0; i < breakpoints.size(); ++i)
+    {
+        Breakpoint& breakpoint = breakpoints[i];
+        if (breakpoint.address != pc)
+        {
+            continue;
+        }
+
+        uint16_t operand = registers[breakpoint.reg];
+        int match;
+
+        switch (breakpoint.op)
+        {
+        case ConditionOperators::COND_EQ:
+            match = operand == breakpoint.value;
+            break;
+        case ConditionOperators::COND_NE:
+            match = operand != breakpoint.value;
+            break;
+        case ConditionOperators::COND_LT:
+            match = operand < breakpoint.value;
+            break;
+        case ConditionOperators::COND_LE:
+            match = operand <= breakpoint.value;
+            break;
+        case ConditionOperators::COND_GT:
+            match = operand > breakpoint.value;
+            break;
+        case ConditionOperators::COND_GE:
+            match = operand >= breakpoint.value;
+            break;
+        case ConditionOperators::COND_ALWAYS:
+        default:
+            match = 1;
+            break;
+        }
+
+        // Only matching hits count towards the ignore count, as in GDB
+        if (match && ++breakpoint.hits > breakpoint.ignore)
+        {
+            stop = 1;
+        }
+    }
+
+    if (stop)
+    {
+        stopReason = StopReasons::STOP_BREAKPOINT;
+        stopAddress = pc;
+    }
+
+    return stop;
+}
+
+
+/**
+ * @brief Slow path for accesses to a page holding a watchpoint.
+ *
+ * The access itself completes; the debug dispatch loop stops after the current instruction.
+ * Addresses are compared by the word they select, so an alias of a watched word hits too.
+ *
+ * @param address The accessed address.
+ * @param value The value read, or the value being written.
+ * @param kind WATCH_READ or WATCH_WRITE.
+ */
+void Debugger::OnAccess(uint16_t address, uint16_t value, uint8_t kind)
+{
+    for (size_t i = 0; i < watchpoints.size(); ++i)
+    {
+        const Watchpoint& watchpoint = watchpoints[i];
+
+        if ((watchpoint.kinds & kind) && ((address - watchpoint.address) & cpuPtr->addressMask) < watchpoint.length)
+        {
+            stopReason = StopReasons::STOP_WATCHPOINT;
+            stopAddress = address;
+            stopKind = kind;
+            stopValue = value;
+            return;
+        }
+    }
+}
+
+
+/**
+ * @brief Prints where and why execution stopped, with the registers, to stderr.
+ */
+void Debugger::ReportStop() const
+{
+    uint16_t* registers = cpuPtr->registers;
+
+    if (stopReason == StopReasons::STOP_BREAKPOINT)
+    {
+        fprintf(stderr, "break: x%04X, instruction x%04X\n", stopAddress, cpuPtr->Word(stopAddress));
+    }
+    else if (stopReason == StopReasons::STOP_WATCHPOINT)
+    {
+        uint16_t pc = registers[Registers::R_PC] - 1;
+        fprintf(stderr, "watch: %s x%04X value x%04X, by instruction x%04X at x%04X\n",
+            stopKind == WatchKinds::WATCH_READ ? "read" : "write", stopAddress, stopValue, cpuPtr->Word(pc), pc);
+    }
+    else
+    {
+        return;
+    }
+
+    fprintf(stderr, "       R0 x%04X R1 x%04X R2 x%04X R3 x%04X R4 x%04X R5 x%04X R6 x%04X R7 x%04X PC x%04X\n",
+        registers[Registers::R_0], registers[Registers::R_1], registers[Registers::R_2], registers[Registers::R_3],
+        registers[Registers::R_4], registers[Registers::R_5], registers[Registers::R_6], registers[Registers::R_7],
+        registers[Registers::R_PC]);
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+// Watchpoints are tracked per page of 2^WATCH_PAGE_SHIFT words; accesses to other pages skip them entirely.
+#define WATCH_PAGE_SHIFT 8
+#define WATCH_PAGES (MEMORY_MAX >> WATCH_PAGE_SHIFT)
+
+
+#include <cstdint>
+#include <vector>
+
+#include "CPU.h"
+
+
+enum ConditionOperators : uint8_t
+{
+    COND_ALWAYS = 0, // unconditional breakpoint
+    COND_EQ,         // register == value
+    COND_NE,         // register != value
+    COND_LT,         // register <  value
+    COND_LE,         // register <= value
+    COND_GT,         // register >  value
+    COND_GE          // register >= value
+};
+
+
+enum WatchKinds : uint8_t
+{
+    WATCH_READ = (1 << 0),
+    WATCH_WRITE = (1 << 1)
+};
+
+
+enum StopReasons : uint16_t
+{
+    STOP_NONE = 0,   // running
+    STOP_BREAKPOINT, // a breakpoint and its condition matched before the instruction at stopAddress
+    STOP_WATCHPOINT  // the last instruction accessed the watched word at stopAddress
+};
+
+
+struct Breakpoint
+{
+    uint16_t address;
+    uint8_t reg;      // Registers index, R_0-R_7 or R_PC
+    uint8_t op;       // ConditionOperators, compared as unsigned 16-bit values
+    uint16_t value;
+    uint64_t ignore;  // matches to let pass before stopping
+    uint64_t hits;    // matches so far
+};
+
+
+struct Watchpoint
+{
+    uint16_t address;
+    uint16_t length;
+    uint8_t kinds;    // WatchKinds
+};
+
+
+class Debugger
+{
+public:
+    // One bit per address holding at least one breakpoint, tested by the debug dispatch loop.
+    uint64_t breakpointMap[MEMORY_MAX / 64];
+
+    // Nonzero for every page holding at least one watchpoint, indexed by the word an address selects; tested by MemoryIO.
+    uint8_t watchPages[WATCH_PAGES];
+
+    // Why the debug dispatch loop last returned, and where.
+    uint16_t stopReason;
+    uint16_t stopAddress;
+    uint8_t stopKind;
+    uint16_t stopValue;
+
+    // Set to resume past a breakpoint at the current PC, as debuggers expect after a stop.
+    int stepOver;
+
+private:
+    std::vector<Breakpoint> breakpoints;
+    std::vector<Watchpoint> watchpoints;
+
+    CPU* cpuPtr;
+
+public:
+    Debugger(CPU* cpu);
+
+    int AddBreakpoint(const char* spec);
+    void AddBreakpoint(const Breakpoint& breakpoint);
+    void RemoveBreakpoints(uint16_t address);
+
+    int AddWatchpoint(const char* spec);
+    void AddWatchpoint(const Watchpoint& watchpoint);
+    void RemoveWatchpoints(uint16_t address);
+
+    void Clear();
+
+    int IsActive() const;
+
+    int CheckBreakpoints(uint16_t pc);
+    void OnAccess(uint16_t address, uint16_t value, uint8_t kind);
+
+    void ReportStop() const;
+
+private:
+    void RebuildWatchPages();
+    static int ParseNumber(const char* text, const char** end, uint16_t* value);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,239 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <emmintrin.h>
+
+
+#include "DecodeCache.h"
+#include "MemoryIO.h"
+#include "CPU.h"
+
+
+// Predecode packs eight entries into five 16-byte vectors.
+static_assert(sizeof(DecodedInstruction) == 10 &&
+    offsetof(DecodedInstruction, offset) == 2 && offsetof(DecodedInstruction, operation) == 4 &&
+    offsetof(DecodedInstruction, DR) == 5 && offsetof(DecodedInstruction, SR1) == 6 &&
+    offsetof(DecodedInstruction, SR2) == 7 && offsetof(DecodedInstruction, flag) == 8,
+    "Predecode assumes the layout of DecodedInstruction");
+
+
+// Per-opcode value Predecode looks up: the offset sign bit, and bit 15 if the flag is the long flag.
+#define PREDECODE_LOOKUP(FORMAT, BITS) \
+    (((1 << BITS) >> 1) | (IsaFormats::ISA_FORMAT_##FORMAT == IsaFormats::ISA_FORMAT_SUBROUTINE ? 0x8000 : 0))
+
+// Sets the lookup value of the lanes holding an opcode; rows without one compile to nothing.
+#define PREDECODE_MERGE(NAME, KIND, FORMAT, BITS) \
+    if (PREDECODE_LOOKUP(FORMAT, BITS)) \
+    { \
+        lookup = _mm_or_si128(lookup, _mm_and_si128(_mm_cmpeq_epi16(operation, _mm_set1_epi16(OP_##NAME)), \
+            _mm_set1_epi16((short)PREDECODE_LOOKUP(FORMAT, BITS)))); \
+    }
+
+
+/**
+ * @brief Constructs a DecodeCache covering the whole address space.
+ *
+ * All entries start out invalid, so each address is decoded on its first execution. The three
+ * tables share one allocation, on the given NUMA node, handlers first for their alignment.
+ *
+ * @param alu Pointer to the ArithmeticLogicUnit object used to decode instructions.
+ * @param node The NUMA node to allocate the tables on, or NUMA_NO_PREFERRED_NODE.
+ */
+DecodeCache::DecodeCache(ArithmeticLogicUnit* alu, DWORD node)
+{
+    aluPtr = alu;
+
+    size_t bytes = MEMORY_MAX * (sizeof(DecodedHandler) + sizeof(DecodedInstruction) + sizeof(uint8_t));
+    uint8_t* tables = (uint8_t*)VirtualAllocExNuma(GetCurrentProcess(), NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+    if (!tables)
+    {
+        fprintf(stderr, "could not allocate the decode tables\n");
+        exit(1);
+    }
+    handlers = (DecodedHandler*)tables;
+    entries = (DecodedInstruction*)(tables + MEMORY_MAX * sizeof(DecodedHandler));
+    valid = tables + MEMORY_MAX * (sizeof(DecodedHandler) + sizeof(DecodedInstruction));
+
+    Clear();
+}
+
+
+/**
+ * @brief Destroys the DecodeCache object and releases its tables.
+ */
+DecodeCache::~DecodeCache()
+{
+    VirtualFree(handlers, 0, MEM_RELEASE);
+}
+
+
+/**
+ * @brief Takes over the address layout of a CPU, after CPU::ConfigureMemory.
+ *
+ * @param cpu Pointer to the CPU object owning the memory.
+ */
+void DecodeCache::AttachMemory(const CPU* cpu)
+{
+    addressMask = cpu->addressMask;
+    faultMask = cpu->faultMask;
+    aliasStride = cpu->memoryWords;
+    absentPagesPtr = cpu->absentPages;
+}
+
+
+/**
+ * @brief Decodes the instruction at the given address and stores it in the cache.
+ *
+ * The memory-mapped device registers are never marked valid, so fetching from them
+ * keeps going through MemoryIO::Read and its side effects; neither are addresses that fault,
+ * so fetching from them faults every time.
+ *
+ * @param address The address the instruction was fetched from.
+ * @param instruction The 16-bit instruction stored at that address.
+ * @param handler The threaded engine handler for the instruction's opcode.
+ */
+void DecodeCache::Fill(uint16_t address, uint16_t instruction, DecodedHandler handler)
+{
+    entries[address] = aluPtr->Decode(instruction);
+    handlers[address] = handler;
+    valid[address] = (address < MemoryMappedRegisters::MR_KBSR) && !(address & faultMask);
+}
+
+
+/**
+ * @brief Decodes every word of memory at once, as ArithmeticLogicUnit::Decode would.
+ *
+ * The fields of eight words are extracted side by side in SSE2 registers. The offset sign bit and
+ * the flag bit of each word's opcode are looked up by comparing the opcode against the rows of
+ * LC3_ISA that have them, unrolled at compile time. The fields are then transposed into the 80 bytes of eight
+ * DecodedInstruction entries and written with five 16-byte stores. Every address below the
+ * device registers becomes valid, so the engines never decode lazily until the guest writes code,
+ * except in pages of images still to be loaded on demand.
+ *
+ * @param memory The guest memory, laid out as given to AttachMemory.
+ * @param opcodeHandlers The threaded engine handler of every opcode.
+ */
+void DecodeCache::Predecode(const uint16_t* memory, const DecodedHandler* opcodeHandlers)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i seven = _mm_set1_epi16(7);
+    const __m128i signBits = _mm_set1_epi16(0x7FFF);
+    __m128i* out = (__m128i*)entries;
+
+    for (uint32_t address = 0; address < MEMORY_MAX; address += 8, out += 5)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i*)(memory + (address & addressMask)));
+        __m128i operation = _mm_srli_epi16(words, 12);
+
+        __m128i lookup = zero;
+        LC3_ISA(PREDECODE_MERGE)
+
+        // Same arithmetic as IsaOffset, with the width of each lane's opcode; 0 without an offset
+        __m128i sign = _mm_and_si128(lookup, signBits);
+        __m128i mask = _mm_sub_epi16(_mm_add_epi16(sign, sign), one);
+        __m128i offset = _mm_andnot_si128(_mm_cmpeq_epi16(sign, zero),
+            _mm_sub_epi16(_mm_xor_si128(_mm_and_si128(words, mask), sign), sign));
+
+        __m128i isLong = _mm_srai_epi16(lookup, 15);
+        __m128i flag = _mm_and_si128(_mm_or_si128(
+            _mm_and_si128(isLong, _mm_srli_epi16(words, 11)),
+            _mm_andnot_si128(isLong, _mm_srli_epi16(words, 5))), one);
+
+        // Byte pairs of an entry: operation and DR, SR1 and SR2
+        __m128i operationDR = _mm_or_si128(operation, _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(words, 9), seven), 8));
+        __m128i sources = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(words, 6), seven), _mm_slli_epi16(_mm_and_si128(words, seven), 8));
+
+        // Bytes 0-7 of each entry, two entries per register
+        __m128i fields = _mm_unpacklo_epi16(words, offset);
+        __m128i registers = _mm_unpacklo_epi16(operationDR, sources);
+        __m128i pair01 = _mm_unpacklo_epi32(fields, registers);
+        __m128i pair23 = _mm_unpackhi_epi32(fields, registers);
+        fields = _mm_unpackhi_epi16(words, offset);
+        registers = _mm_unpackhi_epi16(operationDR, sources);
+        __m128i pair45 = _mm_unpacklo_epi32(fields, registers);
+        __m128i pair67 = _mm_unpackhi_epi32(fields, registers);
+
+        // Bytes 8-9: the flag, alone in a 64-bit lane per entry
+        __m128i flags03 = _mm_unpacklo_epi16(flag, zero);
+        __m128i flags47 = _mm_unpackhi_epi16(flag, zero);
+        __m128i flags01 = _mm_unpacklo_epi32(flags03, zero);
+        __m128i flags23 = _mm_unpackhi_epi32(flags03, zero);
+        __m128i flags45 = _mm_unpacklo_epi32(flags47, zero);
+        __m128i flags67 = _mm_unpackhi_epi32(flags47, zero);
+
+        // One entry per register, zero past byte 9
+        __m128i entry0 = _mm_unpacklo_epi64(pair01, flags01);
+        __m128i entry1 = _mm_unpackhi_epi64(pair01, flags01);
+        __m128i entry2 = _mm_unpacklo_epi64(pair23, flags23);
+        __m128i entry3 = _mm_unpackhi_epi64(pair23, flags23);
+        __m128i entry4 = _mm_unpacklo_epi64(pair45, flags45);
+        __m128i entry5 = _mm_unpackhi_epi64(pair45, flags45);
+        __m128i entry6 = _mm_unpacklo_epi64(pair67, flags67);
+        __m128i entry7 = _mm_unpackhi_epi64(pair67, flags67);
+
+        // Eight 10-byte entries fill exactly five registers
+        _mm_storeu_si128(out + 0, _mm_or_si128(entry0, _mm_slli_si128(entry1, 10)));
+        _mm_storeu_si128(out + 1, _mm_or_si128(_mm_or_si128(_mm_srli_si128(entry1, 6), _mm_slli_si128(entry2, 4)), _mm_slli_si128(entry3, 14)));
+        _mm_storeu_si128(out + 2, _mm_or_si128(_mm_srli_si128(entry3, 2), _mm_slli_si128(entry4, 8)));
+        _mm_storeu_si128(out + 3, _mm_or_si128(_mm_or_si128(_mm_srli_si128(entry4, 8), _mm_slli_si128(entry5, 2)), _mm_slli_si128(entry6, 12)));
+        _mm_storeu_si128(out + 4, _mm_or_si128(_mm_srli_si128(entry6, 4), _mm_slli_si128(entry7, 6)));
+    }
+
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        handlers[address] = opcodeHandlers[memory[address & addressMask] >> 12];
+    }
+
+    // The device registers keep going through MemoryIO::Read, as in Fill, and so do addresses that fault
+    uint32_t validEnd = faultMask ? aliasStride : (uint32_t)MemoryMappedRegisters::MR_KBSR;
+    memset(valid, 1, validEnd);
+    memset(valid + validEnd, 0, MEMORY_MAX - validEnd);
+
+    // Pages of images loaded on demand were decoded as zeros; their first fetch brings them in
+    if (absentPagesPtr)
+    {
+        for (uint32_t address = 0; address < MEMORY_MAX; address += IMAGE_PAGE_WORDS)
+        {
+            if (absentPagesPtr[(address & addressMask) >> IMAGE_PAGE_SHIFT])
+            {
+                memset(valid + address, 0, IMAGE_PAGE_WORDS);
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Drops the cached decoding of an address after it has been written.
+ *
+ * @param address The address that was written.
+ */
+void DecodeCache::Invalidate(uint16_t address)
+{
+    // Every address of the written word, which is just the one unless the memory is smaller
+    for (uint32_t alias = address & addressMask; alias < MEMORY_MAX; alias += aliasStride)
+    {
+        valid[alias] = 0;
+    }
+}
+
+
+/**
+ * @brief Drops the cached decoding of every address.
+ */
+void DecodeCache::Clear()
+{
+    memset(valid, 0, MEMORY_MAX);
+}
\ No newline at end of file
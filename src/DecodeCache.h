@@ -0,0 +1,63 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+
+#include <cstdint>
+
+#include "ArithmeticLogicUnit.h"
+#include "CPU.h"
+
+
+class Trap;
+class CPU;
+
+
+// Handler used by the threaded engine, stored per address next to the decoded instruction.
+typedef void (*DecodedHandler)(ArithmeticLogicUnit* alu, Trap* trap, const DecodedInstruction& decoded);
+
+
+class DecodeCache
+{
+public:
+    // Decoded instruction for every memory address, valid only while "valid" is set.
+    DecodedInstruction* entries;
+
+    // Threaded engine handler for every memory address, filled together with "entries".
+    DecodedHandler* handlers;
+
+    // One byte per address, cleared whenever the address is written.
+    uint8_t* valid;
+
+private:
+    ArithmeticLogicUnit* aluPtr;
+
+    // Memory layout of the CPU; entries stay indexed by address, so every address aliasing a
+    // word of a smaller memory has its own entry.
+    uint16_t addressMask = 0xFFFF;
+    uint16_t faultMask = 0;
+    uint32_t aliasStride = MEMORY_MAX;
+
+    // Pages of images not loaded yet, never valid; null when images are loaded eagerly.
+    const uint8_t* absentPagesPtr = nullptr;
+
+public:
+    DecodeCache(ArithmeticLogicUnit* alu, DWORD node = NUMA_NO_PREFERRED_NODE);
+    ~DecodeCache();
+
+    void AttachMemory(const CPU* cpu);
+    void Fill(uint16_t address, uint16_t instruction, DecodedHandler handler);
+    void Predecode(const uint16_t* memory, const DecodedHandler* opcodeHandlers);
+    void Invalidate(uint16_t address);
+    void Clear();
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,148 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+
+
+#include "DensityBenchmark.h"
+#include "Console.h"
+
+
+// Memory sizes compared, in words.
+static const uint32_t densitySizes[] = { 1 << 12, 1 << 14, 1 << 16 };
+
+
+/**
+ * @brief Constructs a guest with a memory of the given size.
+ *
+ * @param words The memory size in words.
+ * @param mode What addresses past the end of the memory refer to, as a value of MemoryModes.
+ * @param os Pointer to the OS object shared by all guests.
+ * @param console Pointer to the Console object shared by all guests.
+ */
+DensityGuest::DensityGuest(uint32_t words, uint16_t mode, OS* os, Console* console)
+    : cpu(words, mode),
+      memoryIO(&cpu, os, console),
+      alu(cpu.memory, cpu.registers, &memoryIO, &cpu),
+      trap(cpu.registers, &cpu, console),
+      loop(&cpu, &memoryIO, &alu, &trap)
+{
+}
+
+
+/**
+ * @brief Constructs a DensityBenchmark whose guests share the given OS and console.
+ *
+ * @param os Pointer to the OS object.
+ * @param console Pointer to the Console object receiving guest output.
+ */
+DensityBenchmark::DensityBenchmark(OS* os, Console* console)
+{
+    osPtr = os;
+    consolePtr = console;
+}
+
+
+/**
+ * @brief Runs the guests round-robin, DENSITY_SLICE instructions per turn, until DENSITY_INSTRUCTIONS
+ *        have run or every guest has halted.
+ *
+ * @param guests The guests.
+ * @param count The number of guests.
+ * @param retired Receives the number of instructions run.
+ * @return The elapsed time in seconds.
+ */
+double DensityBenchmark::Measure(DensityGuest** guests, int count, uint64_t* retired)
+{
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    uint64_t total = 0;
+    int running = count;
+
+    while (total < DENSITY_INSTRUCTIONS && running > 0)
+    {
+        running = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            if (guests[i]->cpu.running)
+            {
+                total += guests[i]->loop.Run(DENSITY_SLICE);
+                ++running;
+            }
+        }
+    }
+
+    QueryPerformanceCounter(&end);
+    *retired = total;
+    return (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+}
+
+
+/**
+ * @brief Loads the image files into DENSITY_GUESTS guests for each memory size and compares them.
+ *
+ * The guests of one size are all resident together, so the footprint reported is what that many
+ * guests cost a host, and the throughput shows how well their memories share the caches. The
+ * images should keep running for the whole measurement; a guest that halts drops out.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments; those not starting with "--" are image files.
+ * @param mode What addresses past the end of a smaller memory refer to, as a value of MemoryModes.
+ * @return The exit code: 0 on success, 1 if an image cannot be loaded at any size.
+ */
+int DensityBenchmark::Run(int argc, const char* argv[], uint16_t mode)
+{
+    int measured = 0;
+
+    for (size_t size = 0; size < sizeof(densitySizes) / sizeof(densitySizes[0]); ++size)
+    {
+        uint32_t words = densitySizes[size];
+        DensityGuest** guests = new DensityGuest*[DENSITY_GUESTS];
+        int loaded = 1;
+
+        for (int i = 0; i < DENSITY_GUESTS; ++i)
+        {
+            guests[i] = new DensityGuest(words, mode, osPtr, consolePtr);
+
+            for (int j = 1; j < argc && loaded; ++j)
+            {
+                if (strncmp(argv[j], "--", 2) != 0 && !guests[i]->cpu.ReadImage(argv[j], &guests[i]->alu))
+                {
+                    fprintf(stderr, "density: %s does not fit in %u words\n", argv[j], words);
+                    loaded = 0;
+                }
+            }
+        }
+
+        if (loaded)
+        {
+            uint64_t retired;
+            double seconds = Measure(guests, DENSITY_GUESTS, &retired);
+            double bytes = (double)sizeof(DensityGuest) + words * sizeof(uint16_t);
+
+            consolePtr->Flush();
+            fprintf(stderr, "density: %2uK words, %d guests, %6.1f KB each, %6.1f MB in all, %8.2f MIPS\n",
+                words >> 10, DENSITY_GUESTS, bytes / 1024, bytes * DENSITY_GUESTS / (1024 * 1024),
+                seconds > 0 ? retired / seconds / 1e6 : 0);
+            ++measured;
+        }
+
+        for (int i = 0; i < DENSITY_GUESTS; ++i)
+        {
+            delete guests[i];
+        }
+        delete[] guests;
+    }
+
+    return measured ? 0 : 1;
+}
\ No newline at end of file
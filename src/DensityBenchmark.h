@@ -0,0 +1,65 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef DENSITY_BENCHMARK_H
+#define DENSITY_BENCHMARK_H
+
+// Guests created for each memory size.
+#define DENSITY_GUESTS 512
+
+// Instructions a guest runs per turn; short, so guests keep evicting each other as on a busy host.
+#define DENSITY_SLICE 1024
+
+// Instructions run in total for each memory size.
+#define DENSITY_INSTRUCTIONS (1 << 27)
+
+
+#include <cstdint>
+
+#include "CPU.h"
+#include "MemoryIO.h"
+#include "ArithmeticLogicUnit.h"
+#include "Trap.h"
+#include "BasicVirtualMachine.h"
+
+
+class OS;
+class Console;
+
+
+// One guest of the density benchmark: a machine with its own memory, run by the switch loop.
+struct DensityGuest
+{
+    CPU cpu;
+    MemoryIO memoryIO;
+    ArithmeticLogicUnit alu;
+    Trap trap;
+    BasicVirtualMachine<> loop;
+
+    DensityGuest(uint32_t words, uint16_t mode, OS* os, Console* console);
+};
+
+
+// Runs many guests round-robin at several memory sizes and reports their footprint and throughput.
+class DensityBenchmark
+{
+private:
+    OS* osPtr;
+    Console* consolePtr;
+
+public:
+    DensityBenchmark(OS* os, Console* console);
+
+    int Run(int argc, const char* argv[], uint16_t mode);
+
+private:
+    double Measure(DensityGuest** guests, int count, uint64_t* retired);
+};
+#endif
\ No newline at end of file
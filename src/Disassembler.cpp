@@ -0,0 +1,436 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstring>
+
+
+#include "Disassembler.h"
+#include "Isa.h"
+
+
+// Service routine names printed instead of TRAP for vectors x20 to x28.
+static const char* const trapNames[] = { "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT", "YIELD", "SLEEP", "WAIT" };
+
+// Digits of the address and encoding columns.
+static const char hexDigits[] = "0123456789ABCDEF";
+
+
+/**
+ * @brief Constructs a Disassembler writing its listings to a stream.
+ *
+ * @param output The stream receiving the listing.
+ * @param symbols Names shown for labelled addresses and operands, or nullptr.
+ */
+Disassembler::Disassembler(FILE* output, const SymbolTable* symbols)
+    : outputFile(output), symbolsPtr(symbols)
+{
+    buffer = new char[LISTING_BUFFER_SIZE];
+}
+
+
+/**
+ * @brief Destroys the Disassembler object, writing the rest of the listing.
+ */
+Disassembler::~Disassembler()
+{
+    Flush();
+    delete[] cache;
+    delete[] buffer;
+}
+
+
+/**
+ * @brief Writes the collected listing to the output stream.
+ */
+void Disassembler::Flush()
+{
+    fwrite(buffer, 1, used, outputFile);
+    used = 0;
+}
+
+
+/**
+ * @brief Writes the rest of the listing and checks that all of it reached the output.
+ *
+ * @return 1 if the listing was written, 0 on a write error.
+ */
+int Disassembler::Finish()
+{
+    Flush();
+    return fflush(outputFile) == 0 && !ferror(outputFile);
+}
+
+
+/**
+ * @brief Formats the listing line of one instruction, such as "x3000 x1021  ADD R0, R0, #1".
+ *
+ * A labelled address gets a "LABEL:" line first.
+ *
+ * @param address The address of the instruction.
+ * @param instruction The 16-bit instruction.
+ * @param line Receives the text, without a terminating null; must hold LISTING_LINE_MAX characters.
+ * @return The length of the text.
+ */
+size_t Disassembler::FormatLine(uint16_t address, uint16_t instruction, char* line) const
+{
+    char* out = line;
+
+    const char* label = symbolsPtr ? symbolsPtr->Find(address) : nullptr;
+    if (label)
+    {
+        out = AppendText(out, label);
+        *out++ = ':';
+        *out++ = '\n';
+    }
+
+    out[0] = 'x';
+    out[5] = ' ';
+    out[6] = 'x';
+    out[11] = ' ';
+    out[12] = ' ';
+    for (int i = 0; i < 4; ++i)
+    {
+        out[4 - i] = hexDigits[(address >> (4 * i)) & 0xF];
+        out[10 - i] = hexDigits[(instruction >> (4 * i)) & 0xF];
+    }
+    out += 13;
+
+    out += Format(address, instruction, out, symbolsPtr);
+    *out++ = '\n';
+    return (size_t)(out - line);
+}
+
+
+/**
+ * @brief Lists every word of an image file as an instruction, starting at its origin.
+ *
+ * @param imagePath The path of the image file.
+ * @return 1 if the image was read, 0 if it could not be opened.
+ */
+int Disassembler::ListImage(const char* imagePath)
+{
+    FILE* file = fopen(imagePath, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    // Images are at most the 64K-word memory plus the origin, so one read takes all of it
+    static uint8_t image[2 * (1 << 16) + 2];
+    size_t size = fread(image, 1, sizeof(image), file);
+    fclose(file);
+
+    if (size < 2)
+    {
+        return 1;
+    }
+
+    uint16_t address = (uint16_t)((image[0] << 8) | image[1]);
+    for (size_t i = 2; i + 1 < size; i += 2, ++address)
+    {
+        if (used + LISTING_LINE_MAX > LISTING_BUFFER_SIZE)
+        {
+            Flush();
+        }
+        used += FormatLine(address, (uint16_t)((image[i] << 8) | image[i + 1]), buffer + used);
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Lists a binary trace of retired instructions, as written by --trace-file.
+ *
+ * Traces revisit the same instructions over and over, so the line of the instruction last seen at
+ * each address is kept and copied while the encoding there stays the same; only new or modified
+ * code is formatted. Together with the large reads and writes this keeps the listing as fast as
+ * the disk.
+ *
+ * @param tracePath The path of the trace file.
+ * @return 1 if the trace was read, 0 if it could not be opened or ends with a partial record.
+ */
+int Disassembler::ListTrace(const char* tracePath)
+{
+    FILE* file = fopen(tracePath, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    if (!cache)
+    {
+        cache = new CachedLine[1 << 16];
+        for (int i = 0; i < (1 << 16); ++i)
+        {
+            cache[i].tag = 0;
+        }
+    }
+
+    uint8_t* records = new uint8_t[TRACE_READ_SIZE];
+    size_t size;
+    size_t partial = 0;
+
+    while ((size = fread(records + partial, 1, TRACE_READ_SIZE - partial, file) + partial) >= TRACE_RECORD_SIZE)
+    {
+        size_t end = size - size % TRACE_RECORD_SIZE;
+        for (size_t i = 0; i < end; i += TRACE_RECORD_SIZE)
+        {
+            uint16_t address = (uint16_t)((records[i] << 8) | records[i + 1]);
+            uint32_t tag = 0x10000 | (uint32_t)(records[i + 2] << 8) | records[i + 3];
+
+            CachedLine& line = cache[address];
+            if (line.tag != tag)
+            {
+                line.length = (uint32_t)FormatLine(address, (uint16_t)tag, line.text);
+                line.tag = tag;
+            }
+
+            if (used + LISTING_LINE_MAX > LISTING_BUFFER_SIZE)
+            {
+                Flush();
+            }
+            memcpy(buffer + used, line.text, line.length);
+            used += line.length;
+        }
+
+        // Keep a record split across two reads for the next one
+        partial = size - end;
+        memmove(records, records + end, partial);
+        if (feof(file))
+        {
+            break;
+        }
+    }
+
+    delete[] records;
+    fclose(file);
+    return size % TRACE_RECORD_SIZE == 0;
+}
+
+
+/**
+ * @brief Copies a null-terminated string.
+ *
+ * @return The position after the copied text.
+ */
+char* Disassembler::AppendText(char* out, const char* text)
+{
+    while (*text)
+    {
+        *out++ = *text++;
+    }
+    return out;
+}
+
+
+/**
+ * @brief Writes the target of a PC-relative instruction: its symbol if it has one, else its address.
+ *
+ * @return The position after the operand.
+ */
+char* Disassembler::AppendTarget(char* out, uint16_t target, const SymbolTable* symbols)
+{
+    const char* name = symbols ? symbols->Find(target) : nullptr;
+    return name ? AppendText(out, name) : AppendHex(out, target, 4);
+}
+
+
+/**
+ * @brief Writes a register operand such as "R3".
+ *
+ * @return The position after the operand.
+ */
+char* Disassembler::AppendRegister(char* out, uint16_t reg)
+{
+    *out++ = 'R';
+    *out++ = (char)('0' + reg);
+    return out;
+}
+
+
+/**
+ * @brief Writes a hexadecimal operand in LC-3 assembler notation, such as "x3000".
+ *
+ * @return The position after the operand.
+ */
+char* Disassembler::AppendHex(char* out, uint16_t value, int digits)
+{
+    *out++ = 'x';
+    for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+    {
+        *out++ = hexDigits[(value >> shift) & 0xF];
+    }
+    return out;
+}
+
+
+/**
+ * @brief Writes a sign-extended immediate in decimal, such as "#-3".
+ *
+ * @return The position after the operand.
+ */
+char* Disassembler::AppendImmediate(char* out, uint16_t value)
+{
+    int number = (int16_t)value;
+
+    *out++ = '#';
+    if (number < 0)
+    {
+        *out++ = '-';
+        number = -number;
+    }
+
+    char digits[8];
+    int count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + number % 10);
+        number /= 10;
+    } while (number);
+
+    while (count)
+    {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+
+/**
+ * @brief Writes the assembly text of one instruction.
+ *
+ * The operand layout comes from the format of the opcode's row of LC3_ISA and the fields are
+ * extracted with the same helpers as ArithmeticLogicUnit, so the text always matches what the
+ * interpreter executes. PC-relative operands are shown as absolute addresses, or by name when the
+ * symbol table has one.
+ *
+ * @param address The address of the instruction, used to resolve PC-relative operands.
+ * @param instruction The 16-bit instruction.
+ * @param text Receives the null-terminated text; must hold DISASSEMBLY_MAX characters.
+ * @param symbols Names of the operand addresses, or nullptr.
+ * @return The length of the text.
+ */
+size_t Disassembler::Format(uint16_t address, uint16_t instruction, char* text, const SymbolTable* symbols)
+{
+    const IsaEntry& entry = isaTable[instruction >> 12];
+    uint16_t next = (uint16_t)(address + 1);
+    char* out = text;
+
+    switch (entry.format)
+    {
+    case IsaFormats::ISA_FORMAT_BRANCH:
+    {
+        uint16_t flags = IsaDR(instruction);
+        if (flags == 0)
+        {
+            out = AppendText(out, "NOP");
+            break;
+        }
+        out = AppendText(out, entry.mnemonic);
+        out = AppendText(out, (flags & 4) ? "n" : "");
+        out = AppendText(out, (flags & 2) ? "z" : "");
+        out = AppendText(out, (flags & 1) ? "p" : "");
+        *out++ = ' ';
+        out = AppendTarget(out, (uint16_t)(next + IsaOffset(instruction, entry.offsetBits)), symbols);
+        break;
+    }
+
+    case IsaFormats::ISA_FORMAT_OPERATE:
+        out = AppendText(out, entry.mnemonic);
+        *out++ = ' ';
+        out = AppendRegister(out, IsaDR(instruction));
+        out = AppendText(out, ", ");
+        out = AppendRegister(out, IsaSR1(instruction));
+        out = AppendText(out, ", ");
+        out = IsaImmediateFlag(instruction)
+            ? AppendImmediate(out, IsaOffset(instruction, entry.offsetBits))
+            : AppendRegister(out, IsaSR2(instruction));
+        break;
+
+    case IsaFormats::ISA_FORMAT_PC_OFFSET:
+        out = AppendText(out, entry.mnemonic);
+        *out++ = ' ';
+        out = AppendRegister(out, IsaDR(instruction));
+        out = AppendText(out, ", ");
+        out = AppendTarget(out, (uint16_t)(next + IsaOffset(instruction, entry.offsetBits)), symbols);
+        break;
+
+    case IsaFormats::ISA_FORMAT_BASE_OFFSET:
+        out = AppendText(out, entry.mnemonic);
+        *out++ = ' ';
+        out = AppendRegister(out, IsaDR(instruction));
+        out = AppendText(out, ", ");
+        out = AppendRegister(out, IsaSR1(instruction));
+        out = AppendText(out, ", ");
+        out = AppendImmediate(out, IsaOffset(instruction, entry.offsetBits));
+        break;
+
+    case IsaFormats::ISA_FORMAT_SUBROUTINE:
+        if (IsaLongFlag(instruction))
+        {
+            out = AppendText(out, entry.mnemonic);
+            *out++ = ' ';
+            out = AppendTarget(out, (uint16_t)(next + IsaOffset(instruction, entry.offsetBits)), symbols);
+        }
+        else
+        {
+            out = AppendText(out, entry.mnemonic);
+            out = AppendText(out, "R ");
+            out = AppendRegister(out, IsaSR1(instruction));
+        }
+        break;
+
+    case IsaFormats::ISA_FORMAT_NOT:
+        out = AppendText(out, entry.mnemonic);
+        *out++ = ' ';
+        out = AppendRegister(out, IsaDR(instruction));
+        out = AppendText(out, ", ");
+        out = AppendRegister(out, IsaSR1(instruction));
+        break;
+
+    case IsaFormats::ISA_FORMAT_JUMP:
+        if (IsaSR1(instruction) == 7)
+        {
+            out = AppendText(out, "RET");
+            break;
+        }
+        out = AppendText(out, entry.mnemonic);
+        *out++ = ' ';
+        out = AppendRegister(out, IsaSR1(instruction));
+        break;
+
+    case IsaFormats::ISA_FORMAT_TRAP:
+    {
+        uint16_t vector = instruction & 0x00FF;
+        if (vector >= 0x20 && vector <= 0x28)
+        {
+            out = AppendText(out, trapNames[vector - 0x20]);
+            break;
+        }
+        out = AppendText(out, entry.mnemonic);
+        *out++ = ' ';
+        out = AppendHex(out, vector, 2);
+        break;
+    }
+
+    case IsaFormats::ISA_FORMAT_NONE:
+        out = AppendText(out, entry.mnemonic);
+        break;
+
+    case IsaFormats::ISA_FORMAT_DATA:
+    default:
+        out = AppendText(out, ".FILL ");
+        out = AppendHex(out, instruction, 4);
+        break;
+    }
+
+    *out = '\0';
+    return (size_t)(out - text);
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+// Longest text produced for one instruction, including the terminating null.
+#define DISASSEMBLY_MAX (16 + SYMBOL_NAME_MAX)
+
+// Longest listing line: a label line, the address and encoding columns and the instruction.
+#define LISTING_LINE_MAX (SYMBOL_NAME_MAX + 16 + DISASSEMBLY_MAX)
+
+// Bytes of listing collected before they are written out.
+#define LISTING_BUFFER_SIZE (1 << 20)
+
+// Trace bytes read at a time; a multiple of the record size.
+#define TRACE_READ_SIZE (1 << 20)
+
+// Bytes of one binary trace record: the address and the encoding, big-endian like an image.
+#define TRACE_RECORD_SIZE 4
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "SymbolTable.h"
+
+
+// Turns images and binary traces into LC-3 assembly text.
+class Disassembler
+{
+private:
+    // Formatted listing line of the instruction last seen at an address of a trace.
+    struct CachedLine
+    {
+        uint32_t tag; // 0x10000 | instruction, 0 when empty
+        uint32_t length;
+        char text[LISTING_LINE_MAX];
+    };
+
+    FILE* outputFile;
+    const SymbolTable* symbolsPtr;
+    char* buffer;
+    size_t used = 0;
+    CachedLine* cache = nullptr;
+
+public:
+    Disassembler(FILE* output, const SymbolTable* symbols);
+    ~Disassembler();
+
+    int ListImage(const char* imagePath);
+    int ListTrace(const char* tracePath);
+    int Finish();
+
+    static size_t Format(uint16_t address, uint16_t instruction, char* text, const SymbolTable* symbols = nullptr);
+
+private:
+    size_t FormatLine(uint16_t address, uint16_t instruction, char* line) const;
+    void Flush();
+
+    static char* AppendText(char* out, const char* text);
+    static char* AppendTarget(char* out, uint16_t target, const SymbolTable* symbols);
+    static char* AppendRegister(char* out, uint16_t reg);
+    static char* AppendHex(char* out, uint16_t value, int digits);
+    static char* AppendImmediate(char* out, uint16_t value);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,213 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cstring>
+
+
+#include "EngineTuner.h"
+#include "VirtualMachine.h"
+#include "CPU.h"
+
+
+/**
+ * @brief Constructs an EngineTuner for the given virtual machine.
+ *
+ * @param vm Pointer to the VirtualMachine object whose engines are calibrated.
+ * @param cpu Pointer to the CPU object holding the loaded image.
+ */
+EngineTuner::EngineTuner(VirtualMachine* vm, CPU* cpu)
+{
+    vmPtr = vm;
+    cpuPtr = cpu;
+}
+
+
+/**
+ * @brief Computes a 64-bit FNV-1a hash of the loaded memory image.
+ *
+ * The hash covers the whole memory and its size, so it identifies the combination of
+ * images loaded from the command line and the memory they were loaded into. Pages of images
+ * loaded on demand are brought in, so the hash does not depend on how the images were loaded.
+ *
+ * @return The hash of the memory contents.
+ */
+uint64_t EngineTuner::HashImage() const
+{
+    uint64_t hash = 0xCBF29CE484222325ULL; // FNV offset basis
+
+    hash ^= cpuPtr->memoryWords;
+    hash *= 0x100000001B3ULL;
+
+    for (uint32_t address = 0; address < cpuPtr->memoryWords; ++address)
+    {
+        hash ^= cpuPtr->Word((uint16_t)address);
+        hash *= 0x100000001B3ULL; // FNV prime
+    }
+
+    return hash;
+}
+
+
+/**
+ * @brief Picks the engine to run the loaded image with.
+ *
+ * A decision cached for the same image is reused. Otherwise every engine is calibrated
+ * on the running guest, the measured rates are logged to stderr and the fastest engine
+ * is stored in the cache file.
+ *
+ * @param cachePath Path of the engine cache file.
+ * @return The selected engine, as a value of the Engines enumeration.
+ */
+uint16_t EngineTuner::SelectEngine(const char* cachePath)
+{
+    // Hash before calibration starts modifying memory
+    uint64_t imageHash = HashImage();
+    uint16_t engine = Engines::ENGINE_SWITCH;
+
+    if (LookupEngine(cachePath, imageHash, &engine))
+    {
+        fprintf(stderr, "engine: %s (cached for image %016llx)\n", Options::EngineName(engine), (unsigned long long)imageHash);
+        return engine;
+    }
+
+    double rates[Engines::ENGINE_COUNT] = { 0 };
+    int complete = Calibrate(rates);
+
+    // Pick the engine with the highest measured rate
+    for (uint16_t i = 0; i < Engines::ENGINE_COUNT; ++i)
+    {
+        fprintf(stderr, "engine: %-10s %8.2f MIPS\n", Options::EngineName(i), rates[i]);
+        if (rates[i] > rates[engine])
+        {
+            engine = i;
+        }
+    }
+
+    fprintf(stderr, "engine: selected %s for image %016llx\n", Options::EngineName(engine), (unsigned long long)imageHash);
+
+    // A guest that halted during calibration did not give every engine a fair measurement
+    if (complete)
+    {
+        StoreEngine(cachePath, imageHash, engine);
+    }
+
+    return engine;
+}
+
+
+/**
+ * @brief Runs calibration windows under every engine, round robin.
+ *
+ * The guest keeps running normally during calibration; the engines only differ in speed. A window
+ * in which the guest sleeps or waits for a key is not measured.
+ *
+ * @param rates Receives the best measured rate of each engine, in millions of instructions per second.
+ * @return Returns 1 if every window completed, 0 if the guest halted during calibration.
+ */
+int EngineTuner::Calibrate(double rates[Engines::ENGINE_COUNT])
+{
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    for (int round = 0; round < CALIBRATION_ROUNDS; ++round)
+    {
+        for (uint16_t engine = 0; engine < Engines::ENGINE_COUNT; ++engine)
+        {
+            if (!vmPtr->WaitUntilReady())
+            {
+                continue;
+            }
+
+            QueryPerformanceCounter(&start);
+            uint64_t retired = vmPtr->Execute(engine, CALIBRATION_WINDOW);
+            QueryPerformanceCounter(&end);
+
+            double seconds = (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+            if (seconds > 0)
+            {
+                double rate = (double)retired / seconds / 1e6;
+                if (rate > rates[engine])
+                {
+                    rates[engine] = rate;
+                }
+            }
+
+            if (!cpuPtr->running)
+            {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Looks up the engine cached for an image.
+ *
+ * Each line of the cache file holds an image hash in hexadecimal followed by an engine name.
+ *
+ * @param cachePath Path of the engine cache file.
+ * @param imageHash Hash of the loaded image.
+ * @param engine Receives the cached engine if one is found.
+ * @return Returns 1 if the image has a cached engine, 0 otherwise.
+ */
+int EngineTuner::LookupEngine(const char* cachePath, uint64_t imageHash, uint16_t* engine) const
+{
+    FILE* file = fopen(cachePath, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    unsigned long long hash;
+    char name[32];
+    int found = 0;
+
+    // Later lines win, so a re-calibrated image overrides its older entry
+    while (fscanf(file, "%llx %31s", &hash, name) == 2)
+    {
+        for (uint16_t i = 0; i < Engines::ENGINE_COUNT; ++i)
+        {
+            if (hash == imageHash && strcmp(name, Options::EngineName(i)) == 0)
+            {
+                *engine = i;
+                found = 1;
+            }
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+
+/**
+ * @brief Appends the engine selected for an image to the cache file.
+ *
+ * @param cachePath Path of the engine cache file.
+ * @param imageHash Hash of the loaded image.
+ * @param engine The selected engine.
+ */
+void EngineTuner::StoreEngine(const char* cachePath, uint64_t imageHash, uint16_t engine) const
+{
+    FILE* file = fopen(cachePath, "a");
+    if (!file)
+    {
+        return;
+    }
+
+    fprintf(file, "%016llx %s\n", (unsigned long long)imageHash, Options::EngineName(engine));
+    fclose(file);
+}
\ No newline at end of file
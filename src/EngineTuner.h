@@ -0,0 +1,48 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef ENGINE_TUNER_H
+#define ENGINE_TUNER_H
+
+// Number of instructions each engine executes per calibration window.
+#define CALIBRATION_WINDOW (1 << 18)
+
+// Number of calibration windows per engine. The best window counts, so a window
+// stalled on keyboard input does not decide the result.
+#define CALIBRATION_ROUNDS 3
+
+
+#include <cstdint>
+
+#include "Options.h"
+
+
+class VirtualMachine;
+class CPU;
+
+
+class EngineTuner
+{
+private:
+    VirtualMachine* vmPtr;
+    CPU* cpuPtr;
+
+public:
+    EngineTuner(VirtualMachine* vm, CPU* cpu);
+
+    uint64_t HashImage() const;
+    uint16_t SelectEngine(const char* cachePath);
+
+private:
+    int Calibrate(double rates[Engines::ENGINE_COUNT]);
+    int LookupEngine(const char* cachePath, uint64_t imageHash, uint16_t* engine) const;
+    void StoreEngine(const char* cachePath, uint64_t imageHash, uint16_t engine) const;
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+
+
+#include "ExecutionPolicies.h"
+
+
+// Mnemonics reported by the instruction mix, indexed by opcode.
+static const char* const opcodeNames[16] =
+{
+    "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+    "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"
+};
+
+
+/**
+ * @brief Destroys the TracePolicy object, writing the trace collected so far.
+ */
+TracePolicy::~TracePolicy()
+{
+    Flush();
+}
+
+
+/**
+ * @brief Writes the collected trace to stderr.
+ */
+void TracePolicy::Flush()
+{
+    fwrite(buffer, 1, used, stderr);
+    used = 0;
+}
+
+
+/**
+ * @brief Writes the rest of the trace.
+ */
+void TracePolicy::Report()
+{
+    Flush();
+}
+
+
+/**
+ * @brief Destroys the BinaryTracePolicy object, writing the trace collected so far and closing the file.
+ */
+BinaryTracePolicy::~BinaryTracePolicy()
+{
+    Flush();
+    if (traceFile)
+    {
+        fclose(traceFile);
+    }
+}
+
+
+/**
+ * @brief Creates the trace file, replacing an existing one.
+ *
+ * @param path The path of the trace file.
+ * @return 1 if the file was created, 0 otherwise.
+ */
+int BinaryTracePolicy::Open(const char* path)
+{
+    traceFile = fopen(path, "wb");
+    return traceFile != nullptr;
+}
+
+
+/**
+ * @brief Writes the collected records to the trace file.
+ */
+void BinaryTracePolicy::Flush()
+{
+    if (traceFile)
+    {
+        fwrite(buffer, 1, used, traceFile);
+    }
+    used = 0;
+}
+
+
+/**
+ * @brief Writes the rest of the trace.
+ */
+void BinaryTracePolicy::Report()
+{
+    Flush();
+    if (traceFile)
+    {
+        fflush(traceFile);
+    }
+}
+
+
+/**
+ * @brief Prints the number of distinct addresses executed and their range to stderr.
+ */
+void CoveragePolicy::Report()
+{
+    uint64_t count = 0;
+    int lowest = -1, highest = -1;
+
+    for (int address = 0; address < (1 << 16); ++address)
+    {
+        if (executed[address >> 6] & (1ULL << (address & 63)))
+        {
+            ++count;
+            lowest = lowest < 0 ? address : lowest;
+            highest = address;
+        }
+    }
+
+    if (count == 0)
+    {
+        fprintf(stderr, "coverage: no instructions executed\n");
+        return;
+    }
+
+    fprintf(stderr, "coverage: %llu addresses executed between x%04X and x%04X\n",
+        (unsigned long long)count, lowest, highest);
+}
+
+
+/**
+ * @brief Prints the instruction mix, memory accesses and traps to stderr.
+ */
+void MixPolicy::Report()
+{
+    uint64_t total = 0;
+    for (int opcode = 0; opcode < 16; ++opcode)
+    {
+        total += opcodes[opcode];
+    }
+
+    fprintf(stderr, "mix: %llu instructions, %llu memory reads, %llu memory writes\n",
+        (unsigned long long)total, (unsigned long long)reads, (unsigned long long)writes);
+
+    for (int opcode = 0; opcode < 16; ++opcode)
+    {
+        if (opcodes[opcode])
+        {
+            fprintf(stderr, "mix: %-5s %14llu %6.2f%%\n", opcodeNames[opcode],
+                (unsigned long long)opcodes[opcode], opcodes[opcode] * 100.0 / (double)total);
+        }
+    }
+
+    for (int vector = 0; vector < 256; ++vector)
+    {
+        if (traps[vector])
+        {
+            fprintf(stderr, "mix: TRAP x%02X %10llu\n", vector, (unsigned long long)traps[vector]);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,145 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef EXECUTION_POLICIES_H
+#define EXECUTION_POLICIES_H
+
+// Bytes of trace text collected before they are written to stderr.
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+
+// Hooks called by BasicVirtualMachine around every instruction. They are empty and inline, so a
+// policy only pays for the hooks it redefines, and a loop instantiated without policies compiles
+// to the same code as one without hooks.
+struct ExecutionPolicy
+{
+    void OnFetch(uint16_t, uint16_t) {}
+    void OnRetire(uint16_t, uint16_t) {}
+    void OnMemRead(uint16_t) {}
+    void OnMemWrite(uint16_t, uint16_t) {}
+    void OnTrap(uint16_t) {}
+    void Report() {}
+};
+
+
+// Writes the address and encoding of every retired instruction to stderr.
+class TracePolicy : public ExecutionPolicy
+{
+private:
+    char buffer[TRACE_BUFFER_SIZE];
+    size_t used = 0;
+
+public:
+    ~TracePolicy();
+
+    void OnRetire(uint16_t pc, uint16_t instruction)
+    {
+        // "x3000 x1021\n"
+        static const char hexDigits[] = "0123456789ABCDEF";
+        if (used + 12 > TRACE_BUFFER_SIZE)
+        {
+            Flush();
+        }
+
+        char* line = buffer + used;
+        line[0] = 'x';
+        line[5] = ' ';
+        line[6] = 'x';
+        line[11] = '\n';
+        for (int i = 0; i < 4; ++i)
+        {
+            line[4 - i] = hexDigits[(pc >> (4 * i)) & 0xF];
+            line[10 - i] = hexDigits[(instruction >> (4 * i)) & 0xF];
+        }
+        used += 12;
+    }
+
+    void Report();
+
+private:
+    void Flush();
+};
+
+
+// Writes the address and encoding of every retired instruction to a file as 4-byte big-endian
+// records, the input of the trace disassembler.
+class BinaryTracePolicy : public ExecutionPolicy
+{
+private:
+    unsigned char buffer[TRACE_BUFFER_SIZE];
+    size_t used = 0;
+    FILE* traceFile = nullptr;
+
+public:
+    ~BinaryTracePolicy();
+
+    int Open(const char* path);
+
+    void OnRetire(uint16_t pc, uint16_t instruction)
+    {
+        if (used + 4 > TRACE_BUFFER_SIZE)
+        {
+            Flush();
+        }
+
+        unsigned char* record = buffer + used;
+        record[0] = (unsigned char)(pc >> 8);
+        record[1] = (unsigned char)pc;
+        record[2] = (unsigned char)(instruction >> 8);
+        record[3] = (unsigned char)instruction;
+        used += 4;
+    }
+
+    void Report();
+
+private:
+    void Flush();
+};
+
+
+// Marks every address executed and reports how much of the image ran.
+class CoveragePolicy : public ExecutionPolicy
+{
+private:
+    uint64_t executed[(1 << 16) / 64] = {};
+
+public:
+    void OnRetire(uint16_t pc, uint16_t)
+    {
+        executed[pc >> 6] |= 1ULL << (pc & 63);
+    }
+
+    void Report();
+};
+
+
+// Counts retired instructions per opcode, memory accesses and traps per vector.
+class MixPolicy : public ExecutionPolicy
+{
+private:
+    uint64_t opcodes[16] = {};
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t traps[256] = {};
+
+public:
+    void OnRetire(uint16_t, uint16_t instruction) { ++opcodes[instruction >> 12]; }
+    void OnMemRead(uint16_t) { ++reads; }
+    void OnMemWrite(uint16_t, uint16_t) { ++writes; }
+    void OnTrap(uint16_t vector) { ++traps[vector & 0xFF]; }
+
+    void Report();
+};
+#endif
\ No newline at end of file
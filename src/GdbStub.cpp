@@ -0,0 +1,790 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+// Winsock must be included before Windows.h pulls in its older winsock.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <cstdio>
+#include <cstring>
+
+
+#include "GdbStub.h"
+#include "VirtualMachine.h"
+#include "CPU.h"
+#include "MemoryIO.h"
+#include "Debugger.h"
+
+
+#pragma comment(lib, "Ws2_32.lib")
+
+
+// Guest memory as seen by the client: two bytes per word, little-endian.
+#define GDB_MEMORY_BYTES (MEMORY_MAX * 2)
+
+// Signals reported in stop replies.
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+
+
+static const char hexDigits[] = "0123456789abcdef";
+
+
+/**
+ * @brief Constructs a GdbStub serving the given virtual machine.
+ *
+ * @param vm Pointer to the VirtualMachine object executing the guest.
+ * @param cpu Pointer to the CPU object holding registers and memory.
+ * @param memoryIO Pointer to the MemoryIO object, whose decode cache is kept coherent with memory writes.
+ * @param debugger Pointer to the Debugger object holding breakpoints and watchpoints.
+ */
+GdbStub::GdbStub(VirtualMachine* vm, CPU* cpu, MemoryIO* memoryIO, Debugger* debugger)
+{
+    vmPtr = vm;
+    cpuPtr = cpu;
+    memoryIOPtr = memoryIO;
+    debuggerPtr = debugger;
+
+    listener = (uintptr_t)INVALID_SOCKET;
+    client = (uintptr_t)INVALID_SOCKET;
+
+    inputLength = 0;
+    inputPosition = 0;
+
+    noAck = 0;
+    startNoAck = 0;
+    interrupted = 0;
+    engine = 0;
+}
+
+
+/**
+ * @brief Destroys the GdbStub object, closing its sockets.
+ */
+GdbStub::~GdbStub()
+{
+    if ((SOCKET)client != INVALID_SOCKET)
+    {
+        closesocket((SOCKET)client);
+    }
+    if ((SOCKET)listener != INVALID_SOCKET)
+    {
+        closesocket((SOCKET)listener);
+        WSACleanup();
+    }
+}
+
+
+/**
+ * @brief Starts listening for a debugger on the loopback interface.
+ *
+ * @param port The TCP port to listen on.
+ * @return Returns 1 on success, 0 if the socket could not be set up.
+ */
+int GdbStub::Listen(uint16_t port)
+{
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+    {
+        fprintf(stderr, "gdb: Winsock could not be initialized\n");
+        return 0;
+    }
+
+    SOCKET socketHandle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (socketHandle == INVALID_SOCKET)
+    {
+        fprintf(stderr, "gdb: could not create a socket\n");
+        WSACleanup();
+        return 0;
+    }
+    listener = (uintptr_t)socketHandle;
+
+    int reuse = 1;
+    setsockopt(socketHandle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    // Only local debuggers may connect; the stub has no authentication
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    if (bind(socketHandle, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(socketHandle, 1) == SOCKET_ERROR)
+    {
+        fprintf(stderr, "gdb: could not listen on localhost:%u\n", port);
+        return 0;
+    }
+
+    fprintf(stderr, "gdb: listening on localhost:%u\n", port);
+    return 1;
+}
+
+
+/**
+ * @brief Waits for a debugger and serves it until it detaches, kills the guest or disconnects.
+ *
+ * The guest stays stopped until the debugger resumes it. After a detach or disconnect the caller
+ * keeps running the guest without the stub, and without the breakpoints and watchpoints set.
+ *
+ * @param selectedEngine The engine used to execute the guest, as a value of the Engines enumeration.
+ */
+void GdbStub::Serve(uint16_t selectedEngine)
+{
+    engine = selectedEngine;
+
+    SOCKET socketHandle = accept((SOCKET)listener, NULL, NULL);
+    if (socketHandle == INVALID_SOCKET)
+    {
+        fprintf(stderr, "gdb: accept failed\n");
+        return;
+    }
+    client = (uintptr_t)socketHandle;
+
+    // Replies are small and latency bound
+    int noDelay = 1;
+    setsockopt(socketHandle, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+    fprintf(stderr, "gdb: debugger connected\n");
+
+    for (;;)
+    {
+        int length = ReceivePacket();
+        if (length < 0)
+        {
+            break;
+        }
+
+        reply.clear();
+        int serving = HandlePacket(length);
+
+        if (SendPacket(reply) < 0 || !serving)
+        {
+            break;
+        }
+
+        if (startNoAck)
+        {
+            noAck = 1;
+            startNoAck = 0;
+        }
+    }
+
+    closesocket(socketHandle);
+    client = (uintptr_t)INVALID_SOCKET;
+
+    // Nobody is left to report stops to, so the guest runs on without the debug dispatch loop
+    debuggerPtr->Clear();
+
+    fprintf(stderr, "gdb: debugger disconnected\n");
+}
+
+
+/**
+ * @brief Returns the next byte from the client, receiving more when the buffer is empty.
+ *
+ * @return The byte, or -1 if the connection was closed.
+ */
+int GdbStub::ReadByte()
+{
+    if (inputPosition == inputLength)
+    {
+        int received = recv((SOCKET)client, input, sizeof(input), 0);
+        if (received <= 0)
+        {
+            return -1;
+        }
+        inputLength = received;
+        inputPosition = 0;
+    }
+
+    return (unsigned char)input[inputPosition++];
+}
+
+
+/**
+ * @brief Receives one packet into "packet", acknowledging it unless no-ack mode was negotiated.
+ *
+ * Acknowledgements and interrupts received while the guest is stopped are skipped.
+ *
+ * @return The length of the packet data, or -1 if the connection was closed.
+ */
+int GdbStub::ReceivePacket()
+{
+    for (;;)
+    {
+        int character;
+
+        // Everything before the start of a packet is ignored
+        do
+        {
+            character = ReadByte();
+            if (character < 0)
+            {
+                return -1;
+            }
+        } while (character != '$');
+
+        int length = 0;
+        int overflow = 0;
+        uint8_t checksum = 0;
+
+        while ((character = ReadByte()) != '#')
+        {
+            if (character < 0)
+            {
+                return -1;
+            }
+
+            checksum += (uint8_t)character;
+            if (length < GDB_PACKET_MAX)
+            {
+                packet[length++] = (char)character;
+            }
+            else
+            {
+                overflow = 1;
+            }
+        }
+        packet[length] = '\0';
+
+        int high = ReadByte();
+        int low = ReadByte();
+        if (high < 0 || low < 0)
+        {
+            return -1;
+        }
+
+        if (noAck)
+        {
+            return length;
+        }
+
+        int valid = !overflow && HexDigit((char)high) >= 0 && HexDigit((char)low) >= 0
+            && (uint8_t)(HexDigit((char)high) * 16 + HexDigit((char)low)) == checksum;
+
+        send((SOCKET)client, valid ? "+" : "-", 1, 0);
+        if (valid)
+        {
+            return length;
+        }
+    }
+}
+
+
+/**
+ * @brief Sends a packet and, unless no-ack mode was negotiated, resends it until it is acknowledged.
+ *
+ * @param data The packet data.
+ * @return Returns 0 on success, -1 if the connection was closed.
+ */
+int GdbStub::SendPacket(const std::string& data)
+{
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        checksum += (uint8_t)data[i];
+    }
+
+    std::string frame;
+    frame.reserve(data.size() + 4);
+    frame += '$';
+    frame += data;
+    frame += '#';
+    frame += hexDigits[checksum >> 4];
+    frame += hexDigits[checksum & 0xF];
+
+    for (;;)
+    {
+        if (send((SOCKET)client, frame.data(), (int)frame.size(), 0) != (int)frame.size())
+        {
+            return -1;
+        }
+
+        if (noAck)
+        {
+            return 0;
+        }
+
+        int character;
+        do
+        {
+            character = ReadByte();
+            if (character < 0)
+            {
+                return -1;
+            }
+        } while (character != '+' && character != '-');
+
+        if (character == '+')
+        {
+            return 0;
+        }
+    }
+}
+
+
+/**
+ * @brief Checks, without blocking, whether the client sent an interrupt (Ctrl+C) while the guest runs.
+ *
+ * @return Returns 1 if the guest must stop, 0 otherwise.
+ */
+int GdbStub::PollInterrupt()
+{
+    if (inputPosition == inputLength)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET((SOCKET)client, &readable);
+
+        timeval timeout = { 0, 0 };
+        if (select((int)(SOCKET)client + 1, &readable, NULL, NULL, &timeout) <= 0)
+        {
+            return 0;
+        }
+    }
+
+    int character = ReadByte();
+
+    // A closed connection also stops the guest, so the caller notices the disconnect
+    return character < 0 || character == 0x03;
+}
+
+
+/**
+ * @brief Handles one packet and stores the answer in "reply".
+ *
+ * Unsupported packets get an empty reply, which tells the client to fall back to simpler ones.
+ *
+ * @param length The length of the packet data.
+ * @return Returns 1 to keep serving, 0 after a detach or kill.
+ */
+int GdbStub::HandlePacket(int length)
+{
+    const char* arguments = packet + 1;
+
+    switch (packet[0])
+    {
+    case '?':
+        StopReply();
+        break;
+    case 'g':
+        ReadRegisters();
+        break;
+    case 'G':
+        WriteRegisters(arguments);
+        break;
+    case 'p':
+    {
+        uint32_t index = ParseHex(&arguments);
+        if (index < GDB_REGISTER_COUNT)
+        {
+            AppendHex16(cpuPtr->registers[index]);
+        }
+        else
+        {
+            reply = "E01";
+        }
+        break;
+    }
+    case 'P':
+    {
+        uint32_t index = ParseHex(&arguments);
+        if (index < GDB_REGISTER_COUNT && *arguments == '=' && length >= (int)(arguments - packet) + 5)
+        {
+            ++arguments;
+            cpuPtr->registers[index] = (uint16_t)(HexDigit(arguments[0]) << 4 | HexDigit(arguments[1])
+                | HexDigit(arguments[2]) << 12 | HexDigit(arguments[3]) << 8);
+            reply = "OK";
+        }
+        else
+        {
+            reply = "E01";
+        }
+        break;
+    }
+    case 'm':
+        ReadMemory(arguments);
+        break;
+    case 'M':
+        WriteMemory(arguments);
+        break;
+    case 'c':
+    case 's':
+        // An address to resume at is optional
+        if (*arguments)
+        {
+            cpuPtr->registers[Registers::R_PC] = (uint16_t)(ParseHex(&arguments) >> 1);
+        }
+        Resume(packet[0] == 's');
+        break;
+    case 'Z':
+    case 'z':
+        ChangePoint(arguments, packet[0] == 'Z');
+        break;
+    case 'H':
+    case 'T':
+        // A single thread, which is always alive
+        reply = "OK";
+        break;
+    case 'D':
+        reply = "OK";
+        return 0;
+    case 'k':
+        cpuPtr->running = 0;
+        return 0;
+    case 'q':
+        if (strncmp(packet, "qSupported", 10) == 0)
+        {
+            char features[96];
+            sprintf(features, "PacketSize=%x;QStartNoAckMode+;swbreak+;hwbreak+", GDB_PACKET_MAX);
+            reply = features;
+        }
+        else if (strcmp(packet, "qAttached") == 0)
+        {
+            reply = "1";
+        }
+        else if (strcmp(packet, "qC") == 0)
+        {
+            reply = "QC1";
+        }
+        else if (strcmp(packet, "qfThreadInfo") == 0)
+        {
+            reply = "m1";
+        }
+        else if (strcmp(packet, "qsThreadInfo") == 0)
+        {
+            reply = "l";
+        }
+        break;
+    case 'Q':
+        if (strcmp(packet, "QStartNoAckMode") == 0)
+        {
+            // The OK itself is still acknowledged; acknowledgements stop after it is sent
+            reply = "OK";
+            startNoAck = 1;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Resumes the guest for one instruction or until something stops it, then sets the stop reply.
+ *
+ * "continue" runs the selected engine in large batches and only checks for an interrupt between
+ * them. While breakpoints or watchpoints exist, Execute runs the debug dispatch loop, which stops by
+ * itself. A breakpoint at the resume address does not stop the guest again, as the client expects.
+ * While the guest sleeps or waits for a key, only the interrupt is checked.
+ *
+ * @param step 1 to execute a single instruction, 0 to continue.
+ */
+void GdbStub::Resume(int step)
+{
+    debuggerPtr->stopReason = StopReasons::STOP_NONE;
+    debuggerPtr->stepOver = 1;
+    interrupted = 0;
+
+    if (step)
+    {
+        while (!vmPtr->WaitUntilReady())
+        {
+            if (PollInterrupt())
+            {
+                interrupted = 1;
+                break;
+            }
+        }
+
+        if (!interrupted)
+        {
+            vmPtr->Execute(engine, 1);
+        }
+    }
+    else
+    {
+        while (cpuPtr->running)
+        {
+            if (vmPtr->WaitUntilReady())
+            {
+                vmPtr->Execute(engine, GDB_CONTINUE_BATCH);
+
+                if (debuggerPtr->stopReason != StopReasons::STOP_NONE)
+                {
+                    break;
+                }
+            }
+
+            if (PollInterrupt())
+            {
+                interrupted = 1;
+                break;
+            }
+        }
+    }
+
+    StopReply();
+}
+
+
+/**
+ * @brief Sets the reply describing why the guest is stopped.
+ */
+void GdbStub::StopReply()
+{
+    char text[64];
+
+    if (!cpuPtr->running)
+    {
+        reply = "W00";
+        return;
+    }
+
+    if (debuggerPtr->stopReason == StopReasons::STOP_BREAKPOINT)
+    {
+        sprintf(text, "T%02xswbreak:;", GDB_SIGTRAP);
+    }
+    else if (debuggerPtr->stopReason == StopReasons::STOP_WATCHPOINT)
+    {
+        sprintf(text, "T%02x%s:%x;", GDB_SIGTRAP,
+            debuggerPtr->stopKind == WatchKinds::WATCH_READ ? "rwatch" : "watch", debuggerPtr->stopAddress * 2);
+    }
+    else
+    {
+        sprintf(text, "S%02x", interrupted ? GDB_SIGINT : GDB_SIGTRAP);
+    }
+
+    reply = text;
+}
+
+
+/**
+ * @brief Answers a "g" packet with all registers in one reply.
+ */
+void GdbStub::ReadRegisters()
+{
+    for (int i = 0; i < GDB_REGISTER_COUNT; ++i)
+    {
+        AppendHex16(cpuPtr->registers[i]);
+    }
+}
+
+
+/**
+ * @brief Handles a "G" packet, writing all registers at once.
+ *
+ * @param data Four hexadecimal digits per register, little-endian.
+ */
+void GdbStub::WriteRegisters(const char* data)
+{
+    if (strlen(data) < GDB_REGISTER_COUNT * 4)
+    {
+        reply = "E01";
+        return;
+    }
+
+    for (int i = 0; i < GDB_REGISTER_COUNT; ++i, data += 4)
+    {
+        cpuPtr->registers[i] = (uint16_t)(HexDigit(data[0]) << 4 | HexDigit(data[1])
+            | HexDigit(data[2]) << 12 | HexDigit(data[3]) << 8);
+    }
+
+    reply = "OK";
+}
+
+
+/**
+ * @brief Answers an "m ADDR,LENGTH" packet with the whole block in one reply.
+ *
+ * Memory is read directly, so reading the keyboard registers has no side effects.
+ *
+ * @param arguments The packet arguments.
+ */
+void GdbStub::ReadMemory(const char* arguments)
+{
+    uint32_t address = ParseHex(&arguments);
+    uint32_t length = (*arguments == ',') ? (++arguments, ParseHex(&arguments)) : 0;
+
+    if (address >= GDB_MEMORY_BYTES || length > GDB_PACKET_MAX / 2)
+    {
+        reply = "E01";
+        return;
+    }
+
+    if (length > GDB_MEMORY_BYTES - address)
+    {
+        length = GDB_MEMORY_BYTES - address;
+    }
+
+    reply.reserve(length * 2);
+
+    for (uint32_t byte = address; byte < address + length; ++byte)
+    {
+        uint16_t word = cpuPtr->Word((uint16_t)(byte >> 1));
+        uint8_t value = (byte & 1) ? (uint8_t)(word >> 8) : (uint8_t)word;
+
+        reply += hexDigits[value >> 4];
+        reply += hexDigits[value & 0xF];
+    }
+}
+
+
+/**
+ * @brief Handles an "M ADDR,LENGTH:DATA" packet, writing the whole block at once.
+ *
+ * @param arguments The packet arguments.
+ */
+void GdbStub::WriteMemory(const char* arguments)
+{
+    uint32_t address = ParseHex(&arguments);
+    uint32_t length = (*arguments == ',') ? (++arguments, ParseHex(&arguments)) : 0;
+
+    if (*arguments++ != ':' || address + length > GDB_MEMORY_BYTES || strlen(arguments) < length * 2)
+    {
+        reply = "E01";
+        return;
+    }
+
+    for (uint32_t byte = address; byte < address + length; ++byte, arguments += 2)
+    {
+        uint16_t value = (uint16_t)(HexDigit(arguments[0]) << 4 | HexDigit(arguments[1]));
+        uint16_t word = cpuPtr->Word((uint16_t)(byte >> 1));
+
+        // Through MemoryIO, so patched pages are checkpointed and patched code is decoded again
+        memoryIOPtr->Patch((uint16_t)(byte >> 1),
+            (byte & 1) ? (uint16_t)((word & 0x00FF) | (value << 8)) : (uint16_t)((word & 0xFF00) | value));
+    }
+
+    reply = "OK";
+}
+
+
+/**
+ * @brief Handles "Z"/"z TYPE,ADDR,KIND" packets inserting or removing breakpoints and watchpoints.
+ *
+ * Software and hardware breakpoints (types 0 and 1) both use the breakpoint map, so guest memory is
+ * never patched. Watchpoints (types 2 to 4) cover the words spanned by the byte range.
+ *
+ * @param arguments The packet arguments.
+ * @param insert 1 for "Z", 0 for "z".
+ */
+void GdbStub::ChangePoint(const char* arguments, int insert)
+{
+    uint32_t type = ParseHex(&arguments);
+    uint32_t address = (*arguments == ',') ? (++arguments, ParseHex(&arguments)) : GDB_MEMORY_BYTES;
+    uint32_t kind = (*arguments == ',') ? (++arguments, ParseHex(&arguments)) : 0;
+
+    if (address >= GDB_MEMORY_BYTES)
+    {
+        reply = "E01";
+        return;
+    }
+
+    uint16_t word = (uint16_t)(address >> 1);
+
+    if (type <= 1)
+    {
+        if (insert)
+        {
+            Breakpoint breakpoint = {};
+            breakpoint.address = word;
+            debuggerPtr->AddBreakpoint(breakpoint);
+        }
+        else
+        {
+            debuggerPtr->RemoveBreakpoints(word);
+        }
+    }
+    else if (type <= 4)
+    {
+        if (insert)
+        {
+            static const uint8_t kinds[] = { WatchKinds::WATCH_WRITE, WatchKinds::WATCH_READ, WatchKinds::WATCH_READ | WatchKinds::WATCH_WRITE };
+
+            Watchpoint watchpoint = {};
+            watchpoint.address = word;
+            watchpoint.length = (uint16_t)(((address + (kind ? kind : 1) + 1) >> 1) - word);
+            watchpoint.kinds = kinds[type - 2];
+            debuggerPtr->AddWatchpoint(watchpoint);
+        }
+        else
+        {
+            debuggerPtr->RemoveWatchpoints(word);
+        }
+    }
+    else
+    {
+        // Unsupported type: empty reply
+        return;
+    }
+
+    reply = "OK";
+}
+
+
+/**
+ * @brief Appends a 16-bit value as four hexadecimal digits in little-endian byte order.
+ *
+ * @param value The value to append.
+ */
+void GdbStub::AppendHex16(uint16_t value)
+{
+    reply += hexDigits[(value >> 4) & 0xF];
+    reply += hexDigits[value & 0xF];
+    reply += hexDigits[(value >> 12) & 0xF];
+    reply += hexDigits[(value >> 8) & 0xF];
+}
+
+
+/**
+ * @brief Parses a hexadecimal number and advances past it.
+ *
+ * @param text Pointer to the text, moved to the first character after the number.
+ * @return The parsed value.
+ */
+uint32_t GdbStub::ParseHex(const char** text)
+{
+    uint32_t value = 0;
+    int digit;
+
+    while ((digit = HexDigit(**text)) >= 0)
+    {
+        value = (value << 4) | (uint32_t)digit;
+        ++*text;
+    }
+
+    return value;
+}
+
+
+/**
+ * @brief Converts a hexadecimal digit to its value.
+ *
+ * @param character The digit.
+ * @return The value of the digit, or -1 if the character is not a hexadecimal digit.
+ */
+int GdbStub::HexDigit(char character)
+{
+    if (character >= '0' && character <= '9')
+    {
+        return character - '0';
+    }
+    if (character >= 'a' && character <= 'f')
+    {
+        return character - 'a' + 10;
+    }
+    if (character >= 'A' && character <= 'F')
+    {
+        return character - 'A' + 10;
+    }
+    return -1;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef GDB_STUB_H
+#define GDB_STUB_H
+
+// Port used by --gdb without an explicit port, as with gdbserver examples.
+#define GDB_DEFAULT_PORT 1234
+
+// Largest packet accepted or sent, advertised to the client in qSupported.
+#define GDB_PACKET_MAX 0x4000
+
+// Instructions executed by "continue" between checks for an interrupt from the client.
+#define GDB_CONTINUE_BATCH (1 << 16)
+
+// R0-R7, PC and PSR, in the order of the "g" packet.
+#define GDB_REGISTER_COUNT 10
+
+
+#include <cstdint>
+#include <string>
+
+
+class VirtualMachine;
+class CPU;
+class MemoryIO;
+class Debugger;
+
+
+class GdbStub
+{
+private:
+    VirtualMachine* vmPtr;
+    CPU* cpuPtr;
+    MemoryIO* memoryIOPtr;
+    Debugger* debuggerPtr;
+
+    // SOCKET handles, kept as integers so that this header does not depend on Winsock.
+    uintptr_t listener;
+    uintptr_t client;
+
+    // Bytes received but not parsed yet.
+    char input[GDB_PACKET_MAX];
+    int inputLength;
+    int inputPosition;
+
+    char packet[GDB_PACKET_MAX + 1];
+    std::string reply;
+
+    int noAck;
+    int startNoAck;
+    int interrupted;
+    uint16_t engine;
+
+public:
+    GdbStub(VirtualMachine* vm, CPU* cpu, MemoryIO* memoryIO, Debugger* debugger);
+    ~GdbStub();
+
+    int Listen(uint16_t port);
+    void Serve(uint16_t engine);
+
+private:
+    int ReadByte();
+    int ReceivePacket();
+    int SendPacket(const std::string& data);
+    int PollInterrupt();
+
+    int HandlePacket(int length);
+    void Resume(int step);
+    void StopReply();
+
+    void ReadRegisters();
+    void WriteRegisters(const char* data);
+    void ReadMemory(const char* arguments);
+    void WriteMemory(const char* arguments);
+    void ChangePoint(const char* arguments, int insert);
+
+    void AppendHex16(uint16_t value);
+    static uint32_t ParseHex(const char** text);
+    static int HexDigit(char character);
+};
+#endif
\ No newline at end of file
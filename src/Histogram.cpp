@@ -0,0 +1,215 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstring>
+
+
+#include "Histogram.h"
+
+
+/**
+ * @brief Returns the power-of-two range a value falls in.
+ *
+ * Range 0 holds the values below HISTOGRAM_SUB_BUCKETS exactly; range r >= 1 holds
+ * [SUB_BUCKETS << (r - 1), SUB_BUCKETS << r) in buckets of width 1 << (r - 1).
+ */
+static int RangeOf(uint64_t value)
+{
+    int range = 0;
+    while ((value >> range) >= HISTOGRAM_SUB_BUCKETS)
+    {
+        ++range;
+    }
+    return range;
+}
+
+
+/**
+ * @brief Returns the largest value counted by a bucket.
+ */
+static uint64_t UpperBound(int range, int subBucket)
+{
+    if (range == 0)
+    {
+        return (uint64_t)subBucket;
+    }
+    return ((uint64_t)(HISTOGRAM_SUB_BUCKETS + subBucket + 1) << (range - 1)) - 1;
+}
+
+
+/**
+ * @brief Constructs an empty Histogram.
+ *
+ * Buckets are log-linear in the style of HdrHistogram: each power-of-two range is split into
+ * HISTOGRAM_SUB_BUCKETS linear buckets, so recording is a handful of shifts and one increment.
+ */
+Histogram::Histogram()
+{
+    Reset();
+}
+
+
+/**
+ * @brief Records one value.
+ *
+ * @param value The value to record, in any unit chosen by the caller.
+ */
+void Histogram::Record(uint64_t value)
+{
+    int range = RangeOf(value);
+    int subBucket = range == 0
+        ? (int)value
+        : (int)(value >> (range - 1)) - HISTOGRAM_SUB_BUCKETS;
+
+    ++counts[range][subBucket];
+    ++count;
+    sum += value;
+    if (value > max)
+    {
+        max = value;
+    }
+}
+
+
+/**
+ * @brief Adds the recorded values of another histogram to this one.
+ *
+ * @param other The histogram to merge.
+ */
+void Histogram::Merge(const Histogram& other)
+{
+    for (int range = 0; range < HISTOGRAM_RANGES; ++range)
+    {
+        for (int subBucket = 0; subBucket < HISTOGRAM_SUB_BUCKETS; ++subBucket)
+        {
+            counts[range][subBucket] += other.counts[range][subBucket];
+        }
+    }
+
+    count += other.count;
+    sum += other.sum;
+    if (other.max > max)
+    {
+        max = other.max;
+    }
+}
+
+
+/**
+ * @brief Discards all recorded values.
+ */
+void Histogram::Reset()
+{
+    memset(counts, 0, sizeof(counts));
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+
+/**
+ * @brief Returns the number of recorded values.
+ */
+uint64_t Histogram::Count() const
+{
+    return count;
+}
+
+
+/**
+ * @brief Returns the largest recorded value.
+ */
+uint64_t Histogram::Max() const
+{
+    return max;
+}
+
+
+/**
+ * @brief Returns the sum of the recorded values.
+ */
+uint64_t Histogram::Sum() const
+{
+    return sum;
+}
+
+
+/**
+ * @brief Returns the mean of the recorded values, or zero if none were recorded.
+ */
+double Histogram::Mean() const
+{
+    return count ? (double)sum / (double)count : 0;
+}
+
+
+/**
+ * @brief Returns the value below which the given percentage of recorded values fall.
+ *
+ * The result is the upper bound of the bucket holding the percentile, capped at the maximum.
+ *
+ * @param percentile The percentile to compute, between 0 and 100.
+ * @return The percentile value, or zero if no values were recorded.
+ */
+uint64_t Histogram::Percentile(double percentile) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)((double)count * percentile / 100.0 + 0.5);
+    if (target == 0)
+    {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int range = 0; range < HISTOGRAM_RANGES; ++range)
+    {
+        for (int subBucket = 0; subBucket < HISTOGRAM_SUB_BUCKETS; ++subBucket)
+        {
+            seen += counts[range][subBucket];
+            if (seen >= target)
+            {
+                uint64_t bound = UpperBound(range, subBucket);
+                return bound < max ? bound : max;
+            }
+        }
+    }
+
+    return max;
+}
+
+
+/**
+ * @brief Returns the number of recorded values in buckets whose upper bound does not exceed the given value.
+ *
+ * Used to export cumulative bucket counts, such as OpenMetrics histogram buckets.
+ *
+ * @param value The inclusive upper bound.
+ * @return The cumulative count.
+ */
+uint64_t Histogram::CountAtOrBelow(uint64_t value) const
+{
+    uint64_t seen = 0;
+    for (int range = 0; range < HISTOGRAM_RANGES; ++range)
+    {
+        for (int subBucket = 0; subBucket < HISTOGRAM_SUB_BUCKETS; ++subBucket)
+        {
+            if (UpperBound(range, subBucket) > value)
+            {
+                return seen;
+            }
+            seen += counts[range][subBucket];
+        }
+    }
+    return seen;
+}
\ No newline at end of file
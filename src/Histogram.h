@@ -0,0 +1,47 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// Every power-of-two range of values is split into this many linear sub-buckets,
+// bounding the relative error of a reported percentile to 1/16.
+#define HISTOGRAM_SUB_BUCKETS 16
+
+// Number of power-of-two ranges, enough for any 64-bit value.
+#define HISTOGRAM_RANGES 64
+
+
+#include <cstdint>
+
+
+class Histogram
+{
+private:
+    uint64_t counts[HISTOGRAM_RANGES][HISTOGRAM_SUB_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+public:
+    Histogram();
+
+    void Record(uint64_t value);
+    void Merge(const Histogram& other);
+    void Reset();
+
+    uint64_t Count() const;
+    uint64_t Max() const;
+    uint64_t Sum() const;
+    double Mean() const;
+    uint64_t Percentile(double percentile) const;
+    uint64_t CountAtOrBelow(uint64_t value) const;
+};
+#endif
\ No newline at end of file
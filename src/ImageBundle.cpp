@@ -0,0 +1,414 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+
+#include "ImageBundle.h"
+#include "CPU.h"
+#include "ShadowMemory.h"
+
+
+static_assert(sizeof(BundleHeader) == 32 && sizeof(BundleEntry) == 64, "bundle layout changed; bump BUNDLE_VERSION");
+
+
+/**
+ * @brief Returns the file name part of a path, which names an image in a bundle.
+ *
+ * @param path The path.
+ * @return Pointer to the character following the last separator.
+ */
+static const char* BaseName(const char* path)
+{
+    const char* name = path;
+    for (const char* c = path; *c; ++c)
+    {
+        if (*c == '/' || *c == '\\' || *c == ':')
+        {
+            name = c + 1;
+        }
+    }
+    return name;
+}
+
+
+/**
+ * @brief Rounds a file offset up to BUNDLE_ALIGN.
+ */
+static uint64_t AlignOffset(uint64_t offset)
+{
+    return (offset + BUNDLE_ALIGN - 1) & ~(uint64_t)(BUNDLE_ALIGN - 1);
+}
+
+
+/**
+ * @brief Constructs an ImageBundle with no file open.
+ */
+ImageBundle::ImageBundle()
+{
+    file = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+    view = nullptr;
+    header = nullptr;
+    entries = nullptr;
+}
+
+
+/**
+ * @brief Destroys the ImageBundle object, unmapping its file.
+ */
+ImageBundle::~ImageBundle()
+{
+    Close();
+}
+
+
+/**
+ * @brief Unmaps and closes the bundle file.
+ */
+void ImageBundle::Close()
+{
+    if (view)
+    {
+        UnmapViewOfFile(view);
+        view = nullptr;
+    }
+    if (mapping)
+    {
+        CloseHandle(mapping);
+        mapping = NULL;
+    }
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+    header = nullptr;
+    entries = nullptr;
+}
+
+
+/**
+ * @brief Maps a bundle file and checks its header and index.
+ *
+ * Every entry is checked once here, so loading an image later needs no check against the file.
+ *
+ * @param path The path of the bundle file.
+ * @return Returns 1 on success, 0 if the file cannot be mapped or is not a valid bundle.
+ */
+int ImageBundle::Open(const char* path)
+{
+    Close();
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(BundleHeader))
+    {
+        Close();
+        return 0;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    view = mapping ? (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view)
+    {
+        Close();
+        return 0;
+    }
+
+    header = (const BundleHeader*)view;
+    uint64_t length = (uint64_t)size.QuadPart;
+
+    if (header->magic != BUNDLE_MAGIC || header->version != BUNDLE_VERSION || header->size != length ||
+        header->indexOffset > length || header->count > (length - header->indexOffset) / sizeof(BundleEntry))
+    {
+        fprintf(stderr, "bundle: %s is not a version %d bundle\n", path, BUNDLE_VERSION);
+        Close();
+        return 0;
+    }
+
+    entries = (const BundleEntry*)(view + header->indexOffset);
+
+    for (uint32_t i = 0; i < header->count; ++i)
+    {
+        const BundleEntry& entry = entries[i];
+        int named = memchr(entry.name, '\0', BUNDLE_NAME_MAX) != nullptr;
+        int sorted = i == 0 || strcmp(entries[i - 1].name, entry.name) < 0;
+
+        if (!named || !sorted || entry.offset > length || entry.words > (length - entry.offset) / sizeof(uint16_t))
+        {
+            fprintf(stderr, "bundle: %s has a damaged index at entry %u\n", path, i);
+            Close();
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Looks an image up by name, or by hash when the name is '#' followed by the hash in hex.
+ *
+ * Any directory part of the name is ignored, as when packing.
+ *
+ * @param name The name of the image.
+ * @return The entry of the image, or nullptr if the bundle has no such image.
+ */
+const BundleEntry* ImageBundle::Find(const char* name) const
+{
+    if (name[0] == '#')
+    {
+        return FindHash(strtoull(name + 1, nullptr, 16));
+    }
+
+    name = BaseName(name);
+
+    // Entries are sorted by name
+    uint32_t low = 0, high = header ? header->count : 0;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        int order = strcmp(entries[middle].name, name);
+        if (order == 0)
+        {
+            return &entries[middle];
+        }
+        if (order < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return nullptr;
+}
+
+
+/**
+ * @brief Looks an image up by the hash of its original file.
+ *
+ * @param hash The FNV-1a hash of the image file.
+ * @return The entry of the image, or nullptr if the bundle has no such image.
+ */
+const BundleEntry* ImageBundle::FindHash(uint64_t hash) const
+{
+    for (uint32_t i = 0; header && i < header->count; ++i)
+    {
+        if (entries[i].hash == hash)
+        {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+
+/**
+ * @brief Copies an image from the mapped bundle into the memory of a CPU.
+ *
+ * The image must fit as for CPU::ReadImageFile. Its words are already in host byte order, so
+ * loading is a single copy and touches no file.
+ *
+ * @param cpu The CPU to load the image into.
+ * @param entry The entry of the image.
+ * @return Returns 1 if the image was loaded, 0 if it does not fit.
+ */
+int ImageBundle::Load(CPU* cpu, const BundleEntry* entry) const
+{
+    if (!cpu->Contains(entry->origin) || entry->words > cpu->memoryWords - (entry->origin & cpu->addressMask))
+    {
+        return 0;
+    }
+
+    memcpy(cpu->memory + (entry->origin & cpu->addressMask), view + entry->offset, entry->words * sizeof(uint16_t));
+
+    // The loaded words are initialized as far as the shadow memory is concerned
+    if (cpu->shadowPtr)
+    {
+        cpu->shadowPtr->MarkInitialized(entry->origin, entry->words);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Copies an image, looked up as by Find, into the memory of a CPU.
+ *
+ * @param cpu The CPU to load the image into.
+ * @param name The name of the image, or '#' followed by its hash in hex.
+ * @return Returns 1 if the image was loaded, 0 if it is not in the bundle or does not fit.
+ */
+int ImageBundle::Load(CPU* cpu, const char* name) const
+{
+    const BundleEntry* entry = Find(name);
+    return entry ? Load(cpu, entry) : 0;
+}
+
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of a block of bytes.
+ *
+ * @param data The bytes.
+ * @param length The number of bytes.
+ * @return The hash.
+ */
+uint64_t ImageBundle::Hash(const uint8_t* data, size_t length)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL; // FNV offset basis
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL; // FNV prime
+    }
+    return hash;
+}
+
+
+/**
+ * @brief Packs the image files given on the command line into a bundle.
+ *
+ * Images are named after their file name without the directory, and listed on stdout with their
+ * origin, size and hash.
+ *
+ * @param path The path of the bundle to write.
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments; those not starting with "--" are image files.
+ * @return The exit code: 0 on success, 1 if an image cannot be read or named, or the bundle cannot be written.
+ */
+int ImageBundle::Pack(const char* path, int argc, const char* argv[])
+{
+    std::vector<BundleEntry> index;
+    std::vector<std::vector<uint16_t>> images;
+
+    for (int j = 1; j < argc; ++j)
+    {
+        if (strncmp(argv[j], "--", 2) == 0)
+        {
+            continue;
+        }
+
+        FILE* image = fopen(argv[j], "rb");
+        if (!image)
+        {
+            fprintf(stderr, "bundle: cannot open %s\n", argv[j]);
+            return 1;
+        }
+
+        std::vector<uint8_t> bytes(sizeof(uint16_t) * (MEMORY_MAX + 1) + 1);
+        size_t length = fread(bytes.data(), 1, bytes.size(), image);
+        fclose(image);
+
+        const char* name = BaseName(argv[j]);
+        if (length < sizeof(uint16_t) || length > sizeof(uint16_t) * (MEMORY_MAX + 1) || strlen(name) >= BUNDLE_NAME_MAX)
+        {
+            fprintf(stderr, "bundle: %s is not an image of at most %d words with a name shorter than %d characters\n",
+                argv[j], MEMORY_MAX, BUNDLE_NAME_MAX);
+            return 1;
+        }
+
+        BundleEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        strcpy(entry.name, name);
+        entry.hash = Hash(bytes.data(), length);
+        entry.origin = (uint16_t)((bytes[0] << 8) | bytes[1]);
+        entry.words = (uint32_t)((length - sizeof(uint16_t)) / sizeof(uint16_t));
+
+        // Swapped once here instead of on every load
+        std::vector<uint16_t> words(entry.words);
+        for (uint32_t i = 0; i < entry.words; ++i)
+        {
+            words[i] = (uint16_t)((bytes[2 + 2 * i] << 8) | bytes[3 + 2 * i]);
+        }
+
+        index.push_back(entry);
+        images.push_back(words);
+    }
+
+    // Sort by name for the binary search of Find
+    std::vector<uint32_t> order(index.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return strcmp(index[a].name, index[b].name) < 0; });
+
+    BundleHeader bundleHeader;
+    memset(&bundleHeader, 0, sizeof(bundleHeader));
+    bundleHeader.magic = BUNDLE_MAGIC;
+    bundleHeader.version = BUNDLE_VERSION;
+    bundleHeader.count = (uint32_t)index.size();
+    bundleHeader.indexOffset = sizeof(BundleHeader);
+
+    std::vector<BundleEntry> sorted;
+    uint64_t offset = AlignOffset(bundleHeader.indexOffset + index.size() * sizeof(BundleEntry));
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        BundleEntry entry = index[order[i]];
+        if (!sorted.empty() && strcmp(sorted.back().name, entry.name) == 0)
+        {
+            fprintf(stderr, "bundle: two images are named %s\n", entry.name);
+            return 1;
+        }
+        entry.offset = offset;
+        offset = AlignOffset(offset + entry.words * sizeof(uint16_t));
+        sorted.push_back(entry);
+    }
+    bundleHeader.size = offset;
+
+    FILE* bundle = fopen(path, "wb");
+    if (!bundle)
+    {
+        fprintf(stderr, "bundle: cannot create %s\n", path);
+        return 1;
+    }
+
+    static const uint8_t padding[BUNDLE_ALIGN] = {};
+    int failed = fwrite(&bundleHeader, sizeof(bundleHeader), 1, bundle) != 1 ||
+        (!sorted.empty() && fwrite(sorted.data(), sizeof(BundleEntry), sorted.size(), bundle) != sorted.size());
+    uint64_t written = sizeof(bundleHeader) + sorted.size() * sizeof(BundleEntry);
+
+    for (uint32_t i = 0; i < sorted.size() && !failed; ++i)
+    {
+        const std::vector<uint16_t>& words = images[order[i]];
+        failed = fwrite(padding, 1, (size_t)(sorted[i].offset - written), bundle) != sorted[i].offset - written ||
+            (!words.empty() && fwrite(words.data(), sizeof(uint16_t), words.size(), bundle) != words.size());
+        written = sorted[i].offset + words.size() * sizeof(uint16_t);
+
+        printf("%-*s x%04X %5u words %016llx\n", BUNDLE_NAME_MAX - 1, sorted[i].name, sorted[i].origin,
+            sorted[i].words, (unsigned long long)sorted[i].hash);
+    }
+
+    failed = failed || fwrite(padding, 1, (size_t)(bundleHeader.size - written), bundle) != bundleHeader.size - written;
+    failed = fclose(bundle) != 0 || failed;
+
+    if (failed)
+    {
+        fprintf(stderr, "bundle: cannot write %s\n", path);
+        remove(path);
+        return 1;
+    }
+
+    fprintf(stderr, "bundle: %u images, %llu bytes in %s\n", bundleHeader.count, (unsigned long long)bundleHeader.size, path);
+    return 0;
+}
\ No newline at end of file
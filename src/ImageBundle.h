@@ -0,0 +1,83 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef IMAGE_BUNDLE_H
+#define IMAGE_BUNDLE_H
+
+// Identifies a bundle file ("LC3BUNDL") and the layout of its header and index; bump the version whenever they change.
+#define BUNDLE_MAGIC 0x4C444E5542334C43ULL
+#define BUNDLE_VERSION 1
+
+// Longest image name in a bundle, including the terminating null.
+#define BUNDLE_NAME_MAX 40
+
+// Alignment of the words of each image within the bundle, in bytes.
+#define BUNDLE_ALIGN 64
+
+
+#include <cstddef>
+#include <cstdint>
+#include <Windows.h>
+
+
+class CPU;
+
+
+// Start of a bundle file. The index follows at indexOffset, then the words of every image.
+struct BundleHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint64_t indexOffset;
+    uint64_t size;
+};
+
+
+// One image of a bundle. Entries are sorted by name; the words are stored in host byte order,
+// ready to be copied into memory.
+struct BundleEntry
+{
+    char name[BUNDLE_NAME_MAX];
+    uint64_t hash;       // FNV-1a hash of the original image file, origin included
+    uint64_t offset;     // file offset of the words
+    uint32_t words;      // number of words
+    uint16_t origin;     // load address
+    uint16_t reserved;
+};
+
+
+// Many images in one file, mapped once and loaded into any number of CPUs by name or hash.
+class ImageBundle
+{
+private:
+    HANDLE file;
+    HANDLE mapping;
+    const uint8_t* view;
+    const BundleHeader* header;
+    const BundleEntry* entries;
+
+public:
+    ImageBundle();
+    ~ImageBundle();
+
+    int Open(const char* path);
+    const BundleEntry* Find(const char* name) const;
+    const BundleEntry* FindHash(uint64_t hash) const;
+    int Load(CPU* cpu, const BundleEntry* entry) const;
+    int Load(CPU* cpu, const char* name) const;
+
+    static int Pack(const char* path, int argc, const char* argv[]);
+    static uint64_t Hash(const uint8_t* data, size_t length);
+
+private:
+    void Close();
+};
+#endif
\ No newline at end of file
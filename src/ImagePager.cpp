@@ -0,0 +1,192 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+
+
+#include "ImagePager.h"
+#include "ShadowMemory.h"
+
+
+/**
+ * @brief Constructs an ImagePager and attaches it to a CPU.
+ *
+ * MemoryIO and DecodeCache keep their own copy of the memory layout, so they must be attached to
+ * the CPU again once the images are mapped.
+ *
+ * @param cpu Pointer to the CPU whose memory the images are loaded into.
+ */
+ImagePager::ImagePager(CPU* cpu)
+{
+    cpuPtr = cpu;
+    segmentCount = 0;
+    pagesMapped = 0;
+    pagesLoaded = 0;
+    memset(absent, 0, sizeof(absent));
+
+    cpu->pagerPtr = this;
+    cpu->absentPages = absent;
+}
+
+
+/**
+ * @brief Detaches the ImagePager from its CPU and unmaps the image files.
+ */
+ImagePager::~ImagePager()
+{
+    if (cpuPtr->pagerPtr == this)
+    {
+        cpuPtr->pagerPtr = nullptr;
+        cpuPtr->absentPages = nullptr;
+    }
+
+    for (int i = 0; i < segmentCount; ++i)
+    {
+        UnmapViewOfFile(segments[i].view);
+        CloseHandle(segments[i].mapping);
+        CloseHandle(segments[i].file);
+    }
+}
+
+
+/**
+ * @brief Maps an image file and marks the pages it covers absent, without reading them.
+ *
+ * The image is checked as by CPU::ReadImageFile: it must start and end inside the memory.
+ *
+ * @param imagePath The path to the image file.
+ * @return Returns 1 if the image was mapped, 0 if it cannot be opened or does not fit.
+ */
+int ImagePager::Map(const char* imagePath)
+{
+    if (segmentCount == IMAGE_MAX_SEGMENTS)
+    {
+        fprintf(stderr, "image: more than %d images to load on demand\n", IMAGE_MAX_SEGMENTS);
+        return 0;
+    }
+
+    HANDLE file = CreateFileA(imagePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    const uint8_t* view = NULL;
+
+    // A file too short to hold an origin cannot be mapped, and is not an image either
+    if (GetFileSizeEx(file, &size) && size.QuadPart >= (LONGLONG)sizeof(uint16_t))
+    {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        view = mapping ? (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    }
+
+    uint16_t origin = view ? (uint16_t)((view[0] << 8) | view[1]) : 0;
+    uint64_t count = view ? (uint64_t)(size.QuadPart - sizeof(uint16_t)) / sizeof(uint16_t) : 0;
+
+    if (!view || !cpuPtr->Contains(origin) || count > cpuPtr->memoryWords - (origin & cpuPtr->addressMask))
+    {
+        if (view)
+        {
+            UnmapViewOfFile(view);
+        }
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return 0;
+    }
+
+    ImageSegment& segment = segments[segmentCount++];
+    segment.file = file;
+    segment.mapping = mapping;
+    segment.view = view;
+    segment.words = view + sizeof(uint16_t);
+    segment.start = origin & cpuPtr->addressMask;
+    segment.count = (uint32_t)count;
+
+    uint32_t end = segment.start + segment.count;
+    for (uint32_t page = segment.start >> IMAGE_PAGE_SHIFT; page << IMAGE_PAGE_SHIFT < end; ++page)
+    {
+        if (!absent[page])
+        {
+            absent[page] = 1;
+            ++pagesMapped;
+        }
+    }
+
+    // The mapped words are initialized as far as the shadow memory is concerned
+    if (cpuPtr->shadowPtr)
+    {
+        cpuPtr->shadowPtr->MarkInitialized(origin, segment.count);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Copies the page holding an address from the mapped images into memory.
+ *
+ * Images are copied in the order they were mapped, so where they overlap the later one wins,
+ * as when they are read one after the other.
+ *
+ * @param address An address in the absent page.
+ */
+void ImagePager::Load(uint16_t address)
+{
+    uint32_t page = (address & cpuPtr->addressMask) >> IMAGE_PAGE_SHIFT;
+    uint32_t first = page << IMAGE_PAGE_SHIFT;
+    uint32_t end = first + IMAGE_PAGE_WORDS;
+
+    for (int i = 0; i < segmentCount; ++i)
+    {
+        const ImageSegment& segment = segments[i];
+        uint32_t from = segment.start > first ? segment.start : first;
+        uint32_t to = segment.start + segment.count < end ? segment.start + segment.count : end;
+
+        for (uint32_t index = from; index < to; ++index)
+        {
+            const uint8_t* bytes = segment.words + (size_t)(index - segment.start) * sizeof(uint16_t);
+            cpuPtr->memory[index] = (uint16_t)((bytes[0] << 8) | bytes[1]);
+        }
+    }
+
+    absent[page] = 0;
+    ++pagesLoaded;
+}
+
+
+/**
+ * @brief Copies every page still absent, so that no page comes in later.
+ */
+void ImagePager::LoadAll()
+{
+    for (uint32_t page = 0; page < (cpuPtr->memoryWords >> IMAGE_PAGE_SHIFT); ++page)
+    {
+        if (absent[page])
+        {
+            Load((uint16_t)(page << IMAGE_PAGE_SHIFT));
+        }
+    }
+}
+
+
+/**
+ * @brief Prints how many of the mapped pages the guest actually used.
+ */
+void ImagePager::Report() const
+{
+    fprintf(stderr, "image: %u of %u mapped pages loaded on demand (%u words each)\n",
+        pagesLoaded, pagesMapped, (unsigned)IMAGE_PAGE_WORDS);
+}
\ No newline at end of file
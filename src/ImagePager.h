@@ -0,0 +1,60 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef IMAGE_PAGER_H
+#define IMAGE_PAGER_H
+
+// Largest number of image files mapped into one memory.
+#define IMAGE_MAX_SEGMENTS 64
+
+
+#include <cstdint>
+#include <Windows.h>
+
+#include "CPU.h"
+
+
+// One image file mapped into memory.
+struct ImageSegment
+{
+    HANDLE file;
+    HANDLE mapping;
+    const uint8_t* view;   // the whole file, origin first
+    const uint8_t* words;  // the big-endian words following the origin
+    uint32_t start;        // index in memory of the first word
+    uint32_t count;        // number of words
+};
+
+
+// Loads images on demand: a mapped image only marks its pages absent, and each page is copied
+// from the mapped files, with the byte order converted, on the first access to it.
+class ImagePager
+{
+public:
+    // One flag per page of memory, set while the page still has to be copied from the images.
+    uint8_t absent[MEMORY_MAX >> IMAGE_PAGE_SHIFT];
+
+private:
+    CPU* cpuPtr;
+    ImageSegment segments[IMAGE_MAX_SEGMENTS];
+    int segmentCount;
+    uint32_t pagesMapped;
+    uint32_t pagesLoaded;
+
+public:
+    ImagePager(CPU* cpu);
+    ~ImagePager();
+
+    int Map(const char* imagePath);
+    void Load(uint16_t address);
+    void LoadAll();
+    void Report() const;
+};
+#endif
\ No newline at end of file
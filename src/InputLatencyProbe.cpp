@@ -0,0 +1,164 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+
+
+#include "InputLatencyProbe.h"
+#include "Console.h"
+
+
+/**
+ * @brief Returns the current value of the performance counter.
+ */
+static int64_t Now()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+
+/**
+ * @brief Constructs an InputLatencyProbe watching the given console input handle.
+ *
+ * @param input Handle to the console input.
+ */
+InputLatencyProbe::InputLatencyProbe(HANDLE input) : arrival(0), watching(0)
+{
+    hInput = input;
+    consumedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = counterFrequency.QuadPart;
+}
+
+
+/**
+ * @brief Destroys the InputLatencyProbe object, stopping its watcher thread.
+ */
+InputLatencyProbe::~InputLatencyProbe()
+{
+    Stop();
+    if (consumedEvent)
+    {
+        CloseHandle(consumedEvent);
+    }
+}
+
+
+/**
+ * @brief Starts the watcher thread that timestamps input arrival.
+ */
+void InputLatencyProbe::Start()
+{
+    watching = 1;
+    watcher = std::thread(&InputLatencyProbe::Watch, this);
+}
+
+
+/**
+ * @brief Stops the watcher thread.
+ */
+void InputLatencyProbe::Stop()
+{
+    if (watcher.joinable())
+    {
+        watching = 0;
+        SetEvent(consumedEvent);
+        watcher.join();
+    }
+}
+
+
+/**
+ * @brief Watcher thread body.
+ *
+ * Records when a key press first shows up in the console input buffer. Records that are not
+ * key presses are drained rather than timestamped, so the wait on the input handle blocks until
+ * something new arrives. The timestamp is kept until the guest takes the key, so the measured
+ * latency covers the time a key sits in the console buffer while the guest is busy.
+ */
+void InputLatencyProbe::Watch()
+{
+    while (watching)
+    {
+        if (!Console::DrainInput())
+        {
+            // Nothing pending, so any remembered arrival was consumed by a trap rather than KBSR
+            arrival = 0;
+            WaitForSingleObject(hInput, 50);
+            continue;
+        }
+
+        int64_t none = 0;
+        arrival.compare_exchange_strong(none, Now());
+
+        // Sleep until the guest takes the key instead of spinning on the still-signaled handle
+        WaitForSingleObject(consumedEvent, 50);
+    }
+}
+
+
+/**
+ * @brief Timestamps a key found by the guest's own KBSR poll.
+ *
+ * When the VM was already blocked waiting for input it may see the key before the watcher
+ * thread does; the arrival is then taken from the poll's wake-up instead.
+ */
+void InputLatencyProbe::OnKeyPending()
+{
+    int64_t none = 0;
+    arrival.compare_exchange_strong(none, Now());
+}
+
+
+/**
+ * @brief Records the latency of a key that was just made visible through KBSR.
+ *
+ * Called by MemoryIO::Read right after the keyboard status register was set.
+ */
+void InputLatencyProbe::OnKeyConsumed()
+{
+    int64_t arrived = arrival.exchange(0);
+    if (arrived)
+    {
+        // Split to avoid overflowing the multiplication when the key waited long
+        int64_t ticks = Now() - arrived;
+        latency.Record((uint64_t)(ticks / frequency * 1000000000 + ticks % frequency * 1000000000 / frequency));
+    }
+    SetEvent(consumedEvent);
+}
+
+
+/**
+ * @brief Forgets a pending arrival that turned out not to be a key press.
+ *
+ * Console input also signals for focus and key-release events, which never reach KBSR.
+ */
+void InputLatencyProbe::OnNoKey()
+{
+    arrival = 0;
+}
+
+
+/**
+ * @brief Prints the input latency percentiles to stderr.
+ */
+void InputLatencyProbe::Report() const
+{
+    fprintf(stderr, "input latency: %llu keys, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+        (unsigned long long)latency.Count(),
+        latency.Percentile(50.0) / 1000.0,
+        latency.Percentile(99.0) / 1000.0,
+        latency.Percentile(99.9) / 1000.0,
+        latency.Max() / 1000.0);
+}
\ No newline at end of file
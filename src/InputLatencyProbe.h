@@ -0,0 +1,54 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef INPUT_LATENCY_PROBE_H
+#define INPUT_LATENCY_PROBE_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <Windows.h>
+
+#include "Histogram.h"
+
+
+class InputLatencyProbe
+{
+private:
+    // Console input handle watched for pending input, and the event signaled when the guest takes a key.
+    HANDLE hInput;
+    HANDLE consumedEvent;
+
+    // Performance counter value at which pending input was first seen, zero while none is pending.
+    std::atomic<int64_t> arrival;
+    std::atomic<int> watching;
+    std::thread watcher;
+
+    // Arrival to KBSR-set latency, in nanoseconds.
+    Histogram latency;
+    LONGLONG frequency;
+
+public:
+    InputLatencyProbe(HANDLE input);
+    ~InputLatencyProbe();
+
+    void Start();
+    void Stop();
+
+    void OnKeyPending();
+    void OnKeyConsumed();
+    void OnNoKey();
+    void Report() const;
+
+private:
+    void Watch();
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include "Isa.h"
+
+
+#define ISA_ENTRY(NAME, KIND, FORMAT, BITS) { #NAME, IsaKinds::ISA_KIND_##KIND, IsaFormats::ISA_FORMAT_##FORMAT, BITS },
+
+// Rows of LC3_ISA, indexed by opcode.
+const IsaEntry isaTable[ISA_OPCODES] =
+{
+    LC3_ISA(ISA_ENTRY)
+};
+
+#undef ISA_ENTRY
+
+
+#define ISA_COUNT(NAME, KIND, FORMAT, BITS) + 1
+static_assert(0 LC3_ISA(ISA_COUNT) == ISA_OPCODES, "LC3_ISA must have one row per opcode");
+#undef ISA_COUNT
\ No newline at end of file
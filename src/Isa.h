@@ -0,0 +1,127 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef ISA_H
+#define ISA_H
+
+// The LC-3 instruction set, one row per opcode in opcode order: X(NAME, KIND, FORMAT, OFFSET_BITS).
+// The Opcodes enumeration, the ArithmeticLogicUnit declarations, the decoder, the dispatch tables
+// and switches of every engine, the disassembler and the --isa-check vectors are all generated
+// from it, so an instruction is added or changed here and nowhere else.
+//
+//   KIND         ALU runs an ArithmeticLogicUnit method, TRAP the Trap proxy, RESERVED aborts
+//   FORMAT       operand layout, as a value of the IsaFormats enumeration without its prefix
+//   OFFSET_BITS  width of the sign-extended immediate or offset in bits [OFFSET_BITS-1:0], 0 if none
+#define LC3_ISA(X) \
+    X(BR,   ALU,      BRANCH,       9) \
+    X(ADD,  ALU,      OPERATE,      5) \
+    X(LD,   ALU,      PC_OFFSET,    9) \
+    X(ST,   ALU,      PC_OFFSET,    9) \
+    X(JSR,  ALU,      SUBROUTINE,  11) \
+    X(AND,  ALU,      OPERATE,      5) \
+    X(LDR,  ALU,      BASE_OFFSET,  6) \
+    X(STR,  ALU,      BASE_OFFSET,  6) \
+    X(RTI,  RESERVED, NONE,         0) \
+    X(NOT,  ALU,      NOT,          0) \
+    X(LDI,  ALU,      PC_OFFSET,    9) \
+    X(STI,  ALU,      PC_OFFSET,    9) \
+    X(JMP,  ALU,      JUMP,         0) \
+    X(RES,  RESERVED, DATA,         0) \
+    X(LEA,  ALU,      PC_OFFSET,    9) \
+    X(TRAP, TRAP,     TRAP,         0)
+
+// Number of opcodes, the rows of LC3_ISA.
+#define ISA_OPCODES 16
+
+// Expands to one statement per ALU instruction, as "case OP_NAME: ISA_EXECUTE(NAME); break;".
+// Define ISA_EXECUTE before expanding LC3_ISA(ISA_ALU_CASE) inside a switch on the opcode.
+#define ISA_ALU_CASE(NAME, KIND, FORMAT, BITS) ISA_ALU_CASE_##KIND(NAME)
+#define ISA_ALU_CASE_ALU(NAME) case OP_##NAME: ISA_EXECUTE(NAME); break;
+#define ISA_ALU_CASE_TRAP(NAME)
+#define ISA_ALU_CASE_RESERVED(NAME)
+
+
+#include <cstdint>
+
+
+#define ISA_OPCODE(NAME, KIND, FORMAT, BITS) OP_##NAME,
+enum Opcodes : uint16_t
+{
+    LC3_ISA(ISA_OPCODE)
+};
+#undef ISA_OPCODE
+
+
+#define ISA_OFFSET_BITS(NAME, KIND, FORMAT, BITS) ISA_BITS_##NAME = BITS,
+enum IsaOffsetBits : uint16_t
+{
+    LC3_ISA(ISA_OFFSET_BITS)
+};
+#undef ISA_OFFSET_BITS
+
+
+enum IsaKinds : uint8_t
+{
+    ISA_KIND_ALU = 0, // executed by an ArithmeticLogicUnit method
+    ISA_KIND_TRAP,    // executed by Trap::Proxy
+    ISA_KIND_RESERVED // not implemented, aborts
+};
+
+
+enum IsaFormats : uint8_t
+{
+    ISA_FORMAT_NONE = 0,     // no operands
+    ISA_FORMAT_BRANCH,       // condition flags [11:9], PCoffset9
+    ISA_FORMAT_OPERATE,      // DR, SR1, SR2 or imm5 selected by bit 5
+    ISA_FORMAT_PC_OFFSET,    // DR (or SR), PCoffset9
+    ISA_FORMAT_BASE_OFFSET,  // DR (or SR), BaseR, offset6
+    ISA_FORMAT_SUBROUTINE,   // PCoffset11 or BaseR selected by bit 11
+    ISA_FORMAT_NOT,          // DR, SR1
+    ISA_FORMAT_JUMP,         // BaseR
+    ISA_FORMAT_TRAP,         // trapvect8
+    ISA_FORMAT_DATA          // not an instruction
+};
+
+
+// One row of LC3_ISA, indexed by opcode in isaTable.
+struct IsaEntry
+{
+    const char* mnemonic;
+    uint8_t kind;
+    uint8_t format;
+    uint8_t offsetBits;
+};
+
+extern const IsaEntry isaTable[ISA_OPCODES];
+
+
+// Operand fields shared by every format.
+inline uint16_t IsaDR(uint16_t instruction) { return (instruction >> 9) & 0x0007; }
+inline uint16_t IsaSR1(uint16_t instruction) { return (instruction >> 6) & 0x0007; }
+inline uint16_t IsaSR2(uint16_t instruction) { return instruction & 0x0007; }
+inline uint16_t IsaImmediateFlag(uint16_t instruction) { return (instruction >> 5) & 0x0001; }
+inline uint16_t IsaLongFlag(uint16_t instruction) { return (instruction >> 11) & 0x0001; }
+
+
+/**
+ * @brief Returns the sign-extended immediate or offset held in the low bits of an instruction.
+ *
+ * Branch-free, and folded to a mask and two constants when the width is known at compile time.
+ *
+ * @param instruction The 16-bit instruction.
+ * @param bits The width of the field, as given by the ISA_BITS_ constant of the opcode.
+ * @return The sign-extended value.
+ */
+inline uint16_t IsaOffset(uint16_t instruction, int bits)
+{
+    uint16_t sign = (uint16_t)(1u << (bits - 1));
+    return (uint16_t)(((instruction & ((1u << bits) - 1)) ^ sign) - sign);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,202 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+#include <Windows.h>
+
+
+#include "IsaCheck.h"
+#include "CPU.h"
+#include "ArithmeticLogicUnit.h"
+#include "Disassembler.h"
+#include "DecodeCache.h"
+
+
+/**
+ * @brief Constructs an IsaCheck running instructions on the given CPU.
+ *
+ * @param cpu Pointer to the CPU object whose registers and memory are overwritten by the check.
+ * @param alu Pointer to the ArithmeticLogicUnit object executing the instructions.
+ */
+IsaCheck::IsaCheck(CPU* cpu, ArithmeticLogicUnit* alu)
+{
+    cpuPtr = cpu;
+    aluPtr = alu;
+}
+
+
+/**
+ * @brief Predecodes a memory holding every encoding and compares each entry with ArithmeticLogicUnit::Decode.
+ *
+ * Also reports how long predecoding the whole address space takes.
+ *
+ * @return The number of entries that differ.
+ */
+uint64_t IsaCheck::CheckPredecode()
+{
+    DecodeCache cache(aluPtr);
+    static const DecodedHandler handlers[ISA_OPCODES] = {};
+    uint64_t mismatches = 0;
+
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        cpuPtr->memory[address] = (uint16_t)address;
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    double best = 0;
+
+    for (int round = 0; round < ISA_CHECK_PREDECODE_ROUNDS; ++round)
+    {
+        QueryPerformanceCounter(&start);
+        cache.Predecode(cpuPtr->memory, handlers);
+        QueryPerformanceCounter(&end);
+
+        double seconds = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+        best = (round == 0 || seconds < best) ? seconds : best;
+    }
+
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        DecodedInstruction expected = aluPtr->Decode((uint16_t)address);
+        const DecodedInstruction& actual = cache.entries[address];
+
+        if (expected.instruction != actual.instruction || expected.offset != actual.offset ||
+            expected.operation != actual.operation || expected.DR != actual.DR ||
+            expected.SR1 != actual.SR1 || expected.SR2 != actual.SR2 || expected.flag != actual.flag)
+        {
+            if (mismatches < ISA_CHECK_REPORT_LIMIT)
+            {
+                fprintf(stderr, "isa: x%04X: predecode differs from Decode\n", address);
+            }
+            ++mismatches;
+        }
+    }
+
+    fprintf(stderr, "isa: predecoded %d words in %.1f us\n", MEMORY_MAX, best * 1e6);
+    return mismatches;
+}
+
+
+/**
+ * @brief Sets the registers and the memory window to the pattern every instruction starts from.
+ *
+ * Base registers point near x3100 and memory words hold pointers into x3400-x34FF, so every
+ * effective address, direct or indirect, stays inside the window and away from the device registers.
+ */
+void IsaCheck::Prepare()
+{
+    for (int reg = Registers::R_0; reg <= Registers::R_7; ++reg)
+    {
+        cpuPtr->registers[reg] = (uint16_t)(0x3100 + 0x10 * reg);
+    }
+    cpuPtr->registers[Registers::R_PC] = 0x3001;
+    cpuPtr->registers[Registers::R_COND] = ConditionFlags::FL_ZERO;
+
+    for (int address = ISA_CHECK_FIRST; address < ISA_CHECK_LAST; ++address)
+    {
+        cpuPtr->memory[address] = (uint16_t)(0x3400 + (address & 0xFF));
+    }
+}
+
+
+/**
+ * @brief Executes an instruction through the ALU method taking the raw instruction.
+ */
+void IsaCheck::ExecuteRaw(uint16_t instruction)
+{
+    switch (instruction >> 12)
+    {
+#define ISA_EXECUTE(NAME) aluPtr->NAME(instruction)
+    LC3_ISA(ISA_ALU_CASE)
+#undef ISA_EXECUTE
+    }
+}
+
+
+/**
+ * @brief Executes an instruction through the ALU method taking its decoded fields.
+ */
+void IsaCheck::ExecuteDecoded(uint16_t instruction)
+{
+    DecodedInstruction decoded = aluPtr->Decode(instruction);
+
+    switch (decoded.operation)
+    {
+#define ISA_EXECUTE(NAME) aluPtr->NAME(decoded)
+    LC3_ISA(ISA_ALU_CASE)
+#undef ISA_EXECUTE
+    }
+}
+
+
+/**
+ * @brief Runs every encoding of every ALU instruction of LC3_ISA and prints the result to stderr.
+ *
+ * The vectors are generated from the table: all 4096 operand encodings of each ALU opcode are
+ * executed once through the raw path and once through Decode, from the same state, and must leave
+ * identical registers and memory. Every encoding of every opcode must also disassemble. The CPU is
+ * left in an arbitrary state, so the check runs instead of a guest.
+ *
+ * @return Returns 0 if every vector passed, 1 otherwise.
+ */
+int IsaCheck::Run()
+{
+    static uint16_t expected[ISA_CHECK_LAST - ISA_CHECK_FIRST];
+    uint16_t expectedRegisters[REGISTER_COUNT];
+
+    uint64_t vectors = 0;
+    uint64_t mismatches = 0;
+    char text[DISASSEMBLY_MAX];
+
+    for (uint32_t encoding = 0; encoding < MEMORY_MAX; ++encoding)
+    {
+        uint16_t instruction = (uint16_t)encoding;
+
+        // Every instruction is executed as if fetched from x3000
+        if (Disassembler::Format(0x3000, instruction, text) == 0)
+        {
+            fprintf(stderr, "isa: x%04X does not disassemble\n", instruction);
+            ++mismatches;
+        }
+
+        if (isaTable[instruction >> 12].kind != IsaKinds::ISA_KIND_ALU)
+        {
+            continue;
+        }
+        ++vectors;
+
+        Prepare();
+        ExecuteRaw(instruction);
+        memcpy(expectedRegisters, cpuPtr->registers, sizeof(expectedRegisters));
+        memcpy(expected, cpuPtr->memory + ISA_CHECK_FIRST, sizeof(expected));
+
+        Prepare();
+        ExecuteDecoded(instruction);
+
+        if (memcmp(expectedRegisters, cpuPtr->registers, sizeof(expectedRegisters)) != 0 ||
+            memcmp(expected, cpuPtr->memory + ISA_CHECK_FIRST, sizeof(expected)) != 0)
+        {
+            if (mismatches < ISA_CHECK_REPORT_LIMIT)
+            {
+                fprintf(stderr, "isa: x%04X %s: raw and decoded execution differ\n", instruction, text);
+            }
+            ++mismatches;
+        }
+    }
+
+    mismatches += CheckPredecode();
+
+    fprintf(stderr, "isa: %llu vectors from %d opcodes, %llu mismatches\n",
+        (unsigned long long)vectors, ISA_OPCODES, (unsigned long long)mismatches);
+    return mismatches ? 1 : 0;
+}
\ No newline at end of file
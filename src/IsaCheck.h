@@ -0,0 +1,50 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef ISA_CHECK_H
+#define ISA_CHECK_H
+
+// Memory window every checked instruction reads and writes, given the register and memory
+// patterns set up before each one.
+#define ISA_CHECK_FIRST 0x2E00
+#define ISA_CHECK_LAST 0x3500
+
+// Predecode passes timed by the check; the fastest one is reported.
+#define ISA_CHECK_PREDECODE_ROUNDS 16
+
+// Mismatches printed before the rest are only counted.
+#define ISA_CHECK_REPORT_LIMIT 16
+
+
+#include <cstdint>
+
+
+class CPU;
+class ArithmeticLogicUnit;
+
+
+class IsaCheck
+{
+private:
+    CPU* cpuPtr;
+    ArithmeticLogicUnit* aluPtr;
+
+public:
+    IsaCheck(CPU* cpu, ArithmeticLogicUnit* alu);
+
+    int Run();
+
+private:
+    uint64_t CheckPredecode();
+    void Prepare();
+    void ExecuteRaw(uint16_t instruction);
+    void ExecuteDecoded(uint16_t instruction);
+};
+#endif
\ No newline at end of file
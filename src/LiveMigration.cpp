@@ -0,0 +1,640 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+// Winsock must be included before Windows.h pulls in its older winsock.h
+#include <winsock2.h>
+#include <afunix.h>
+#include <cstdio>
+#include <cstring>
+
+
+#include "LiveMigration.h"
+#include "OS.h"
+#include "Console.h"
+#include "MemoryIO.h"
+#include "ShadowMemory.h"
+
+
+/**
+ * @brief Constructs a LiveMigration that neither listens nor is connected.
+ *
+ * @param cpu Pointer to the CPU whose guest is sent or received.
+ * @param os Pointer to the OS object, whose keyboard is watched while the guest waits for a key.
+ * @param console Pointer to the Console object, whose unread keys travel with the guest.
+ * @param memoryIO Pointer to the MemoryIO object, whose counters travel with the guest.
+ */
+LiveMigration::LiveMigration(CPU* cpu, OS* os, Console* console, MemoryIO* memoryIO)
+{
+    cpuPtr = cpu;
+    osPtr = os;
+    consolePtr = console;
+    memoryIOPtr = memoryIO;
+
+    listener = (uintptr_t)INVALID_SOCKET;
+    connection = (uintptr_t)INVALID_SOCKET;
+
+    memset(pageSent, 0, sizeof(pageSent));
+    scanPage = 0;
+    roundDirty = 0;
+    rounds = 0;
+    pagesSent = 0;
+    handedOver = 0;
+
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = counterFrequency.QuadPart;
+    pausedAt = 0;
+    idleKind = 0;
+    idleUntil = 0;
+
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+}
+
+
+/**
+ * @brief Closes the sockets and removes the socket file listened on.
+ */
+LiveMigration::~LiveMigration()
+{
+    if ((SOCKET)connection != INVALID_SOCKET)
+    {
+        closesocket((SOCKET)connection);
+    }
+    if ((SOCKET)listener != INVALID_SOCKET)
+    {
+        closesocket((SOCKET)listener);
+        DeleteFileA(socketPath.c_str());
+    }
+
+    WSACleanup();
+}
+
+
+/**
+ * @brief Listens on a Unix domain socket for the target to take the guest over.
+ *
+ * The guest keeps running; Poll accepts the target and migrates the guest once it connects.
+ *
+ * @param path The socket path.
+ * @return Returns 1 on success, 0 if the socket could not be set up.
+ */
+int LiveMigration::Listen(const char* path)
+{
+    SOCKADDR_UN address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "migration: socket path too long: %s\n", path);
+        return 0;
+    }
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    SOCKET socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketHandle == INVALID_SOCKET)
+    {
+        fprintf(stderr, "migration: could not create a Unix socket\n");
+        return 0;
+    }
+    listener = (uintptr_t)socketHandle;
+
+    // A socket file left by an earlier run would make bind fail
+    DeleteFileA(path);
+
+    if (bind(socketHandle, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(socketHandle, 1) == SOCKET_ERROR)
+    {
+        fprintf(stderr, "migration: could not listen on %s\n", path);
+        return 0;
+    }
+    socketPath = path;
+
+    fprintf(stderr, "migration: listening on %s\n", path);
+    return 1;
+}
+
+
+/**
+ * @brief Moves the migration on by a step; called between slices and while the guest waits for input.
+ *
+ * Between slices at most MIGRATE_PAGES_PER_SLICE dirty pages are sent, so the guest keeps running
+ * while its memory is copied. A waiting guest cannot write memory, so the rounds are finished at once.
+ * The guest is handed over as soon as a round finds few enough dirty pages.
+ *
+ * @param waiting Nonzero if the guest waits inside an instruction, which the target then executes again.
+ * @param idle How the guest is idle between slices, a value of IdleKinds; it stays so on the target.
+ * @param until The deadline of IDLE_SLEEP, as a GetTickCount64 value.
+ * @return Returns 1 if the guest was handed over and must stop here, 0 if it keeps running.
+ */
+int LiveMigration::Poll(int waiting, uint16_t idle, ULONGLONG until)
+{
+    if (handedOver)
+    {
+        return 1;
+    }
+
+    idleKind = idle;
+    idleUntil = until;
+
+    if ((SOCKET)connection == INVALID_SOCKET && !Accept())
+    {
+        return 0;
+    }
+
+    int converged = PreCopy(waiting ? UINT32_MAX : MIGRATE_PAGES_PER_SLICE);
+    while (waiting && converged == 0)
+    {
+        converged = PreCopy(UINT32_MAX);
+    }
+
+    if (converged < 0)
+    {
+        Abandon();
+        return 0;
+    }
+
+    return converged ? HandOver(waiting) : 0;
+}
+
+
+/**
+ * @brief Waits for a key while keeping an eye on the socket, for traps that read the keyboard.
+ *
+ * The keyboard is checked every second, as by keyboard status polls, and the migration in between.
+ *
+ * @return Returns 1 if the guest was handed over while waiting, 0 once a key can be read.
+ */
+int LiveMigration::WaitForInput()
+{
+    while (!consolePtr->HasQueuedInput() && !osPtr->CheckKey())
+    {
+        if (Poll(1))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Connects to the source and receives the guest: its memory, unread keys and registers.
+ *
+ * The guest only runs here once Resume is called.
+ *
+ * @param path The socket path the source listens on.
+ * @return Returns 1 once the guest has arrived, 0 on failure, after printing the reason.
+ */
+int LiveMigration::Receive(const char* path)
+{
+    SOCKADDR_UN address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "migration: socket path too long: %s\n", path);
+        return 0;
+    }
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    SOCKET socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketHandle == INVALID_SOCKET || connect(socketHandle, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+    {
+        if (socketHandle != INVALID_SOCKET)
+        {
+            closesocket(socketHandle);
+        }
+        fprintf(stderr, "migration: could not connect to %s\n", path);
+        return 0;
+    }
+    connection = (uintptr_t)socketHandle;
+
+    MigrationHeader header;
+    if (!ReceiveAll(&header, sizeof(header)) || header.magic != MIGRATE_MAGIC || header.version != MIGRATE_VERSION)
+    {
+        fprintf(stderr, "migration: %s does not send a guest\n", path);
+        return 0;
+    }
+
+    // Memory was configured from the options, before anything was loaded into it
+    uint16_t faultMask = (header.memoryMode == MemoryModes::MEMORY_FAULT) ? (uint16_t)~(header.memoryWords - 1) : 0;
+    if (header.memoryWords != cpuPtr->memoryWords || faultMask != cpuPtr->faultMask)
+    {
+        fprintf(stderr, "migration: the guest has %u words of %s memory; start the target with the same --memory options\n",
+            header.memoryWords, header.memoryMode == MemoryModes::MEMORY_FAULT ? "faulting" : "wrapping");
+        return 0;
+    }
+
+    for (;;)
+    {
+        MigrationRecord record;
+        if (!ReceiveAll(&record, sizeof(record)))
+        {
+            break;
+        }
+
+        if (record.kind == MigrationRecords::MIGRATE_PAGE && record.length == IMAGE_PAGE_WORDS * sizeof(uint16_t) &&
+            ((uint32_t)record.page << IMAGE_PAGE_SHIFT) < cpuPtr->memoryWords)
+        {
+            uint32_t first = (uint32_t)record.page << IMAGE_PAGE_SHIFT;
+            if (!ReceiveAll(&cpuPtr->memory[first], record.length))
+            {
+                break;
+            }
+
+            // Which words the source initialized is not sent
+            if (cpuPtr->shadowPtr)
+            {
+                cpuPtr->shadowPtr->MarkInitialized((uint16_t)first, IMAGE_PAGE_WORDS);
+            }
+            ++pagesSent;
+        }
+        else if (record.kind == MigrationRecords::MIGRATE_ROUND && record.length == 0)
+        {
+            ++rounds;
+        }
+        else if (record.kind == MigrationRecords::MIGRATE_INPUT)
+        {
+            std::string keys(record.length, '\0');
+            if (!ReceiveAll(&keys[0], keys.size()))
+            {
+                break;
+            }
+            consolePtr->QueueInput(keys.data(), keys.size());
+        }
+        else if (record.kind == MigrationRecords::MIGRATE_STATE && record.length == sizeof(MigrationState))
+        {
+            MigrationState state;
+            if (!ReceiveAll(&state, sizeof(state)))
+            {
+                break;
+            }
+
+            memcpy(cpuPtr->registers, state.registers, sizeof(cpuPtr->registers));
+            pausedAt = state.pausedAt;
+            idleKind = state.idleKind;
+            idleUntil = state.idleUntil;
+
+            // The guest's clock keeps running through the downtime
+            LARGE_INTEGER now;
+            QueryPerformanceCounter(&now);
+            LONGLONG downtime = now.QuadPart - pausedAt;
+            memoryIOPtr->SeedCounters(state.instructions, state.microseconds +
+                (uint64_t)(downtime / frequency) * 1000000 + (uint64_t)(downtime % frequency) * 1000000 / (uint64_t)frequency);
+            return 1;
+        }
+        else
+        {
+            fprintf(stderr, "migration: unexpected record %u from %s\n", (unsigned)record.kind, path);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "migration: connection to %s lost before the guest arrived\n", path);
+    return 0;
+}
+
+
+/**
+ * @brief Takes whether the received guest slept or waited for a key when the source paused it.
+ *
+ * Both ends read the same tick count, so a sleep ends when it would have on the source.
+ *
+ * @param until Receives the deadline of IDLE_SLEEP, as a GetTickCount64 value.
+ * @return The idle state, as a value of IdleKinds.
+ */
+uint16_t LiveMigration::TakeIdle(ULONGLONG* until)
+{
+    uint16_t kind = idleKind;
+    *until = idleUntil;
+    idleKind = 0;
+    return kind;
+}
+
+
+/**
+ * @brief Tells the source that the guest runs here now and reports the downtime.
+ *
+ * Called right before the received guest runs again; the downtime is measured from the moment
+ * the source paused it, both processes reading the same performance counter.
+ */
+void LiveMigration::Resume()
+{
+    if ((SOCKET)connection == INVALID_SOCKET)
+    {
+        return;
+    }
+
+    char resumed = 1;
+    SendAll(&resumed, sizeof(resumed));
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    fprintf(stderr, "migration: guest resumed from %llu pages in %u pre-copy rounds, downtime %.0f us\n",
+        (unsigned long long)pagesSent, rounds, (double)(now.QuadPart - pausedAt) * 1e6 / (double)frequency);
+
+    closesocket((SOCKET)connection);
+    connection = (uintptr_t)INVALID_SOCKET;
+    pagesSent = 0;
+    rounds = 0;
+}
+
+
+/**
+ * @brief Accepts a target if one is connecting, and sends it the stream header.
+ *
+ * @return Returns 1 if a target is connected, 0 otherwise.
+ */
+int LiveMigration::Accept()
+{
+    if ((SOCKET)listener == INVALID_SOCKET)
+    {
+        return 0;
+    }
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET((SOCKET)listener, &readable);
+    timeval timeout = { 0, 0 };
+
+    if (select((int)(SOCKET)listener + 1, &readable, NULL, NULL, &timeout) <= 0)
+    {
+        return 0;
+    }
+
+    SOCKET socketHandle = accept((SOCKET)listener, NULL, NULL);
+    if (socketHandle == INVALID_SOCKET)
+    {
+        return 0;
+    }
+    connection = (uintptr_t)socketHandle;
+
+    MigrationHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MIGRATE_MAGIC;
+    header.version = MIGRATE_VERSION;
+    header.memoryWords = cpuPtr->memoryWords;
+    header.memoryMode = cpuPtr->faultMask ? MemoryModes::MEMORY_FAULT : MemoryModes::MEMORY_WRAP;
+
+    if (!SendAll(&header, sizeof(header)))
+    {
+        Abandon();
+        return 0;
+    }
+
+    fprintf(stderr, "migration: target connected, copying %u pages\n", cpuPtr->memoryWords >> IMAGE_PAGE_SHIFT);
+    return 1;
+}
+
+
+/**
+ * @brief Continues the current pre-copy round, sending the pages written since they were last sent.
+ *
+ * @param limit The largest number of pages to send before returning.
+ * @return Returns 1 if a round ended with few enough dirty pages to pause the guest, 0 if more
+ *         remain to be sent, -1 if the connection was lost.
+ */
+int LiveMigration::PreCopy(uint32_t limit)
+{
+    uint32_t pages = cpuPtr->memoryWords >> IMAGE_PAGE_SHIFT;
+
+    for (uint32_t count = 0; count < limit; )
+    {
+        if (scanPage == pages)
+        {
+            ++rounds;
+            if (!SendRecord(MigrationRecords::MIGRATE_ROUND, 0, nullptr, 0))
+            {
+                return -1;
+            }
+
+            int converged = roundDirty <= MIGRATE_STOP_PAGES || rounds >= MIGRATE_MAX_ROUNDS;
+            scanPage = 0;
+            roundDirty = 0;
+            return converged;
+        }
+
+        uint32_t page = scanPage++;
+        if (IsDirty(page))
+        {
+            if (!SendPage(page))
+            {
+                return -1;
+            }
+            ++roundDirty;
+            ++count;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Pauses the guest and sends what it needs to continue on the target.
+ *
+ * The remaining dirty pages, the keys typed but not read yet, the registers, the counters and
+ * whether the guest sleeps or waits for a key are sent, and the guest stops here once the target
+ * confirms that it runs there. A guest waiting inside an instruction is handed over in the middle
+ * of a slice, whose instructions MR_ICOUNT0 has not counted yet; they are lost to the count.
+ *
+ * @param waiting Nonzero if the guest waits inside an instruction, which the target then executes again.
+ * @return Returns 1 if the target took the guest over, 0 if it keeps running here.
+ */
+int LiveMigration::HandOver(int waiting)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    pausedAt = now.QuadPart;
+
+    // Output of the guest so far appears before the target's
+    consolePtr->InputWait();
+    fflush(stdout);
+
+    uint64_t precopied = pagesSent;
+    uint32_t pages = cpuPtr->memoryWords >> IMAGE_PAGE_SHIFT;
+    for (uint32_t page = 0; page < pages; ++page)
+    {
+        if (IsDirty(page) && !SendPage(page))
+        {
+            Abandon();
+            return 0;
+        }
+    }
+
+    std::string keys;
+    consolePtr->TakeInput(keys);
+
+    MigrationState state;
+    memset(&state, 0, sizeof(state));
+    memcpy(state.registers, cpuPtr->registers, sizeof(state.registers));
+    state.pausedAt = pausedAt;
+    state.idleKind = idleKind;
+    state.idleUntil = idleUntil;
+    state.instructions = memoryIOPtr->GetInstructions();
+    state.microseconds = memoryIOPtr->GetMicroseconds();
+    if (waiting)
+    {
+        --state.registers[Registers::R_PC];
+    }
+
+    char resumed;
+    if ((!keys.empty() && !SendRecord(MigrationRecords::MIGRATE_INPUT, 0, keys.data(), (uint32_t)keys.size())) ||
+        !SendRecord(MigrationRecords::MIGRATE_STATE, 0, &state, sizeof(state)) ||
+        !ReceiveAll(&resumed, sizeof(resumed)))
+    {
+        // The keys are still the guest's to read here
+        consolePtr->QueueInput(keys.data(), keys.size());
+        Abandon();
+        return 0;
+    }
+
+    QueryPerformanceCounter(&now);
+    fprintf(stderr, "migration: %llu pages sent in %u pre-copy rounds and %llu more while paused, resumed %.0f us after the pause\n",
+        (unsigned long long)precopied, rounds, (unsigned long long)(pagesSent - precopied),
+        (double)(now.QuadPart - pausedAt) * 1e6 / (double)frequency);
+
+    closesocket((SOCKET)connection);
+    connection = (uintptr_t)INVALID_SOCKET;
+    handedOver = 1;
+    cpuPtr->running = 0;
+    return 1;
+}
+
+
+/**
+ * @brief Drops the connection to a failed target; the guest keeps running and waits for another.
+ */
+void LiveMigration::Abandon()
+{
+    fprintf(stderr, "migration: connection to the target lost, the guest keeps running here\n");
+
+    closesocket((SOCKET)connection);
+    connection = (uintptr_t)INVALID_SOCKET;
+
+    memset(pageSent, 0, sizeof(pageSent));
+    scanPage = 0;
+    roundDirty = 0;
+    rounds = 0;
+    pagesSent = 0;
+}
+
+
+/**
+ * @brief Tells whether a page differs from what the target last received of it.
+ *
+ * Comparing against a copy finds every write, whichever engine, trap or device made it, without
+ * tracking writes while the guest runs. Pages of images loaded on demand are loaded first.
+ *
+ * @param page The page index.
+ * @return Returns 1 if the page has to be sent, 0 otherwise.
+ */
+int LiveMigration::IsDirty(uint32_t page)
+{
+    uint32_t first = page << IMAGE_PAGE_SHIFT;
+
+    if (cpuPtr->absentPages && cpuPtr->absentPages[page])
+    {
+        cpuPtr->LoadPage((uint16_t)first);
+    }
+
+    return !pageSent[page] || memcmp(&cpuPtr->memory[first], &sent[first], IMAGE_PAGE_WORDS * sizeof(uint16_t)) != 0;
+}
+
+
+/**
+ * @brief Sends a page and remembers what was sent.
+ *
+ * @param page The page index.
+ * @return Returns 1 on success, 0 if the connection was lost.
+ */
+int LiveMigration::SendPage(uint32_t page)
+{
+    uint32_t first = page << IMAGE_PAGE_SHIFT;
+
+    memcpy(&sent[first], &cpuPtr->memory[first], IMAGE_PAGE_WORDS * sizeof(uint16_t));
+    pageSent[page] = 1;
+    ++pagesSent;
+
+    return SendRecord(MigrationRecords::MIGRATE_PAGE, (uint16_t)page, &sent[first], IMAGE_PAGE_WORDS * sizeof(uint16_t));
+}
+
+
+/**
+ * @brief Sends a record and its payload.
+ *
+ * @param kind The record, as a value of MigrationRecords.
+ * @param page The page index of a MIGRATE_PAGE record, 0 otherwise.
+ * @param data The payload.
+ * @param length The size of the payload in bytes.
+ * @return Returns 1 on success, 0 if the connection was lost.
+ */
+int LiveMigration::SendRecord(uint16_t kind, uint16_t page, const void* data, uint32_t length)
+{
+    MigrationRecord record;
+    record.kind = kind;
+    record.page = page;
+    record.length = length;
+
+    return SendAll(&record, sizeof(record)) && (length == 0 || SendAll(data, length));
+}
+
+
+/**
+ * @brief Sends bytes over the connection, waiting until all of them are sent.
+ *
+ * @param data The bytes.
+ * @param length The number of bytes.
+ * @return Returns 1 on success, 0 if the connection was lost.
+ */
+int LiveMigration::SendAll(const void* data, size_t length)
+{
+    const char* bytes = (const char*)data;
+
+    while (length > 0)
+    {
+        int count = send((SOCKET)connection, bytes, (int)length, 0);
+        if (count <= 0)
+        {
+            return 0;
+        }
+        bytes += count;
+        length -= count;
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Receives bytes from the connection, waiting until all of them have arrived.
+ *
+ * @param data Receives the bytes.
+ * @param length The number of bytes.
+ * @return Returns 1 on success, 0 if the connection was lost.
+ */
+int LiveMigration::ReceiveAll(void* data, size_t length)
+{
+    char* bytes = (char*)data;
+
+    while (length > 0)
+    {
+        int count = recv((SOCKET)connection, bytes, (int)length, 0);
+        if (count <= 0)
+        {
+            return 0;
+        }
+        bytes += count;
+        length -= count;
+    }
+
+    return 1;
+}
\ No newline at end of file
@@ -0,0 +1,137 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef LIVE_MIGRATION_H
+#define LIVE_MIGRATION_H
+
+// Identifies a migration stream ("LC3MIGR1"); bump the version whenever its records change.
+#define MIGRATE_MAGIC 0x3152474D49334C43ULL
+#define MIGRATE_VERSION 3
+
+// Instructions the source runs between two looks at the socket while it listens.
+#define MIGRATE_SLICE (1 << 16)
+
+// Dirty pages sent per look during a pre-copy round, so that the guest keeps running in between.
+#define MIGRATE_PAGES_PER_SLICE 16
+
+// Pre-copy stops once a round finds no more dirty pages than this, or after MIGRATE_MAX_ROUNDS rounds.
+#define MIGRATE_STOP_PAGES 4
+#define MIGRATE_MAX_ROUNDS 30
+
+
+#include <cstdint>
+#include <string>
+#include <Windows.h>
+
+#include "CPU.h"
+
+
+class OS;
+class Console;
+class MemoryIO;
+
+
+// Records of a migration stream, each a MigrationRecord followed by its payload.
+enum MigrationRecords : uint16_t
+{
+    MIGRATE_PAGE = 0, // one page of memory, IMAGE_PAGE_WORDS words
+    MIGRATE_ROUND,    // end of a pre-copy round
+    MIGRATE_INPUT,    // keys typed on the source that the guest has not read
+    MIGRATE_STATE     // a MigrationState; the last record, sent while the source is paused
+};
+
+
+// Start of a migration stream. Both ends run on one machine, so everything is in host byte order.
+struct MigrationHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t memoryWords;
+    uint16_t memoryMode;
+    uint16_t reserved[3];
+};
+
+
+struct MigrationRecord
+{
+    uint16_t kind;    // a value of MigrationRecords
+    uint16_t page;    // page index of MIGRATE_PAGE
+    uint32_t length;  // bytes of payload
+};
+
+
+struct MigrationState
+{
+    uint16_t registers[REGISTER_COUNT];
+    uint16_t idleKind;  // a value of IdleKinds, if the guest slept or waited for a key when paused
+    uint16_t reserved;
+    LONGLONG pausedAt;  // performance counter when the source paused the guest
+    uint64_t idleUntil; // GetTickCount64 deadline of IDLE_SLEEP
+    uint64_t instructions; // MR_ICOUNT0 and MR_USEC0 of the guest when paused
+    uint64_t microseconds;
+};
+
+
+// Moves a running guest to another process over a Unix socket by iterative pre-copy: memory is
+// sent while the guest keeps running, pages written in the meantime are sent again, and the
+// guest is only paused to send the registers, the last dirty pages and the unread keys.
+class LiveMigration
+{
+private:
+    CPU* cpuPtr;
+    OS* osPtr;
+    Console* consolePtr;
+    MemoryIO* memoryIOPtr;
+
+    uintptr_t listener;
+    uintptr_t connection;
+    std::string socketPath;
+
+    // Memory as last sent, and whether each page was sent at all
+    uint16_t sent[MEMORY_MAX];
+    uint8_t pageSent[MEMORY_MAX >> IMAGE_PAGE_SHIFT];
+
+    uint32_t scanPage;
+    uint32_t roundDirty;
+    uint32_t rounds;
+    uint64_t pagesSent;
+    int handedOver;
+
+    LONGLONG frequency;
+    LONGLONG pausedAt;
+
+    // Idle state of the guest between slices, a value of IdleKinds, sent along with the registers
+    uint16_t idleKind;
+    ULONGLONG idleUntil;
+
+public:
+    LiveMigration(CPU* cpu, OS* os, Console* console, MemoryIO* memoryIO);
+    ~LiveMigration();
+
+    int Listen(const char* path);
+    int Poll(int waiting, uint16_t idle = 0, ULONGLONG until = 0);
+    int WaitForInput();
+
+    int Receive(const char* path);
+    uint16_t TakeIdle(ULONGLONG* until);
+    void Resume();
+
+private:
+    int Accept();
+    int PreCopy(uint32_t limit);
+    int HandOver(int waiting);
+    void Abandon();
+    int IsDirty(uint32_t page);
+    int SendPage(uint32_t page);
+    int SendRecord(uint16_t kind, uint16_t page, const void* data, uint32_t length);
+    int SendAll(const void* data, size_t length);
+    int ReceiveAll(void* data, size_t length);
+};
+#endif
\ No newline at end of file
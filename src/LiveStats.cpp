@@ -0,0 +1,384 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+
+#include "LiveStats.h"
+
+
+/**
+ * @brief Constructs a LiveStats object that publishes nothing until it is opened.
+ */
+LiveStats::LiveStats()
+{
+    file = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+    stats = nullptr;
+
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = counterFrequency.QuadPart;
+    rateStart = 0;
+    rateInstructions = 0;
+    idleStart = 0;
+}
+
+
+/**
+ * @brief Destroys the LiveStats object, removing its stats file.
+ */
+LiveStats::~LiveStats()
+{
+    Close();
+}
+
+
+/**
+ * @brief Builds the path of the directory holding the stats files, creating it if needed.
+ *
+ * @param path Receives the directory path, with a trailing separator.
+ * @param size The size of the path buffer.
+ * @return Returns 1 on success, 0 otherwise.
+ */
+int LiveStats::Directory(char* path, size_t size)
+{
+    char temp[MAX_PATH];
+    DWORD length = GetTempPathA(MAX_PATH, temp);
+    if (length == 0 || length >= MAX_PATH)
+    {
+        return 0;
+    }
+
+    if (snprintf(path, size, "%s%s", temp, STATS_DIRECTORY) >= (int)size)
+    {
+        return 0;
+    }
+    CreateDirectoryA(path, NULL);
+
+    strncat(path, "\\", size - strlen(path) - 1);
+    return 1;
+}
+
+
+/**
+ * @brief Creates the stats file of this VM and maps it.
+ *
+ * The file is named after the process ID, marked temporary so it normally stays in the file cache,
+ * and deleted by the system when the VM exits, even if it crashes.
+ *
+ * @param image The first image file, shown by the top view.
+ * @return Returns 1 on success, 0 if the file could not be created or mapped.
+ */
+int LiveStats::Open(const char* image)
+{
+    char path[MAX_PATH];
+    if (!Directory(path, sizeof(path)))
+    {
+        return 0;
+    }
+
+    size_t length = strlen(path);
+    snprintf(path + length, sizeof(path) - length, "%lu.stats", (unsigned long)GetCurrentProcessId());
+
+    file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "stats: could not create %s\n", path);
+        return 0;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, sizeof(VmStats), NULL);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(VmStats)) : NULL;
+    if (!view)
+    {
+        fprintf(stderr, "stats: could not map %s\n", path);
+        Close();
+        return 0;
+    }
+
+    stats = new (view) VmStats();
+    stats->processId = (uint32_t)GetCurrentProcessId();
+    strncpy(stats->image, image, sizeof(stats->image) - 1);
+    stats->version = STATS_VERSION;
+
+    // Readers ignore the file until the header is complete
+    std::atomic_thread_fence(std::memory_order_release);
+    stats->magic = STATS_MAGIC;
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    rateStart = now.QuadPart;
+
+    return 1;
+}
+
+
+/**
+ * @brief Marks the VM halted and removes its stats file.
+ */
+void LiveStats::Close()
+{
+    if (stats)
+    {
+        stats->state.store(VmStates::VM_STATE_HALTED, std::memory_order_relaxed);
+        UnmapViewOfFile(stats);
+        stats = nullptr;
+    }
+    if (mapping)
+    {
+        CloseHandle(mapping);
+        mapping = NULL;
+    }
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+}
+
+
+/**
+ * @brief Adds to a counter that only the VM thread writes.
+ *
+ * A relaxed load and store instead of a locked read-modify-write, since there is a single writer.
+ *
+ * @param counter The counter to update.
+ * @param amount The amount to add.
+ */
+void LiveStats::Add(std::atomic<uint64_t>& counter, uint64_t amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+
+/**
+ * @brief Publishes the progress of the last slice of execution.
+ *
+ * Called between slices of STATS_SLICE instructions, so the interpreter loops themselves carry
+ * no instrumentation.
+ *
+ * @param retired The number of instructions executed by the slice.
+ * @param pc The current program counter.
+ * @param outputBytes The total number of bytes written by the guest.
+ */
+void LiveStats::Publish(uint64_t retired, uint16_t pc, uint64_t outputBytes)
+{
+    if (!stats)
+    {
+        return;
+    }
+
+    Add(stats->instructions, retired);
+    stats->pc.store(pc, std::memory_order_relaxed);
+    stats->outputBytes.store(outputBytes, std::memory_order_relaxed);
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    LONGLONG elapsed = now.QuadPart - rateStart;
+    if (elapsed * 1000 >= frequency * STATS_RATE_MS)
+    {
+        uint64_t instructions = stats->instructions.load(std::memory_order_relaxed);
+        double rate = (double)(instructions - rateInstructions) * (double)frequency / (double)elapsed;
+
+        stats->instructionsPerSecond.store((uint64_t)rate, std::memory_order_relaxed);
+        rateStart = now.QuadPart;
+        rateInstructions = instructions;
+    }
+}
+
+
+/**
+ * @brief Counts a trap.
+ *
+ * @param vector The trap vector, counted only if it is one of TRAP_GETC to TRAP_HALT.
+ */
+void LiveStats::CountTrap(uint16_t vector)
+{
+    uint16_t index = (uint16_t)(vector - 0x20);
+
+    if (stats && index < STATS_TRAP_VECTORS)
+    {
+        Add(stats->traps[index], 1);
+    }
+}
+
+
+/**
+ * @brief Counts a read of the keyboard status register.
+ */
+void LiveStats::CountKbsrPoll()
+{
+    if (stats)
+    {
+        Add(stats->kbsrPolls, 1);
+    }
+}
+
+
+/**
+ * @brief Counts a byte of guest input.
+ */
+void LiveStats::CountInput()
+{
+    if (stats)
+    {
+        Add(stats->inputBytes, 1);
+    }
+}
+
+
+/**
+ * @brief Marks the start of a blocking wait for input.
+ */
+void LiveStats::BeginIdle()
+{
+    if (!stats)
+    {
+        return;
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    idleStart = now.QuadPart;
+
+    stats->state.store(VmStates::VM_STATE_INPUT, std::memory_order_relaxed);
+}
+
+
+/**
+ * @brief Marks the end of a blocking wait for input and adds its duration to the idle time.
+ */
+void LiveStats::EndIdle()
+{
+    if (!stats)
+    {
+        return;
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    Add(stats->idleMicroseconds, (uint64_t)((now.QuadPart - idleStart) * 1000000 / frequency));
+    stats->state.store(VmStates::VM_STATE_RUNNING, std::memory_order_relaxed);
+}
+
+
+/**
+ * @brief Shows the stats of every running VM, refreshed every second, like top.
+ *
+ * @param refreshes The number of refreshes before returning, or 0 to run until interrupted.
+ * @return Returns 0 on success, 1 if the stats directory is not available.
+ */
+int LiveStats::Top(int refreshes)
+{
+    static const char* const stateNames[] = { "run", "input", "halted" };
+
+    char directory[MAX_PATH];
+    if (!Directory(directory, sizeof(directory)))
+    {
+        fprintf(stderr, "stats: no temporary directory\n");
+        return 1;
+    }
+
+    char pattern[MAX_PATH + 16];
+    snprintf(pattern, sizeof(pattern), "%s*.stats", directory);
+
+    // The view is redrawn with ANSI sequences
+    HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode;
+    if (GetConsoleMode(hStdout, &mode))
+    {
+        SetConsoleMode(hStdout, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
+
+    for (int refresh = 0; refreshes == 0 || refresh < refreshes; ++refresh)
+    {
+        if (refresh > 0)
+        {
+            Sleep(1000);
+        }
+
+        printf("\x1b[H\x1b[2J");
+        printf("%7s %-20s %-6s %6s %9s %12s %8s %8s %8s %8s %8s %8s %10s %8s %8s %9s\n",
+            "PID", "IMAGE", "STATE", "PC", "MIPS", "INSTR", "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT",
+            "KBSR", "IN-B", "OUT-B", "IDLE-S");
+
+        uint64_t totalInstructions = 0;
+        uint64_t totalRate = 0;
+        int count = 0;
+
+        WIN32_FIND_DATAA entry;
+        HANDLE find = FindFirstFileA(pattern, &entry);
+
+        while (find != INVALID_HANDLE_VALUE)
+        {
+            char path[2 * MAX_PATH];
+            snprintf(path, sizeof(path), "%s%s", directory, entry.cFileName);
+
+            HANDLE statsFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            HANDLE statsMapping = (statsFile != INVALID_HANDLE_VALUE) ? CreateFileMappingA(statsFile, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+            const VmStats* vm = statsMapping ? (const VmStats*)MapViewOfFile(statsMapping, FILE_MAP_READ, 0, 0, sizeof(VmStats)) : NULL;
+
+            if (vm && vm->magic == STATS_MAGIC && vm->version == STATS_VERSION)
+            {
+                uint32_t state = vm->state.load(std::memory_order_relaxed);
+                uint64_t instructions = vm->instructions.load(std::memory_order_relaxed);
+                uint64_t rate = vm->instructionsPerSecond.load(std::memory_order_relaxed);
+
+                printf("%7lu %-20.20s %-6s  x%04X %9.2f %12llu", (unsigned long)vm->processId, vm->image,
+                    state <= VmStates::VM_STATE_HALTED ? stateNames[state] : "?", vm->pc.load(std::memory_order_relaxed),
+                    rate / 1e6, (unsigned long long)instructions);
+                for (int i = 0; i < STATS_TRAP_VECTORS; ++i)
+                {
+                    printf(" %8llu", (unsigned long long)vm->traps[i].load(std::memory_order_relaxed));
+                }
+                printf(" %10llu %8llu %8llu %9.1f\n",
+                    (unsigned long long)vm->kbsrPolls.load(std::memory_order_relaxed),
+                    (unsigned long long)vm->inputBytes.load(std::memory_order_relaxed),
+                    (unsigned long long)vm->outputBytes.load(std::memory_order_relaxed),
+                    vm->idleMicroseconds.load(std::memory_order_relaxed) / 1e6);
+
+                totalInstructions += instructions;
+                totalRate += rate;
+                ++count;
+            }
+
+            if (vm)
+            {
+                UnmapViewOfFile(vm);
+            }
+            if (statsMapping)
+            {
+                CloseHandle(statsMapping);
+            }
+            if (statsFile != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(statsFile);
+            }
+
+            if (!FindNextFileA(find, &entry))
+            {
+                FindClose(find);
+                find = INVALID_HANDLE_VALUE;
+            }
+        }
+
+        printf("\n%d VMs, %.2f MIPS total, %llu instructions\n", count, totalRate / 1e6, (unsigned long long)totalInstructions);
+        fflush(stdout);
+    }
+
+    return 0;
+}
\ No newline at end of file
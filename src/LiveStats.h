@@ -0,0 +1,97 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef LIVE_STATS_H
+#define LIVE_STATS_H
+
+// Identifies a stats file and the layout of VmStats; bump the version whenever the layout changes.
+#define STATS_MAGIC 0x5354415453334C43ULL
+#define STATS_VERSION 1
+
+// Instructions executed between two publications of the retired count, PC and rate.
+#define STATS_SLICE (1 << 20)
+
+// The published instruction rate is averaged over at least this many milliseconds.
+#define STATS_RATE_MS 500
+
+// Trap vectors counted individually, TRAP_GETC to TRAP_HALT.
+#define STATS_TRAP_VECTORS 6
+
+// Subdirectory of the temporary directory holding one stats file per running VM.
+#define STATS_DIRECTORY "lc3-stats"
+
+
+#include <atomic>
+#include <cstdint>
+#include <Windows.h>
+
+
+enum VmStates : uint32_t
+{
+    VM_STATE_RUNNING = 0, // executing guest instructions
+    VM_STATE_INPUT,       // blocked in GETC, IN or WAIT, or sleeping in SLEEP
+    VM_STATE_HALTED       // the guest halted
+};
+
+
+// Layout of a stats file. Every counter has a single writer, the VM thread, and is written with
+// relaxed atomics; readers may see counters from slightly different moments, never torn values.
+struct VmStats
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t processId;
+    char image[64];
+
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> pc;
+    std::atomic<uint64_t> instructions;
+    std::atomic<uint64_t> instructionsPerSecond;
+    std::atomic<uint64_t> traps[STATS_TRAP_VECTORS];
+    std::atomic<uint64_t> kbsrPolls;
+    std::atomic<uint64_t> inputBytes;
+    std::atomic<uint64_t> outputBytes;
+    std::atomic<uint64_t> idleMicroseconds;
+};
+
+
+class LiveStats
+{
+private:
+    HANDLE file;
+    HANDLE mapping;
+    VmStats* stats;
+
+    LONGLONG frequency;
+    LONGLONG rateStart;
+    uint64_t rateInstructions;
+    LONGLONG idleStart;
+
+public:
+    LiveStats();
+    ~LiveStats();
+
+    int Open(const char* image);
+    void Close();
+
+    void Publish(uint64_t retired, uint16_t pc, uint64_t outputBytes);
+    void CountTrap(uint16_t vector);
+    void CountKbsrPoll();
+    void CountInput();
+    void BeginIdle();
+    void EndIdle();
+
+    static int Top(int refreshes);
+
+private:
+    static void Add(std::atomic<uint64_t>& counter, uint64_t amount);
+    static int Directory(char* path, size_t size);
+};
+#endif
\ No newline at end of file
@@ -8,23 +8,287 @@ Copyright 
 */
 
 
+#include <cstring>
+
+
 #include "MemoryIO.h"
 #include "CPU.h"
 #include "OS.h"
+#include "DecodeCache.h"
+#include "InputLatencyProbe.h"
+#include "Console.h"
+#include "ShadowMemory.h"
+#include "Debugger.h"
+#include "LiveStats.h"
+#include "MetricsExporter.h"
+#include "TrapProfiler.h"
+#include "LiveMigration.h"
+#include "CheckpointLog.h"
+#include "TaskScheduler.h"
 
 
 /**
  * @brief Constructs a MemoryIO object.
  *
- * This constructor initializes a MemoryIO object with the provided memory array and OS pointer.
+ * This constructor initializes a MemoryIO object with the memory of the provided CPU and the OS and Console pointers.
  *
- * @param memory Pointer to the memory array.
+ * @param cpu Pointer to the CPU object owning the memory.
  * @param os Pointer to the OS object.
+ * @param console Pointer to the Console object, told when the guest polls for input.
  */
-MemoryIO::MemoryIO(uint16_t* memory, OS* os)
+MemoryIO::MemoryIO(CPU* cpu, OS* os, Console* console)
 {
-    memoryPtr = memory;
+    AttachMemory(cpu);
     osPtr = os;
+    consolePtr = console;
+
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    clockStart = now.QuadPart;
+    clockFrequency = frequency.QuadPart;
+}
+
+
+/**
+ * @brief Takes over the memory and address layout of a CPU, after construction or CPU::ConfigureMemory.
+ *
+ * @param cpu Pointer to the CPU object owning the memory.
+ */
+void MemoryIO::AttachMemory(CPU* cpu)
+{
+    cpuPtr = cpu;
+    memoryPtr = cpu->memory;
+    addressMask = cpu->addressMask;
+    faultMask = cpu->faultMask;
+    absentPagesPtr = cpu->absentPages;
+}
+
+
+/**
+ * @brief Attaches a decode cache that must be kept coherent with memory writes.
+ *
+ * While a cache is attached, every write invalidates the cached decoding of the written address,
+ * so self-modifying code keeps working under the caching engines. Pass nullptr to detach.
+ *
+ * @param decodeCache Pointer to the DecodeCache object, or nullptr.
+ */
+void MemoryIO::AttachDecodeCache(DecodeCache* decodeCache)
+{
+    decodeCachePtr = decodeCache;
+}
+
+
+/**
+ * @brief Returns the currently attached decode cache.
+ *
+ * @return Pointer to the attached DecodeCache object, or nullptr if none is attached.
+ */
+DecodeCache* MemoryIO::GetDecodeCache() const
+{
+    return decodeCachePtr;
+}
+
+
+/**
+ * @brief Attaches a probe measuring the latency from key arrival to KBSR being set.
+ *
+ * @param inputProbe Pointer to the InputLatencyProbe object, or nullptr to detach.
+ */
+void MemoryIO::AttachInputProbe(InputLatencyProbe* inputProbe)
+{
+    inputProbePtr = inputProbe;
+}
+
+
+/**
+ * @brief Attaches a shadow memory checking every guest access.
+ *
+ * @param shadow Pointer to the ShadowMemory object, or nullptr to detach.
+ */
+void MemoryIO::AttachShadow(ShadowMemory* shadow)
+{
+    shadowPtr = shadow;
+}
+
+
+/**
+ * @brief Attaches a debugger whose watchpoints are checked on every access to a watched page.
+ *
+ * Accesses to pages without watchpoints only cost a lookup in the page flags.
+ *
+ * @param debugger Pointer to the Debugger object, or nullptr to detach.
+ */
+void MemoryIO::AttachDebugger(Debugger* debugger)
+{
+    debuggerPtr = debugger;
+    watchPagesPtr = debugger ? debugger->watchPages : nullptr;
+}
+
+
+/**
+ * @brief Attaches live stats counting keyboard polls and input bytes.
+ *
+ * @param stats Pointer to the LiveStats object, or nullptr to detach.
+ */
+void MemoryIO::AttachStats(LiveStats* stats)
+{
+    statsPtr = stats;
+}
+
+
+/**
+ * @brief Attaches the metrics shard counting keyboard input.
+ *
+ * @param metrics Pointer to the MetricsShard object, or nullptr to stop counting.
+ */
+void MemoryIO::AttachMetrics(MetricsShard* metrics)
+{
+    metricsPtr = metrics;
+}
+
+
+/**
+ * @brief Attaches the trap profiler timing keyboard status polls.
+ *
+ * @param profiler Pointer to the TrapProfiler object, or nullptr to stop timing.
+ */
+void MemoryIO::AttachProfiler(TrapProfiler* profiler)
+{
+    profilerPtr = profiler;
+}
+
+
+/**
+ * @brief Attaches the live migration that may hand the guest over while it polls an idle keyboard.
+ *
+ * @param migration Pointer to the LiveMigration object, or nullptr to detach.
+ */
+void MemoryIO::AttachMigration(LiveMigration* migration)
+{
+    migrationPtr = migration;
+}
+
+
+/**
+ * @brief Attaches the checkpoint log told which pages of memory each write changes.
+ *
+ * @param checkpoints Pointer to the CheckpointLog object, or nullptr to stop marking pages.
+ */
+void MemoryIO::AttachCheckpoints(CheckpointLog* checkpoints)
+{
+    dirtyPagesPtr = checkpoints ? checkpoints->dirty : nullptr;
+}
+
+
+/**
+ * @brief Attaches the task scheduler that a task polling an empty keyboard gives the CPU back to.
+ *
+ * @param tasks Pointer to the TaskScheduler object, or nullptr to detach.
+ */
+void MemoryIO::AttachTasks(TaskScheduler* tasks)
+{
+    tasksPtr = tasks;
+}
+
+
+/**
+ * @brief Marks the start of a slice, which stops at a read of MR_ICOUNT0 because only the engine knows how far it got.
+ */
+void MemoryIO::BeginSlice()
+{
+    inSlice = 1;
+}
+
+
+/**
+ * @brief Takes the stop of a slice at a read of MR_ICOUNT0 and puts the registers back as they were before the load.
+ *
+ * The load then runs again by itself once the instructions before it are counted. The slice
+ * counted the stopped load as retired, so the caller must not.
+ *
+ * @return Returns 1 if the slice stopped at the load, 0 otherwise.
+ */
+int MemoryIO::TakeCounterStop()
+{
+    if (!counterStop)
+    {
+        return 0;
+    }
+
+    counterStop = 0;
+    memcpy(cpuPtr->registers, stopRegisters, sizeof(stopRegisters));
+    --cpuPtr->registers[Registers::R_PC];
+    cpuPtr->running = 1;
+    return 1;
+}
+
+
+/**
+ * @brief Counts the instructions of a slice into MR_ICOUNT0-2 and marks the end of the slice.
+ *
+ * @param retired The number of instructions executed by the slice.
+ */
+void MemoryIO::CountInstructions(uint64_t retired)
+{
+    instructions += retired;
+    inSlice = 0;
+}
+
+
+/**
+ * @brief Gets the instructions counted for MR_ICOUNT0, which only grows between slices.
+ *
+ * @return The number of instructions retired by the slices counted so far.
+ */
+uint64_t MemoryIO::GetInstructions() const
+{
+    return instructions;
+}
+
+
+/**
+ * @brief Gets the time MR_USEC0 reads now.
+ *
+ * @return The microseconds since the guest started.
+ */
+uint64_t MemoryIO::GetMicroseconds() const
+{
+    // Split to avoid overflowing the multiplication
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    LONGLONG ticks = now.QuadPart - clockStart;
+    return (uint64_t)(ticks / clockFrequency) * 1000000 + (uint64_t)(ticks % clockFrequency) * 1000000 / (uint64_t)clockFrequency;
+}
+
+
+/**
+ * @brief Continues the counters of a guest that ran elsewhere before, in another process or host guest.
+ *
+ * @param retired The instructions the guest had retired.
+ * @param microseconds The time its clock had reached, which MR_USEC0 continues from.
+ */
+void MemoryIO::SeedCounters(uint64_t retired, uint64_t microseconds)
+{
+    instructions = retired;
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    clockStart = now.QuadPart - (LONGLONG)(microseconds / 1000000) * clockFrequency - (LONGLONG)(microseconds % 1000000) * clockFrequency / 1000000;
+}
+
+
+/**
+ * @brief Tells whether a load from an address would stop the slice to latch MR_ICOUNT0.
+ *
+ * Lets the instrumented loop report such a load only once, when it runs again.
+ *
+ * @param address The address about to be read.
+ * @return Returns 1 if the load stops the slice, 0 otherwise.
+ */
+int MemoryIO::StopsSlice(uint16_t address) const
+{
+    return inSlice && address == MemoryMappedRegisters::MR_ICOUNT0;
 }
 
 
@@ -33,32 +297,131 @@ MemoryIO::MemoryIO(uint16_t* memory, OS* os)
  *
  * This function reads a 16-bit value from memory at the specified address.
  * If the address corresponds to the keyboard status register, it checks if a key is pressed
- * and updates the keyboard status register accordingly.
+ * and updates the keyboard status register accordingly. Reading the low word of a counter
+ * latches the counter into its three registers.
  *
  * @param memoryAddress The address to read from.
  * @return The 16-bit value read from memory.
  */
 uint16_t MemoryIO::Read(uint16_t memoryAddress)
 {
+    // Pages of images loaded on demand come in on their first access, before any device update
+    if (absentPagesPtr && absentPagesPtr[(memoryAddress & addressMask) >> IMAGE_PAGE_SHIFT])
+    {
+        cpuPtr->LoadPage(memoryAddress);
+    }
+
     // Check if the memory address corresponds to the keyboard status register
     if (memoryAddress == MemoryMappedRegisters::MR_KBSR)
     {
+        uint64_t pollStart = profilerPtr ? profilerPtr->Begin() : 0;
+
+        // A keyboard poll is a frame boundary for the screen model
+        consolePtr->InputWait();
+
+        if (statsPtr)
+        {
+            statsPtr->CountKbsrPoll();
+        }
+
+        // Without a key, another ready task runs once this load completes instead of waiting for one
+        int yielded = tasksPtr && tasksPtr->PollInput();
+
         // If a key is pressed, set the keyboard status register's most significant bit (bit 15) to indicate input
-        if (osPtr->CheckKey())
+        if (!yielded && (consolePtr->HasQueuedInput() || osPtr->CheckKey()))
         {
-            memoryPtr[MemoryMappedRegisters::MR_KBSR] = (1 << 15);
+            if (inputProbePtr)
+            {
+                inputProbePtr->OnKeyPending();
+            }
+
+            memoryPtr[MemoryMappedRegisters::MR_KBSR & addressMask] = (1 << 15);
             // Read the character from the keyboard and store it in the keyboard data register
-            memoryPtr[MemoryMappedRegisters::MR_KBDR] = getchar();
+            memoryPtr[MemoryMappedRegisters::MR_KBDR & addressMask] = (uint16_t)consolePtr->GetChar();
+
+            if (statsPtr)
+            {
+                statsPtr->CountInput();
+            }
+
+            if (metricsPtr)
+            {
+                metricsPtr->CountInput();
+            }
+
+            if (inputProbePtr)
+            {
+                inputProbePtr->OnKeyConsumed();
+            }
         }
         else
         {
             // If no key is pressed, clear the keyboard status register
-            memoryPtr[MemoryMappedRegisters::MR_KBSR] = 0;
+            memoryPtr[MemoryMappedRegisters::MR_KBSR & addressMask] = 0;
+
+            if (inputProbePtr)
+            {
+                inputProbePtr->OnNoKey();
+            }
+
+            // A guest handed over while it polls executes this load again on the target
+            if (migrationPtr && migrationPtr->Poll(1))
+            {
+                return 0;
+            }
+        }
+
+        if (profilerPtr)
+        {
+            profilerPtr->End(TRAP_PROFILE_KBSR, pollStart);
+        }
+    }
+    else if (memoryAddress >= MemoryMappedRegisters::MR_ICOUNT0 && memoryAddress <= MemoryMappedRegisters::MR_USEC2)
+    {
+        if (!LatchCounter(memoryAddress))
+        {
+            return 0;
         }
     }
 
+    // Addresses past the end of a smaller memory in fault mode; never taken otherwise
+    if ((memoryAddress & faultMask) && !cpuPtr->Contains(memoryAddress))
+    {
+        return Fault(memoryAddress);
+    }
+
+    if (shadowPtr)
+    {
+        shadowPtr->CheckRead(memoryAddress);
+    }
+
+    // Slow path only for pages holding a watchpoint
+    if (watchPagesPtr && watchPagesPtr[(memoryAddress & addressMask) >> WATCH_PAGE_SHIFT])
+    {
+        debuggerPtr->OnAccess(memoryAddress, memoryPtr[memoryAddress & addressMask], WatchKinds::WATCH_READ);
+    }
+
     // Return the value stored in memory at the specified address
-    return memoryPtr[memoryAddress];
+    return memoryPtr[memoryAddress & addressMask];
+}
+
+
+/**
+ * @brief Reads the instruction at the specified address.
+ *
+ * Behaves like Read, but lets the shadow memory tell instruction fetches from data reads.
+ *
+ * @param address The address of the instruction.
+ * @return The instruction read from memory.
+ */
+uint16_t MemoryIO::Fetch(uint16_t address)
+{
+    if (shadowPtr)
+    {
+        shadowPtr->CheckFetch(address);
+    }
+
+    return Read(address);
 }
 
 
@@ -72,5 +435,133 @@ uint16_t MemoryIO::Read(uint16_t memoryAddress)
  */
 void MemoryIO::Write(uint16_t address, uint16_t value)
 {
-    memoryPtr[address] = value;
+    // Addresses past the end of a smaller memory in fault mode; never taken otherwise
+    if ((address & faultMask) && !cpuPtr->Contains(address))
+    {
+        Fault(address);
+        return;
+    }
+
+    // The counter registers are read-only
+    if (address >= MemoryMappedRegisters::MR_ICOUNT0 && address <= MemoryMappedRegisters::MR_USEC2)
+    {
+        return;
+    }
+
+    // The rest of the page must be loaded before this word is overwritten
+    if (absentPagesPtr && absentPagesPtr[(address & addressMask) >> IMAGE_PAGE_SHIFT])
+    {
+        cpuPtr->LoadPage(address);
+    }
+
+    memoryPtr[address & addressMask] = value;
+
+    // The page goes into the next checkpoint
+    if (dirtyPagesPtr)
+    {
+        dirtyPagesPtr[(address & addressMask) >> CHECKPOINT_PAGE_SHIFT] = 1;
+    }
+
+    if (shadowPtr)
+    {
+        shadowPtr->CheckWrite(address);
+    }
+
+    if (watchPagesPtr && watchPagesPtr[(address & addressMask) >> WATCH_PAGE_SHIFT])
+    {
+        debuggerPtr->OnAccess(address, value, WatchKinds::WATCH_WRITE);
+    }
+
+    // Keep the decode cache coherent with the written word
+    if (decodeCachePtr)
+    {
+        decodeCachePtr->Invalidate(address);
+    }
+}
+
+
+/**
+ * @brief Writes a word on behalf of a debugger, keeping the checkpoints, the shadow memory and the decode cache coherent.
+ *
+ * Unlike a guest store, it never faults, triggers a watchpoint or counts as a shadow memory finding.
+ *
+ * @param address The address to write to; past the end of a smaller memory, the word it wraps onto.
+ * @param value The 16-bit value to write.
+ */
+void MemoryIO::Patch(uint16_t address, uint16_t value)
+{
+    cpuPtr->Word(address) = value;
+
+    if (dirtyPagesPtr)
+    {
+        dirtyPagesPtr[(address & addressMask) >> CHECKPOINT_PAGE_SHIFT] = 1;
+    }
+
+    if (shadowPtr)
+    {
+        shadowPtr->MarkInitialized(address, 1);
+    }
+
+    if (decodeCachePtr)
+    {
+        decodeCachePtr->Invalidate(address);
+    }
+}
+
+
+/**
+ * @brief Stops the guest on an access past the end of a memory in fault mode.
+ *
+ * @param address The address accessed.
+ * @return 0, the value a faulting load produces.
+ */
+uint16_t MemoryIO::Fault(uint16_t address)
+{
+    consolePtr->Flush();
+    fprintf(stderr, "memory fault: x%04X is outside the %u-word memory, PC x%04X\n",
+        address, cpuPtr->memoryWords, (uint16_t)(cpuPtr->registers[Registers::R_PC] - 1));
+    cpuPtr->running = 0;
+    return 0;
+}
+
+
+/**
+ * @brief Latches a counter into its three registers when its low word is read.
+ *
+ * MR_ICOUNT0 counts the instructions retired before the load reading it. Inside a slice that
+ * count is not known yet, so the load stops the engine, with the registers saved before the
+ * load writes its destination, and is executed again once the slice is counted. MR_USEC0 reads
+ * the host clock. The upper words only return what the last read of the low word latched, so a
+ * guest reads the low word first and gets a consistent 48-bit value.
+ *
+ * @param address The counter register read.
+ * @return Returns 1 if the register can be read from memory, 0 if the load was stopped.
+ */
+int MemoryIO::LatchCounter(uint16_t address)
+{
+    uint64_t value;
+    if (address == MemoryMappedRegisters::MR_ICOUNT0)
+    {
+        if (inSlice)
+        {
+            memcpy(stopRegisters, cpuPtr->registers, sizeof(stopRegisters));
+            counterStop = 1;
+            cpuPtr->running = 0;
+            return 0;
+        }
+        value = instructions;
+    }
+    else if (address == MemoryMappedRegisters::MR_USEC0)
+    {
+        value = GetMicroseconds();
+    }
+    else
+    {
+        return 1;
+    }
+
+    memoryPtr[address & addressMask] = (uint16_t)value;
+    memoryPtr[(address + 1) & addressMask] = (uint16_t)(value >> 16);
+    memoryPtr[(address + 2) & addressMask] = (uint16_t)(value >> 32);
+    return 1;
 }
\ No newline at end of file
@@ -13,15 +13,35 @@ Copyright 
 
 
 #include <cstdint>
+#include <Windows.h>
+
+#include "CPU.h"
 
 
 class OS;
+class DecodeCache;
+class InputLatencyProbe;
+class Console;
+class ShadowMemory;
+class Debugger;
+class LiveStats;
+class MetricsShard;
+class TrapProfiler;
+class LiveMigration;
+class CheckpointLog;
+class TaskScheduler;
 
 
 enum MemoryMappedRegisters : uint16_t
 {
-	MR_KBSR = 0xFE00, // keyboard status
-	MR_KBDR = 0xFE02  // keyboard data
+	MR_KBSR = 0xFE00,    // keyboard status
+	MR_KBDR = 0xFE02,    // keyboard data
+	MR_ICOUNT0 = 0xFE10, // retired instructions, bits 0-15; reading it latches MR_ICOUNT1 and MR_ICOUNT2
+	MR_ICOUNT1 = 0xFE11, // retired instructions, bits 16-31, as of the last read of MR_ICOUNT0
+	MR_ICOUNT2 = 0xFE12, // retired instructions, bits 32-47, as of the last read of MR_ICOUNT0
+	MR_USEC0 = 0xFE13,   // microseconds since the guest started, bits 0-15; reading it latches MR_USEC1 and MR_USEC2
+	MR_USEC1 = 0xFE14,   // microseconds, bits 16-31, as of the last read of MR_USEC0
+	MR_USEC2 = 0xFE15    // microseconds, bits 32-47, as of the last read of MR_USEC0
 };
 
 
@@ -29,12 +49,65 @@ class MemoryIO
 {
 private:
 	uint16_t* memoryPtr;
+	uint16_t addressMask;
+	uint16_t faultMask;
+	const uint8_t* absentPagesPtr;
+	CPU* cpuPtr;
 	OS* osPtr;
+	Console* consolePtr;
+	DecodeCache* decodeCachePtr = nullptr;
+	InputLatencyProbe* inputProbePtr = nullptr;
+	ShadowMemory* shadowPtr = nullptr;
+	Debugger* debuggerPtr = nullptr;
+	const uint8_t* watchPagesPtr = nullptr;
+	LiveStats* statsPtr = nullptr;
+	MetricsShard* metricsPtr = nullptr;
+	TrapProfiler* profilerPtr = nullptr;
+	LiveMigration* migrationPtr = nullptr;
+	uint8_t* dirtyPagesPtr = nullptr;
+	TaskScheduler* tasksPtr = nullptr;
+
+	// Instructions retired by the slices counted so far, and the clock MR_USEC0 starts from
+	uint64_t instructions = 0;
+	LONGLONG clockStart;
+	LONGLONG clockFrequency;
+
+	// Set while a slice runs, which has to stop at a read of MR_ICOUNT0, and once it did, with the registers before the load
+	int inSlice = 0;
+	int counterStop = 0;
+	uint16_t stopRegisters[REGISTER_COUNT];
 
 public:
-	MemoryIO(uint16_t* memory, OS* os);
+	MemoryIO(CPU* cpu, OS* os, Console* console);
+
+	void AttachMemory(CPU* cpu);
+	void AttachDecodeCache(DecodeCache* decodeCache);
+	DecodeCache* GetDecodeCache() const;
+	void AttachInputProbe(InputLatencyProbe* inputProbe);
+	void AttachShadow(ShadowMemory* shadow);
+	void AttachDebugger(Debugger* debugger);
+	void AttachStats(LiveStats* stats);
+	void AttachMetrics(MetricsShard* metrics);
+	void AttachProfiler(TrapProfiler* profiler);
+	void AttachMigration(LiveMigration* migration);
+	void AttachCheckpoints(CheckpointLog* checkpoints);
+	void AttachTasks(TaskScheduler* tasks);
+
+	void BeginSlice();
+	int TakeCounterStop();
+	void CountInstructions(uint64_t retired);
+	int StopsSlice(uint16_t address) const;
+	uint64_t GetInstructions() const;
+	uint64_t GetMicroseconds() const;
+	void SeedCounters(uint64_t retired, uint64_t microseconds);
 
 	uint16_t Read(uint16_t memoryAddress);
+	uint16_t Fetch(uint16_t address);
 	void Write(uint16_t address, uint16_t value);
+	void Patch(uint16_t address, uint16_t value);
+
+private:
+	uint16_t Fault(uint16_t address);
+	int LatchCounter(uint16_t address);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,637 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+// Winsock must be included before Windows.h pulls in its older winsock.h
+#include <winsock2.h>
+#include <afunix.h>
+#include <cstdio>
+#include <cstring>
+
+
+#include "MetricsExporter.h"
+#include "LiveStats.h"
+#include "Trap.h"
+
+
+#pragma comment(lib, "Ws2_32.lib")
+
+
+// Upper bounds of the exported histogram buckets, in nanoseconds, from 1 us to 10 s.
+static const uint64_t bucketBounds[] =
+{
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 500000000,
+    1000000000, 2500000000ULL, 5000000000ULL, 10000000000ULL
+};
+
+static const char* const trapNames[METRICS_TRAP_VECTORS] = { "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT" };
+
+static const char* const stateNames[] = { "running", "input", "halted" };
+
+
+/**
+ * @brief Constructs a MetricsShard for one VM.
+ *
+ * @param name The name of the VM, exported as the vm label.
+ */
+MetricsShard::MetricsShard(const char* name) : sequence(0)
+{
+    memset(data.name, 0, sizeof(data.name));
+    strncpy(data.name, name, sizeof(data.name) - 1);
+    data.state = VmStates::VM_STATE_RUNNING;
+    data.instructions = 0;
+    data.inputBytes = 0;
+
+    inputArrival = 0;
+
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = counterFrequency.QuadPart;
+}
+
+
+/**
+ * @brief Marks the start of an update; a scrape copying the data meanwhile discards its copy.
+ */
+void MetricsShard::BeginWrite()
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+/**
+ * @brief Marks the end of an update.
+ */
+void MetricsShard::EndWrite()
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+/**
+ * @brief Converts an interval of the performance counter to nanoseconds.
+ *
+ * Split to avoid overflowing the multiplication, which a long wait for input would otherwise do.
+ */
+LONGLONG MetricsShard::Nanoseconds(LONGLONG start, LONGLONG end) const
+{
+    LONGLONG ticks = end - start;
+    return ticks / frequency * 1000000000 + ticks % frequency * 1000000000 / frequency;
+}
+
+
+/**
+ * @brief Returns the timestamp at which a trap starts.
+ *
+ * @return The current value of the performance counter, passed back to EndTrap.
+ */
+LONGLONG MetricsShard::BeginTrap() const
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+
+/**
+ * @brief Records the latency of a trap.
+ *
+ * A trap that writes output also answers the oldest input not answered yet, which is recorded
+ * as input-to-output latency.
+ *
+ * @param vector The trap vector; vectors other than TRAP_GETC to TRAP_HALT are not recorded.
+ * @param start The timestamp returned by BeginTrap.
+ */
+void MetricsShard::EndTrap(uint16_t vector, LONGLONG start)
+{
+    uint16_t index = (uint16_t)(vector - 0x20);
+    if (index >= METRICS_TRAP_VECTORS)
+    {
+        return;
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    BeginWrite();
+    data.trapLatency[index].Record((uint64_t)Nanoseconds(start, now.QuadPart));
+
+    // Every trap except GETC and HALT writes to the console
+    if (inputArrival && vector != TrapCodes::TRAP_GETC && vector != TrapCodes::TRAP_HALT)
+    {
+        data.inputToOutput.Record((uint64_t)Nanoseconds(inputArrival, now.QuadPart));
+        inputArrival = 0;
+    }
+    EndWrite();
+}
+
+
+/**
+ * @brief Adds the instructions executed by a slice.
+ *
+ * @param retired The number of instructions executed.
+ */
+void MetricsShard::CountInstructions(uint64_t retired)
+{
+    BeginWrite();
+    data.instructions += retired;
+    EndWrite();
+}
+
+
+/**
+ * @brief Counts a byte of guest input and starts timing the output answering it.
+ */
+void MetricsShard::CountInput()
+{
+    if (!inputArrival)
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        inputArrival = now.QuadPart;
+    }
+
+    BeginWrite();
+    ++data.inputBytes;
+    EndWrite();
+}
+
+
+/**
+ * @brief Sets the execution state of the VM.
+ *
+ * Only the VM thread writes the data, so an unchanged state is seen without a write, and the
+ * state can be set after every slice.
+ *
+ * @param state The new state, as a value of the VmStates enumeration.
+ */
+void MetricsShard::SetState(uint32_t state)
+{
+    if (data.state == state)
+    {
+        return;
+    }
+
+    BeginWrite();
+    data.state = state;
+    EndWrite();
+}
+
+
+/**
+ * @brief Copies a consistent snapshot of the data, retrying while the VM thread updates it.
+ *
+ * @param copy Receives the snapshot.
+ */
+void MetricsShard::Snapshot(MetricsData& copy) const
+{
+    for (;;)
+    {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            YieldProcessor();
+            continue;
+        }
+
+        memcpy(&copy, &data, sizeof(MetricsData));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before)
+        {
+            return;
+        }
+    }
+}
+
+
+/**
+ * @brief Constructs a MetricsExporter with no listeners and no VMs.
+ */
+MetricsExporter::MetricsExporter() : shardCount(0), serving(0)
+{
+    unixListener = (uintptr_t)INVALID_SOCKET;
+    httpListener = (uintptr_t)INVALID_SOCKET;
+
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+}
+
+
+/**
+ * @brief Destroys the MetricsExporter object, stopping its thread and removing its socket file.
+ */
+MetricsExporter::~MetricsExporter()
+{
+    Stop();
+
+    if ((SOCKET)unixListener != INVALID_SOCKET)
+    {
+        closesocket((SOCKET)unixListener);
+        DeleteFileA(unixPath.c_str());
+    }
+    if ((SOCKET)httpListener != INVALID_SOCKET)
+    {
+        closesocket((SOCKET)httpListener);
+    }
+
+    WSACleanup();
+}
+
+
+/**
+ * @brief Adds the shard of a VM to the scraped ones; may be called while the exporter runs.
+ *
+ * @param shard The shard, which must outlive the exporter.
+ * @return Returns 1 on success, 0 if METRICS_MAX_SHARDS shards were already added.
+ */
+int MetricsExporter::AddShard(MetricsShard* shard)
+{
+    int count = shardCount.load(std::memory_order_relaxed);
+    if (count >= METRICS_MAX_SHARDS)
+    {
+        return 0;
+    }
+
+    shards[count] = shard;
+    shardCount.store(count + 1, std::memory_order_release);
+    return 1;
+}
+
+
+/**
+ * @brief Listens on a Unix domain socket; every connection receives the metrics and is closed.
+ *
+ * @param path The socket path, or an empty string for lc3-PID.metrics in the temporary directory.
+ * @return Returns 1 on success, 0 if the socket could not be set up.
+ */
+int MetricsExporter::ListenUnix(const char* path)
+{
+    char defaultPath[MAX_PATH + 32];
+    if (*path == '\0')
+    {
+        char temp[MAX_PATH];
+        DWORD length = GetTempPathA(MAX_PATH, temp);
+        if (length == 0 || length >= MAX_PATH)
+        {
+            fprintf(stderr, "metrics: no temporary directory\n");
+            return 0;
+        }
+        snprintf(defaultPath, sizeof(defaultPath), "%slc3-%lu.metrics", temp, (unsigned long)GetCurrentProcessId());
+        path = defaultPath;
+    }
+
+    SOCKADDR_UN address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "metrics: socket path too long: %s\n", path);
+        return 0;
+    }
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    SOCKET socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketHandle == INVALID_SOCKET)
+    {
+        fprintf(stderr, "metrics: could not create a Unix socket\n");
+        return 0;
+    }
+    unixListener = (uintptr_t)socketHandle;
+
+    // A socket file left by an earlier run would make bind fail
+    DeleteFileA(path);
+
+    if (bind(socketHandle, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(socketHandle, 4) == SOCKET_ERROR)
+    {
+        fprintf(stderr, "metrics: could not listen on %s\n", path);
+        return 0;
+    }
+    unixPath = path;
+
+    fprintf(stderr, "metrics: serving on %s\n", path);
+    return 1;
+}
+
+
+/**
+ * @brief Listens for HTTP scrapes on the loopback interface.
+ *
+ * @param port The TCP port to listen on.
+ * @return Returns 1 on success, 0 if the socket could not be set up.
+ */
+int MetricsExporter::ListenHttp(uint16_t port)
+{
+    SOCKET socketHandle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (socketHandle == INVALID_SOCKET)
+    {
+        fprintf(stderr, "metrics: could not create a socket\n");
+        return 0;
+    }
+    httpListener = (uintptr_t)socketHandle;
+
+    int reuse = 1;
+    setsockopt(socketHandle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    if (bind(socketHandle, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(socketHandle, 4) == SOCKET_ERROR)
+    {
+        fprintf(stderr, "metrics: could not listen on localhost:%u\n", port);
+        return 0;
+    }
+
+    fprintf(stderr, "metrics: serving on http://localhost:%u/metrics\n", port);
+    return 1;
+}
+
+
+/**
+ * @brief Starts the exporter thread.
+ */
+void MetricsExporter::Start()
+{
+    serving = 1;
+    server = std::thread(&MetricsExporter::Serve, this);
+}
+
+
+/**
+ * @brief Stops the exporter thread.
+ */
+void MetricsExporter::Stop()
+{
+    if (server.joinable())
+    {
+        serving = 0;
+        server.join();
+    }
+}
+
+
+/**
+ * @brief Exporter thread body: answers every connection on either listener in turn.
+ *
+ * Waits with a timeout so that Stop is noticed within METRICS_POLL_MS.
+ */
+void MetricsExporter::Serve()
+{
+    SOCKET listeners[2] = { (SOCKET)unixListener, (SOCKET)httpListener };
+
+    while (serving)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+
+        SOCKET highest = 0;
+        for (int i = 0; i < 2; ++i)
+        {
+            if (listeners[i] != INVALID_SOCKET)
+            {
+                FD_SET(listeners[i], &readable);
+                highest = listeners[i] > highest ? listeners[i] : highest;
+            }
+        }
+
+        timeval timeout = { 0, METRICS_POLL_MS * 1000 };
+        if (select((int)highest + 1, &readable, NULL, NULL, &timeout) <= 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < 2; ++i)
+        {
+            if (listeners[i] != INVALID_SOCKET && FD_ISSET(listeners[i], &readable))
+            {
+                SOCKET client = accept(listeners[i], NULL, NULL);
+                if (client != INVALID_SOCKET)
+                {
+                    Respond((uintptr_t)client, i == 1);
+                    closesocket(client);
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Sends the metrics to a client.
+ *
+ * Unix socket clients receive the exposition as is. HTTP clients receive it as the response to
+ * their GET request, whatever its path.
+ *
+ * @param client The connected socket.
+ * @param http Whether the client connected to the HTTP listener.
+ */
+void MetricsExporter::Respond(uintptr_t client, int http) const
+{
+    SOCKET socketHandle = (SOCKET)client;
+    std::string text;
+
+    if (http)
+    {
+        // Read the request headers, giving slow clients one second
+        char request[4096];
+        int length = 0;
+
+        while (length < (int)sizeof(request) - 1)
+        {
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(socketHandle, &readable);
+            timeval timeout = { 1, 0 };
+            if (select((int)socketHandle + 1, &readable, NULL, NULL, &timeout) <= 0)
+            {
+                return;
+            }
+
+            int received = recv(socketHandle, request + length, (int)sizeof(request) - 1 - length, 0);
+            if (received <= 0)
+            {
+                return;
+            }
+            length += received;
+            request[length] = '\0';
+
+            if (strstr(request, "\r\n\r\n"))
+            {
+                break;
+            }
+        }
+
+        if (strncmp(request, "GET ", 4) != 0)
+        {
+            text = "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+        else
+        {
+            std::string body;
+            Scrape(body);
+
+            char header[256];
+            snprintf(header, sizeof(header),
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                "Content-Length: %u\r\n"
+                "Connection: close\r\n\r\n", (unsigned)body.size());
+            text = header + body;
+        }
+    }
+    else
+    {
+        Scrape(text);
+    }
+
+    size_t sent = 0;
+    while (sent < text.size())
+    {
+        int count = send(socketHandle, text.data() + sent, (int)(text.size() - sent), 0);
+        if (count <= 0)
+        {
+            return;
+        }
+        sent += (size_t)count;
+    }
+}
+
+
+/**
+ * @brief Appends a label value, escaped as OpenMetrics requires.
+ */
+static void AppendLabel(std::string& text, const char* value)
+{
+    for (; *value; ++value)
+    {
+        if (*value == '\\' || *value == '"')
+        {
+            text += '\\';
+            text += *value;
+        }
+        else if (*value == '\n')
+        {
+            text += "\\n";
+        }
+        else
+        {
+            text += *value;
+        }
+    }
+}
+
+
+/**
+ * @brief Appends the buckets, count and sum of one histogram sample, converting nanoseconds to seconds.
+ *
+ * @param text The exposition being built.
+ * @param name The metric family name.
+ * @param labels The labels of the sample, without braces.
+ * @param histogram The recorded latencies, in nanoseconds.
+ */
+static void AppendHistogram(std::string& text, const char* name, const std::string& labels, const Histogram& histogram)
+{
+    char line[256];
+
+    for (size_t i = 0; i < sizeof(bucketBounds) / sizeof(bucketBounds[0]); ++i)
+    {
+        snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%g\"} %llu\n", name, labels.c_str(),
+            bucketBounds[i] / 1e9, (unsigned long long)histogram.CountAtOrBelow(bucketBounds[i]));
+        text += line;
+    }
+
+    snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %llu\n%s_count{%s} %llu\n%s_sum{%s} %.9f\n",
+        name, labels.c_str(), (unsigned long long)histogram.Count(),
+        name, labels.c_str(), (unsigned long long)histogram.Count(),
+        name, labels.c_str(), histogram.Sum() / 1e9);
+    text += line;
+}
+
+
+/**
+ * @brief Builds the OpenMetrics exposition of every VM.
+ *
+ * Each shard is copied once, so all samples of a VM come from the same moment.
+ *
+ * @param text Receives the exposition, terminated by "# EOF".
+ */
+void MetricsExporter::Scrape(std::string& text) const
+{
+    int count = shardCount.load(std::memory_order_acquire);
+
+    // Histograms are large, so the snapshots live on the heap
+    MetricsData* snapshots = new MetricsData[count > 0 ? count : 1];
+    std::string* labels = new std::string[count > 0 ? count : 1];
+
+    for (int i = 0; i < count; ++i)
+    {
+        shards[i]->Snapshot(snapshots[i]);
+        labels[i] = "vm=\"";
+        AppendLabel(labels[i], snapshots[i].name);
+        labels[i] += '"';
+    }
+
+    char line[256];
+    text.clear();
+
+    text += "# TYPE lc3_vm_state stateset\n# HELP lc3_vm_state Execution state of the VM.\n";
+    for (int i = 0; i < count; ++i)
+    {
+        for (uint32_t state = 0; state <= VmStates::VM_STATE_HALTED; ++state)
+        {
+            snprintf(line, sizeof(line), "lc3_vm_state{%s,lc3_vm_state=\"%s\"} %d\n", labels[i].c_str(), stateNames[state],
+                snapshots[i].state == state);
+            text += line;
+        }
+    }
+
+    text += "# TYPE lc3_instructions counter\n# HELP lc3_instructions Guest instructions executed.\n";
+    for (int i = 0; i < count; ++i)
+    {
+        snprintf(line, sizeof(line), "lc3_instructions_total{%s} %llu\n", labels[i].c_str(),
+            (unsigned long long)snapshots[i].instructions);
+        text += line;
+    }
+
+    text += "# TYPE lc3_input_bytes counter\n# UNIT lc3_input_bytes bytes\n# HELP lc3_input_bytes Bytes of input read by the guest.\n";
+    for (int i = 0; i < count; ++i)
+    {
+        snprintf(line, sizeof(line), "lc3_input_bytes_total{%s} %llu\n", labels[i].c_str(),
+            (unsigned long long)snapshots[i].inputBytes);
+        text += line;
+    }
+
+    text += "# TYPE lc3_trap_latency_seconds histogram\n# UNIT lc3_trap_latency_seconds seconds\n"
+        "# HELP lc3_trap_latency_seconds Time spent in a trap, including waits for input.\n";
+    for (int i = 0; i < count; ++i)
+    {
+        for (int vector = 0; vector < METRICS_TRAP_VECTORS; ++vector)
+        {
+            std::string vectorLabels = labels[i] + ",vector=\"" + trapNames[vector] + "\"";
+            AppendHistogram(text, "lc3_trap_latency_seconds", vectorLabels, snapshots[i].trapLatency[vector]);
+        }
+    }
+
+    text += "# TYPE lc3_input_to_output_latency_seconds histogram\n# UNIT lc3_input_to_output_latency_seconds seconds\n"
+        "# HELP lc3_input_to_output_latency_seconds Time from guest input to the next output trap.\n";
+    for (int i = 0; i < count; ++i)
+    {
+        AppendHistogram(text, "lc3_input_to_output_latency_seconds", labels[i], snapshots[i].inputToOutput);
+    }
+
+    text += "# EOF\n";
+
+    delete[] labels;
+    delete[] snapshots;
+}
\ No newline at end of file
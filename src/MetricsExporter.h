@@ -0,0 +1,108 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+// Largest number of VMs a single exporter serves.
+#define METRICS_MAX_SHARDS 64
+
+// Trap vectors with their own latency histogram, TRAP_GETC to TRAP_HALT.
+#define METRICS_TRAP_VECTORS 6
+
+// Interval at which the exporter thread checks whether it was stopped.
+#define METRICS_POLL_MS 100
+
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <Windows.h>
+
+#include "Histogram.h"
+
+
+// Everything one VM reports, copied as a whole by a scrape.
+struct MetricsData
+{
+    char name[64];
+    uint32_t state;
+    uint64_t instructions;
+    uint64_t inputBytes;
+
+    // Latencies in nanoseconds
+    Histogram trapLatency[METRICS_TRAP_VECTORS];
+    Histogram inputToOutput;
+};
+
+
+// Counters of one VM, written only by the thread running it. Writes are bracketed by a sequence
+// number instead of being atomic read-modify-writes, so the VM thread never takes a lock or a
+// locked instruction; a scrape copies the data and retries if a write overlapped the copy.
+class MetricsShard
+{
+private:
+    std::atomic<uint32_t> sequence;
+    MetricsData data;
+
+    // Performance counter value at which the last unanswered input arrived, zero if none
+    LONGLONG inputArrival;
+    LONGLONG frequency;
+
+public:
+    MetricsShard(const char* name);
+
+    LONGLONG BeginTrap() const;
+    void EndTrap(uint16_t vector, LONGLONG start);
+    void CountInstructions(uint64_t retired);
+    void CountInput();
+    void SetState(uint32_t state);
+
+    void Snapshot(MetricsData& copy) const;
+
+private:
+    void BeginWrite();
+    void EndWrite();
+    LONGLONG Nanoseconds(LONGLONG start, LONGLONG end) const;
+};
+
+
+class MetricsExporter
+{
+private:
+    MetricsShard* shards[METRICS_MAX_SHARDS];
+    std::atomic<int> shardCount;
+
+    uintptr_t unixListener;
+    uintptr_t httpListener;
+    std::string unixPath;
+
+    std::atomic<int> serving;
+    std::thread server;
+
+public:
+    MetricsExporter();
+    ~MetricsExporter();
+
+    int AddShard(MetricsShard* shard);
+    int ListenUnix(const char* path);
+    int ListenHttp(uint16_t port);
+
+    void Start();
+    void Stop();
+
+    void Scrape(std::string& text) const;
+
+private:
+    void Serve();
+    void Respond(uintptr_t client, int http) const;
+};
+#endif
\ No newline at end of file
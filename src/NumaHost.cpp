@@ -0,0 +1,729 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+#include <Psapi.h>
+
+
+#include "NumaHost.h"
+#include "ImageBundle.h"
+#include "LiveStats.h"
+#include "MetricsExporter.h"
+
+
+#pragma comment(lib, "Psapi.lib")
+
+
+/**
+ * @brief Constructs a guest with a memory of the given size, allocated on a NUMA node.
+ *
+ * @param index The order in which the guest was created.
+ * @param node The index of the node of the worker constructing it.
+ * @param numaNode The system node number of that node, which the memory and decode tables are allocated on.
+ * @param words The memory size in words.
+ * @param mode What addresses past the end of the memory refer to, as a value of MemoryModes.
+ * @param cached Whether the engine uses decode tables; they are only allocated then.
+ * @param os Pointer to the OS object shared by all guests.
+ */
+HostGuest::HostGuest(int index, int node, ULONG numaNode, uint32_t words, uint16_t mode, int cached, OS* os)
+    : cpu(words, mode, numaNode),
+      memoryIO(&cpu, os, &console),
+      alu(cpu.memory, cpu.registers, &memoryIO, &cpu),
+      trap(cpu.registers, &cpu, &console),
+      decodeCache(cached ? new DecodeCache(&alu, numaNode) : nullptr),
+      vm(&cpu, os, &trap, &memoryIO, &alu, decodeCache, &console),
+      index(index), node(node), located(0), memoryNode(-1), tableNode(-1), metrics(nullptr)
+{
+    if (decodeCache)
+    {
+        decodeCache->AttachMemory(&cpu);
+    }
+}
+
+
+/**
+ * @brief Destroys the guest and its decode tables.
+ */
+HostGuest::~HostGuest()
+{
+    delete decodeCache;
+}
+
+
+/**
+ * @brief Takes over the registers, memory, run state, sleep and counters of another guest of the same memory size.
+ *
+ * The decode tables are not copied: they are rebuilt from the memory when the guest first runs.
+ *
+ * @param from The guest to copy.
+ */
+void HostGuest::CopyState(const HostGuest& from)
+{
+    memcpy(cpu.registers, from.cpu.registers, sizeof(cpu.registers));
+    memcpy(cpu.memory, from.cpu.memory, cpu.memoryWords * sizeof(uint16_t));
+    cpu.running = from.cpu.running;
+    vm.CopyIdle(from.vm);
+    memoryIO.SeedCounters(from.memoryIO.GetInstructions(), from.memoryIO.GetMicroseconds());
+}
+
+
+/**
+ * @brief Reports the traps and input of the guest to a metrics shard.
+ *
+ * @param shard The shard, or nullptr to stop reporting.
+ */
+void HostGuest::AttachMetrics(MetricsShard* shard)
+{
+    metrics = shard;
+    trap.AttachMetrics(shard);
+    memoryIO.AttachMetrics(shard);
+}
+
+
+/**
+ * @brief Sets the execution state the metrics show for the guest, if it has a shard.
+ *
+ * @param state The new state, as a value of the VmStates enumeration.
+ */
+void HostGuest::SetState(uint32_t state)
+{
+    if (metrics)
+    {
+        metrics->SetState(state);
+    }
+}
+
+
+/**
+ * @brief Constructs a NumaHost running guests as configured by the options.
+ *
+ * @param os Pointer to the OS object shared by all guests.
+ * @param options The options; the engine, memory size and host settings are used.
+ */
+NumaHost::NumaHost(OS* os, const Options& options) : halted(0), failed(0), handOffPending(0)
+{
+    osPtr = os;
+
+    // Guests are not calibrated one by one; predecoding is the fastest engine on most hosts
+    engine = options.engine == Engines::ENGINE_AUTO ? (uint16_t)Engines::ENGINE_PREDECODED : options.engine;
+    usesDecodeCache = engine == Engines::ENGINE_PREDECODED || engine == Engines::ENGINE_THREADED;
+    memoryWords = options.memoryWords ? options.memoryWords : MEMORY_MAX;
+    memoryMode = options.memoryMode;
+    pinning = options.hostPinning;
+    imbalance = options.hostImbalance;
+    guestCount = options.hostGuests;
+    metricsSocket = options.metricsSocket;
+    metricsPort = options.metricsPort;
+
+    imagePaths = nullptr;
+    imageCount = 0;
+    nodeCount = 0;
+    workerCount = 0;
+}
+
+
+/**
+ * @brief Destroys the NumaHost object and its workers.
+ */
+NumaHost::~NumaHost()
+{
+    for (int i = 0; i < workerCount; ++i)
+    {
+        CloseHandle(workers[i]->wakeEvent);
+        delete workers[i];
+    }
+    delete[] imagePaths;
+    delete[] shards;
+}
+
+
+/**
+ * @brief Loads the guests' images from a bundle instead of from image files.
+ *
+ * The bundle is mapped once and shared read-only by every worker.
+ *
+ * @param bundle Pointer to the open ImageBundle, or nullptr to read image files.
+ */
+void NumaHost::AttachBundle(const ImageBundle* bundle)
+{
+    bundlePtr = bundle;
+}
+
+
+/**
+ * @brief Finds the NUMA nodes and the processors of each that the process may run on.
+ *
+ * Without NUMA support, or when no node has a usable processor, all the processors of the
+ * process form a single node, and the host only pins and balances its workers.
+ */
+void NumaHost::Discover()
+{
+    DWORD_PTR processMask = 0, systemMask = 0;
+    GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest))
+    {
+        highest = 0;
+    }
+
+    for (ULONG number = 0; number <= highest && nodeCount < HOST_MAX_NODES; ++number)
+    {
+        ULONGLONG processors = 0;
+        if (GetNumaNodeProcessorMask((UCHAR)number, &processors) && (processors & processMask))
+        {
+            nodes[nodeCount].number = number;
+            nodes[nodeCount].processors = processors & processMask;
+            nodes[nodeCount].workers = 0;
+            ++nodeCount;
+        }
+    }
+
+    if (nodeCount == 0)
+    {
+        nodes[0].number = 0;
+        nodes[0].processors = processMask ? processMask : 1;
+        nodes[0].workers = 0;
+        nodeCount = 1;
+    }
+}
+
+
+/**
+ * @brief Creates one worker per processor, up to one per guest, taking processors from the nodes in turn.
+ *
+ * Taking them in turn spreads a few guests over every node instead of filling the first one.
+ */
+void NumaHost::PlaceWorkers()
+{
+    int limit = guestCount < HOST_MAX_WORKERS ? guestCount : HOST_MAX_WORKERS;
+    int next[HOST_MAX_NODES] = {};
+    int placed = 1;
+
+    while (workerCount < limit && placed)
+    {
+        placed = 0;
+        for (int node = 0; node < nodeCount && workerCount < limit; ++node)
+        {
+            // Next processor of the node not taken yet
+            int processor = next[node];
+            while (processor < HOST_MAX_WORKERS && !(nodes[node].processors & (1ULL << processor)))
+            {
+                ++processor;
+            }
+            if (processor >= HOST_MAX_WORKERS)
+            {
+                continue;
+            }
+            next[node] = processor + 1;
+
+            HostWorker* worker = new HostWorker();
+            worker->node = node;
+            worker->processor = processor;
+            worker->affinity = pinning == HostPinnings::HOST_PIN_NODE ?
+                (DWORD_PTR)nodes[node].processors : (DWORD_PTR)1 << processor;
+            worker->wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+            worker->runnable.store(0);
+            worker->handOffTo.store(-1);
+
+            workers[workerCount++] = worker;
+            ++nodes[node].workers;
+            placed = 1;
+        }
+    }
+
+    for (int i = 0; i < guestCount; ++i)
+    {
+        workers[i % workerCount]->initialGuests.push_back(i);
+    }
+}
+
+
+/**
+ * @brief Constructs a guest and loads the images into it.
+ *
+ * @param index The order in which the guest is created.
+ * @param node The index of the node of the calling worker.
+ * @return The guest, halted if an image does not fit its memory.
+ */
+HostGuest* NumaHost::CreateGuest(int index, int node)
+{
+    HostGuest* guest = new HostGuest(index, node, nodes[node].number, memoryWords, memoryMode, usesDecodeCache, osPtr);
+
+    // The shard is created on the worker too, so the guest updates it on its own node
+    if (shards)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "%s#%d", imageCount ? imagePaths[0] : "", index);
+        shards[index] = new MetricsShard(name);
+        {
+            std::lock_guard<std::mutex> guard(shardLock);
+            exporterPtr->AddShard(shards[index]);
+        }
+        guest->AttachMetrics(shards[index]);
+    }
+
+    for (int i = 0; i < imageCount; ++i)
+    {
+        int loaded = bundlePtr ? bundlePtr->Load(&guest->cpu, imagePaths[i]) : guest->cpu.ReadImage(imagePaths[i], &guest->alu);
+        if (!loaded)
+        {
+            fprintf(stderr, "host: %s does not fit in guest %d\n", imagePaths[i], index);
+            guest->cpu.running = 0;
+            failed.fetch_add(1);
+            halted.fetch_add(1);
+            break;
+        }
+    }
+
+    return guest;
+}
+
+
+/**
+ * @brief Returns the system node number of the physical page behind an address.
+ *
+ * @param address The address, within a page the process has touched.
+ * @return The node number, or -1 if the page is not resident.
+ */
+int NumaHost::PageNode(const void* address) const
+{
+    PSAPI_WORKING_SET_EX_INFORMATION info;
+    info.VirtualAddress = (PVOID)address;
+
+    if (!QueryWorkingSetEx(GetCurrentProcess(), &info, sizeof(info)) || !info.VirtualAttributes.Valid)
+    {
+        return -1;
+    }
+    return (int)info.VirtualAttributes.Node;
+}
+
+
+/**
+ * @brief Adds the instructions of a slice to the counters of a worker.
+ *
+ * Where a guest's pages landed is looked up after its first slice on the worker, once the engine
+ * has touched its decode tables. A slice of a guest whose memory or tables are on another node
+ * than the worker counts as remote. The instructions also go to the guest's metrics, if any.
+ *
+ * @param worker The worker that ran the slice.
+ * @param guest The guest it ran.
+ * @param retired The number of instructions executed.
+ */
+void NumaHost::Account(HostWorker* worker, HostGuest* guest, uint64_t retired)
+{
+    if (!guest->located)
+    {
+        guest->memoryNode = PageNode(guest->cpu.memory);
+        guest->tableNode = guest->decodeCache ? PageNode(guest->decodeCache->entries) : -1;
+        guest->located = 1;
+    }
+
+    if (guest->metrics)
+    {
+        guest->metrics->CountInstructions(retired);
+    }
+
+    int local = (int)nodes[worker->node].number;
+    worker->instructions += retired;
+    if ((guest->memoryNode >= 0 && guest->memoryNode != local) || (guest->tableNode >= 0 && guest->tableNode != local))
+    {
+        worker->remoteInstructions += retired;
+    }
+}
+
+
+/**
+ * @brief Takes over the guests other workers handed to this one.
+ *
+ * A guest coming from another node is constructed again on this thread and its state copied, so
+ * that its memory and decode tables move to this node; one from the same node is kept as it is.
+ *
+ * @param worker The calling worker.
+ */
+void NumaHost::Adopt(HostWorker* worker)
+{
+    std::vector<HostGuest*> arrived;
+    {
+        std::lock_guard<std::mutex> guard(worker->inboxLock);
+        if (worker->inbox.empty())
+        {
+            return;
+        }
+        arrived.swap(worker->inbox);
+    }
+
+    for (HostGuest* guest : arrived)
+    {
+        if (guest->node != worker->node)
+        {
+            HostGuest* moved = new HostGuest(guest->index, worker->node, nodes[worker->node].number, memoryWords, memoryMode, usesDecodeCache, osPtr);
+            moved->CopyState(*guest);
+            moved->AttachMetrics(guest->metrics);
+            delete guest;
+            guest = moved;
+            ++worker->migrationsIn;
+        }
+        else
+        {
+            guest->located = 0;
+            ++worker->handOffsIn;
+        }
+        worker->guests.push_back(guest);
+    }
+
+    handOffPending.store(0);
+}
+
+
+/**
+ * @brief Hands one running guest over to the worker the balancer asked for.
+ *
+ * @param worker The calling worker.
+ */
+void NumaHost::HandOff(HostWorker* worker)
+{
+    int target = worker->handOffTo.exchange(-1);
+
+    for (size_t i = worker->guests.size(); i-- > 0;)
+    {
+        HostGuest* guest = worker->guests[i];
+        if (guest->cpu.running)
+        {
+            worker->guests.erase(worker->guests.begin() + i);
+            {
+                std::lock_guard<std::mutex> guard(workers[target]->inboxLock);
+                workers[target]->inbox.push_back(guest);
+            }
+            SetEvent(workers[target]->wakeEvent);
+            return;
+        }
+    }
+
+    // Every guest halted meanwhile
+    handOffPending.store(0);
+}
+
+
+/**
+ * @brief Runs the guests of one worker round-robin until every guest of the host has halted.
+ *
+ * @param worker The worker.
+ */
+void NumaHost::Work(HostWorker* worker)
+{
+    SetThreadAffinityMask(GetCurrentThread(), worker->affinity);
+    SetThreadIdealProcessor(GetCurrentThread(), (DWORD)worker->processor);
+
+    // Constructed by the worker, which allocates their memory and decode tables on its node
+    for (int index : worker->initialGuests)
+    {
+        worker->guests.push_back(CreateGuest(index, worker->node));
+    }
+
+    while (halted.load() < guestCount)
+    {
+        Adopt(worker);
+        if (worker->handOffTo.load() >= 0)
+        {
+            HandOff(worker);
+        }
+
+        int runnable = 0;
+        for (HostGuest* guest : worker->guests)
+        {
+            if (!guest->cpu.running)
+            {
+                continue;
+            }
+
+            // A guest in SLEEP or WAIT is skipped, and counts as runnable only once ready
+            if (!guest->vm.IsReady())
+            {
+                guest->SetState(VmStates::VM_STATE_INPUT);
+                continue;
+            }
+
+            guest->SetState(VmStates::VM_STATE_RUNNING);
+            Account(worker, guest, guest->vm.Execute(engine, HOST_SLICE));
+
+            if (guest->cpu.running)
+            {
+                ++runnable;
+            }
+            else
+            {
+                guest->console.Flush();
+                guest->SetState(VmStates::VM_STATE_HALTED);
+                halted.fetch_add(1);
+            }
+        }
+        worker->runnable.store(runnable, std::memory_order_relaxed);
+
+        if (runnable == 0)
+        {
+            WaitForSingleObject(worker->wakeEvent, HOST_IDLE_MS);
+        }
+    }
+
+    for (HostGuest* guest : worker->guests)
+    {
+        delete guest;
+    }
+    worker->guests.clear();
+}
+
+
+/**
+ * @brief Asks a worker to hand one of its running guests to another worker.
+ *
+ * @param source The index of the worker giving a guest up.
+ * @param target The index of the worker receiving it.
+ */
+void NumaHost::RequestHandOff(int source, int target)
+{
+    handOffPending.store(1);
+    workers[source]->handOffTo.store(target);
+}
+
+
+/**
+ * @brief Moves a guest when the load of the nodes, or of the workers of one node, is uneven.
+ *
+ * The load of a node is its running guests per worker. A guest moves to another node only when
+ * the busiest and idlest nodes differ by more than the imbalance threshold, in percent of the mean
+ * load, and the move does not make the receiving node the busier one; moving it costs a copy of
+ * its memory and a new decode. Within a node, where a move costs nothing, a guest moves whenever
+ * one worker runs at least two more than another. One move is in flight at a time.
+ */
+void NumaHost::Balance()
+{
+    if (handOffPending.load())
+    {
+        return;
+    }
+
+    int nodeRunnable[HOST_MAX_NODES] = {};
+    int total = 0;
+    for (int i = 0; i < workerCount; ++i)
+    {
+        int runnable = workers[i]->runnable.load(std::memory_order_relaxed);
+        nodeRunnable[workers[i]->node] += runnable;
+        total += runnable;
+    }
+
+    int busiest = -1, idlest = -1;
+    for (int node = 0; node < nodeCount; ++node)
+    {
+        if (nodes[node].workers == 0)
+        {
+            continue;
+        }
+        if (busiest < 0 || nodeRunnable[node] * nodes[busiest].workers > nodeRunnable[busiest] * nodes[node].workers)
+        {
+            busiest = node;
+        }
+        if (idlest < 0 || nodeRunnable[node] * nodes[idlest].workers < nodeRunnable[idlest] * nodes[node].workers)
+        {
+            idlest = node;
+        }
+    }
+
+    if (busiest != idlest && total > 0)
+    {
+        double mean = (double)total / workerCount;
+        double busy = (double)nodeRunnable[busiest] / nodes[busiest].workers;
+        double idle = (double)nodeRunnable[idlest] / nodes[idlest].workers;
+        double busyAfter = (double)(nodeRunnable[busiest] - 1) / nodes[busiest].workers;
+        double idleAfter = (double)(nodeRunnable[idlest] + 1) / nodes[idlest].workers;
+
+        if ((busy - idle) * 100 > imbalance * mean && busyAfter >= idleAfter)
+        {
+            int source = -1, target = -1;
+            for (int i = 0; i < workerCount; ++i)
+            {
+                int runnable = workers[i]->runnable.load(std::memory_order_relaxed);
+                if (workers[i]->node == busiest && (source < 0 || runnable > workers[source]->runnable.load(std::memory_order_relaxed)))
+                {
+                    source = i;
+                }
+                if (workers[i]->node == idlest && (target < 0 || runnable < workers[target]->runnable.load(std::memory_order_relaxed)))
+                {
+                    target = i;
+                }
+            }
+            RequestHandOff(source, target);
+            return;
+        }
+    }
+
+    for (int node = 0; node < nodeCount; ++node)
+    {
+        int source = -1, target = -1;
+        for (int i = 0; i < workerCount; ++i)
+        {
+            if (workers[i]->node != node)
+            {
+                continue;
+            }
+            int runnable = workers[i]->runnable.load(std::memory_order_relaxed);
+            if (source < 0 || runnable > workers[source]->runnable.load(std::memory_order_relaxed))
+            {
+                source = i;
+            }
+            if (target < 0 || runnable < workers[target]->runnable.load(std::memory_order_relaxed))
+            {
+                target = i;
+            }
+        }
+
+        if (source >= 0 && workers[source]->runnable.load(std::memory_order_relaxed) >=
+            workers[target]->runnable.load(std::memory_order_relaxed) + 2)
+        {
+            RequestHandOff(source, target);
+            return;
+        }
+    }
+}
+
+
+/**
+ * @brief Prints where the workers ran, how much of their work was on remote memory and how often guests moved.
+ *
+ * @param seconds The time the guests ran for.
+ */
+void NumaHost::Report(double seconds) const
+{
+    uint64_t instructions = 0, remote = 0, migrations = 0, handOffs = 0;
+
+    for (int node = 0; node < nodeCount; ++node)
+    {
+        uint64_t nodeInstructions = 0, nodeRemote = 0, nodeMigrations = 0;
+        int guests = 0;
+
+        for (int i = 0; i < workerCount; ++i)
+        {
+            if (workers[i]->node == node)
+            {
+                nodeInstructions += workers[i]->instructions;
+                nodeRemote += workers[i]->remoteInstructions;
+                nodeMigrations += workers[i]->migrationsIn;
+                handOffs += workers[i]->handOffsIn;
+                guests += (int)workers[i]->initialGuests.size();
+            }
+        }
+
+        if (nodes[node].workers)
+        {
+            fprintf(stderr, "host: node %lu, %d workers, %d guests placed, %llu instructions, %5.1f%% on remote memory, %llu migrated in\n",
+                (unsigned long)nodes[node].number, nodes[node].workers, guests, (unsigned long long)nodeInstructions,
+                nodeInstructions ? 100.0 * nodeRemote / nodeInstructions : 0.0, (unsigned long long)nodeMigrations);
+        }
+
+        instructions += nodeInstructions;
+        remote += nodeRemote;
+        migrations += nodeMigrations;
+    }
+
+    fprintf(stderr, "host: %d guests on %d workers over %d %s, %.2f MIPS, %llu migrations between nodes, %llu hand-offs within nodes\n",
+        guestCount, workerCount, nodeCount, nodeCount == 1 ? "node" : "nodes",
+        seconds > 0 ? instructions / seconds / 1e6 : 0, (unsigned long long)migrations, (unsigned long long)handOffs);
+}
+
+
+/**
+ * @brief Runs the configured number of guests, each loaded with the image files, until all have halted.
+ *
+ * With --metrics or --metrics-http, every guest is exported as a VM of its own, named after the
+ * first image and its index, until all have halted.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments; those not starting with "--" are image files.
+ * @return The exit code: 0 on success, 1 if an image did not fit a guest or the metrics could not
+ * be served, 2 if there are more guests than METRICS_MAX_SHARDS to export.
+ */
+int NumaHost::Run(int argc, const char* argv[])
+{
+    imagePaths = new const char*[argc];
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            imagePaths[imageCount++] = argv[i];
+        }
+    }
+
+    if (metricsSocket || metricsPort)
+    {
+        if (guestCount > METRICS_MAX_SHARDS)
+        {
+            fprintf(stderr, "host: metrics are exported for at most %d guests\n", METRICS_MAX_SHARDS);
+            return 2;
+        }
+
+        exporterPtr = new MetricsExporter();
+        if ((metricsSocket && !exporterPtr->ListenUnix(metricsSocket)) ||
+            (metricsPort && !exporterPtr->ListenHttp(metricsPort)))
+        {
+            delete exporterPtr;
+            exporterPtr = nullptr;
+            return 1;
+        }
+        shards = new MetricsShard*[guestCount]();
+        exporterPtr->Start();
+    }
+
+    Discover();
+    PlaceWorkers();
+
+    if (nodeCount == 1)
+    {
+        fprintf(stderr, "host: one NUMA node, workers are pinned and balanced without migration\n");
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    for (int i = 0; i < workerCount; ++i)
+    {
+        workers[i]->thread = std::thread(&NumaHost::Work, this, workers[i]);
+    }
+
+    while (halted.load() < guestCount)
+    {
+        Sleep(HOST_BALANCE_MS);
+        Balance();
+    }
+
+    for (int i = 0; i < workerCount; ++i)
+    {
+        SetEvent(workers[i]->wakeEvent);
+        workers[i]->thread.join();
+    }
+
+    QueryPerformanceCounter(&end);
+    Report((double)(end.QuadPart - start.QuadPart) / frequency.QuadPart);
+
+    // Scrapes keep seeing the halted guests until the exporter stops
+    if (exporterPtr)
+    {
+        exporterPtr->Stop();
+        delete exporterPtr;
+        exporterPtr = nullptr;
+        for (int i = 0; i < guestCount; ++i)
+        {
+            delete shards[i];
+        }
+    }
+
+    return failed.load() ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef NUMA_HOST_H
+#define NUMA_HOST_H
+
+// Largest number of worker threads; processors are taken from processor group 0, as by RealTime.
+#define HOST_MAX_WORKERS 64
+
+// Largest number of NUMA nodes placed on.
+#define HOST_MAX_NODES 64
+
+// Instructions a worker runs a guest for before turning to its next guest.
+#define HOST_SLICE 4096
+
+// Interval at which the host compares the load of the nodes and workers, in milliseconds.
+#define HOST_BALANCE_MS 50
+
+// Longest a worker without runnable guests waits before looking at its inbox again, in milliseconds.
+#define HOST_IDLE_MS 10
+
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+
+#include "CPU.h"
+#include "MemoryIO.h"
+#include "ArithmeticLogicUnit.h"
+#include "Trap.h"
+#include "DecodeCache.h"
+#include "Console.h"
+#include "VirtualMachine.h"
+#include "Options.h"
+
+
+class OS;
+class ImageBundle;
+class MetricsShard;
+class MetricsExporter;
+
+
+// One guest of the host. Its memory and decode tables are allocated on the NUMA node of the worker
+// that constructs it.
+struct HostGuest
+{
+    Console console;
+    CPU cpu;
+    MemoryIO memoryIO;
+    ArithmeticLogicUnit alu;
+    Trap trap;
+    DecodeCache* decodeCache; // null unless the engine uses decode tables
+    VirtualMachine vm;
+
+    int index;      // order of creation, for messages
+    int node;       // index of the node whose worker constructed it
+    int located;    // whether memoryNode and tableNode were looked up since
+    int memoryNode; // system node number its memory was found on, -1 if unknown
+    int tableNode;  // system node number its decode tables were found on, -1 if unknown or unused
+
+    // Its shard of the host's metrics exporter, kept across moves; null without metrics
+    MetricsShard* metrics;
+
+    HostGuest(int index, int node, ULONG numaNode, uint32_t words, uint16_t mode, int cached, OS* os);
+    ~HostGuest();
+
+    void CopyState(const HostGuest& from);
+    void AttachMetrics(MetricsShard* shard);
+    void SetState(uint32_t state);
+};
+
+
+// A NUMA node the host places workers on.
+struct HostNode
+{
+    ULONG number;          // system node number
+    ULONGLONG processors;  // processors of group 0 on the node that the process may use
+    int workers;           // workers placed on the node
+};
+
+
+// A thread running a list of guests, pinned to one processor or to the processors of one node.
+struct HostWorker
+{
+    int node;             // index of its node
+    int processor;        // its processor, and ideal processor when pinned to the node
+    DWORD_PTR affinity;
+
+    std::thread thread;
+    HANDLE wakeEvent;
+
+    // Guests handed over by other workers, adopted at the start of the next round
+    std::mutex inboxLock;
+    std::vector<HostGuest*> inbox;
+
+    // Guests run by the worker, touched only by its thread
+    std::vector<HostGuest*> guests;
+    std::vector<int> initialGuests;
+
+    // Published for the balancer: guests still running, and the worker to hand one of them to
+    std::atomic<int> runnable;
+    std::atomic<int> handOffTo;
+
+    // Read once the worker has stopped
+    uint64_t instructions = 0;
+    uint64_t remoteInstructions = 0;
+    uint64_t migrationsIn = 0;
+    uint64_t handOffsIn = 0;
+};
+
+
+// Runs many guests on worker threads placed across the NUMA nodes, and moves guests between
+// nodes only when their load differs by more than a threshold.
+class NumaHost
+{
+private:
+    OS* osPtr;
+    uint16_t engine;
+    int usesDecodeCache;
+    uint32_t memoryWords;
+    uint16_t memoryMode;
+    uint16_t pinning;
+    int imbalance;
+    const ImageBundle* bundlePtr = nullptr;
+
+    const char** imagePaths;
+    int imageCount;
+    int guestCount;
+
+    HostNode nodes[HOST_MAX_NODES];
+    int nodeCount;
+    HostWorker* workers[HOST_MAX_WORKERS];
+    int workerCount;
+
+    std::atomic<int> halted;
+    std::atomic<int> failed;
+    std::atomic<int> handOffPending;
+
+    // With --metrics or --metrics-http, one exporter scrapes a shard per guest, by index
+    const char* metricsSocket;
+    uint16_t metricsPort;
+    MetricsExporter* exporterPtr = nullptr;
+    MetricsShard** shards = nullptr;
+    std::mutex shardLock;
+
+public:
+    NumaHost(OS* os, const Options& options);
+    ~NumaHost();
+
+    void AttachBundle(const ImageBundle* bundle);
+    int Run(int argc, const char* argv[]);
+
+private:
+    void Discover();
+    void PlaceWorkers();
+    void Work(HostWorker* worker);
+    HostGuest* CreateGuest(int index, int node);
+    void Adopt(HostWorker* worker);
+    void HandOff(HostWorker* worker);
+    void Account(HostWorker* worker, HostGuest* guest, uint64_t retired);
+    void Balance();
+    void RequestHandOff(int source, int target);
+    int PageNode(const void* address) const;
+    void Report(double seconds) const;
+};
+#endif
\ No newline at end of file
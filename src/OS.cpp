@@ -88,6 +88,19 @@ uint16_t OS::CheckKey()
 }
 
 
+/**
+ * @brief Returns the handle of the standard input device.
+ *
+ * The handle is only valid after DisableInputBuffering has been called.
+ *
+ * @return Handle to the standard input device.
+ */
+HANDLE OS::GetInputHandle() const
+{
+    return hStdin;
+}
+
+
 /**
  * @brief Handles an interrupt signal.
  *
@@ -29,6 +29,7 @@ public:
     void DisableInputBuffering();
     void RestoreInputBuffering();
     uint16_t CheckKey();
+    HANDLE GetInputHandle() const;
     void HandleInterrupt(int signal);
     static void HandleInterruptWrapper(int signal);
 };
@@ -0,0 +1,399 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstring>
+#include <cstdlib>
+
+
+#include "Options.h"
+#include "OutputWriter.h"
+#include "GdbStub.h"
+#include "CPU.h"
+#include "TaskScheduler.h"
+
+
+// Names accepted by --engine=, indexed by the Engines enumeration.
+static const char* const engineNames[Engines::ENGINE_COUNT + 1] =
+{
+    "switch",
+    "table",
+    "predecoded",
+    "threaded",
+    "auto"
+};
+
+
+// Names accepted by --instrument=, indexed by the Instrumentations enumeration.
+static const char* const instrumentNames[Instrumentations::INSTRUMENT_COUNT] =
+{
+    "none",
+    "trace",
+    "coverage",
+    "mix",
+    "all"
+};
+
+
+// Names accepted by --host-pin=, indexed by the HostPinnings enumeration.
+static const char* const hostPinningNames[HostPinnings::HOST_PIN_COUNT] =
+{
+    "core",
+    "node"
+};
+
+
+/**
+ * @brief Constructs an Options object holding the default settings.
+ */
+Options::Options()
+{
+}
+
+
+/**
+ * @brief Parses a single "--name=value" command-line option.
+ *
+ * @param argument The command-line argument, including the leading dashes.
+ * @return Returns 1 if the option was recognized and applied, 0 otherwise.
+ */
+int Options::Parse(const char* argument)
+{
+    if (strncmp(argument, "--engine=", 9) == 0)
+    {
+        // Look the engine up by name, "auto" included
+        for (uint16_t i = 0; i <= Engines::ENGINE_COUNT; ++i)
+        {
+            if (strcmp(argument + 9, engineNames[i]) == 0)
+            {
+                engine = i;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    if (strncmp(argument, "--engine-cache=", 15) == 0)
+    {
+        engineCachePath = argument + 15;
+        return 1;
+    }
+
+    if (strncmp(argument, "--clock=", 8) == 0)
+    {
+        char* end;
+        clockRate = strtoull(argument + 8, &end, 10);
+        return *end == '\0' && clockRate > 0;
+    }
+
+    if (strcmp(argument, "--realtime") == 0)
+    {
+        realTime = 1;
+        return 1;
+    }
+
+    if (strncmp(argument, "--realtime-cpu=", 15) == 0)
+    {
+        char* end;
+        realTime = 1;
+        realTimeCpu = (int)strtol(argument + 15, &end, 10);
+        return *end == '\0' && realTimeCpu >= 0;
+    }
+
+    if (strcmp(argument, "--realtime-class") == 0)
+    {
+        realTime = 1;
+        realTimeClass = 1;
+        return 1;
+    }
+
+    if (strcmp(argument, "--screen") == 0)
+    {
+        screen = 1;
+        return 1;
+    }
+
+    if (strncmp(argument, "--screen=", 9) == 0)
+    {
+        char* end;
+        screen = 1;
+        screenColumns = (int)strtol(argument + 9, &end, 10);
+        if (*end != 'x')
+        {
+            return 0;
+        }
+        screenRows = (int)strtol(end + 1, &end, 10);
+        return *end == '\0' && screenColumns > 0 && screenRows > 0;
+    }
+
+    if (strcmp(argument, "--output-thread") == 0)
+    {
+        outputRing = OUTPUT_RING_SIZE;
+        return 1;
+    }
+
+    if (strncmp(argument, "--output-thread=", 16) == 0)
+    {
+        char* end;
+        outputRing = (size_t)strtoull(argument + 16, &end, 10) * 1024;
+        return *end == '\0' && outputRing > 0;
+    }
+
+    if (strcmp(argument, "--shadow") == 0)
+    {
+        shadow = 1;
+        return 1;
+    }
+
+    if (strncmp(argument, "--break=", 8) == 0)
+    {
+        breakpoints.push_back(argument + 8);
+        return 1;
+    }
+
+    if (strncmp(argument, "--watch=", 8) == 0)
+    {
+        watchpoints.push_back(argument + 8);
+        return 1;
+    }
+
+    if (strcmp(argument, "--gdb") == 0)
+    {
+        gdbPort = GDB_DEFAULT_PORT;
+        return 1;
+    }
+
+    if (strncmp(argument, "--gdb=", 6) == 0)
+    {
+        char* end;
+        unsigned long port = strtoul(argument + 6, &end, 10);
+        gdbPort = (uint16_t)port;
+        return *end == '\0' && port > 0 && port <= 0xFFFF;
+    }
+
+    if (strcmp(argument, "--stats") == 0)
+    {
+        stats = 1;
+        return 1;
+    }
+
+    if (strcmp(argument, "--top") == 0)
+    {
+        top = 0;
+        return 1;
+    }
+
+    if (strncmp(argument, "--top=", 6) == 0)
+    {
+        char* end;
+        top = (int)strtol(argument + 6, &end, 10);
+        return *end == '\0' && top > 0;
+    }
+
+    if (strcmp(argument, "--metrics") == 0)
+    {
+        metricsSocket = "";
+        return 1;
+    }
+
+    if (strncmp(argument, "--metrics=", 10) == 0)
+    {
+        metricsSocket = argument + 10;
+        return *metricsSocket != '\0';
+    }
+
+    if (strncmp(argument, "--metrics-http=", 15) == 0)
+    {
+        char* end;
+        unsigned long port = strtoul(argument + 15, &end, 10);
+        metricsPort = (uint16_t)port;
+        return *end == '\0' && port > 0 && port <= 0xFFFF;
+    }
+
+    if (strcmp(argument, "--trap-profile") == 0)
+    {
+        trapProfile = 1;
+        return 1;
+    }
+
+    if (strncmp(argument, "--instrument=", 13) == 0)
+    {
+        for (uint16_t i = 0; i < Instrumentations::INSTRUMENT_COUNT; ++i)
+        {
+            if (strcmp(argument + 13, instrumentNames[i]) == 0)
+            {
+                instrument = i;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    if (strcmp(argument, "--bench-policies") == 0)
+    {
+        benchPolicies = 1;
+        return 1;
+    }
+
+    if (strcmp(argument, "--isa-check") == 0)
+    {
+        isaCheck = 1;
+        return 1;
+    }
+
+    if (strncmp(argument, "--trace-file=", 13) == 0)
+    {
+        traceFile = argument + 13;
+        instrument = Instrumentations::INSTRUMENT_TRACE;
+        return *traceFile != '\0';
+    }
+
+    if (strcmp(argument, "--disasm") == 0)
+    {
+        disassemble = 1;
+        return 1;
+    }
+
+    if (strncmp(argument, "--disasm-trace=", 15) == 0)
+    {
+        disassembleTrace = argument + 15;
+        return *disassembleTrace != '\0';
+    }
+
+    if (strncmp(argument, "--symbols=", 10) == 0)
+    {
+        symbolsPath = argument + 10;
+        return *symbolsPath != '\0';
+    }
+
+    if (strncmp(argument, "--memory=", 9) == 0)
+    {
+        char* end;
+        unsigned long words = strtoul(argument + 9, &end, 10);
+        if (*end == 'K' || *end == 'k')
+        {
+            words *= 1024;
+            ++end;
+        }
+        memoryWords = (uint32_t)words;
+        return *end == '\0' && words >= MEMORY_MIN && words <= MEMORY_MAX && (words & (words - 1)) == 0;
+    }
+
+    if (strcmp(argument, "--memory-fault") == 0)
+    {
+        memoryMode = MemoryModes::MEMORY_FAULT;
+        return 1;
+    }
+
+    if (strcmp(argument, "--bench-density") == 0)
+    {
+        benchDensity = 1;
+        return 1;
+    }
+
+    if (strncmp(argument, "--host=", 7) == 0)
+    {
+        char* end;
+        hostGuests = (int)strtol(argument + 7, &end, 10);
+        return *end == '\0' && hostGuests > 0;
+    }
+
+    if (strncmp(argument, "--host-pin=", 11) == 0)
+    {
+        for (uint16_t i = 0; i < HostPinnings::HOST_PIN_COUNT; ++i)
+        {
+            if (strcmp(argument + 11, hostPinningNames[i]) == 0)
+            {
+                hostPinning = i;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    if (strncmp(argument, "--host-imbalance=", 17) == 0)
+    {
+        char* end;
+        hostImbalance = (int)strtol(argument + 17, &end, 10);
+        return *end == '\0' && hostImbalance > 0;
+    }
+
+    if (strcmp(argument, "--lazy-load") == 0)
+    {
+        lazyLoad = 1;
+        return 1;
+    }
+
+    if (strncmp(argument, "--bundle=", 9) == 0)
+    {
+        bundlePath = argument + 9;
+        return *bundlePath != '\0';
+    }
+
+    if (strncmp(argument, "--pack=", 7) == 0)
+    {
+        packPath = argument + 7;
+        return *packPath != '\0';
+    }
+
+    if (strncmp(argument, "--migrate-listen=", 17) == 0)
+    {
+        migrateListen = argument + 17;
+        return *migrateListen != '\0';
+    }
+
+    if (strncmp(argument, "--migrate-from=", 15) == 0)
+    {
+        migrateFrom = argument + 15;
+        return *migrateFrom != '\0';
+    }
+
+    if (strncmp(argument, "--memory-file=", 14) == 0)
+    {
+        memoryFile = argument + 14;
+        return *memoryFile != '\0';
+    }
+
+    if (strncmp(argument, "--checkpoint=", 13) == 0)
+    {
+        checkpointPath = argument + 13;
+        return *checkpointPath != '\0';
+    }
+
+    if (strcmp(argument, "--tasks") == 0)
+    {
+        taskQuantum = TASK_QUANTUM;
+        return 1;
+    }
+
+    if (strncmp(argument, "--tasks=", 8) == 0)
+    {
+        char* end;
+        taskQuantum = strtoull(argument + 8, &end, 10);
+        return *end == '\0' && taskQuantum > 0;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Returns the command-line name of an engine.
+ *
+ * @param engine The engine, as a value of the Engines enumeration.
+ * @return The engine name used by --engine=.
+ */
+const char* Options::EngineName(uint16_t engine)
+{
+    if (engine > Engines::ENGINE_COUNT)
+    {
+        return "unknown";
+    }
+    return engineNames[engine];
+}
\ No newline at end of file
@@ -0,0 +1,175 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+enum Engines : uint16_t
+{
+    ENGINE_SWITCH = 0, // switch on the opcode of every fetched instruction
+    ENGINE_TABLE,      // handler table indexed by the opcode
+    ENGINE_PREDECODED, // switch on instructions decoded once per address
+    ENGINE_THREADED,   // handler and operands cached per address
+    ENGINE_COUNT,      // number of selectable engines
+    ENGINE_AUTO = ENGINE_COUNT // calibrate every engine and pick the fastest
+};
+
+
+enum Instrumentations : uint16_t
+{
+    INSTRUMENT_NONE = 0, // run the selected engine
+    INSTRUMENT_TRACE,    // print every retired instruction
+    INSTRUMENT_COVERAGE, // report the addresses executed
+    INSTRUMENT_MIX,      // report the instruction mix, memory accesses and traps
+    INSTRUMENT_ALL,      // coverage and instruction mix together
+    INSTRUMENT_COUNT     // number of selectable instrumentations
+};
+
+
+enum HostPinnings : uint16_t
+{
+    HOST_PIN_CORE = 0, // each worker thread runs on one processor
+    HOST_PIN_NODE,     // each worker thread runs on any processor of its NUMA node
+    HOST_PIN_COUNT     // number of selectable pinnings
+};
+
+
+class Options
+{
+public:
+    // Engine used to execute the guest, selected with --engine=.
+    uint16_t engine = Engines::ENGINE_SWITCH;
+
+    // File remembering the engine picked by --engine=auto for each image, selected with --engine-cache=.
+    const char* engineCachePath = "engine.cache";
+
+    // Guest clock rate in instructions per second, selected with --clock=. Zero runs unpaced.
+    uint64_t clockRate = 0;
+
+    // Low-jitter mode selected with --realtime: pinned thread, locked and prefaulted memory, raised priority.
+    int realTime = 0;
+
+    // CPU to pin to, selected with --realtime-cpu=. -1 keeps the CPU the VM starts on.
+    int realTimeCpu = -1;
+
+    // Request the real-time priority class instead of the high one, selected with --realtime-class.
+    int realTimeClass = 0;
+
+    // Render guest output through an in-memory screen model, selected with --screen or --screen=COLSxROWS.
+    int screen = 0;
+    int screenColumns = 0;
+    int screenRows = 0;
+
+    // Size in bytes of the output ring of the writer thread selected with --output-thread[=KB]; 0 writes synchronously.
+    size_t outputRing = 0;
+
+    // Check guest accesses against shadow memory, selected with --shadow.
+    int shadow = 0;
+
+    // Breakpoint and watchpoint specifications from --break= and --watch=, parsed by the Debugger.
+    std::vector<const char*> breakpoints;
+    std::vector<const char*> watchpoints;
+
+    // Port of the GDB remote stub selected with --gdb or --gdb=PORT; 0 runs without it.
+    uint16_t gdbPort = 0;
+
+    // Publish live counters to a shared stats file, selected with --stats.
+    int stats = 0;
+
+    // Show the stats of all running VMs instead of running one, selected with --top or --top=REFRESHES; -1 runs a VM.
+    int top = -1;
+
+    // Unix socket path of the metrics exporter selected with --metrics or --metrics=PATH; empty picks
+    // a path in the temporary directory, nullptr runs without it.
+    const char* metricsSocket = nullptr;
+
+    // Loopback port serving the metrics over HTTP, selected with --metrics-http=PORT; 0 runs without it.
+    uint16_t metricsPort = 0;
+
+    // Time every trap vector and keyboard poll and report host I/O against guest computation, selected with --trap-profile.
+    int trapProfile = 0;
+
+    // Instrumented execution loop selected with --instrument=, replacing the engine.
+    uint16_t instrument = Instrumentations::INSTRUMENT_NONE;
+
+    // Compare the policy-based loop against the hand-written one instead of running, selected with --bench-policies.
+    int benchPolicies = 0;
+
+    // Check the interpreter and disassembler against every encoding of LC3_ISA instead of running, selected with --isa-check.
+    int isaCheck = 0;
+
+    // File receiving a binary trace of retired instructions, selected with --trace-file=FILE; implies --instrument=trace.
+    const char* traceFile = nullptr;
+
+    // List the image files as assembly instead of running them, selected with --disasm.
+    int disassemble = 0;
+
+    // Binary trace listed as assembly instead of running, selected with --disasm-trace=FILE.
+    const char* disassembleTrace = nullptr;
+
+    // Symbol file naming addresses in listings, selected with --symbols=FILE.
+    const char* symbolsPath = nullptr;
+
+    // Guest memory size in words, a power of two selected with --memory=WORDS or --memory=NK; 0 keeps MEMORY_MAX.
+    uint32_t memoryWords = 0;
+
+    // What addresses past the end of a smaller memory refer to, as a value of MemoryModes; --memory-fault selects MEMORY_FAULT.
+    uint16_t memoryMode = 0;
+
+    // Compare many small guests against fewer large ones instead of running, selected with --bench-density.
+    int benchDensity = 0;
+
+    // Number of guests run together by the NUMA-aware host instead of one VM, selected with --host=N; 0 runs one VM.
+    int hostGuests = 0;
+
+    // How host worker threads are pinned, as a value of HostPinnings, selected with --host-pin=core|node.
+    uint16_t hostPinning = HostPinnings::HOST_PIN_CORE;
+
+    // Load imbalance between NUMA nodes, in percent of the mean, above which the host migrates a guest, selected with --host-imbalance=P.
+    int hostImbalance = 25;
+
+    // Map the image files and copy each page on its first access instead of reading them whole, selected with --lazy-load.
+    int lazyLoad = 0;
+
+    // Bundle the image arguments are looked up in by name, or by '#' and their hash, selected with --bundle=FILE.
+    const char* bundlePath = nullptr;
+
+    // Bundle to pack the image files into instead of running them, selected with --pack=FILE.
+    const char* packPath = nullptr;
+
+    // Unix socket a target VM connects to in order to take over the running guest, selected with --migrate-listen=PATH.
+    const char* migrateListen = nullptr;
+
+    // Unix socket of a source VM to take the running guest over from instead of loading images, selected with --migrate-from=PATH.
+    const char* migrateFrom = nullptr;
+
+    // File the guest memory is mapped from, kept with the registers of the last sync across runs, selected with --memory-file=PATH.
+    const char* memoryFile = nullptr;
+
+    // Log the guest is checkpointed to incrementally and recovered from after a crash, selected with --checkpoint=PATH.
+    const char* checkpointPath = nullptr;
+
+    // Quantum in instructions when every image runs as a task of its own, selected with --tasks[=N]; 0 runs one program.
+    uint64_t taskQuantum = 0;
+
+public:
+    Options();
+
+    int Parse(const char* argument);
+
+    static const char* EngineName(uint16_t engine);
+};
+#endif
\ No newline at end of file
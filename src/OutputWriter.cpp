@@ -0,0 +1,217 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+
+
+#include "OutputWriter.h"
+
+
+/**
+ * @brief Constructs an OutputWriter with a ring of the given size.
+ *
+ * @param size Ring size in bytes, rounded up to a power of two.
+ */
+OutputWriter::OutputWriter(size_t size) : head(0), tail(0), writerIdle(0), running(0)
+{
+    size_t capacity = 1;
+    while (capacity < size)
+    {
+        capacity <<= 1;
+    }
+
+    ring = new char[capacity];
+    mask = capacity - 1;
+    stagedHead = 0;
+    cachedTail = 0;
+
+    wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    bytesWritten = 0;
+    batches = 0;
+    stalls = 0;
+}
+
+
+/**
+ * @brief Destroys the OutputWriter object, draining and stopping the writer thread.
+ */
+OutputWriter::~OutputWriter()
+{
+    Stop();
+    if (wakeEvent)
+    {
+        CloseHandle(wakeEvent);
+    }
+    delete[] ring;
+}
+
+
+/**
+ * @brief Starts the writer thread.
+ */
+void OutputWriter::Start()
+{
+    running = 1;
+    writer = std::thread(&OutputWriter::Drain, this);
+}
+
+
+/**
+ * @brief Publishes staged output, waits until all of it has been written and stops the writer thread.
+ */
+void OutputWriter::Stop()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+
+    Publish();
+    running = 0;
+    SetEvent(wakeEvent);
+    writer.join();
+}
+
+
+/**
+ * @brief Stages one output byte.
+ *
+ * The byte becomes visible to the writer thread at the next Publish. The guest thread
+ * only waits when the ring is full.
+ *
+ * @param character The byte to output.
+ */
+void OutputWriter::Put(char character)
+{
+    if (stagedHead - cachedTail > mask)
+    {
+        WaitForSpace();
+    }
+
+    ring[stagedHead & mask] = character;
+    ++stagedHead;
+}
+
+
+/**
+ * @brief Stages a block of output bytes.
+ *
+ * @param data The bytes to output.
+ * @param length The number of bytes.
+ */
+void OutputWriter::Write(const char* data, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        Put(data[i]);
+    }
+}
+
+
+/**
+ * @brief Makes the staged bytes visible to the writer thread, waking it if it is idle.
+ */
+void OutputWriter::Publish()
+{
+    if (stagedHead == head.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    head.store(stagedHead);
+
+    // Only pay for the wake-up system call when the writer is about to sleep
+    if (writerIdle.load())
+    {
+        SetEvent(wakeEvent);
+    }
+}
+
+
+/**
+ * @brief Blocks the guest thread until the writer has freed space in the full ring.
+ *
+ * This is the only point where a slow output sink slows down the guest.
+ */
+void OutputWriter::WaitForSpace()
+{
+    ++stalls;
+    Publish();
+
+    while (stagedHead - (cachedTail = tail.load(std::memory_order_acquire)) > mask)
+    {
+        SetEvent(wakeEvent);
+        SwitchToThread();
+    }
+}
+
+
+/**
+ * @brief Writer thread body.
+ *
+ * Writes everything published since the last batch with at most two writes (one per side of
+ * the ring's wrap point) and a single flush, then sleeps until more output is published.
+ */
+void OutputWriter::Drain()
+{
+    for (;;)
+    {
+        size_t end = head.load(std::memory_order_acquire);
+        size_t start = tail.load(std::memory_order_relaxed);
+
+        if (start == end)
+        {
+            if (!running)
+            {
+                break;
+            }
+
+            // Announce the sleep before re-checking, so a concurrent Publish either is seen here or wakes us
+            writerIdle.store(1);
+            if (head.load() == start)
+            {
+                WaitForSingleObject(wakeEvent, OUTPUT_IDLE_MS);
+            }
+            writerIdle.store(0);
+            continue;
+        }
+
+        size_t first = start & mask;
+        size_t length = end - start;
+        size_t contiguous = mask + 1 - first;
+
+        if (length <= contiguous)
+        {
+            fwrite(ring + first, 1, length, stdout);
+        }
+        else
+        {
+            fwrite(ring + first, 1, contiguous, stdout);
+            fwrite(ring, 1, length - contiguous, stdout);
+        }
+        fflush(stdout);
+
+        bytesWritten += length;
+        ++batches;
+
+        tail.store(end, std::memory_order_release);
+    }
+}
+
+
+/**
+ * @brief Prints the writer statistics to stderr.
+ */
+void OutputWriter::Report() const
+{
+    fprintf(stderr, "output: %llu bytes in %llu writes, guest stalled %llu times on a full ring\n",
+        (unsigned long long)bytesWritten, (unsigned long long)batches, (unsigned long long)stalls);
+}
\ No newline at end of file
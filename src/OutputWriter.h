@@ -0,0 +1,67 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+// Default size of the output ring in bytes, must be a power of two.
+#define OUTPUT_RING_SIZE (1 << 20)
+
+// The writer thread re-checks the ring at least this often even without a wake-up.
+#define OUTPUT_IDLE_MS 10
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <Windows.h>
+
+
+class OutputWriter
+{
+private:
+    // Single-producer single-consumer ring. The guest thread owns "head", the writer thread owns "tail".
+    char* ring;
+    size_t mask;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+
+    // Producer-side copies: bytes staged but not yet published, and the last tail seen.
+    size_t stagedHead;
+    size_t cachedTail;
+
+    std::atomic<int> writerIdle;
+    std::atomic<int> running;
+    HANDLE wakeEvent;
+    std::thread writer;
+
+    // Statistics, owned by the writer thread until it has been stopped.
+    uint64_t bytesWritten;
+    uint64_t batches;
+    uint64_t stalls;
+
+public:
+    OutputWriter(size_t size);
+    ~OutputWriter();
+
+    void Start();
+    void Stop();
+
+    void Put(char character);
+    void Write(const char* data, size_t length);
+    void Publish();
+    void Report() const;
+
+private:
+    void WaitForSpace();
+    void Drain();
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,190 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+
+
+#include "Pacer.h"
+
+
+// Not defined by older Windows SDKs; supported since Windows 10 1803.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+
+/**
+ * @brief Returns the current value of the performance counter.
+ */
+static LONGLONG Now()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+
+/**
+ * @brief Constructs a Pacer running the guest at the given clock rate.
+ *
+ * A high resolution waitable timer is used where available, falling back to a
+ * regular waitable timer on older systems.
+ *
+ * @param clockRate Target guest clock rate in instructions per second.
+ */
+Pacer::Pacer(uint64_t clockRate)
+{
+    this->clockRate = clockRate;
+
+    timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!timer)
+    {
+        timer = CreateWaitableTimer(NULL, TRUE, NULL);
+    }
+
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = counterFrequency.QuadPart;
+
+    anchor = 0;
+    scheduled = 0;
+    retiredTotal = 0;
+    startTicks = 0;
+    batches = 0;
+    resyncs = 0;
+}
+
+
+/**
+ * @brief Destroys the Pacer object and releases its timer.
+ */
+Pacer::~Pacer()
+{
+    if (timer)
+    {
+        CloseHandle(timer);
+    }
+}
+
+
+/**
+ * @brief Returns the number of instructions to execute per paced batch.
+ *
+ * @return Instructions per PACING_PERIOD_US microseconds at the target rate, at least one.
+ */
+uint64_t Pacer::BatchSize() const
+{
+    uint64_t batch = clockRate * PACING_PERIOD_US / 1000000;
+    return batch ? batch : 1;
+}
+
+
+/**
+ * @brief Anchors the schedule at the current time.
+ */
+void Pacer::Start()
+{
+    anchor = Now();
+    startTicks = anchor;
+    scheduled = 0;
+}
+
+
+/**
+ * @brief Accounts an executed batch and sleeps until its absolute deadline.
+ *
+ * Deadlines are computed from the anchor rather than from the previous wake-up,
+ * so wake-up lateness never accumulates into drift.
+ *
+ * @param retired The number of instructions executed by the batch.
+ */
+void Pacer::Pace(uint64_t retired)
+{
+    scheduled += retired;
+    retiredTotal += retired;
+    ++batches;
+
+    // Absolute deadline of the batch, split to avoid overflowing the multiplication
+    LONGLONG deadline = anchor
+        + (LONGLONG)(scheduled / clockRate) * frequency
+        + (LONGLONG)((scheduled % clockRate) * (uint64_t)frequency / clockRate);
+
+    LONGLONG now = Now();
+
+    if (deadline > now)
+    {
+        SleepUntil(deadline);
+    }
+    else if (now - deadline > frequency * PACING_RESYNC_US / 1000000)
+    {
+        // Too far behind to catch up smoothly, restart the schedule from here
+        anchor = now;
+        scheduled = 0;
+        ++resyncs;
+    }
+}
+
+
+/**
+ * @brief Sleeps on the waitable timer until the given deadline and records the wake-up lateness.
+ *
+ * @param deadline The deadline, in performance counter ticks.
+ */
+void Pacer::SleepUntil(LONGLONG deadline)
+{
+    LONGLONG remaining = deadline - Now();
+    if (remaining <= 0)
+    {
+        return;
+    }
+
+    // Waitable timers take relative due times as negative 100 ns intervals
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -(LONGLONG)((remaining * 10000000) / frequency);
+    if (dueTime.QuadPart == 0)
+    {
+        dueTime.QuadPart = -1;
+    }
+
+    SetWaitableTimer(timer, &dueTime, 0, NULL, NULL, FALSE);
+    WaitForSingleObject(timer, INFINITE);
+
+    LONGLONG lateness = Now() - deadline;
+    if (lateness < 0)
+    {
+        lateness = 0;
+    }
+
+    jitter.Record((uint64_t)lateness);
+}
+
+
+/**
+ * @brief Prints the achieved clock rate and the wake-up jitter to stderr.
+ */
+void Pacer::Report() const
+{
+    double elapsed = (double)(Now() - startTicks) / (double)frequency;
+    double achieved = elapsed > 0 ? (double)retiredTotal / elapsed : 0;
+    double toMicroseconds = 1e6 / (double)frequency;
+
+    fprintf(stderr, "pacing: target %llu Hz, achieved %.0f Hz over %llu batches, %llu resyncs\n",
+        (unsigned long long)clockRate, achieved, (unsigned long long)batches, (unsigned long long)resyncs);
+
+    if (jitter.Count() == 0)
+    {
+        return;
+    }
+
+    fprintf(stderr, "pacing: jitter over %llu sleeps: mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        (unsigned long long)jitter.Count(), jitter.Mean() * toMicroseconds,
+        (double)jitter.Percentile(50.0) * toMicroseconds, (double)jitter.Percentile(99.0) * toMicroseconds,
+        (double)jitter.Max() * toMicroseconds);
+}
\ No newline at end of file
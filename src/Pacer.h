@@ -0,0 +1,64 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef PACER_H
+#define PACER_H
+
+// Length of one paced batch in microseconds. The guest runs a batch at full speed,
+// then sleeps until the batch's absolute deadline.
+#define PACING_PERIOD_US 1000
+
+// Falling further behind the schedule than this (e.g. while blocked on keyboard input)
+// restarts the schedule instead of running unpaced until the backlog is caught up.
+#define PACING_RESYNC_US 100000
+
+
+#include <cstdint>
+#include <Windows.h>
+
+#include "Histogram.h"
+
+
+class Pacer
+{
+private:
+    // High resolution waitable timer used to sleep until each deadline.
+    HANDLE timer;
+
+    // Performance counter frequency and the counter value the schedule is anchored at.
+    LONGLONG frequency;
+    LONGLONG anchor;
+
+    // Target guest clock rate in instructions per second.
+    uint64_t clockRate;
+
+    // Instructions accounted into the schedule since the anchor, and in total.
+    uint64_t scheduled;
+    uint64_t retiredTotal;
+    LONGLONG startTicks;
+
+    // Wake-up statistics, lateness in performance counter ticks.
+    uint64_t batches;
+    uint64_t resyncs;
+    Histogram jitter;
+
+public:
+    Pacer(uint64_t clockRate);
+    ~Pacer();
+
+    uint64_t BatchSize() const;
+    void Start();
+    void Pace(uint64_t retired);
+    void Report() const;
+
+private:
+    void SleepUntil(LONGLONG deadline);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+
+
+#include "PersistentMemory.h"
+#include "MemoryIO.h"
+
+
+/**
+ * @brief Constructs a PersistentMemory for a CPU; it keeps a memory of its own until Open.
+ *
+ * @param cpu Pointer to the CPU whose memory is backed by the file.
+ * @param memoryIO Pointer to the MemoryIO object, whose counters are saved with the registers.
+ */
+PersistentMemory::PersistentMemory(CPU* cpu, MemoryIO* memoryIO)
+{
+    cpuPtr = cpu;
+    memoryIOPtr = memoryIO;
+    file = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+    view = nullptr;
+    viewBytes = 0;
+    header = nullptr;
+    filePath = "";
+
+    existed = 0;
+    resuming = 0;
+    instructions = 0;
+    lastSync = 0;
+}
+
+
+/**
+ * @brief Gives the CPU a copy of its memory of its own again and unmaps the file.
+ *
+ * MemoryIO and DecodeCache keep their own copy of the memory layout, so they must be attached to
+ * the CPU again afterwards.
+ */
+PersistentMemory::~PersistentMemory()
+{
+    if (view)
+    {
+        uint16_t* words = (uint16_t*)(view + PERSIST_HEADER_BYTES);
+        if (cpuPtr->memory == words)
+        {
+            cpuPtr->ConfigureMemory(header->memoryWords, header->memoryMode);
+            memcpy(cpuPtr->memory, words, header->memoryWords * sizeof(uint16_t));
+        }
+        UnmapViewOfFile(view);
+    }
+    if (mapping)
+    {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+    }
+}
+
+
+/**
+ * @brief Maps a memory file, creating it if needed, and makes it the memory of the CPU.
+ *
+ * A new file starts zeroed and the images are loaded into it. A file whose guest halted keeps its
+ * memory, and the images are loaded over it. A file whose guest was still running resumes it from
+ * the registers of its last sync, without loading any image.
+ *
+ * @param path The path of the memory file.
+ * @param words The memory size in words, which an existing file must have.
+ * @param mode What addresses past the end of a smaller memory refer to, which an existing file must match.
+ * @return Returns 1 on success, 0 on failure, after printing the reason.
+ */
+int PersistentMemory::Open(const char* path, uint32_t words, uint16_t mode)
+{
+    filePath = path;
+    viewBytes = PERSIST_HEADER_BYTES + (size_t)words * sizeof(uint16_t);
+
+    // Other processes may map the file too, to look at the memory while the guest runs
+    file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "memory: could not open %s\n", path);
+        return 0;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        fprintf(stderr, "memory: could not open %s\n", path);
+        return 0;
+    }
+    existed = size.QuadPart != 0;
+
+    // Never map over a file that is not a memory file of the same layout
+    if (existed)
+    {
+        PersistHeader old;
+        DWORD read = 0;
+        if (!ReadFile(file, &old, sizeof(old), &read, NULL) || read != sizeof(old) ||
+            old.magic != PERSIST_MAGIC || old.version != PERSIST_VERSION || (uint64_t)size.QuadPart < viewBytes)
+        {
+            fprintf(stderr, "memory: %s is not a memory file\n", path);
+            return 0;
+        }
+        if (old.memoryWords != words || old.memoryMode != mode)
+        {
+            fprintf(stderr, "memory: %s holds %u words of %s memory; start with the same --memory options\n",
+                path, old.memoryWords, old.memoryMode == MemoryModes::MEMORY_FAULT ? "faulting" : "wrapping");
+            return 0;
+        }
+    }
+
+    // Mapping a new file extends it with zeros
+    mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)viewBytes >> 32), (DWORD)viewBytes, NULL);
+    view = mapping ? (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, viewBytes) : nullptr;
+    if (!view)
+    {
+        fprintf(stderr, "memory: could not map %s\n", path);
+        return 0;
+    }
+    header = (PersistHeader*)view;
+
+    if (!existed)
+    {
+        memset(header, 0, sizeof(PersistHeader));
+        header->magic = PERSIST_MAGIC;
+        header->version = PERSIST_VERSION;
+        header->memoryWords = words;
+        header->memoryMode = mode;
+        header->state = PersistStates::PERSIST_STOPPED;
+    }
+
+    instructions = header->instructions;
+    resuming = header->state == PersistStates::PERSIST_RUNNING;
+
+    if (resuming)
+    {
+        memcpy(cpuPtr->registers, header->registers, sizeof(cpuPtr->registers));
+        memoryIOPtr->SeedCounters(header->counterInstructions, header->counterMicroseconds);
+        fprintf(stderr, "memory: resuming the guest of %s at x%04X after %llu instructions\n",
+            path, cpuPtr->registers[Registers::R_PC], (unsigned long long)instructions);
+    }
+    else if (existed)
+    {
+        fprintf(stderr, "memory: loading the images over the memory kept in %s\n", path);
+    }
+
+    cpuPtr->MapMemory((uint16_t*)(view + PERSIST_HEADER_BYTES), words, mode);
+    lastSync = GetTickCount64();
+
+    return 1;
+}
+
+
+/**
+ * @brief Tells whether the memory file existed before, so its memory counts as initialized.
+ *
+ * @return Returns 1 if the file was opened rather than created, 0 otherwise.
+ */
+int PersistentMemory::Existed() const
+{
+    return existed;
+}
+
+
+/**
+ * @brief Tells whether the guest resumes from the file, so that no image is loaded.
+ *
+ * @return Returns 1 if the guest of the file was still running, 0 otherwise.
+ */
+int PersistentMemory::IsResuming() const
+{
+    return resuming;
+}
+
+
+/**
+ * @brief Counts a slice of execution and syncs once PERSIST_SYNC_MS have passed since the last sync.
+ *
+ * Called between slices, where the registers match the memory.
+ *
+ * @param retired The number of instructions executed by the slice.
+ */
+void PersistentMemory::Tick(uint64_t retired)
+{
+    instructions += retired;
+
+    if (GetTickCount64() - lastSync >= PERSIST_SYNC_MS)
+    {
+        Sync();
+    }
+}
+
+
+/**
+ * @brief Saves the registers and counters in the header and starts writing the changed pages back to the file.
+ *
+ * The mapping is shared, so other processes see every write at once; the sync only matters for a
+ * later run, which resumes from the registers saved here unless Close is called after it.
+ */
+void PersistentMemory::Sync()
+{
+    header->state = PersistStates::PERSIST_RUNNING;
+    memcpy(header->registers, cpuPtr->registers, sizeof(header->registers));
+    header->instructions = instructions;
+    header->counterInstructions = memoryIOPtr->GetInstructions();
+    header->counterMicroseconds = memoryIOPtr->GetMicroseconds();
+    ++header->syncs;
+
+    FlushViewOfFile(view, viewBytes);
+    lastSync = GetTickCount64();
+}
+
+
+/**
+ * @brief Marks the guest stopped, syncs and waits until the file is written.
+ */
+void PersistentMemory::Close()
+{
+    Sync();
+    header->state = PersistStates::PERSIST_STOPPED;
+    FlushViewOfFile(header, sizeof(PersistHeader));
+    FlushFileBuffers(file);
+
+    fprintf(stderr, "memory: %llu instructions run on %s, %llu syncs\n",
+        (unsigned long long)instructions, filePath, (unsigned long long)header->syncs);
+}
\ No newline at end of file
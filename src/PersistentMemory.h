@@ -0,0 +1,91 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef PERSISTENT_MEMORY_H
+#define PERSISTENT_MEMORY_H
+
+// Identifies a memory file ("L3MEMORY"); bump the version whenever the header changes.
+#define PERSIST_MAGIC 0x59524F4D454D334CULL
+#define PERSIST_VERSION 2
+
+// Bytes before the words in a memory file: one page holding the header, so the words are page-aligned.
+#define PERSIST_HEADER_BYTES 4096
+
+// Interval at which the registers are saved and the mapped memory is written back, in milliseconds.
+#define PERSIST_SYNC_MS 1000
+
+// Instructions run between two looks at the clock while memory is backed by a file.
+#define PERSIST_SLICE (1 << 20)
+
+
+#include <cstdint>
+#include <Windows.h>
+
+#include "CPU.h"
+
+
+class MemoryIO;
+
+
+// How the guest of a memory file last stopped.
+enum PersistStates : uint16_t
+{
+    PERSIST_STOPPED = 0, // it halted, or the file is new: the images are loaded over the memory
+    PERSIST_RUNNING      // it was still running: it resumes from the registers of the last sync
+};
+
+
+// First page of a memory file.
+struct PersistHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t memoryWords;
+    uint16_t memoryMode;
+    uint16_t state;                       // a value of PersistStates
+    uint16_t registers[REGISTER_COUNT];   // as of the last sync
+    uint64_t instructions;                // run by all guests of the file, as of the last sync
+    uint64_t syncs;
+    uint64_t counterInstructions;         // MR_ICOUNT0 and MR_USEC0 of the guest, as of the last sync
+    uint64_t counterMicroseconds;
+};
+
+
+// Backs the memory of a CPU with a shared file mapping, so that the guest's memory outlives the
+// VM and other processes can map it while the guest runs.
+class PersistentMemory
+{
+private:
+    CPU* cpuPtr;
+    MemoryIO* memoryIOPtr;
+    HANDLE file;
+    HANDLE mapping;
+    uint8_t* view;
+    size_t viewBytes;
+    PersistHeader* header;
+    const char* filePath;
+
+    int existed;
+    int resuming;
+    uint64_t instructions;
+    ULONGLONG lastSync;
+
+public:
+    PersistentMemory(CPU* cpu, MemoryIO* memoryIO);
+    ~PersistentMemory();
+
+    int Open(const char* path, uint32_t words, uint16_t mode);
+    int Existed() const;
+    int IsResuming() const;
+    void Tick(uint64_t retired);
+    void Sync();
+    void Close();
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,126 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdint>
+#include <cstdio>
+#include <Windows.h>
+
+
+#include "RealTime.h"
+
+
+/**
+ * @brief Constructs a RealTime object.
+ *
+ * This constructor does not perform any specific initialization.
+ */
+RealTime::RealTime()
+{
+}
+
+
+/**
+ * @brief Pins the calling thread to a single CPU.
+ *
+ * @param cpu The CPU to run on, or -1 for the CPU the thread is currently running on.
+ * @return Returns 1 on success, 0 otherwise.
+ */
+int RealTime::PinCurrentThread(int cpu)
+{
+    if (cpu < 0)
+    {
+        cpu = (int)GetCurrentProcessorNumber();
+    }
+
+    if (cpu >= (int)(sizeof(DWORD_PTR) * 8) || !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu))
+    {
+        fprintf(stderr, "realtime: cannot pin to cpu %d\n", cpu);
+        return 0;
+    }
+
+    fprintf(stderr, "realtime: pinned to cpu %d\n", cpu);
+    return 1;
+}
+
+
+/**
+ * @brief Raises the scheduling priority of the process and the calling thread.
+ *
+ * The real-time priority class is the counterpart of SCHED_FIFO. Windows silently
+ * grants the high priority class instead when the caller lacks the privilege for it.
+ *
+ * @param realTimeClass Nonzero to request the real-time priority class, zero for the high priority class.
+ * @return Returns 1 on success, 0 otherwise.
+ */
+int RealTime::RaisePriority(int realTimeClass)
+{
+    DWORD priorityClass = realTimeClass ? REALTIME_PRIORITY_CLASS : HIGH_PRIORITY_CLASS;
+
+    if (!SetPriorityClass(GetCurrentProcess(), priorityClass)
+        || !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+    {
+        fprintf(stderr, "realtime: cannot raise priority\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Locks a memory region into physical memory.
+ *
+ * The working set is grown by the size of the region first, since VirtualLock
+ * fails once the locked pages would exceed the minimum working set.
+ *
+ * @param address Start of the region.
+ * @param size Size of the region in bytes.
+ * @return Returns 1 on success, 0 otherwise.
+ */
+int RealTime::Lock(void* address, size_t size)
+{
+    SIZE_T minimum, maximum;
+    if (GetProcessWorkingSetSize(GetCurrentProcess(), &minimum, &maximum))
+    {
+        SetProcessWorkingSetSize(GetCurrentProcess(), minimum + size, maximum + size);
+    }
+
+    if (!VirtualLock(address, size))
+    {
+        fprintf(stderr, "realtime: cannot lock %zu bytes (error %lu)\n", size, (unsigned long)GetLastError());
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Touches every page of a memory region so it is resident before the guest runs.
+ *
+ * Each page is read and written back unchanged, which also breaks copy-on-write sharing.
+ *
+ * @param address Start of the region.
+ * @param size Size of the region in bytes.
+ */
+void RealTime::Prefault(void* address, size_t size)
+{
+    volatile uint8_t* bytes = (volatile uint8_t*)address;
+
+    for (size_t offset = 0; offset < size; offset += PREFAULT_PAGE_SIZE)
+    {
+        bytes[offset] = bytes[offset];
+    }
+
+    if (size)
+    {
+        bytes[size - 1] = bytes[size - 1];
+    }
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef REAL_TIME_H
+#define REAL_TIME_H
+
+// Granularity used to touch memory when prefaulting.
+#define PREFAULT_PAGE_SIZE 4096
+
+
+#include <cstddef>
+
+
+class RealTime
+{
+public:
+    RealTime();
+
+    int PinCurrentThread(int cpu);
+    int RaisePriority(int realTimeClass);
+    int Lock(void* address, size_t size);
+    void Prefault(void* address, size_t size);
+};
+#endif
\ No newline at end of file
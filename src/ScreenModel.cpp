@@ -0,0 +1,599 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+#include "ScreenModel.h"
+
+
+/**
+ * @brief Returns whether two cells look the same on the terminal.
+ */
+static bool SameCell(const ScreenCell& a, const ScreenCell& b)
+{
+    return a.character == b.character && a.foreground == b.foreground
+        && a.background == b.background && a.bold == b.bold;
+}
+
+
+/**
+ * @brief Returns whether two cells use the same attributes.
+ */
+static bool SameAttributes(const ScreenCell& a, const ScreenCell& b)
+{
+    return a.foreground == b.foreground && a.background == b.background && a.bold == b.bold;
+}
+
+
+/**
+ * @brief Constructs a blank ScreenModel of the given size.
+ *
+ * The terminal contents are unknown at first, so the first render clears the terminal.
+ *
+ * @param columns Width of the screen in characters.
+ * @param rows Height of the screen in characters.
+ */
+ScreenModel::ScreenModel(int columns, int rows)
+{
+    this->columns = columns;
+    this->rows = rows;
+
+    pen.character = ' ';
+    pen.foreground = SCREEN_DEFAULT_COLOR;
+    pen.background = SCREEN_DEFAULT_COLOR;
+    pen.bold = 0;
+    emitted = pen;
+
+    cells = new ScreenCell[columns * rows];
+    shown = new ScreenCell[columns * rows];
+    for (int i = 0; i < columns * rows; ++i)
+    {
+        cells[i] = pen;
+        shown[i] = pen;
+    }
+
+    cursorRow = cursorColumn = 0;
+    savedRow = savedColumn = 0;
+    shownRow = shownColumn = -1;
+    pendingScroll = 0;
+    dirty = 1;
+    escapeState = EscapeStates::ESCAPE_NONE;
+    escapeLength = 0;
+}
+
+
+/**
+ * @brief Destroys the ScreenModel object.
+ */
+ScreenModel::~ScreenModel()
+{
+    delete[] cells;
+    delete[] shown;
+}
+
+
+/**
+ * @brief Interprets one byte of guest output.
+ *
+ * Printable characters, CR, LF, BS, TAB and the common ANSI cursor, erase and color
+ * sequences update the model; other sequences are forwarded to the terminal unchanged.
+ *
+ * @param character The output byte.
+ */
+void ScreenModel::Write(char character)
+{
+    switch (escapeState)
+    {
+    case EscapeStates::ESCAPE_START:
+        if (character == '[')
+        {
+            escapeState = EscapeStates::ESCAPE_CSI;
+            escapeLength = 0;
+            return;
+        }
+
+        escapeState = EscapeStates::ESCAPE_NONE;
+        if (character == '7')
+        {
+            savedRow = cursorRow;
+            savedColumn = cursorColumn;
+        }
+        else if (character == '8')
+        {
+            cursorRow = savedRow;
+            cursorColumn = savedColumn;
+            dirty = 1;
+        }
+        else
+        {
+            passthrough += '\x1B';
+            passthrough += character;
+        }
+        return;
+
+    case EscapeStates::ESCAPE_CSI:
+        // Parameter and intermediate bytes are collected until the final byte (0x40-0x7E)
+        if (character >= 0x40 && character <= 0x7E)
+        {
+            escapeState = EscapeStates::ESCAPE_NONE;
+            ControlSequence(character);
+        }
+        else if (escapeLength < SCREEN_ESCAPE_MAX - 1)
+        {
+            escape[escapeLength++] = character;
+        }
+        return;
+
+    default:
+        break;
+    }
+
+    switch (character)
+    {
+    case '\x1B':
+        escapeState = EscapeStates::ESCAPE_START;
+        break;
+    case '\n':
+        // Output is translated like a terminal in cooked mode: LF also returns the carriage
+        cursorColumn = 0;
+        LineFeed();
+        break;
+    case '\r':
+        cursorColumn = 0;
+        break;
+    case '\b':
+        if (cursorColumn > 0)
+        {
+            --cursorColumn;
+        }
+        break;
+    case '\t':
+        cursorColumn = (cursorColumn / 8 + 1) * 8;
+        if (cursorColumn >= columns)
+        {
+            cursorColumn = columns - 1;
+        }
+        break;
+    case '\a':
+        passthrough += character;
+        break;
+    default:
+        if ((unsigned char)character >= 0x20)
+        {
+            Print(character);
+        }
+        break;
+    }
+
+    dirty = 1;
+}
+
+
+/**
+ * @brief Returns whether the model changed since the last render.
+ */
+int ScreenModel::IsDirty() const
+{
+    return dirty;
+}
+
+
+/**
+ * @brief Places a printable character at the cursor and advances it, wrapping at the right margin.
+ */
+void ScreenModel::Print(char character)
+{
+    if (cursorColumn >= columns)
+    {
+        cursorColumn = 0;
+        LineFeed();
+    }
+
+    ScreenCell& cell = cells[cursorRow * columns + cursorColumn];
+    cell = pen;
+    cell.character = character;
+
+    ++cursorColumn;
+}
+
+
+/**
+ * @brief Moves the cursor down one line, scrolling the screen at the bottom row.
+ */
+void ScreenModel::LineFeed()
+{
+    if (cursorRow < rows - 1)
+    {
+        ++cursorRow;
+        return;
+    }
+
+    memmove(cells, cells + columns, sizeof(ScreenCell) * columns * (rows - 1));
+
+    ScreenCell blank = pen;
+    blank.character = ' ';
+    for (int column = 0; column < columns; ++column)
+    {
+        cells[(rows - 1) * columns + column] = blank;
+    }
+
+    ++pendingScroll;
+}
+
+
+/**
+ * @brief Blanks the cells in [from, to) with the current background.
+ */
+void ScreenModel::Erase(int from, int to)
+{
+    ScreenCell blank = pen;
+    blank.character = ' ';
+    blank.bold = 0;
+
+    for (int i = from; i < to; ++i)
+    {
+        cells[i] = blank;
+    }
+}
+
+
+/**
+ * @brief Executes a complete CSI sequence whose parameters are in "escape".
+ *
+ * @param final The final byte of the sequence.
+ */
+void ScreenModel::ControlSequence(char final)
+{
+    escape[escapeLength] = '\0';
+
+    // Private sequences such as ESC [ ? 25 l do not change the screen contents
+    if (escapeLength > 0 && (escape[0] < '0' || escape[0] > ';'))
+    {
+        passthrough += "\x1B[";
+        passthrough += escape;
+        passthrough += final;
+        return;
+    }
+
+    int parameters[SCREEN_PARAMETER_MAX] = { 0 };
+    int count = 0;
+    const char* p = escape;
+    while (*p && count < SCREEN_PARAMETER_MAX)
+    {
+        parameters[count++] = (int)strtol(p, (char**)&p, 10);
+        if (*p == ';')
+        {
+            ++p;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    // Cursor movements default to one step, positions to the first row and column
+    int amount = (count > 0 && parameters[0] > 0) ? parameters[0] : 1;
+    int cursor = cursorRow * columns + (cursorColumn < columns ? cursorColumn : columns - 1);
+
+    switch (final)
+    {
+    case 'A':
+        cursorRow = cursorRow > amount ? cursorRow - amount : 0;
+        break;
+    case 'B':
+        cursorRow = cursorRow + amount < rows ? cursorRow + amount : rows - 1;
+        break;
+    case 'C':
+        cursorColumn = cursorColumn + amount < columns ? cursorColumn + amount : columns - 1;
+        break;
+    case 'D':
+        cursorColumn = cursorColumn > amount ? cursorColumn - amount : 0;
+        break;
+    case 'G':
+        cursorColumn = amount <= columns ? amount - 1 : columns - 1;
+        break;
+    case 'd':
+        cursorRow = amount <= rows ? amount - 1 : rows - 1;
+        break;
+    case 'H':
+    case 'f':
+    {
+        int row = (count > 0 && parameters[0] > 0) ? parameters[0] : 1;
+        int column = (count > 1 && parameters[1] > 0) ? parameters[1] : 1;
+        cursorRow = row <= rows ? row - 1 : rows - 1;
+        cursorColumn = column <= columns ? column - 1 : columns - 1;
+        break;
+    }
+    case 'J':
+        if (count == 0 || parameters[0] == 0)
+        {
+            Erase(cursor, columns * rows);
+        }
+        else if (parameters[0] == 1)
+        {
+            Erase(0, cursor + 1);
+        }
+        else
+        {
+            Erase(0, columns * rows);
+        }
+        break;
+    case 'K':
+    {
+        int lineStart = cursorRow * columns;
+        if (count == 0 || parameters[0] == 0)
+        {
+            Erase(cursor, lineStart + columns);
+        }
+        else if (parameters[0] == 1)
+        {
+            Erase(lineStart, cursor + 1);
+        }
+        else
+        {
+            Erase(lineStart, lineStart + columns);
+        }
+        break;
+    }
+    case 'm':
+        SelectGraphicRendition(parameters, count);
+        break;
+    case 's':
+        savedRow = cursorRow;
+        savedColumn = cursorColumn;
+        break;
+    case 'u':
+        cursorRow = savedRow;
+        cursorColumn = savedColumn;
+        break;
+    default:
+        passthrough += "\x1B[";
+        passthrough += escape;
+        passthrough += final;
+        return;
+    }
+
+    dirty = 1;
+}
+
+
+/**
+ * @brief Applies an SGR sequence to the pen.
+ *
+ * Supports reset, bold and the 8 + 8 bright foreground and background colors.
+ */
+void ScreenModel::SelectGraphicRendition(const int* parameters, int count)
+{
+    if (count == 0)
+    {
+        count = 1; // ESC [ m is a reset
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        int code = parameters[i];
+
+        if (code == 0)
+        {
+            pen.foreground = SCREEN_DEFAULT_COLOR;
+            pen.background = SCREEN_DEFAULT_COLOR;
+            pen.bold = 0;
+        }
+        else if (code == 1)
+        {
+            pen.bold = 1;
+        }
+        else if (code == 22)
+        {
+            pen.bold = 0;
+        }
+        else if (code >= 30 && code <= 37)
+        {
+            pen.foreground = (uint8_t)(code - 30);
+        }
+        else if (code == 39)
+        {
+            pen.foreground = SCREEN_DEFAULT_COLOR;
+        }
+        else if (code >= 40 && code <= 47)
+        {
+            pen.background = (uint8_t)(code - 40);
+        }
+        else if (code == 49)
+        {
+            pen.background = SCREEN_DEFAULT_COLOR;
+        }
+        else if (code >= 90 && code <= 97)
+        {
+            pen.foreground = (uint8_t)(code - 90 + 8);
+        }
+        else if (code >= 100 && code <= 107)
+        {
+            pen.background = (uint8_t)(code - 100 + 8);
+        }
+    }
+}
+
+
+/**
+ * @brief Appends the shortest cursor movement from the last known terminal cursor position.
+ */
+void ScreenModel::MoveTo(std::string& output, int row, int column)
+{
+    if (row == shownRow && column == shownColumn)
+    {
+        return;
+    }
+
+    char sequence[32];
+
+    if (row == shownRow && column == 0)
+    {
+        output += '\r';
+    }
+    else if (row == shownRow && column > shownColumn)
+    {
+        snprintf(sequence, sizeof(sequence), "\x1B[%dC", column - shownColumn);
+        output += sequence;
+    }
+    else
+    {
+        snprintf(sequence, sizeof(sequence), "\x1B[%d;%dH", row + 1, column + 1);
+        output += sequence;
+    }
+
+    shownRow = row;
+    shownColumn = column;
+}
+
+
+/**
+ * @brief Moves the terminal cursor forward to a changed cell.
+ *
+ * Short gaps of unchanged cells drawn with the current attributes are cheaper to rewrite
+ * than to skip with an escape sequence, which costs at least four bytes.
+ */
+void ScreenModel::Skip(std::string& output, int row, int column)
+{
+    int gap = column - shownColumn;
+
+    if (row == shownRow && gap > 0 && gap < 4)
+    {
+        int start = row * columns + shownColumn;
+        int rewritable = 1;
+        for (int i = start; i < start + gap; ++i)
+        {
+            rewritable &= SameAttributes(shown[i], emitted);
+        }
+
+        if (rewritable)
+        {
+            for (int i = start; i < start + gap; ++i)
+            {
+                output += shown[i].character;
+            }
+            shownColumn = column;
+            return;
+        }
+    }
+
+    MoveTo(output, row, column);
+}
+
+
+/**
+ * @brief Appends an SGR sequence if the cell's attributes differ from the last ones sent.
+ */
+void ScreenModel::EmitAttributes(std::string& output, const ScreenCell& cell)
+{
+    if (SameAttributes(cell, emitted))
+    {
+        return;
+    }
+
+    char sequence[8];
+    output += "\x1B[0";
+    if (cell.bold)
+    {
+        output += ";1";
+    }
+    if (cell.foreground != SCREEN_DEFAULT_COLOR)
+    {
+        snprintf(sequence, sizeof(sequence), ";%d", cell.foreground < 8 ? 30 + cell.foreground : 90 + cell.foreground - 8);
+        output += sequence;
+    }
+    if (cell.background != SCREEN_DEFAULT_COLOR)
+    {
+        snprintf(sequence, sizeof(sequence), ";%d", cell.background < 8 ? 40 + cell.background : 100 + cell.background - 8);
+        output += sequence;
+    }
+    output += 'm';
+
+    emitted = cell;
+}
+
+
+/**
+ * @brief Appends the minimal terminal output that makes the terminal match the model.
+ *
+ * Scrolled lines are replayed as line feeds at the bottom row, then only cells that differ
+ * from what the terminal shows are rewritten, and finally the cursor is placed where the
+ * guest left it.
+ *
+ * @param output Receives the escape sequences and characters to write to the terminal.
+ */
+void ScreenModel::Render(std::string& output)
+{
+    output += passthrough;
+    passthrough.clear();
+
+    ScreenCell blank = pen;
+    blank.character = ' ';
+    blank.foreground = blank.background = SCREEN_DEFAULT_COLOR;
+    blank.bold = 0;
+
+    if (shownRow < 0 || pendingScroll >= rows)
+    {
+        // Unknown or entirely replaced contents, start from a cleared terminal
+        EmitAttributes(output, blank);
+        output += "\x1B[2J\x1B[H";
+        for (int i = 0; i < columns * rows; ++i)
+        {
+            shown[i] = blank;
+        }
+        shownRow = 0;
+        shownColumn = 0;
+    }
+    else if (pendingScroll > 0)
+    {
+        // Let the terminal scroll instead of redrawing every line
+        MoveTo(output, rows - 1, 0);
+        EmitAttributes(output, blank);
+        output.append((size_t)pendingScroll, '\n');
+
+        memmove(shown, shown + columns * pendingScroll, sizeof(ScreenCell) * columns * (rows - pendingScroll));
+        for (int i = columns * (rows - pendingScroll); i < columns * rows; ++i)
+        {
+            shown[i] = blank;
+        }
+    }
+
+    pendingScroll = 0;
+
+    for (int row = 0; row < rows; ++row)
+    {
+        for (int column = 0; column < columns; ++column)
+        {
+            int i = row * columns + column;
+            if (SameCell(cells[i], shown[i]))
+            {
+                continue;
+            }
+
+            Skip(output, row, column);
+            EmitAttributes(output, cells[i]);
+            output += cells[i].character;
+            shown[i] = cells[i];
+
+            // After the last column the terminal's cursor position depends on its wrap mode
+            if (++shownColumn >= columns)
+            {
+                shownRow = -1;
+                shownColumn = -1;
+            }
+        }
+    }
+
+    MoveTo(output, cursorRow, cursorColumn < columns ? cursorColumn : columns - 1);
+    dirty = 0;
+}
\ No newline at end of file
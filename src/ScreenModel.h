@@ -0,0 +1,94 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef SCREEN_MODEL_H
+#define SCREEN_MODEL_H
+
+// Longest control sequence kept for parsing; longer ones are dropped.
+#define SCREEN_ESCAPE_MAX 32
+
+// Most parameters interpreted in a single control sequence.
+#define SCREEN_PARAMETER_MAX 8
+
+// Color value meaning "terminal default".
+#define SCREEN_DEFAULT_COLOR 0xFF
+
+
+#include <cstdint>
+#include <string>
+
+
+struct ScreenCell
+{
+    char character;
+    uint8_t foreground; // 0-15, or SCREEN_DEFAULT_COLOR
+    uint8_t background; // 0-15, or SCREEN_DEFAULT_COLOR
+    uint8_t bold;
+};
+
+
+enum EscapeStates : uint8_t
+{
+    ESCAPE_NONE = 0, // plain text
+    ESCAPE_START,    // ESC received
+    ESCAPE_CSI       // ESC [ received, collecting parameters
+};
+
+
+class ScreenModel
+{
+private:
+    int columns;
+    int rows;
+
+    // Screen as the guest has drawn it, and as the terminal currently shows it.
+    ScreenCell* cells;
+    ScreenCell* shown;
+
+    // Guest cursor and saved cursor, and where the terminal cursor was left by the last render (-1 if unknown).
+    int cursorRow, cursorColumn;
+    int savedRow, savedColumn;
+    int shownRow, shownColumn;
+
+    // Attributes applied to new characters, and the attributes last sent to the terminal.
+    ScreenCell pen;
+    ScreenCell emitted;
+
+    // Lines scrolled off the top since the last render.
+    int pendingScroll;
+    int dirty;
+
+    // Control sequence parser.
+    uint8_t escapeState;
+    char escape[SCREEN_ESCAPE_MAX];
+    int escapeLength;
+
+    // Sequences the model does not interpret (e.g. cursor visibility), forwarded at the next render.
+    std::string passthrough;
+
+public:
+    ScreenModel(int columns, int rows);
+    ~ScreenModel();
+
+    void Write(char character);
+    int IsDirty() const;
+    void Render(std::string& output);
+
+private:
+    void Print(char character);
+    void LineFeed();
+    void Erase(int from, int to);
+    void ControlSequence(char final);
+    void SelectGraphicRendition(const int* parameters, int count);
+    void MoveTo(std::string& output, int row, int column);
+    void Skip(std::string& output, int row, int column);
+    void EmitAttributes(std::string& output, const ScreenCell& cell);
+};
+#endif
\ No newline at end of file
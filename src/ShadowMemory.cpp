@@ -0,0 +1,217 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+
+
+#include "ShadowMemory.h"
+#include "MemoryIO.h"
+
+
+// Messages printed for each finding, indexed by the ShadowFindings enumeration.
+static const char* const findingNames[ShadowFindings::SHADOW_FINDING_COUNT] =
+{
+    "read of uninitialized memory",
+    "execution of uninitialized memory",
+    "write into code"
+};
+
+
+/**
+ * @brief Constructs a ShadowMemory object with every guest word uninitialized.
+ *
+ * The memory-mapped device registers are marked initialized, since the devices define their values.
+ * The memory of the CPU must have its final size already.
+ *
+ * @param cpu Pointer to the CPU object, used for the memory layout and for the PC and registers in reports.
+ */
+ShadowMemory::ShadowMemory(CPU* cpu)
+{
+    cpuPtr = cpu;
+
+    memset(initialized, 0, sizeof(initialized));
+    memset(code, 0, sizeof(code));
+    memset(reported, 0, sizeof(reported));
+    memset(findings, 0, sizeof(findings));
+    printed = 0;
+
+    MarkInitialized(MemoryMappedRegisters::MR_KBSR, MEMORY_MAX - MemoryMappedRegisters::MR_KBSR);
+}
+
+
+/**
+ * @brief Marks a range of words as initialized, typically an image just loaded.
+ *
+ * The range wraps around the end of a smaller memory like the addresses it covers.
+ *
+ * @param address The first address of the range.
+ * @param count The number of words in the range.
+ */
+void ShadowMemory::MarkInitialized(uint16_t address, uint32_t count)
+{
+    uint32_t words = (uint32_t)cpuPtr->addressMask + 1;
+    uint32_t begin = address & cpuPtr->addressMask;
+    uint32_t end = begin + (count < words ? count : words);
+
+    if (end > words)
+    {
+        MarkWords(begin, words);
+        MarkWords(0, end - words);
+    }
+    else
+    {
+        MarkWords(begin, end);
+    }
+}
+
+
+/**
+ * @brief Sets the initialized bits of the words in [begin, end).
+ *
+ * Whole bitmap words are filled at once; only the partial words at both ends are masked.
+ *
+ * @param begin The first word.
+ * @param end The word past the last one.
+ */
+void ShadowMemory::MarkWords(uint32_t begin, uint32_t end)
+{
+    while (begin < end)
+    {
+        uint32_t index = begin >> 6;
+        uint32_t first = begin & 63;
+        uint32_t last = (end - begin >= 64 - first) ? 64 : first + (end - begin);
+
+        // Bits [first, last) of this bitmap word
+        uint64_t mask = (last == 64 ? ~0ULL : ((1ULL << last) - 1)) & (~0ULL << first);
+        initialized[index] |= mask;
+
+        begin += last - first;
+    }
+}
+
+
+/**
+ * @brief Checks a data read of a guest word.
+ *
+ * @param address The address being read.
+ */
+void ShadowMemory::CheckRead(uint16_t address)
+{
+    uint16_t word = address & cpuPtr->addressMask;
+    uint64_t bit = 1ULL << (word & 63);
+
+    if (!(initialized[word >> 6] & bit))
+    {
+        Record(ShadowFindings::SHADOW_UNINITIALIZED_READ, address);
+    }
+}
+
+
+/**
+ * @brief Checks a guest write and marks the written word initialized.
+ *
+ * @param address The address being written.
+ */
+void ShadowMemory::CheckWrite(uint16_t address)
+{
+    uint16_t word = address & cpuPtr->addressMask;
+    uint64_t bit = 1ULL << (word & 63);
+
+    initialized[word >> 6] |= bit;
+
+    if (code[word >> 6] & bit)
+    {
+        Record(ShadowFindings::SHADOW_CODE_WRITE, address);
+    }
+}
+
+
+/**
+ * @brief Checks an instruction fetch and marks the fetched word as code.
+ *
+ * @param address The address being fetched.
+ */
+void ShadowMemory::CheckFetch(uint16_t address)
+{
+    uint16_t word = address & cpuPtr->addressMask;
+    uint64_t bit = 1ULL << (word & 63);
+
+    code[word >> 6] |= bit;
+
+    if (!(initialized[word >> 6] & bit))
+    {
+        Record(ShadowFindings::SHADOW_UNINITIALIZED_EXECUTE, address);
+    }
+}
+
+
+/**
+ * @brief Counts a finding and prints it with the PC and registers, once per address.
+ *
+ * Data accesses happen after the fetch incremented the PC, so the faulting instruction is at PC - 1.
+ *
+ * @param finding The kind of finding, as a value of the ShadowFindings enumeration.
+ * @param address The guest address involved.
+ */
+void ShadowMemory::Record(uint16_t finding, uint16_t address)
+{
+    ++findings[finding];
+
+    uint16_t word = address & cpuPtr->addressMask;
+    uint64_t bit = 1ULL << (word & 63);
+    if (reported[word >> 6] & bit)
+    {
+        return;
+    }
+    reported[word >> 6] |= bit;
+
+    if (printed++ >= SHADOW_REPORT_LIMIT)
+    {
+        return;
+    }
+
+    uint16_t* registers = cpuPtr->registers;
+    uint16_t pc = (finding == ShadowFindings::SHADOW_UNINITIALIZED_EXECUTE) ? address : (uint16_t)(registers[Registers::R_PC] - 1);
+
+    fprintf(stderr, "shadow: %s at x%04X, PC x%04X, instruction x%04X\n",
+        findingNames[finding], address, pc, cpuPtr->Word(pc));
+    fprintf(stderr, "shadow:   R0 x%04X R1 x%04X R2 x%04X R3 x%04X R4 x%04X R5 x%04X R6 x%04X R7 x%04X\n",
+        registers[Registers::R_0], registers[Registers::R_1], registers[Registers::R_2], registers[Registers::R_3],
+        registers[Registers::R_4], registers[Registers::R_5], registers[Registers::R_6], registers[Registers::R_7]);
+}
+
+
+/**
+ * @brief Prints the number of findings of each kind.
+ *
+ * @return Returns 1 if anything was found, 0 otherwise.
+ */
+int ShadowMemory::Report() const
+{
+    uint64_t total = 0;
+
+    for (uint16_t i = 0; i < ShadowFindings::SHADOW_FINDING_COUNT; ++i)
+    {
+        total += findings[i];
+    }
+
+    if (printed > SHADOW_REPORT_LIMIT)
+    {
+        fprintf(stderr, "shadow: %llu further addresses not shown\n", (unsigned long long)(printed - SHADOW_REPORT_LIMIT));
+    }
+
+    fprintf(stderr, "shadow: %llu uninitialized reads, %llu uninitialized executions, %llu writes into code\n",
+        (unsigned long long)findings[ShadowFindings::SHADOW_UNINITIALIZED_READ],
+        (unsigned long long)findings[ShadowFindings::SHADOW_UNINITIALIZED_EXECUTE],
+        (unsigned long long)findings[ShadowFindings::SHADOW_CODE_WRITE]);
+
+    return total != 0;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef SHADOW_MEMORY_H
+#define SHADOW_MEMORY_H
+
+// Number of 64-bit bitmap words covering the largest guest memory; a smaller one uses the first of them.
+#define SHADOW_WORDS (MEMORY_MAX / 64)
+
+// Individual reports printed before the checker only keeps counting.
+#define SHADOW_REPORT_LIMIT 64
+
+
+#include <cstdint>
+
+#include "CPU.h"
+
+
+enum ShadowFindings : uint16_t
+{
+    SHADOW_UNINITIALIZED_READ = 0, // data read of a word nothing has written
+    SHADOW_UNINITIALIZED_EXECUTE,  // instruction fetch of a word nothing has written
+    SHADOW_CODE_WRITE,             // store into a word that has been executed
+    SHADOW_FINDING_COUNT
+};
+
+
+class ShadowMemory
+{
+private:
+    // Bits are indexed by the word an address selects, so every alias of a word in a smaller
+    // wrapping memory shares its bit.
+
+    // One bit per guest word: loaded from an image or written by the guest.
+    uint64_t initialized[SHADOW_WORDS];
+
+    // One bit per guest word: fetched as an instruction at least once.
+    uint64_t code[SHADOW_WORDS];
+
+    // One bit per guest word: already reported, so a loop over a bad word is reported once.
+    uint64_t reported[SHADOW_WORDS];
+
+    uint64_t findings[SHADOW_FINDING_COUNT];
+    uint64_t printed;
+
+    CPU* cpuPtr;
+
+public:
+    ShadowMemory(CPU* cpu);
+
+    void MarkInitialized(uint16_t address, uint32_t count);
+
+    void CheckRead(uint16_t address);
+    void CheckWrite(uint16_t address);
+    void CheckFetch(uint16_t address);
+
+    int Report() const;
+
+private:
+    void MarkWords(uint32_t begin, uint32_t end);
+    void Record(uint16_t finding, uint16_t address);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+
+#include "SymbolTable.h"
+
+
+/**
+ * @brief Constructs an empty SymbolTable.
+ */
+SymbolTable::SymbolTable()
+    : offsets(1 << 16, SYMBOL_NONE)
+{
+}
+
+
+/**
+ * @brief Reads a symbol file.
+ *
+ * Every line holding a name followed by a hexadecimal address defines a symbol, which covers both
+ * the "//  LOOP  3005" lines of an assembler .sym file and hand-written "LOOP x3005" lines. Header
+ * and comment lines that do not have this shape are skipped. The first name of an address wins.
+ *
+ * @param path The path of the symbol file.
+ * @return 1 if the file was read, 0 if it could not be opened.
+ */
+int SymbolTable::Load(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        ParseLine(line);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+
+/**
+ * @brief Adds the symbol defined by one line of a symbol file.
+ *
+ * @param line The null-terminated line.
+ * @return 1 if the line defined a symbol, 0 otherwise.
+ */
+int SymbolTable::ParseLine(const char* line)
+{
+    while (*line == '/' || isspace((unsigned char)*line))
+    {
+        ++line;
+    }
+
+    // Labels start with a letter or underscore, as the assembler requires
+    const char* name = line;
+    if (!isalpha((unsigned char)*line) && *line != '_')
+    {
+        return 0;
+    }
+    while (isalnum((unsigned char)*line) || *line == '_' || *line == '.')
+    {
+        ++line;
+    }
+    size_t length = (size_t)(line - name);
+
+    while (isspace((unsigned char)*line))
+    {
+        ++line;
+    }
+
+    if (*line == 'x' || *line == 'X')
+    {
+        ++line;
+    }
+    else if (line[0] == '0' && (line[1] == 'x' || line[1] == 'X'))
+    {
+        line += 2;
+    }
+
+    uint32_t address = 0;
+    int digits = 0;
+    while (isxdigit((unsigned char)*line))
+    {
+        address = (address << 4) | (uint32_t)(isdigit((unsigned char)*line) ? *line - '0' : (tolower((unsigned char)*line) - 'a' + 10));
+        ++digits;
+        ++line;
+    }
+
+    if (digits == 0 || digits > 4 || (*line && !isspace((unsigned char)*line)))
+    {
+        return 0;
+    }
+
+    if (offsets[address] != SYMBOL_NONE)
+    {
+        return 0;
+    }
+
+    if (length > SYMBOL_NAME_MAX - 1)
+    {
+        length = SYMBOL_NAME_MAX - 1;
+    }
+
+    offsets[address] = (uint32_t)names.size();
+    names.insert(names.end(), name, name + length);
+    names.push_back('\0');
+    ++count;
+    return 1;
+}
+
+
+/**
+ * @brief Returns the number of symbols read.
+ */
+size_t SymbolTable::Count() const
+{
+    return count;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+// Longest symbol name kept, including the terminating null; longer names are truncated.
+#define SYMBOL_NAME_MAX 32
+
+// Marks an address without a symbol in the offset table.
+#define SYMBOL_NONE 0xFFFFFFFF
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Names of guest addresses, read from the symbol file written by the LC-3 assembler.
+class SymbolTable
+{
+private:
+    // Null-terminated names, one after another.
+    std::vector<char> names;
+
+    // Offset of each address's name in names, or SYMBOL_NONE.
+    std::vector<uint32_t> offsets;
+
+    size_t count = 0;
+
+public:
+    SymbolTable();
+
+    int Load(const char* path);
+
+    const char* Find(uint16_t address) const
+    {
+        uint32_t offset = offsets[address];
+        return offset == SYMBOL_NONE ? nullptr : &names[offset];
+    }
+
+    size_t Count() const;
+
+private:
+    int ParseLine(const char* line);
+};
+#endif
\ No newline at end of file
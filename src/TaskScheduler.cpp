@@ -0,0 +1,378 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <cstring>
+
+
+#include "TaskScheduler.h"
+#include "Console.h"
+
+
+// Printed names of the TaskSwitches reasons.
+static const char* const switchNames[SWITCH_KINDS] = { "quantum", "yield", "input", "halt", "sleep" };
+
+
+/**
+ * @brief Constructs a TaskScheduler without tasks.
+ *
+ * @param cpu Pointer to the CPU the tasks take turns on.
+ * @param console Pointer to the console, asked whether a key is pending.
+ * @param instructions The quantum of a task, in instructions.
+ */
+TaskScheduler::TaskScheduler(CPU* cpu, Console* console, uint64_t instructions)
+{
+    cpuPtr = cpu;
+    consolePtr = console;
+
+    memset(tasks, 0, sizeof(tasks));
+    taskCount = 0;
+    current = 0;
+    quantum = instructions;
+    turnRetired = 0;
+
+    switchPending = 0;
+    pendingReason = TaskSwitches::SWITCH_QUANTUM;
+
+    memset(switches, 0, sizeof(switches));
+}
+
+
+/**
+ * @brief Adds a task starting at the origin of its image, with the registers of a reset CPU.
+ *
+ * @param name The name of the image, for the report.
+ * @param pc The address the task starts at.
+ * @return Returns 1 on success, 0 if TASK_MAX tasks exist already.
+ */
+int TaskScheduler::AddTask(const char* name, uint16_t pc)
+{
+    if (taskCount == TASK_MAX)
+    {
+        return 0;
+    }
+
+    GuestTask& task = tasks[taskCount++];
+    task.name = name;
+    task.registers[Registers::R_PC] = pc;
+    task.registers[Registers::R_COND] = ConditionFlags::FL_ZERO;
+    task.state = TaskStates::TASK_READY;
+    return 1;
+}
+
+
+/**
+ * @brief Loads the registers of the first task into the CPU.
+ */
+void TaskScheduler::Start()
+{
+    current = 0;
+    memcpy(cpuPtr->registers, tasks[0].registers, sizeof(cpuPtr->registers));
+    ++tasks[0].turns;
+}
+
+
+/**
+ * @brief Shortens a slice so that it ends with the quantum of the running task.
+ *
+ * @param budget The number of instructions the slice may run.
+ * @return The budget, at most what is left of the quantum.
+ */
+uint64_t TaskScheduler::Clamp(uint64_t budget) const
+{
+    uint64_t left = quantum - turnRetired;
+    return budget < left ? budget : left;
+}
+
+
+/**
+ * @brief Gives up the CPU once the yield trap completes, if another task can run now.
+ *
+ * @return Returns 1 if the task gives up the CPU, 0 if none can.
+ */
+int TaskScheduler::Yield()
+{
+    if (Next() == current)
+    {
+        return 0;
+    }
+
+    RequestSwitch(TaskSwitches::SWITCH_YIELD);
+    return 1;
+}
+
+
+/**
+ * @brief Gives up the CPU once the sleep trap completes, until a wake time.
+ *
+ * @param until The GetTickCount64 value the task runs again at.
+ */
+void TaskScheduler::Sleep(ULONGLONG until)
+{
+    tasks[current].wakeAt = until;
+    RequestSwitch(TaskSwitches::SWITCH_SLEEP);
+}
+
+
+/**
+ * @brief Gives up the CPU once the instruction polling KBSR completes, if no key is pending and another task is ready.
+ *
+ * The task polls again on its next turn.
+ *
+ * @return Returns 1 if the task gives up the CPU and KBSR reads as empty, 0 if the keyboard is checked as usual.
+ */
+int TaskScheduler::PollInput()
+{
+    if (!OtherRunnable() || consolePtr->KeyPending())
+    {
+        return 0;
+    }
+
+    RequestSwitch(TaskSwitches::SWITCH_INPUT);
+    return 1;
+}
+
+
+/**
+ * @brief Gives up the CPU instead of blocking in GETC, IN or WAIT while another task is ready or sleeping.
+ *
+ * @return Returns 1 if the trap must return at once; it is executed again on the task's next turn.
+ *         Returns 0 if a key is pending or no other task can run, and the trap waits for a key.
+ */
+int TaskScheduler::WaitForInput()
+{
+    if (!OtherRunnable() || consolePtr->KeyPending())
+    {
+        return 0;
+    }
+
+    cpuPtr->registers[Registers::R_PC] = cpuPtr->registers[Registers::R_7] - 1;
+    RequestSwitch(TaskSwitches::SWITCH_INPUT);
+    return 1;
+}
+
+
+/**
+ * @brief Counts a slice of execution and switches to the next task if the running one gave up the CPU.
+ *
+ * Called after every slice. A halted task leaves the CPU to the next one, so the CPU only stops
+ * running once every task has halted. While no task can run, this waits for a sleeping task to
+ * wake or for a key.
+ *
+ * @param retired The number of instructions executed by the slice.
+ */
+void TaskScheduler::Tick(uint64_t retired)
+{
+    tasks[current].instructions += retired;
+    turnRetired += retired;
+
+    uint16_t reason;
+    if (switchPending)
+    {
+        reason = pendingReason;
+        switchPending = 0;
+        cpuPtr->running = 1;
+    }
+    else if (!cpuPtr->running)
+    {
+        reason = TaskSwitches::SWITCH_HALT;
+    }
+    else if (turnRetired >= quantum)
+    {
+        reason = TaskSwitches::SWITCH_QUANTUM;
+    }
+    else
+    {
+        return;
+    }
+
+    tasks[current].state = reason == TaskSwitches::SWITCH_HALT ? TaskStates::TASK_HALTED :
+        reason == TaskSwitches::SWITCH_INPUT ? TaskStates::TASK_INPUT :
+        reason == TaskSwitches::SWITCH_SLEEP ? TaskStates::TASK_SLEEPING : TaskStates::TASK_READY;
+    turnRetired = 0;
+
+    int next = Pick();
+    if (next < 0)
+    {
+        return;
+    }
+
+    if (next != current)
+    {
+        ++switches[reason];
+        memcpy(tasks[current].registers, cpuPtr->registers, sizeof(cpuPtr->registers));
+        memcpy(cpuPtr->registers, tasks[next].registers, sizeof(cpuPtr->registers));
+        current = next;
+        ++tasks[next].turns;
+    }
+    tasks[next].state = TaskStates::TASK_READY;
+    cpuPtr->running = 1;
+}
+
+
+/**
+ * @brief Prints the instructions and turns of every task and the switches by reason to stderr.
+ */
+void TaskScheduler::Report() const
+{
+    for (int i = 0; i < taskCount; ++i)
+    {
+        fprintf(stderr, "tasks: %d %s: %llu instructions in %llu turns%s\n", i + 1, tasks[i].name,
+            (unsigned long long)tasks[i].instructions, (unsigned long long)tasks[i].turns,
+            tasks[i].state == TaskStates::TASK_HALTED ? ", halted" : "");
+    }
+
+    fprintf(stderr, "tasks: switches:");
+    for (int reason = 0; reason < TaskSwitches::SWITCH_KINDS; ++reason)
+    {
+        fprintf(stderr, " %llu %s%s", (unsigned long long)switches[reason], switchNames[reason],
+            reason + 1 < TaskSwitches::SWITCH_KINDS ? "," : "\n");
+    }
+}
+
+
+/**
+ * @brief Reads the origin of an image file, where its task starts.
+ *
+ * @param imagePath The path of the image file.
+ * @param origin Receives the origin.
+ * @return Returns 1 on success, 0 if the file cannot be read.
+ */
+int TaskScheduler::ReadOrigin(const char* imagePath, uint16_t* origin)
+{
+    FILE* file = fopen(imagePath, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    uint8_t bytes[2];
+    int read = fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+    fclose(file);
+
+    *origin = (uint16_t)((bytes[0] << 8) | bytes[1]);
+    return read;
+}
+
+
+/**
+ * @brief Tells whether a task other than the running one is ready or sleeping, so it runs before long.
+ *
+ * @return Returns 1 if one is, 0 otherwise.
+ */
+int TaskScheduler::OtherRunnable() const
+{
+    for (int i = 0; i < taskCount; ++i)
+    {
+        if (i != current && (tasks[i].state == TaskStates::TASK_READY || tasks[i].state == TaskStates::TASK_SLEEPING))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Stops the engine once the current instruction completes, so that Tick switches tasks.
+ *
+ * @param reason Why the task gives up the CPU, as a value of TaskSwitches.
+ */
+void TaskScheduler::RequestSwitch(uint16_t reason)
+{
+    switchPending = 1;
+    pendingReason = reason;
+    cpuPtr->running = 0;
+}
+
+
+/**
+ * @brief Picks the task to run next, round-robin after the running one.
+ *
+ * Ready tasks come first, unless a key is pending for a task waiting for input. When no task is
+ * ready, the next waiting one runs and polls or blocks for a key itself.
+ *
+ * @return The index of the task, the running one if no other can run, or -1 if every task halted.
+ */
+int TaskScheduler::Next() const
+{
+    int ready = -1;
+    int waiting = -1;
+    for (int i = 1; i <= taskCount; ++i)
+    {
+        int index = (current + i) % taskCount;
+        if (tasks[index].state == TaskStates::TASK_READY && ready < 0)
+        {
+            ready = index;
+        }
+        if (tasks[index].state == TaskStates::TASK_INPUT && waiting < 0)
+        {
+            waiting = index;
+        }
+    }
+
+    // A pending key goes to a task waiting for one, ahead of the ready tasks
+    if (waiting >= 0 && ready >= 0 && (consolePtr->KeyPending()))
+    {
+        return waiting;
+    }
+    return ready >= 0 ? ready : waiting;
+}
+
+
+/**
+ * @brief Wakes the sleeping tasks whose time has come and picks the task to run next, waiting while none can run.
+ *
+ * A task waiting for input is only picked over sleeping tasks once a key is pending; until then,
+ * the host thread waits for a key or for the earliest wake time, whichever comes first.
+ *
+ * @return The index of the task, or -1 if every task halted.
+ */
+int TaskScheduler::Pick()
+{
+    for (;;)
+    {
+        ULONGLONG now = GetTickCount64();
+        ULONGLONG wake = 0;
+        int sleeping = 0;
+        for (int i = 0; i < taskCount; ++i)
+        {
+            if (tasks[i].state != TaskStates::TASK_SLEEPING)
+            {
+                continue;
+            }
+
+            if (tasks[i].wakeAt <= now)
+            {
+                tasks[i].state = TaskStates::TASK_READY;
+            }
+            else if (!sleeping++ || tasks[i].wakeAt < wake)
+            {
+                wake = tasks[i].wakeAt;
+            }
+        }
+
+        int next = Next();
+        if (!sleeping || (next >= 0 && tasks[next].state == TaskStates::TASK_READY))
+        {
+            return next;
+        }
+
+        DWORD timeout = (DWORD)(wake - now);
+        if (next < 0)
+        {
+            ::Sleep(timeout);
+        }
+        else if (consolePtr->WaitForKey(timeout))
+        {
+            return next;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+// Largest number of tasks, one per image.
+#define TASK_MAX 16
+
+// Instructions a task runs before the next one gets the CPU, unless selected with --tasks=N.
+#define TASK_QUANTUM 10000
+
+
+#include <cstdint>
+#include <Windows.h>
+
+#include "CPU.h"
+
+
+class Console;
+
+
+// State of a task between its turns.
+enum TaskStates : uint16_t
+{
+    TASK_READY = 0, // runnable
+    TASK_INPUT,     // found the keyboard empty; runs again once a key is pending, or when nothing else can run
+    TASK_SLEEPING,  // executed TRAP_SLEEP; runs again once its wake time has passed
+    TASK_HALTED     // halted or faulted; never runs again
+};
+
+
+// Why the running task gave up the CPU.
+enum TaskSwitches : uint16_t
+{
+    SWITCH_QUANTUM = 0, // ran for its quantum
+    SWITCH_YIELD,       // executed TRAP_YIELD
+    SWITCH_INPUT,       // polled an empty keyboard, or waited for a key in GETC or IN
+    SWITCH_HALT,        // halted
+    SWITCH_SLEEP,       // executed TRAP_SLEEP
+    SWITCH_KINDS
+};
+
+
+// One image run as a task, with a register set of its own.
+struct GuestTask
+{
+    const char* name;
+    uint16_t registers[REGISTER_COUNT]; // saved while another task runs
+    uint16_t state;                     // a value of TaskStates
+    ULONGLONG wakeAt;                   // GetTickCount64 value a sleeping task runs again at
+    uint64_t instructions;
+    uint64_t turns;
+};
+
+
+// Runs every loaded image as a task in one address space. Tasks share the memory and the console
+// and take turns on the CPU: the running task gives it up at TRAP_YIELD and TRAP_SLEEP, when it
+// finds the keyboard empty while another task can run, when its quantum ends and when it halts. A
+// switch only saves the registers of one task and loads those of the next. While every task
+// sleeps or waits for a key, the host thread sleeps too.
+class TaskScheduler
+{
+private:
+    CPU* cpuPtr;
+    Console* consolePtr;
+
+    GuestTask tasks[TASK_MAX];
+    int taskCount;
+    int current;
+    uint64_t quantum;
+    uint64_t turnRetired;
+
+    // Set during an instruction, which stops the engine once it completes
+    int switchPending;
+    uint16_t pendingReason;
+
+    uint64_t switches[SWITCH_KINDS];
+
+public:
+    TaskScheduler(CPU* cpu, Console* console, uint64_t instructions);
+
+    int AddTask(const char* name, uint16_t pc);
+    void Start();
+
+    uint64_t Clamp(uint64_t budget) const;
+    int Yield();
+    void Sleep(ULONGLONG until);
+    int PollInput();
+    int WaitForInput();
+    void Tick(uint64_t retired);
+    void Report() const;
+
+    static int ReadOrigin(const char* imagePath, uint16_t* origin);
+
+private:
+    int OtherRunnable() const;
+    void RequestSwitch(uint16_t reason);
+    int Next() const;
+    int Pick();
+};
+#endif
\ No newline at end of file
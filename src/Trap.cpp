@@ -10,23 +10,84 @@ Copyright 
 
 #include "Trap.h"
 #include "CPU.h"
+#include "Console.h"
+#include "LiveStats.h"
+#include "MetricsExporter.h"
+#include "TrapProfiler.h"
+#include "LiveMigration.h"
+#include "TaskScheduler.h"
 
 
 /**
- * @brief Constructs a Trap object with references to memory, registers, and CPU.
+ * @brief Constructs a Trap object with references to registers, CPU and console.
  *
- * This constructor initializes the Trap object with references to the memory, registers,
- * and CPU components of the virtual machine.
+ * This constructor initializes the Trap object with references to the registers,
+ * CPU and console components of the virtual machine; memory is reached through the CPU.
  *
- * @param memory Pointer to the memory array of the virtual machine.
  * @param registers Pointer to the registers array of the virtual machine.
  * @param cpu Pointer to the CPU object controlling the virtual machine's operation.
+ * @param console Pointer to the Console object receiving guest output.
  */
-Trap::Trap(uint16_t* memory, uint16_t* registers, CPU* cpu)
+Trap::Trap(uint16_t* registers, CPU* cpu, Console* console)
 {
-    memoryPtr = memory;
     registersPtr = registers;
     cpuPtr = cpu;
+    consolePtr = console;
+}
+
+
+/**
+ * @brief Attaches live stats counting traps, input bytes and time spent waiting for input.
+ *
+ * @param stats Pointer to the LiveStats object, or nullptr to detach.
+ */
+void Trap::AttachStats(LiveStats* stats)
+{
+    statsPtr = stats;
+}
+
+
+/**
+ * @brief Attaches the metrics shard timing traps and input-to-output latency.
+ *
+ * @param metrics Pointer to the MetricsShard object, or nullptr to stop recording.
+ */
+void Trap::AttachMetrics(MetricsShard* metrics)
+{
+    metricsPtr = metrics;
+}
+
+
+/**
+ * @brief Attaches the trap profiler timing every trap vector.
+ *
+ * @param profiler Pointer to the TrapProfiler object, or nullptr to stop timing.
+ */
+void Trap::AttachProfiler(TrapProfiler* profiler)
+{
+    profilerPtr = profiler;
+}
+
+
+/**
+ * @brief Attaches the live migration that may hand the guest over while it waits for a key.
+ *
+ * @param migration Pointer to the LiveMigration object, or nullptr to detach.
+ */
+void Trap::AttachMigration(LiveMigration* migration)
+{
+    migrationPtr = migration;
+}
+
+
+/**
+ * @brief Attaches the task scheduler that YIELD, SLEEP and the keyboard traps give the CPU back to.
+ *
+ * @param tasks Pointer to the TaskScheduler object, or nullptr to detach.
+ */
+void Trap::AttachTasks(TaskScheduler* tasks)
+{
+    tasksPtr = tasks;
 }
 
 
@@ -42,6 +103,14 @@ void Trap::Proxy(uint16_t instruction)
     // Save the return address
     registersPtr[Registers::R_7] = registersPtr[Registers::R_PC];
 
+    if (statsPtr)
+    {
+        statsPtr->CountTrap(instruction & 0x00FF);
+    }
+
+    LONGLONG trapStart = metricsPtr ? metricsPtr->BeginTrap() : 0;
+    uint64_t profileStart = profilerPtr ? profilerPtr->Begin() : 0;
+
     // Switch based on the trap vector
     switch (instruction & 0x00FF)
     {
@@ -63,7 +132,47 @@ void Trap::Proxy(uint16_t instruction)
     case TRAP_HALT:
         HALT(); // Handle HALT trap
         break;
+    case TRAP_YIELD:
+        YIELD(); // Handle YIELD trap
+        break;
+    case TRAP_SLEEP:
+        SLEEP(); // Handle SLEEP trap
+        break;
+    case TRAP_WAIT:
+        WAIT(); // Handle WAIT trap
+        break;
+    }
+
+    if (profilerPtr && (instruction & 0x00FF) <= TrapCodes::TRAP_HALT)
+    {
+        profilerPtr->End((uint16_t)((instruction & 0x00FF) - TrapCodes::TRAP_GETC), profileStart);
+    }
+
+    if (metricsPtr)
+    {
+        metricsPtr->EndTrap(instruction & 0x00FF, trapStart);
+    }
+}
+
+
+/**
+ * @brief Takes the request of YIELD, SLEEP or WAIT to give up the host CPU, and lets the CPU run again.
+ *
+ * Called by the VM after every slice; a request stops the engine once its trap completes.
+ *
+ * @param until Receives the deadline of IDLE_SLEEP, as a GetTickCount64 value.
+ * @return The request, as a value of IdleKinds; IDLE_NONE if the slice ended for another reason.
+ */
+uint16_t Trap::TakeIdle(ULONGLONG* until)
+{
+    uint16_t kind = idleKind;
+    if (kind != IdleKinds::IDLE_NONE)
+    {
+        idleKind = IdleKinds::IDLE_NONE;
+        *until = idleUntil;
+        cpuPtr->running = 1;
     }
+    return kind;
 }
 
 
@@ -74,8 +183,43 @@ void Trap::Proxy(uint16_t instruction)
  */
 void Trap::GETC()
 {
+    // Everything drawn so far must be visible while the guest waits
+    consolePtr->InputWait();
+
+    // A guest handed over while it waits executes the trap again on the target
+    if (migrationPtr && migrationPtr->WaitForInput())
+    {
+        return;
+    }
+
+    // Another task runs meanwhile, and this one executes the trap again on its next turn
+    if (tasksPtr && tasksPtr->WaitForInput())
+    {
+        return;
+    }
+
+    if (statsPtr)
+    {
+        statsPtr->BeginIdle();
+    }
+    if (metricsPtr)
+    {
+        metricsPtr->SetState(VmStates::VM_STATE_INPUT);
+    }
+
     // Read character from console
-    registersPtr[Registers::R_0] = (uint16_t)getchar();
+    registersPtr[Registers::R_0] = (uint16_t)consolePtr->GetChar();
+
+    if (statsPtr)
+    {
+        statsPtr->EndIdle();
+        statsPtr->CountInput();
+    }
+    if (metricsPtr)
+    {
+        metricsPtr->SetState(VmStates::VM_STATE_RUNNING);
+        metricsPtr->CountInput();
+    }
     // Update condition flags based on the result
     cpuPtr->UpdateFlags(Registers::R_0);
 }
@@ -88,9 +232,9 @@ void Trap::GETC()
 void Trap::OUTC()
 {
     // Output character to console
-    putc((char)registersPtr[Registers::R_0], stdout);
+    consolePtr->Put((char)registersPtr[Registers::R_0]);
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    consolePtr->Flush();
 }
 
 
@@ -101,17 +245,18 @@ void Trap::OUTC()
  */
 void Trap::PUTS()
 {
-    // Iterate through memory and output characters until null terminator is encountered
-    uint16_t* c = memoryPtr + registersPtr[Registers::R_0];
-    while (*c)
+    // Iterate through memory and output characters until null terminator is encountered;
+    // the string wraps around the end of memory like any other access
+    uint16_t address = registersPtr[Registers::R_0];
+    while (uint16_t c = cpuPtr->Word(address))
     {
         // Output character to console
-        putc((char)*c, stdout);
+        consolePtr->Put((char)c);
         // Move to the next character in memory
-        ++c;
+        ++address;
     }
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    consolePtr->Flush();
 }
 
 
@@ -122,14 +267,47 @@ void Trap::PUTS()
  */
 void Trap::INC()
 {
-    printf("Enter a character: ");
+    // Another task runs meanwhile; the trap is executed again, so the prompt is only written once a key is pending
+    if (tasksPtr && tasksPtr->WaitForInput())
+    {
+        return;
+    }
+
+    consolePtr->Write("Enter a character: ");
+    consolePtr->InputWait();
+
+    // Handed over while waiting, the target executes the trap again and repeats the prompt
+    if (migrationPtr && migrationPtr->WaitForInput())
+    {
+        return;
+    }
+
+    if (statsPtr)
+    {
+        statsPtr->BeginIdle();
+    }
+    if (metricsPtr)
+    {
+        metricsPtr->SetState(VmStates::VM_STATE_INPUT);
+    }
 
     // Read character from console
-    char c = getchar();
+    char c = (char)consolePtr->GetChar();
+
+    if (statsPtr)
+    {
+        statsPtr->EndIdle();
+        statsPtr->CountInput();
+    }
+    if (metricsPtr)
+    {
+        metricsPtr->SetState(VmStates::VM_STATE_RUNNING);
+        metricsPtr->CountInput();
+    }
     // Output character to console
-    putc(c, stdout);
+    consolePtr->Put(c);
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    consolePtr->Flush();
     // Store ASCII value of character in register R0
     registersPtr[Registers::R_0] = (uint16_t)c;
     // Update condition flags based on the result
@@ -144,24 +322,25 @@ void Trap::INC()
  */
 void Trap::PUTSP()
 {
-    // Iterate through memory and output characters until null terminator is encountered
-    uint16_t* c = memoryPtr + registersPtr[Registers::R_0];
-    while (*c)
+    // Iterate through memory and output characters until null terminator is encountered;
+    // the string wraps around the end of memory like any other access
+    uint16_t address = registersPtr[Registers::R_0];
+    while (uint16_t c = cpuPtr->Word(address))
     {
         // Extract lower 8 bits of the word
-        char char1 = (*c) & 0x00FF;
+        char char1 = c & 0x00FF;
         // Output lower byte to console
-        putc(char1, stdout);
+        consolePtr->Put(char1);
         // Extract upper 8 bits of the word
-        char char2 = (*c) >> 8;
+        char char2 = c >> 8;
         // Output upper byte to console if not null
-        if (char2) putc(char2, stdout);
+        if (char2) consolePtr->Put(char2);
         // Move to the next word in memory
-        ++c;
+        ++address;
     }
 
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    consolePtr->Flush();
 }
 
 
@@ -172,9 +351,84 @@ void Trap::PUTSP()
  */
 void Trap::HALT()
 {
-    puts("HALT");
+    consolePtr->Write("HALT\n");
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    consolePtr->Flush();
     // Set 'running' flag to false to halt execution
     cpuPtr->running = 0;
 }
+
+
+/**
+ * @brief Gives up the rest of the slice once the trap completes, to the next task under --tasks.
+ *
+ * Without another runnable task, the host thread gives up its processor instead.
+ */
+void Trap::YIELD()
+{
+    if (tasksPtr && tasksPtr->Yield())
+    {
+        return;
+    }
+
+    RequestIdle(IdleKinds::IDLE_YIELD, 0);
+}
+
+
+/**
+ * @brief Sleeps for R0 milliseconds once the trap completes, without using the host CPU.
+ *
+ * Under --tasks only the task sleeps, and the others run meanwhile.
+ */
+void Trap::SLEEP()
+{
+    // Everything the guest wrote before sleeping must be visible during the sleep
+    consolePtr->InputWait();
+
+    ULONGLONG until = GetTickCount64() + registersPtr[Registers::R_0];
+
+    if (tasksPtr)
+    {
+        tasksPtr->Sleep(until);
+        return;
+    }
+
+    RequestIdle(IdleKinds::IDLE_SLEEP, until);
+}
+
+
+/**
+ * @brief Waits until a key is pending, without using the host CPU; the key is left for GETC, IN or KBDR.
+ *
+ * Under --tasks the other tasks run meanwhile, and the trap is executed again on the task's next turn.
+ */
+void Trap::WAIT()
+{
+    consolePtr->InputWait();
+
+    if (consolePtr->KeyPending())
+    {
+        return;
+    }
+
+    if (tasksPtr && tasksPtr->WaitForInput())
+    {
+        return;
+    }
+
+    RequestIdle(IdleKinds::IDLE_INPUT, 0);
+}
+
+
+/**
+ * @brief Stops the engine once the current trap completes, so that the VM gives up the host CPU.
+ *
+ * @param kind How the host CPU is given up, as a value of IdleKinds.
+ * @param until The deadline of IDLE_SLEEP, as a GetTickCount64 value.
+ */
+void Trap::RequestIdle(uint16_t kind, ULONGLONG until)
+{
+    idleKind = kind;
+    idleUntil = until;
+    cpuPtr->running = 0;
+}
@@ -13,9 +13,16 @@ Copyright 
 
 
 #include <cstdint>
+#include <Windows.h>
 
 
 class CPU;
+class Console;
+class LiveStats;
+class MetricsShard;
+class TrapProfiler;
+class LiveMigration;
+class TaskScheduler;
 
 
 enum TrapCodes : uint16_t
@@ -25,21 +32,50 @@ enum TrapCodes : uint16_t
     TRAP_PUTS = 0x0022,  // output a word string
     TRAP_IN = 0x0023,    // get character from keyboard, echoed onto the terminal
     TRAP_PUTSP = 0x0024, // output a byte string
-    TRAP_HALT = 0x0025   // halt the program
+    TRAP_HALT = 0x0025,  // halt the program
+    TRAP_YIELD = 0x0026, // give up the rest of the slice, to the next task under --tasks
+    TRAP_SLEEP = 0x0027, // sleep for R0 milliseconds
+    TRAP_WAIT = 0x0028   // wait until a key is pending, without reading it
+};
+
+
+// How the guest gives up the host CPU once a trap completes.
+enum IdleKinds : uint16_t
+{
+    IDLE_NONE = 0,
+    IDLE_YIELD, // for the rest of the slice
+    IDLE_SLEEP, // until a deadline
+    IDLE_INPUT  // until a key is pending
 };
 
 
 class Trap
 {
 private:
-    uint16_t* memoryPtr;
     uint16_t* registersPtr;
     CPU* cpuPtr;
+    Console* consolePtr;
+    LiveStats* statsPtr = nullptr;
+    MetricsShard* metricsPtr = nullptr;
+    TrapProfiler* profilerPtr = nullptr;
+    LiveMigration* migrationPtr = nullptr;
+    TaskScheduler* tasksPtr = nullptr;
+
+    // Set by YIELD, SLEEP and WAIT, which stop the engine; taken by the VM after the slice
+    uint16_t idleKind = IdleKinds::IDLE_NONE;
+    ULONGLONG idleUntil = 0;
 
 public:
-    Trap(uint16_t* memory, uint16_t* registers, CPU* cpu);
+    Trap(uint16_t* registers, CPU* cpu, Console* console);
+
+    void AttachStats(LiveStats* stats);
+    void AttachMetrics(MetricsShard* metrics);
+    void AttachProfiler(TrapProfiler* profiler);
+    void AttachMigration(LiveMigration* migration);
+    void AttachTasks(TaskScheduler* tasks);
 
     void Proxy(uint16_t instruction);
+    uint16_t TakeIdle(ULONGLONG* until);
 
     void GETC();
     void OUTC();
@@ -47,5 +83,11 @@ public:
     void INC();
     void PUTSP();
     void HALT();
+    void YIELD();
+    void SLEEP();
+    void WAIT();
+
+private:
+    void RequestIdle(uint16_t kind, ULONGLONG until);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include <cstdio>
+#include <intrin.h>
+
+
+#include "TrapProfiler.h"
+
+
+static const char* const slotNames[TRAP_PROFILE_SLOTS] = { "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT", "KBSR" };
+
+
+/**
+ * @brief Constructs a TrapProfiler with empty histograms.
+ */
+TrapProfiler::TrapProfiler()
+{
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = counterFrequency.QuadPart;
+
+    startTicks = 0;
+    startCounter = 0;
+}
+
+
+/**
+ * @brief Marks the start of the run, against which host I/O time is compared.
+ */
+void TrapProfiler::Start()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    startCounter = now.QuadPart;
+    startTicks = __rdtsc();
+}
+
+
+/**
+ * @brief Returns the timestamp at which a trap or poll starts.
+ *
+ * The time stamp counter is read directly, which costs a fraction of QueryPerformanceCounter.
+ * Processors of the last decade keep it invariant across frequency changes and cores.
+ *
+ * @return The time stamp counter, passed back to End.
+ */
+uint64_t TrapProfiler::Begin() const
+{
+    return __rdtsc();
+}
+
+
+/**
+ * @brief Records the time spent since Begin.
+ *
+ * @param slot The trap vector minus TRAP_GETC, or TRAP_PROFILE_KBSR; other values are ignored.
+ * @param start The timestamp returned by Begin.
+ */
+void TrapProfiler::End(uint16_t slot, uint64_t start)
+{
+    if (slot < TRAP_PROFILE_SLOTS)
+    {
+        latency[slot].Record(__rdtsc() - start);
+    }
+}
+
+
+/**
+ * @brief Prints per-vector latencies and the split between host I/O and guest computation to stderr.
+ *
+ * Ticks are converted using the rate of the time stamp counter measured over the whole run.
+ * Time spent outside traps and keyboard polls is attributed to guest computation, so a workload
+ * is reported as I/O-bound when host I/O takes most of the run.
+ */
+void TrapProfiler::Report() const
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    uint64_t ticks = __rdtsc() - startTicks;
+
+    double wall = (double)(now.QuadPart - startCounter) / (double)frequency;
+    double ticksPerMicrosecond = wall > 0 ? (double)ticks / wall / 1e6 : 1;
+
+    fprintf(stderr, "trap profile: %-6s %10s %12s %10s %10s %10s %10s\n",
+        "slot", "count", "total ms", "mean us", "p50 us", "p99 us", "max us");
+
+    double ioSeconds = 0;
+    for (int slot = 0; slot < TRAP_PROFILE_SLOTS; ++slot)
+    {
+        const Histogram& histogram = latency[slot];
+        if (histogram.Count() == 0)
+        {
+            continue;
+        }
+
+        double total = (double)histogram.Sum() / ticksPerMicrosecond;
+        ioSeconds += total / 1e6;
+
+        fprintf(stderr, "trap profile: %-6s %10llu %12.3f %10.2f %10.2f %10.2f %10.2f\n",
+            slotNames[slot], (unsigned long long)histogram.Count(), total / 1000.0,
+            histogram.Mean() / ticksPerMicrosecond,
+            histogram.Percentile(50.0) / ticksPerMicrosecond,
+            histogram.Percentile(99.0) / ticksPerMicrosecond,
+            histogram.Max() / ticksPerMicrosecond);
+    }
+
+    double computeSeconds = wall > ioSeconds ? wall - ioSeconds : 0;
+    double ioShare = wall > 0 ? ioSeconds * 100.0 / wall : 0;
+
+    fprintf(stderr, "trap profile: %.3f ms wall, host I/O %.3f ms (%.1f%%), guest computation %.3f ms (%.1f%%): %s-bound\n",
+        wall * 1000.0, ioSeconds * 1000.0, ioShare, computeSeconds * 1000.0, 100.0 - ioShare, ioShare > 50.0 ? "I/O" : "dispatch");
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef TRAP_PROFILER_H
+#define TRAP_PROFILER_H
+
+// Histogram slots: one per trap vector, TRAP_GETC to TRAP_HALT, then the keyboard status polls.
+#define TRAP_PROFILE_VECTORS 6
+#define TRAP_PROFILE_KBSR TRAP_PROFILE_VECTORS
+#define TRAP_PROFILE_SLOTS (TRAP_PROFILE_VECTORS + 1)
+
+
+#include <cstdint>
+#include <Windows.h>
+
+#include "Histogram.h"
+
+
+class TrapProfiler
+{
+private:
+    // Time stamp counter ticks spent in each slot
+    Histogram latency[TRAP_PROFILE_SLOTS];
+
+    // Run span on both clocks, used to convert ticks to seconds
+    uint64_t startTicks;
+    LONGLONG startCounter;
+    LONGLONG frequency;
+
+public:
+    TrapProfiler();
+
+    void Start();
+    uint64_t Begin() const;
+    void End(uint16_t slot, uint64_t start);
+    void Report() const;
+};
+#endif
\ No newline at end of file
@@ -8,21 +8,121 @@ Copyright 
 */
 
 
+#include <cstring>
+
+
 #include "VirtualMachine.h"
 #include "CPU.h"
 #include "ArithmeticLogicUnit.h"
 #include "MemoryIO.h"
 #include "OS.h"
 #include "Trap.h"
+#include "DecodeCache.h"
+#include "EngineTuner.h"
+#include "Pacer.h"
+#include "RealTime.h"
+#include "InputLatencyProbe.h"
+#include "Console.h"
+#include "ShadowMemory.h"
+#include "Debugger.h"
+#include "GdbStub.h"
+#include "LiveStats.h"
+#include "MetricsExporter.h"
+#include "TrapProfiler.h"
+#include "BasicVirtualMachine.h"
+#include "IsaCheck.h"
+#include "Disassembler.h"
+#include "DensityBenchmark.h"
+#include "NumaHost.h"
+#include "ImagePager.h"
+#include "ImageBundle.h"
+#include "LiveMigration.h"
+#include "PersistentMemory.h"
+#include "CheckpointLog.h"
+#include "TaskScheduler.h"
+
+
+// Command-line usage, printed when no image file is given.
+#define USAGE "lc3 [--engine=switch|table|predecoded|threaded|auto] [--engine-cache=file] [--clock=hz] [--realtime] [--realtime-cpu=n] [--realtime-class] [--screen[=colsxrows]] [--output-thread[=kb]] [--shadow] [--break=addr[,cond][,hits=n]] [--watch=addr[+len][:rw]] [--gdb[=port]] [--stats] [--top[=n]] [--metrics[=path]] [--metrics-http=port] [--trap-profile] [--instrument=none|trace|coverage|mix|all] [--bench-policies] [--isa-check] [--trace-file=file] [--disasm] [--disasm-trace=file] [--symbols=file] [--memory=words|nK] [--memory-fault] [--bench-density] [--host=guests] [--host-pin=core|node] [--host-imbalance=percent] [--lazy-load] [--bundle=file] [--pack=file] [--migrate-listen=path] [--migrate-from=path] [--memory-file=file] [--checkpoint=file] [--tasks[=n]] [image-file1] ...\n"
+
+
+// Instructions each loop executes per window of --bench-policies.
+#define POLICY_BENCH_WINDOW (1 << 22)
+
+// Windows per loop; the best one counts, as in the engine tuner.
+#define POLICY_BENCH_ROUNDS 5
+
+// Longest the VM sleeps for a guest in SLEEP or WAIT before serving the socket, the memory file and
+// the checkpoints again, in milliseconds.
+#define IDLE_WAIT_MS 100
+
+
+// Handler used by the table engine, indexed by opcode.
+typedef void (*InstructionHandler)(ArithmeticLogicUnit* alu, Trap* trap, uint16_t instruction);
+
+
+// Defines the table engine and threaded engine handlers of every ALU instruction of LC3_ISA.
+#define DEFINE_HANDLERS(NAME, KIND, FORMAT, BITS) DEFINE_HANDLERS_##KIND(NAME)
+#define DEFINE_HANDLERS_ALU(NAME) \
+    static void Execute##NAME(ArithmeticLogicUnit* alu, Trap*, uint16_t instruction) { alu->NAME(instruction); } \
+    static void ExecuteDecoded##NAME(ArithmeticLogicUnit* alu, Trap*, const DecodedInstruction& decoded) { alu->NAME(decoded); }
+#define DEFINE_HANDLERS_TRAP(NAME)
+#define DEFINE_HANDLERS_RESERVED(NAME)
+
+LC3_ISA(DEFINE_HANDLERS)
+
+#undef DEFINE_HANDLERS
+#undef DEFINE_HANDLERS_ALU
+#undef DEFINE_HANDLERS_TRAP
+#undef DEFINE_HANDLERS_RESERVED
+
+
+static void ExecuteTRAP(ArithmeticLogicUnit*, Trap* trap, uint16_t instruction) { trap->Proxy(instruction); }
+static void ExecuteDecodedTRAP(ArithmeticLogicUnit*, Trap* trap, const DecodedInstruction& decoded) { trap->Proxy(decoded.instruction); }
 
+static void ExecuteReserved(ArithmeticLogicUnit*, Trap*, uint16_t) { abort(); }
+static void ExecuteDecodedReserved(ArithmeticLogicUnit*, Trap*, const DecodedInstruction&) { abort(); }
 
-VirtualMachine::VirtualMachine(CPU* cpu, OS* os, Trap* trap, MemoryIO* memoryIO, ArithmeticLogicUnit* alu)
+
+// Names the handler of an instruction, or the reserved handler if it is not implemented.
+#define HANDLER_NAME(PREFIX, NAME, KIND) HANDLER_NAME_##KIND(PREFIX, NAME)
+#define HANDLER_NAME_ALU(PREFIX, NAME) PREFIX##NAME
+#define HANDLER_NAME_TRAP(PREFIX, NAME) PREFIX##NAME
+#define HANDLER_NAME_RESERVED(PREFIX, NAME) PREFIX##Reserved
+
+#define INSTRUCTION_HANDLER(NAME, KIND, FORMAT, BITS) HANDLER_NAME(Execute, NAME, KIND),
+#define DECODED_HANDLER(NAME, KIND, FORMAT, BITS) HANDLER_NAME(ExecuteDecoded, NAME, KIND),
+
+// Table engine handlers, in opcode order.
+static const InstructionHandler instructionHandlers[ISA_OPCODES] =
+{
+    LC3_ISA(INSTRUCTION_HANDLER)
+};
+
+
+// Threaded engine handlers, in opcode order.
+static const DecodedHandler decodedHandlers[ISA_OPCODES] =
+{
+    LC3_ISA(DECODED_HANDLER)
+};
+
+#undef INSTRUCTION_HANDLER
+#undef DECODED_HANDLER
+#undef HANDLER_NAME
+#undef HANDLER_NAME_ALU
+#undef HANDLER_NAME_TRAP
+#undef HANDLER_NAME_RESERVED
+
+
+VirtualMachine::VirtualMachine(CPU* cpu, OS* os, Trap* trap, MemoryIO* memoryIO, ArithmeticLogicUnit* alu, DecodeCache* decodeCache, Console* console)
 {
     cpuPtr = cpu;
     osPtr = os;
     trapPtr = trap;
     memoryIOPtr = memoryIO;
     aluPtr = alu;
+    decodeCachePtr = decodeCache;
+    consolePtr = console;
 }
 
 
@@ -32,20 +132,243 @@ void VirtualMachine::RunVirtualMachine(int argc, const char* argv[])
     if (argc < 2)
     {
         // Display usage information and exit if no image files are provided
-        printf("lc3 [image-file1] ...\n");
+        printf(USAGE);
         exit(2);
     }
 
-    // Iterate over command-line arguments (excluding the program name)
+    // Parse the options first, so they apply to every image regardless of their position
     for (int j = 1; j < argc; ++j)
     {
+        // Arguments starting with "--" are options rather than image files
+        if (strncmp(argv[j], "--", 2) == 0 && !options.Parse(argv[j]))
+        {
+            printf("unknown option: %s\n", argv[j]);
+            exit(2);
+        }
+    }
+
+    // The top view only reads the stats of other VMs
+    if (options.top >= 0)
+    {
+        exit(LiveStats::Top(options.top));
+    }
+
+    // The ISA check overwrites registers and memory, so it runs instead of a guest
+    if (options.isaCheck)
+    {
+        IsaCheck check(cpuPtr, aluPtr);
+        exit(check.Run());
+    }
+
+    // Listings only read their files, so they run instead of a guest
+    if (options.disassemble || options.disassembleTrace)
+    {
+        exit(Disassemble(argc, argv));
+    }
+
+    // Packing only reads the image files
+    if (options.packPath)
+    {
+        exit(ImageBundle::Pack(options.packPath, argc, argv));
+    }
+
+    // Tasks keep registers of their own, which migration, memory files and checkpoints do not carry
+    if (options.taskQuantum && (options.migrateListen || options.migrateFrom || options.memoryFile || options.checkpointPath))
+    {
+        fprintf(stderr, "tasks: --tasks cannot be combined with --migrate-listen, --migrate-from, --memory-file or --checkpoint\n");
+        exit(2);
+    }
+
+    // A different memory replaces the CPU's before anything is loaded into it
+    if (options.memoryWords || options.memoryMode != MemoryModes::MEMORY_WRAP)
+    {
+        cpuPtr->ConfigureMemory(options.memoryWords ? options.memoryWords : MEMORY_MAX, options.memoryMode);
+        memoryIOPtr->AttachMemory(cpuPtr);
+        decodeCachePtr->AttachMemory(cpuPtr);
+    }
+
+    // The memory is mapped from a file, which may hold a guest to resume; the host and the
+    // benchmark run guests of their own
+    if (options.memoryFile && !options.hostGuests && !options.benchDensity)
+    {
+        persistentPtr = new PersistentMemory(cpuPtr, memoryIOPtr);
+        if (!persistentPtr->Open(options.memoryFile, cpuPtr->memoryWords, options.memoryMode))
+        {
+            exit(1);
+        }
+        memoryIOPtr->AttachMemory(cpuPtr);
+        decodeCachePtr->AttachMemory(cpuPtr);
+    }
+
+    // The guest is recovered from the last checkpoint a crashed run left in the log
+    if (options.checkpointPath && !options.hostGuests && !options.benchDensity)
+    {
+        checkpointPtr = new CheckpointLog(cpuPtr, memoryIOPtr);
+        if (!checkpointPtr->Open(options.checkpointPath, options.memoryMode))
+        {
+            exit(1);
+        }
+    }
+
+    ShadowMemory* shadow = nullptr;
+
+    // The shadow memory must see the images being loaded
+    if (options.shadow)
+    {
+        shadow = new ShadowMemory(cpuPtr);
+        cpuPtr->shadowPtr = shadow;
+
+        // Memory kept from an earlier run was initialized by it
+        if ((persistentPtr && persistentPtr->Existed()) || (checkpointPtr && checkpointPtr->IsRecovering()))
+        {
+            shadow->MarkInitialized(0, MEMORY_MAX);
+        }
+    }
+
+    // Breakpoints and watchpoints switch execution to the debug dispatch loop
+    if (!options.breakpoints.empty() || !options.watchpoints.empty() || options.gdbPort)
+    {
+        debuggerPtr = new Debugger(cpuPtr);
+
+        for (size_t i = 0; i < options.breakpoints.size(); ++i)
+        {
+            if (!debuggerPtr->AddBreakpoint(options.breakpoints[i]))
+            {
+                printf("invalid breakpoint: %s\n", options.breakpoints[i]);
+                exit(2);
+            }
+        }
+
+        for (size_t i = 0; i < options.watchpoints.size(); ++i)
+        {
+            if (!debuggerPtr->AddWatchpoint(options.watchpoints[i]))
+            {
+                printf("invalid watchpoint: %s\n", options.watchpoints[i]);
+                exit(2);
+            }
+        }
+    }
+
+    // A migrated guest arrives with its memory and registers instead of being loaded from images
+    if (options.migrateFrom)
+    {
+        migrationPtr = new LiveMigration(cpuPtr, osPtr, consolePtr, memoryIOPtr);
+        if (!migrationPtr->Receive(options.migrateFrom))
+        {
+            exit(1);
+        }
+
+        // A guest that slept or waited for a key on the source keeps doing so here
+        ULONGLONG until = 0;
+        idleKind = migrationPtr->TakeIdle(&until);
+        idleUntil = until;
+    }
+
+    ImageBundle* bundle = nullptr;
+
+    // Image arguments name images of the bundle, which is mapped once and copied from
+    if (options.bundlePath)
+    {
+        bundle = new ImageBundle();
+        if (!bundle->Open(options.bundlePath))
+        {
+            printf("failed to open bundle: %s\n", options.bundlePath);
+            exit(1);
+        }
+    }
+
+    ImagePager* pager = nullptr;
+
+    // Images are only mapped, and each page is copied on its first access; a bundle is mapped already
+    if (options.lazyLoad && !bundle)
+    {
+        pager = new ImagePager(cpuPtr);
+    }
+
+    // Each image runs as a task, which the images are loaded for
+    if (options.taskQuantum && !options.hostGuests && !options.benchDensity)
+    {
+        tasksPtr = new TaskScheduler(cpuPtr, consolePtr, options.taskQuantum);
+    }
+
+    int imageCount = 0;
+
+    // A migrated, resumed or recovered guest has its images in memory already
+    int loadImages = !migrationPtr && !(persistentPtr && persistentPtr->IsResuming()) &&
+        !(checkpointPtr && checkpointPtr->IsRecovering());
+
+    // Iterate over command-line arguments (excluding the program name)
+    for (int j = 1; j < argc && loadImages; ++j)
+    {
+        if (strncmp(argv[j], "--", 2) == 0)
+        {
+            continue;
+        }
+
         // Attempt to read the image file specified by the current command-line argument
-        if (!cpuPtr->ReadImage(argv[j], aluPtr))
+        int loaded = bundle ? bundle->Load(cpuPtr, argv[j]) : pager ? pager->Map(argv[j]) : cpuPtr->ReadImage(argv[j], aluPtr);
+        if (!loaded)
         {
             // Print error message if image file cannot be loaded and exit with error code 1
             printf("failed to load image: %s\n", argv[j]);
             exit(1);
         }
+        ++imageCount;
+
+        // Each image runs as a task starting at its origin
+        if (tasksPtr)
+        {
+            uint16_t origin = PC::PC_START;
+            if (bundle)
+            {
+                origin = bundle->Find(argv[j])->origin;
+            }
+            else if (!TaskScheduler::ReadOrigin(argv[j], &origin))
+            {
+                printf("failed to load image: %s\n", argv[j]);
+                exit(1);
+            }
+            if (!tasksPtr->AddTask(argv[j], origin))
+            {
+                fprintf(stderr, "tasks: at most %d images run as tasks\n", TASK_MAX);
+                exit(2);
+            }
+        }
+    }
+
+    if (imageCount == 0 && loadImages)
+    {
+        printf(USAGE);
+        exit(2);
+    }
+
+    // Memory accesses and the decode cache have to know which pages are still absent
+    if (pager)
+    {
+        memoryIOPtr->AttachMemory(cpuPtr);
+        decodeCachePtr->AttachMemory(cpuPtr);
+    }
+
+    if (tasksPtr)
+    {
+        tasksPtr->Start();
+        trapPtr->AttachTasks(tasksPtr);
+        memoryIOPtr->AttachTasks(tasksPtr);
+    }
+
+    // The benchmark loads the images into guests of its own
+    if (options.benchDensity)
+    {
+        DensityBenchmark benchmark(osPtr, consolePtr);
+        exit(benchmark.Run(argc, argv, options.memoryMode));
+    }
+
+    // The host loads the images into guests of its own, one per instance, and exports their metrics itself
+    if (options.hostGuests)
+    {
+        NumaHost host(osPtr, options);
+        host.AttachBundle(bundle);
+        exit(host.Run(argc, argv));
     }
 
     // Set up a signal handler for interrupt signal (Ctrl+C)
@@ -54,11 +377,815 @@ void VirtualMachine::RunVirtualMachine(int argc, const char* argv[])
     // Disable input buffering to allow direct console input
     osPtr->DisableInputBuffering();
 
+    if (options.screen)
+    {
+        consolePtr->EnableScreen(options.screenColumns, options.screenRows);
+    }
+
+    if (options.outputRing)
+    {
+        consolePtr->EnableWriterThread(options.outputRing);
+    }
+
+    if (shadow)
+    {
+        memoryIOPtr->AttachShadow(shadow);
+    }
+
+    if (debuggerPtr)
+    {
+        memoryIOPtr->AttachDebugger(debuggerPtr);
+    }
+
+    // Name the VM after its first image
+    const char* image = "";
+    for (int j = 1; j < argc; ++j)
+    {
+        if (strncmp(argv[j], "--", 2) != 0)
+        {
+            image = argv[j];
+            break;
+        }
+    }
+
+    if (options.stats)
+    {
+        statsPtr = new LiveStats();
+        if (statsPtr->Open(image))
+        {
+            trapPtr->AttachStats(statsPtr);
+            memoryIOPtr->AttachStats(statsPtr);
+        }
+    }
+
+    if (options.metricsSocket || options.metricsPort)
+    {
+        exporterPtr = new MetricsExporter();
+        metricsPtr = new MetricsShard(image);
+        exporterPtr->AddShard(metricsPtr);
+
+        if ((options.metricsSocket && !exporterPtr->ListenUnix(options.metricsSocket)) ||
+            (options.metricsPort && !exporterPtr->ListenHttp(options.metricsPort)))
+        {
+            exit(1);
+        }
+
+        trapPtr->AttachMetrics(metricsPtr);
+        memoryIOPtr->AttachMetrics(metricsPtr);
+        exporterPtr->Start();
+    }
+
+    InputLatencyProbe* inputProbe = nullptr;
+
+    if (options.realTime)
+    {
+        EnterRealTime();
+
+        // Measure from key arrival to KBSR being set
+        inputProbe = new InputLatencyProbe(osPtr->GetInputHandle());
+        inputProbe->Start();
+        memoryIOPtr->AttachInputProbe(inputProbe);
+    }
+
+    if (options.instrument != Instrumentations::INSTRUMENT_NONE)
+    {
+        instrumentedPtr = CreateLoop(options.instrument, options.traceFile);
+        if (!instrumentedPtr)
+        {
+            printf("failed to create trace file: %s\n", options.traceFile);
+            exit(1);
+        }
+    }
+
+    uint16_t engine = options.engine;
+
+    // Let the tuner calibrate the engines on the loaded image, or reuse its earlier decision
+    if (engine == Engines::ENGINE_AUTO && !debuggerPtr && !instrumentedPtr)
+    {
+        EngineTuner tuner(this, cpuPtr);
+        engine = tuner.SelectEngine(options.engineCachePath);
+    }
+
+    // The guest only runs when the debugger resumes it; once it detaches, execution continues below
+    if (options.gdbPort)
+    {
+        GdbStub stub(this, cpuPtr, memoryIOPtr, debuggerPtr);
+        if (!stub.Listen(options.gdbPort))
+        {
+            exit(1);
+        }
+        stub.Serve(engine);
+    }
+
+    TrapProfiler* profiler = nullptr;
+
+    // Profile only the guest's own run, after calibration and debugging sessions
+    if (options.trapProfile)
+    {
+        profiler = new TrapProfiler();
+        trapPtr->AttachProfiler(profiler);
+        memoryIOPtr->AttachProfiler(profiler);
+        profiler->Start();
+    }
+
+    // A received guest runs from here on; a running one can be taken over by another target
+    if (migrationPtr)
+    {
+        migrationPtr->Resume();
+    }
+
+    if (options.migrateListen)
+    {
+        if (!migrationPtr)
+        {
+            migrationPtr = new LiveMigration(cpuPtr, osPtr, consolePtr, memoryIOPtr);
+        }
+        if (!migrationPtr->Listen(options.migrateListen))
+        {
+            exit(1);
+        }
+        trapPtr->AttachMigration(migrationPtr);
+        memoryIOPtr->AttachMigration(migrationPtr);
+    }
+
+    if (checkpointPtr)
+    {
+        checkpointPtr->Start();
+        memoryIOPtr->AttachCheckpoints(checkpointPtr);
+    }
+
+    if (options.benchPolicies)
+    {
+        BenchmarkPolicies();
+    }
+    else if (options.clockRate)
+    {
+        RunPaced(engine);
+    }
+    else
+    {
+        // Run until the guest halts, reporting every debugger stop on the way.
+        // With live stats or metrics, run in slices and publish between them.
+        // While a target may connect, the socket is looked at between slices as well, and so is
+        // the clock while memory is backed by a file or checkpointed, and the screen model.
+        uint64_t budget = (statsPtr || metricsPtr) ? STATS_SLICE : UINT64_MAX;
+        if (options.screen && budget > SCREEN_SLICE)
+        {
+            budget = SCREEN_SLICE;
+        }
+        if (migrationPtr && budget > MIGRATE_SLICE)
+        {
+            budget = MIGRATE_SLICE;
+        }
+        if (persistentPtr && budget > PERSIST_SLICE)
+        {
+            budget = PERSIST_SLICE;
+        }
+        if (checkpointPtr && budget > CHECKPOINT_SLICE)
+        {
+            budget = CHECKPOINT_SLICE;
+        }
+
+        while (cpuPtr->running)
+        {
+            uint64_t retired = WaitUntilReady() ? Execute(engine, budget) : 0;
+            HandleStop();
+            PublishSlice(retired);
+            consolePtr->Tick();
+
+            if (persistentPtr)
+            {
+                persistentPtr->Tick(retired);
+            }
+
+            if (checkpointPtr)
+            {
+                checkpointPtr->Tick(retired);
+            }
+
+            if (migrationPtr)
+            {
+                migrationPtr->Poll(0, idleKind, idleUntil);
+            }
+        }
+    }
+
+    consolePtr->Close();
+
+    if (instrumentedPtr)
+    {
+        instrumentedPtr->Report();
+        delete instrumentedPtr;
+        instrumentedPtr = nullptr;
+    }
+
+    if (profiler)
+    {
+        trapPtr->AttachProfiler(nullptr);
+        memoryIOPtr->AttachProfiler(nullptr);
+        profiler->Report();
+        delete profiler;
+    }
+
+    if (inputProbe)
+    {
+        memoryIOPtr->AttachInputProbe(nullptr);
+        inputProbe->Stop();
+        inputProbe->Report();
+        delete inputProbe;
+    }
+
+    if (shadow)
+    {
+        memoryIOPtr->AttachShadow(nullptr);
+        cpuPtr->shadowPtr = nullptr;
+        shadow->Report();
+        delete shadow;
+    }
+
+    if (pager)
+    {
+        pager->Report();
+        delete pager;
+        memoryIOPtr->AttachMemory(cpuPtr);
+        decodeCachePtr->AttachMemory(cpuPtr);
+    }
+
+    if (tasksPtr)
+    {
+        trapPtr->AttachTasks(nullptr);
+        memoryIOPtr->AttachTasks(nullptr);
+        tasksPtr->Report();
+        delete tasksPtr;
+        tasksPtr = nullptr;
+    }
+
+    // Logs the halt, so that the next run starts over from the images
+    if (checkpointPtr)
+    {
+        memoryIOPtr->AttachCheckpoints(nullptr);
+        checkpointPtr->Stop();
+        delete checkpointPtr;
+        checkpointPtr = nullptr;
+    }
+
+    // Saves the registers at the halt
+    if (persistentPtr)
+    {
+        persistentPtr->Close();
+        delete persistentPtr;
+        persistentPtr = nullptr;
+        memoryIOPtr->AttachMemory(cpuPtr);
+        decodeCachePtr->AttachMemory(cpuPtr);
+    }
+
+    if (migrationPtr)
+    {
+        trapPtr->AttachMigration(nullptr);
+        memoryIOPtr->AttachMigration(nullptr);
+        delete migrationPtr;
+        migrationPtr = nullptr;
+    }
+
+    if (debuggerPtr)
+    {
+        memoryIOPtr->AttachDebugger(nullptr);
+        delete debuggerPtr;
+        debuggerPtr = nullptr;
+    }
+
+    if (statsPtr)
+    {
+        trapPtr->AttachStats(nullptr);
+        memoryIOPtr->AttachStats(nullptr);
+        delete statsPtr;
+        statsPtr = nullptr;
+    }
+
+    if (exporterPtr)
+    {
+        // Scrapes keep seeing the halted VM until the exporter stops
+        metricsPtr->SetState(VmStates::VM_STATE_HALTED);
+        trapPtr->AttachMetrics(nullptr);
+        memoryIOPtr->AttachMetrics(nullptr);
+        exporterPtr->Stop();
+        delete exporterPtr;
+        delete metricsPtr;
+        exporterPtr = nullptr;
+        metricsPtr = nullptr;
+    }
+
+    osPtr->RestoreInputBuffering();
+}
+
+
+/**
+ * @brief Runs the guest at the configured clock rate until it halts.
+ *
+ * Fixed-size batches are executed at full speed, each followed by a sleep until its deadline.
+ *
+ * @param engine The engine to use, as a value of the Engines enumeration.
+ */
+void VirtualMachine::RunPaced(uint16_t engine)
+{
+    Pacer pacer(options.clockRate);
+    pacer.Start();
+
     while (cpuPtr->running)
     {
+        uint64_t retired = WaitUntilReady() ? Execute(engine, pacer.BatchSize()) : 0;
+        pacer.Pace(retired);
+        HandleStop();
+        PublishSlice(retired);
+        consolePtr->Tick();
+
+        if (persistentPtr)
+        {
+            persistentPtr->Tick(retired);
+        }
+
+        if (checkpointPtr)
+        {
+            checkpointPtr->Tick(retired);
+        }
+
+        if (migrationPtr)
+        {
+            migrationPtr->Poll(0, idleKind, idleUntil);
+        }
+    }
+
+    pacer.Report();
+}
+
+
+/**
+ * @brief Gives up the host CPU while the guest sleeps or waits for a key, for at most IDLE_WAIT_MS.
+ *
+ * After YIELD the host thread only gives up its processor once. Time spent sleeping or waiting
+ * counts as idle in the live stats.
+ *
+ * @return Returns 1 if the guest can run, 0 if it still sleeps or waits.
+ */
+int VirtualMachine::WaitUntilReady()
+{
+    if (idleKind == IdleKinds::IDLE_NONE)
+    {
+        return 1;
+    }
+
+    if (idleKind == IdleKinds::IDLE_YIELD)
+    {
+        SwitchToThread();
+        return IsReady();
+    }
 
+    if (statsPtr)
+    {
+        statsPtr->BeginIdle();
+    }
+    if (metricsPtr)
+    {
+        metricsPtr->SetState(VmStates::VM_STATE_INPUT);
+    }
+
+    if (idleKind == IdleKinds::IDLE_SLEEP)
+    {
+        ULONGLONG now = GetTickCount64();
+        if (idleUntil > now)
+        {
+            Sleep((DWORD)(idleUntil - now < IDLE_WAIT_MS ? idleUntil - now : IDLE_WAIT_MS));
+        }
+    }
+    else
+    {
+        // Removes the records that are not keys first, or the signaled handle would not wait
+        consolePtr->WaitForKey(IDLE_WAIT_MS);
+    }
+
+    if (statsPtr)
+    {
+        statsPtr->EndIdle();
+    }
+    if (metricsPtr)
+    {
+        metricsPtr->SetState(VmStates::VM_STATE_RUNNING);
+    }
+
+    return IsReady();
+}
+
+
+/**
+ * @brief Publishes the progress of a slice of execution to the live stats and the metrics shard.
+ *
+ * @param retired The number of instructions executed by the slice.
+ */
+void VirtualMachine::PublishSlice(uint64_t retired)
+{
+    if (statsPtr)
+    {
+        statsPtr->Publish(retired, cpuPtr->registers[Registers::R_PC], consolePtr->GetGuestBytes());
+    }
+
+    if (metricsPtr)
+    {
+        metricsPtr->CountInstructions(retired);
+    }
+}
+
+
+/**
+ * @brief Creates the instrumented loop selected at startup.
+ *
+ * Each variant is a separate instantiation of BasicVirtualMachine, so the loops without a given
+ * hook carry no code for it.
+ *
+ * @param instrument The instrumentation, as a value of the Instrumentations enumeration.
+ * @param traceFile File receiving a binary trace instead of the text trace on stderr, or nullptr.
+ * @return The loop, owned by the caller, or nullptr for INSTRUMENT_NONE or if the trace file
+ *         cannot be created.
+ */
+ExecutionLoop* VirtualMachine::CreateLoop(uint16_t instrument, const char* traceFile)
+{
+    switch (instrument)
+    {
+    case Instrumentations::INSTRUMENT_TRACE:
+        if (traceFile)
+        {
+            BasicVirtualMachine<BinaryTracePolicy>* loop = new BasicVirtualMachine<BinaryTracePolicy>(cpuPtr, memoryIOPtr, aluPtr, trapPtr);
+            if (!loop->Open(traceFile))
+            {
+                delete loop;
+                return nullptr;
+            }
+            return loop;
+        }
+        return new BasicVirtualMachine<TracePolicy>(cpuPtr, memoryIOPtr, aluPtr, trapPtr);
+    case Instrumentations::INSTRUMENT_COVERAGE:
+        return new BasicVirtualMachine<CoveragePolicy>(cpuPtr, memoryIOPtr, aluPtr, trapPtr);
+    case Instrumentations::INSTRUMENT_MIX:
+        return new BasicVirtualMachine<MixPolicy>(cpuPtr, memoryIOPtr, aluPtr, trapPtr);
+    case Instrumentations::INSTRUMENT_ALL:
+        return new BasicVirtualMachine<CoveragePolicy, MixPolicy>(cpuPtr, memoryIOPtr, aluPtr, trapPtr);
+    default:
+        return nullptr;
+    }
+}
+
+
+/**
+ * @brief Compares the policy-based loops against the hand-written switch loop on the loaded image.
+ *
+ * The loops take turns executing windows of POLICY_BENCH_WINDOW instructions, continuing the
+ * same guest, and the best window of each is reported. The loop without policies should match
+ * the hand-written one; the others show what their hooks cost. Their instructions are counted for
+ * MR_ICOUNT0 as in Execute.
+ */
+void VirtualMachine::BenchmarkPolicies()
+{
+    static const char* const names[] = { "hand-written", "none", "coverage", "mix", "all" };
+    const int loopCount = sizeof(names) / sizeof(names[0]);
+
+    ExecutionLoop* loops[loopCount] =
+    {
+        nullptr,
+        new BasicVirtualMachine<>(cpuPtr, memoryIOPtr, aluPtr, trapPtr),
+        CreateLoop(Instrumentations::INSTRUMENT_COVERAGE),
+        CreateLoop(Instrumentations::INSTRUMENT_MIX),
+        CreateLoop(Instrumentations::INSTRUMENT_ALL)
+    };
+    double rates[loopCount] = {};
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    int rounds = 0;
+    for (; rounds < POLICY_BENCH_ROUNDS && cpuPtr->running; ++rounds)
+    {
+        for (int i = 0; i < loopCount && cpuPtr->running; ++i)
+        {
+            memoryIOPtr->BeginSlice();
+            QueryPerformanceCounter(&start);
+            uint64_t retired = loops[i] ? loops[i]->Run(POLICY_BENCH_WINDOW) : RunHandWritten(POLICY_BENCH_WINDOW);
+            QueryPerformanceCounter(&end);
+
+            // As in Execute, a load of MR_ICOUNT0 stops the window and runs again once it is counted
+            if (memoryIOPtr->TakeCounterStop())
+            {
+                memoryIOPtr->CountInstructions(--retired);
+                uint64_t again = loops[i] ? loops[i]->Run(1) : RunHandWritten(1);
+                memoryIOPtr->CountInstructions(again);
+                retired += again;
+            }
+            else
+            {
+                memoryIOPtr->CountInstructions(retired);
+            }
+
+            double seconds = (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+            if (seconds > 0 && retired == POLICY_BENCH_WINDOW && (double)retired / seconds / 1e6 > rates[i])
+            {
+                rates[i] = (double)retired / seconds / 1e6;
+            }
+        }
+    }
+
+    consolePtr->Flush();
+    fprintf(stderr, "bench: %d rounds of %d instructions per loop%s\n", rounds, POLICY_BENCH_WINDOW,
+        cpuPtr->running ? "" : ", cut short by the guest halting");
+
+    for (int i = 0; i < loopCount; ++i)
+    {
+        fprintf(stderr, "bench: %-12s %9.2f MIPS %7.1f%%\n", names[i], rates[i], rates[0] > 0 ? rates[i] * 100.0 / rates[0] : 0);
+        delete loops[i];
+    }
+}
+
+
+/**
+ * @brief Lists the image files given on the command line, or the trace of --disasm-trace, as assembly on stdout.
+ *
+ * @return The exit code: 0 on success, 1 if a file cannot be read or the listing cannot be written.
+ */
+int VirtualMachine::Disassemble(int argc, const char* argv[])
+{
+    SymbolTable symbols;
+
+    if (options.symbolsPath && !symbols.Load(options.symbolsPath))
+    {
+        fprintf(stderr, "failed to load symbols: %s\n", options.symbolsPath);
+        return 1;
+    }
+
+    Disassembler disassembler(stdout, options.symbolsPath ? &symbols : nullptr);
+
+    for (int j = 1; j < argc && options.disassemble; ++j)
+    {
+        if (strncmp(argv[j], "--", 2) == 0)
+        {
+            continue;
+        }
+
+        if (!disassembler.ListImage(argv[j]))
+        {
+            disassembler.Finish();
+            fprintf(stderr, "failed to load image: %s\n", argv[j]);
+            return 1;
+        }
+    }
+
+    if (options.disassembleTrace && !disassembler.ListTrace(options.disassembleTrace))
+    {
+        disassembler.Finish();
+        fprintf(stderr, "failed to read trace: %s\n", options.disassembleTrace);
+        return 1;
+    }
+
+    if (!disassembler.Finish())
+    {
+        fprintf(stderr, "failed to write the listing\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Reports why the debug dispatch loop returned, if it stopped on a breakpoint or watchpoint.
+ *
+ * Execution then resumes; the stop is only cleared by the next call to the debug dispatch loop.
+ */
+void VirtualMachine::HandleStop()
+{
+    if (debuggerPtr && debuggerPtr->stopReason != StopReasons::STOP_NONE)
+    {
+        // Make the guest output preceding the stop visible first
+        consolePtr->Flush();
+        debuggerPtr->ReportStop();
+    }
+}
+
+
+/**
+ * @brief Prepares the host for low-jitter interactive execution.
+ *
+ * Pins the VM thread, raises its priority, and prefaults and locks guest memory and the
+ * decode cache so that no page fault lands on the input path. Each step that the host
+ * does not permit is reported and skipped.
+ */
+void VirtualMachine::EnterRealTime()
+{
+    RealTime realTime;
+
+    realTime.PinCurrentThread(options.realTimeCpu);
+    realTime.RaisePriority(options.realTimeClass);
+
+    // No image page may come in from disk once the guest runs
+    if (cpuPtr->pagerPtr)
+    {
+        cpuPtr->pagerPtr->LoadAll();
+    }
+
+    // Registers live in the CPU object, guest memory next to it
+    realTime.Prefault(cpuPtr, sizeof(CPU));
+    realTime.Lock(cpuPtr, sizeof(CPU));
+    realTime.Prefault(cpuPtr->memory, cpuPtr->memoryWords * sizeof(uint16_t));
+    realTime.Lock(cpuPtr->memory, cpuPtr->memoryWords * sizeof(uint16_t));
+
+    // Decode cache tables, used by the caching engines
+    realTime.Prefault(decodeCachePtr->entries, MEMORY_MAX * sizeof(DecodedInstruction));
+    realTime.Prefault(decodeCachePtr->handlers, MEMORY_MAX * sizeof(DecodedHandler));
+    realTime.Prefault(decodeCachePtr->valid, MEMORY_MAX);
+    realTime.Lock(decodeCachePtr->entries, MEMORY_MAX * sizeof(DecodedInstruction));
+    realTime.Lock(decodeCachePtr->handlers, MEMORY_MAX * sizeof(DecodedHandler));
+    realTime.Lock(decodeCachePtr->valid, MEMORY_MAX);
+}
+
+
+/**
+ * @brief Executes guest instructions with the given engine.
+ *
+ * All engines produce the same guest-visible behavior and may be switched between calls.
+ * While any breakpoint or watchpoint is set, the debug dispatch loop runs instead of the engine,
+ * and an instrumented loop selected with --instrument= runs instead of it otherwise.
+ * The decode cache is attached to MemoryIO only while a caching engine runs, so the
+ * switch and table engines do not pay for cache invalidation on memory writes. Attaching it
+ * predecodes all of memory, so the images loaded by then never take the lazy decode path.
+ *
+ * Under --tasks, the running task gives the CPU to the next one after the slice if it halted,
+ * yielded, sleeps, waits for input or used up its quantum, so the guest only halts with the last task.
+ * Otherwise a slice ending in YIELD, SLEEP or WAIT leaves the guest idle until IsReady. The
+ * instructions of every slice are counted for MR_ICOUNT0.
+ *
+ * @param engine The engine to use, as a value of the Engines enumeration.
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed before the budget ran out or the guest halted.
+ */
+uint64_t VirtualMachine::Execute(uint16_t engine, uint64_t budget)
+{
+    // A slice never runs past the end of the running task's quantum
+    if (tasksPtr)
+    {
+        budget = tasksPtr->Clamp(budget);
+    }
+
+    memoryIOPtr->BeginSlice();
+    uint64_t retired = Dispatch(engine, budget);
+
+    // A load of MR_ICOUNT0 ends the slice, since only the engine knew how far it got; the load
+    // did not retire, and runs again by itself once the instructions before it are counted
+    if (memoryIOPtr->TakeCounterStop())
+    {
+        memoryIOPtr->CountInstructions(--retired);
+        if (debuggerPtr && debuggerPtr->IsActive())
+        {
+            // A breakpoint on the load stopped before it already, if at all
+            debuggerPtr->stepOver = 1;
+        }
+        uint64_t again = Dispatch(engine, 1);
+        memoryIOPtr->CountInstructions(again);
+        retired += again;
+    }
+    else
+    {
+        memoryIOPtr->CountInstructions(retired);
+    }
+
+    // A slice that ended in YIELD, SLEEP or WAIT does not run again before IsReady
+    ULONGLONG until = 0;
+    idleKind = trapPtr->TakeIdle(&until);
+    idleUntil = until;
+
+    if (tasksPtr)
+    {
+        tasksPtr->Tick(retired);
+    }
+
+    return retired;
+}
+
+
+/**
+ * @brief Tells whether the guest can run, or still sleeps or waits for a key after its last slice.
+ *
+ * A host worker runs other guests meanwhile. After YIELD the guest is ready at once, since the
+ * slice has ended.
+ *
+ * @return Returns 1 if the guest can run, 0 otherwise.
+ */
+int VirtualMachine::IsReady()
+{
+    int ready = idleKind == IdleKinds::IDLE_SLEEP ? GetTickCount64() >= idleUntil :
+        idleKind == IdleKinds::IDLE_INPUT ? consolePtr->KeyPending() : 1;
+
+    if (ready)
+    {
+        idleKind = IdleKinds::IDLE_NONE;
+    }
+    return ready;
+}
+
+
+/**
+ * @brief Takes over the sleep or wait of the guest of another VM, whose state this one took over.
+ *
+ * @param from The VM the guest comes from.
+ */
+void VirtualMachine::CopyIdle(const VirtualMachine& from)
+{
+    idleKind = from.idleKind;
+    idleUntil = from.idleUntil;
+}
+
+
+/**
+ * @brief Runs one slice with the engine, the debug dispatch loop or the instrumented loop.
+ *
+ * @param engine The engine to use, as a value of the Engines enumeration.
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed before the budget ran out or the guest stopped.
+ */
+uint64_t VirtualMachine::Dispatch(uint16_t engine, uint64_t budget)
+{
+    int usesDecodeCache = (engine == Engines::ENGINE_PREDECODED || engine == Engines::ENGINE_THREADED);
+
+    if (usesDecodeCache && !memoryIOPtr->GetDecodeCache())
+    {
+        // Writes were not tracked while detached, so decode the whole memory again. The shadow
+        // memory has to see every first fetch, so with it the cache fills as code runs instead.
+        if (cpuPtr->shadowPtr)
+        {
+            decodeCachePtr->Clear();
+        }
+        else
+        {
+            decodeCachePtr->Predecode(cpuPtr->memory, decodedHandlers);
+        }
+        memoryIOPtr->AttachDecodeCache(decodeCachePtr);
+    }
+    else if (!usesDecodeCache)
+    {
+        memoryIOPtr->AttachDecodeCache(nullptr);
+    }
+
+    if (debuggerPtr && debuggerPtr->IsActive())
+    {
+        return RunDebug(budget);
+    }
+
+    if (instrumentedPtr)
+    {
+        return instrumentedPtr->Run(budget);
+    }
+
+    switch (engine)
+    {
+    case Engines::ENGINE_TABLE:
+        return RunTable(budget);
+    case Engines::ENGINE_PREDECODED:
+        return RunPredecoded(budget);
+    case Engines::ENGINE_THREADED:
+        return RunThreaded(budget);
+    case Engines::ENGINE_SWITCH:
+    default:
+        return RunSwitch(budget);
+    }
+}
+
+
+/**
+ * @brief Executes instructions by switching on the opcode of every fetched instruction.
+ *
+ * Runs the policy-based loop instantiated without policies, whose hooks compile away.
+ *
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed.
+ */
+uint64_t VirtualMachine::RunSwitch(uint64_t budget)
+{
+    BasicVirtualMachine<> loop(cpuPtr, memoryIOPtr, aluPtr, trapPtr);
+    return loop.Run(budget);
+}
+
+
+/**
+ * @brief Executes instructions by switching on the opcode of every fetched instruction, without hooks.
+ *
+ * The loop the switch engine used before it became a BasicVirtualMachine instantiation, kept as
+ * the baseline of --bench-policies.
+ *
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed.
+ */
+uint64_t VirtualMachine::RunHandWritten(uint64_t budget)
+{
+    uint64_t retired = 0;
+
+    while (cpuPtr->running && retired < budget)
+    {
         // Fetch Instruction. Read the memory location pointed by program counter.
-        uint16_t instruction = memoryIOPtr->Read(cpuPtr->registers[Registers::R_PC]++);
+        uint16_t instruction = memoryIOPtr->Fetch(cpuPtr->registers[Registers::R_PC]++);
 
         // Extract the opcode from the instruction by considering bits [15:12]
         uint16_t operation = (instruction >> 12);
@@ -113,7 +1240,158 @@ void VirtualMachine::RunVirtualMachine(int argc, const char* argv[])
             abort();
             break;
         }
+
+        ++retired;
     }
 
-    osPtr->RestoreInputBuffering();
+    return retired;
+}
+
+
+/**
+ * @brief Executes instructions through a handler table indexed by the opcode.
+ *
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed.
+ */
+uint64_t VirtualMachine::RunTable(uint64_t budget)
+{
+    uint64_t retired = 0;
+
+    while (cpuPtr->running && retired < budget)
+    {
+        // Fetch Instruction. Read the memory location pointed by program counter.
+        uint16_t instruction = memoryIOPtr->Fetch(cpuPtr->registers[Registers::R_PC]++);
+
+        // Dispatch on bits [15:12] without a compare chain
+        instructionHandlers[instruction >> 12](aluPtr, trapPtr, instruction);
+
+        ++retired;
+    }
+
+    return retired;
+}
+
+
+/**
+ * @brief Executes instructions decoded once per address, switching on the cached opcode.
+ *
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed.
+ */
+uint64_t VirtualMachine::RunPredecoded(uint64_t budget)
+{
+    uint64_t retired = 0;
+
+    while (cpuPtr->running && retired < budget)
+    {
+        uint16_t pc = cpuPtr->registers[Registers::R_PC]++;
+
+        // Decode the instruction again after its address was written, or on its first execution under --shadow
+        if (!decodeCachePtr->valid[pc])
+        {
+            uint16_t instruction = memoryIOPtr->Fetch(pc);
+            decodeCachePtr->Fill(pc, instruction, decodedHandlers[instruction >> 12]);
+        }
+
+        const DecodedInstruction& decoded = decodeCachePtr->entries[pc];
+
+        switch (decoded.operation)
+        {
+#define ISA_EXECUTE(NAME) aluPtr->NAME(decoded)
+        LC3_ISA(ISA_ALU_CASE)
+#undef ISA_EXECUTE
+        case OP_TRAP:
+            trapPtr->Proxy(decoded.instruction);
+            break;
+        default:
+            abort();
+            break;
+        }
+
+        ++retired;
+    }
+
+    return retired;
+}
+
+
+/**
+ * @brief Executes instructions through a handler and operands cached per address.
+ *
+ * Once an address has been decoded, executing it costs a single indirect call with no
+ * opcode extraction or dispatch. MSVC has no computed goto, so the handlers are called
+ * rather than jumped to.
+ *
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed.
+ */
+uint64_t VirtualMachine::RunThreaded(uint64_t budget)
+{
+    uint64_t retired = 0;
+
+    while (cpuPtr->running && retired < budget)
+    {
+        uint16_t pc = cpuPtr->registers[Registers::R_PC]++;
+
+        // Decode the instruction again after its address was written, or on its first execution under --shadow
+        if (!decodeCachePtr->valid[pc])
+        {
+            uint16_t instruction = memoryIOPtr->Fetch(pc);
+            decodeCachePtr->Fill(pc, instruction, decodedHandlers[instruction >> 12]);
+        }
+
+        decodeCachePtr->handlers[pc](aluPtr, trapPtr, decodeCachePtr->entries[pc]);
+
+        ++retired;
+    }
+
+    return retired;
+}
+
+
+/**
+ * @brief Executes instructions through the handler table, checking breakpoints and watchpoints.
+ *
+ * Only this loop tests the breakpoint map, so the other engines pay nothing for debugging. It
+ * returns before an instruction whose breakpoint matches, or after an instruction that touched
+ * a watched word, leaving the reason in the debugger. A breakpoint that stopped the previous call,
+ * or any breakpoint when the debugger asks to step over, does not stop the instruction resumed at.
+ *
+ * @param budget The maximum number of instructions to execute.
+ * @return The number of instructions executed.
+ */
+uint64_t VirtualMachine::RunDebug(uint64_t budget)
+{
+    uint64_t retired = 0;
+    uint64_t* breakpointMap = debuggerPtr->breakpointMap;
+
+    int resuming = (debuggerPtr->stopReason == StopReasons::STOP_BREAKPOINT) || debuggerPtr->stepOver;
+    debuggerPtr->stopReason = StopReasons::STOP_NONE;
+    debuggerPtr->stepOver = 0;
+
+    while (cpuPtr->running && retired < budget)
+    {
+        uint16_t pc = cpuPtr->registers[Registers::R_PC];
+
+        if ((breakpointMap[pc >> 6] & (1ULL << (pc & 63))) && !resuming && debuggerPtr->CheckBreakpoints(pc))
+        {
+            break;
+        }
+        resuming = 0;
+
+        // Fetch Instruction. Read the memory location pointed by program counter.
+        uint16_t instruction = memoryIOPtr->Fetch(cpuPtr->registers[Registers::R_PC]++);
+        instructionHandlers[instruction >> 12](aluPtr, trapPtr, instruction);
+
+        ++retired;
+
+        // A watchpoint was hit by this instruction
+        if (debuggerPtr->stopReason != StopReasons::STOP_NONE)
+        {
+            break;
+        }
+    }
+
+    return retired;
 }
\ No newline at end of file
@@ -14,12 +14,25 @@ Copyright 
 
 #include <cstdint>
 
+#include "Options.h"
+
 
 class CPU;
 class OS;
 class Trap;
 class MemoryIO;
 class ArithmeticLogicUnit;
+class DecodeCache;
+class Console;
+class Debugger;
+class LiveStats;
+class MetricsShard;
+class MetricsExporter;
+class ExecutionLoop;
+class LiveMigration;
+class PersistentMemory;
+class CheckpointLog;
+class TaskScheduler;
 
 
 class VirtualMachine
@@ -30,9 +43,46 @@ private:
 	Trap* trapPtr;
 	MemoryIO* memoryIOPtr;
 	ArithmeticLogicUnit* aluPtr;
+	DecodeCache* decodeCachePtr;
+	Console* consolePtr;
+	Debugger* debuggerPtr = nullptr;
+	LiveStats* statsPtr = nullptr;
+	MetricsShard* metricsPtr = nullptr;
+	MetricsExporter* exporterPtr = nullptr;
+	ExecutionLoop* instrumentedPtr = nullptr;
+	LiveMigration* migrationPtr = nullptr;
+	PersistentMemory* persistentPtr = nullptr;
+	CheckpointLog* checkpointPtr = nullptr;
+	TaskScheduler* tasksPtr = nullptr;
+	Options options;
+
+	// Set when a slice ends in YIELD, SLEEP or WAIT, a value of IdleKinds, until the guest is ready again
+	uint16_t idleKind = 0;
+	uint64_t idleUntil = 0;
 
 public:
-	VirtualMachine(CPU* cpu, OS* os, Trap* trap, MemoryIO* memoryIO, ArithmeticLogicUnit* alu);
+	VirtualMachine(CPU* cpu, OS* os, Trap* trap, MemoryIO* memoryIO, ArithmeticLogicUnit* alu, DecodeCache* decodeCache, Console* console);
 	void RunVirtualMachine(int argc, const char* argv[]);
+	uint64_t Execute(uint16_t engine, uint64_t budget);
+	int IsReady();
+	int WaitUntilReady();
+	void CopyIdle(const VirtualMachine& from);
+
+private:
+	void RunPaced(uint16_t engine);
+	void EnterRealTime();
+	void HandleStop();
+	void PublishSlice(uint64_t retired);
+	ExecutionLoop* CreateLoop(uint16_t instrument, const char* traceFile = nullptr);
+	int Disassemble(int argc, const char* argv[]);
+	void BenchmarkPolicies();
+	uint64_t Dispatch(uint16_t engine, uint64_t budget);
+
+	uint64_t RunSwitch(uint64_t budget);
+	uint64_t RunHandWritten(uint64_t budget);
+	uint64_t RunTable(uint64_t budget);
+	uint64_t RunPredecoded(uint64_t budget);
+	uint64_t RunThreaded(uint64_t budget);
+	uint64_t RunDebug(uint64_t budget);
 };
 #endif
\ No newline at end of file
@@ -15,16 +15,20 @@ Copyright 
 #include "OS.h"
 #include "Trap.h"
 #include "VirtualMachine.h"
+#include "DecodeCache.h"
+#include "Console.h"
 
 int main(int argc, const char* argv[])
 {
     CPU cpu;
     OS os;
-    Trap trap(cpu.memory, cpu.registers, &cpu);
-    MemoryIO memoryIO(cpu.memory, &os);
+    Console console;
+    Trap trap(cpu.registers, &cpu, &console);
+    MemoryIO memoryIO(&cpu, &os, &console);
     ArithmeticLogicUnit alu(cpu.memory, cpu.registers, &memoryIO, &cpu);
+    DecodeCache decodeCache(&alu);
 
-    VirtualMachine virtualMachine(&cpu, &os, &trap, &memoryIO, &alu);
+    VirtualMachine virtualMachine(&cpu, &os, &trap, &memoryIO, &alu, &decodeCache, &console);
     virtualMachine.RunVirtualMachine(argc, argv);
 }
 